@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pc_lib.h>
+#include "pr_gzip.h"
+
+#include "bench_common.h"
+
+static char *g_codecs[] = {
+    PR_CODEC_ZLIB, PR_CODEC_LZ4, NULL
+};
+
+static char *g_sizes[] = {
+    "1024", "65536", "1048576", NULL
+};
+
+static MunitParameterEnum g_corpus_params[] = {
+    { "codec", g_codecs },
+    { NULL, NULL },
+};
+
+static MunitParameterEnum g_payload_params[] = {
+    { "codec", g_codecs },
+    { "size", g_sizes },
+    { NULL, NULL },
+};
+
+static void
+engine_init(pr_gzip_engine_t *engine, const MunitParameter params[])
+{
+    const pr_codec_t *codec = pr_codec_find(munit_parameters_get(params, "codec"));
+    munit_assert_not_null(codec);
+
+    pr_gzip_engine_init(engine, Z_DEFAULT_COMPRESSION);
+    pr_gzip_engine_set_codec(engine, codec);
+}
+
+static void
+report_ratio(const char *name, size_t in, size_t out)
+{
+    munit_logf(MUNIT_LOG_INFO, "%-24s ratio=%5.1f%%", name, 100.0 * (double)out / (double)in);
+}
+
+// Compresses and decompresses every body of the corpus, one message at a time.
+static MunitResult
+test_corpus(const MunitParameter params[], void *fixture)
+{
+    Unused(fixture);
+
+    pr_gzip_engine_t engine;
+    engine_init(&engine, params);
+
+    bench_corpus_t c;
+    bench_corpus_load(&c);
+
+    size_t out_total = 0;
+    uint64_t compress_ns = 0;
+    uint64_t decompress_ns = 0;
+
+    for (size_t i = 0; i < c.count; ++i) {
+        const unsigned char *body = c.data + c.offsets[i];
+        unsigned char *compressed = NULL;
+        size_t compressed_size, out_size;
+        unsigned char *out;
+
+        uint64_t start = uv_hrtime();
+        munit_assert_int(pr_gzip_engine_compress(&engine, NULL, &compressed, &compressed_size, body, c.sizes[i]), ==, 0);
+        uint64_t mid = uv_hrtime();
+        munit_assert_int(pr_gzip_engine_decompress(&engine, NULL, &out, &out_size, compressed, compressed_size), ==, 0);
+        uint64_t end = uv_hrtime();
+
+        munit_assert_size(out_size, ==, c.sizes[i]);
+        munit_assert_memory_equal(out_size, out, body);
+
+        out_total += compressed_size;
+        compress_ns += mid - start;
+        decompress_ns += end - mid;
+        pc_lib_free(compressed);
+    }
+
+    munit_logf(MUNIT_LOG_INFO, "corpus: %s, %zu messages, %zu bytes",
+               getenv(BENCH_CORPUS_ENV) ? getenv(BENCH_CORPUS_ENV) : "generated", c.count, c.total);
+    bench_report("compress", c.total / c.count, (int)c.count, compress_ns);
+    bench_report("decompress", c.total / c.count, (int)c.count, decompress_ns);
+    report_ratio("corpus", c.total, out_total);
+
+    pr_gzip_engine_cleanup(&engine);
+    bench_corpus_free(&c);
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_payload(const MunitParameter params[], void *fixture)
+{
+    Unused(fixture);
+    size_t size = (size_t)strtoul(munit_parameters_get(params, "size"), NULL, 10);
+
+    pr_gzip_engine_t engine;
+    engine_init(&engine, params);
+
+    char *payload = (char*)malloc(size);
+    bench_fill_json(payload, size);
+
+    int iterations = bench_iterations(size);
+    unsigned char *compressed = NULL;
+    size_t compressed_size = 0;
+
+    uint64_t start = uv_hrtime();
+    for (int i = 0; i < iterations; ++i) {
+        pc_lib_free(compressed);
+        munit_assert_int(pr_gzip_engine_compress(&engine, NULL, &compressed, &compressed_size,
+                                                 (unsigned char*)payload, size), ==, 0);
+    }
+    bench_report("compress", size, iterations, uv_hrtime() - start);
+
+    unsigned char *out = NULL;
+    size_t out_size = 0;
+    start = uv_hrtime();
+    for (int i = 0; i < iterations; ++i) {
+        munit_assert_int(pr_gzip_engine_decompress(&engine, NULL, &out, &out_size, compressed, compressed_size), ==, 0);
+    }
+    bench_report("decompress", size, iterations, uv_hrtime() - start);
+    report_ratio("payload", size, compressed_size);
+
+    munit_assert_size(out_size, ==, size);
+    munit_assert_memory_equal(size, out, payload);
+
+    pc_lib_free(compressed);
+    free(payload);
+    pr_gzip_engine_cleanup(&engine);
+    return MUNIT_OK;
+}
+
+static MunitTest tests[] = {
+    {"/corpus", test_corpus, NULL, NULL, MUNIT_TEST_OPTION_NONE, g_corpus_params},
+    {"/payload", test_payload, NULL, NULL, MUNIT_TEST_OPTION_NONE, g_payload_params},
+    {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}
+};
+
+const MunitSuite codec_bench_suite = {
+    "/codec", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
@@ -0,0 +1,151 @@
+/*
+ * File defining common helpers used by the benchmarks.
+ */
+
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#define MUNIT_ENABLE_ASSERT_ALIASES
+#include <munit.h>
+#include <uv.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Macro to sign to the compiler that the parameter is unused, avoiding a warning.
+#define Unused(x) ((void)(x))
+
+#define ArrayCount(arr) (sizeof(arr)/sizeof((arr)[0]))
+
+// Amount of bytes each benchmark tries to process, the number of iterations
+// is derived from it and the size of the payload.
+#define BENCH_TARGET_BYTES (32 * 1024 * 1024)
+#define BENCH_MAX_ITERATIONS 20000
+
+static inline int
+bench_iterations(size_t payload_size)
+{
+    size_t n = BENCH_TARGET_BYTES / (payload_size ? payload_size : 1);
+    if (n > BENCH_MAX_ITERATIONS) {
+        n = BENCH_MAX_ITERATIONS;
+    }
+    return n > 0 ? (int)n : 1;
+}
+
+// Results are logged through munit, which only shows them when the
+// benchmarks are run with `--show-stderr`.
+
+static inline void
+bench_report(const char *name, size_t payload_size, int iterations, uint64_t elapsed_ns)
+{
+    double secs = (double)elapsed_ns / 1e9;
+    double mib = (double)payload_size * iterations / (1024.0 * 1024.0);
+    munit_logf(MUNIT_LOG_INFO, "%-24s size=%-9zu iters=%-7d %9.1f ns/op %9.1f MiB/s",
+               name, payload_size, iterations,
+               (double)elapsed_ns / iterations, secs > 0 ? mib / secs : 0.0);
+}
+
+// Fills `buf` with a JSON-like payload that compresses similarly to real
+// game server responses.
+static inline void
+bench_fill_json(char *buf, size_t size)
+{
+    static const char *fields[] = {
+        "{\"id\":", "\"name\":\"player\",", "\"level\":", "\"items\":[",
+        "\"sword\",", "\"shield\"],", "\"gold\":", "\"guild\":\"knights\"},",
+    };
+    size_t off = 0;
+    unsigned int seed = 42;
+    while (off < size) {
+        const char *f = fields[off % ArrayCount(fields)];
+        size_t i;
+        for (i = 0; f[i] && off < size; ++i) {
+            buf[off++] = f[i];
+        }
+        if (off < size) {
+            seed = seed * 1103515245 + 12345;
+            buf[off++] = (char)('0' + (seed >> 16) % 10);
+        }
+    }
+}
+
+// Recorded message bodies, one per line, can be used instead of the
+// generated ones by setting this environment variable.
+#define BENCH_CORPUS_ENV "PITAYA_BENCH_CORPUS"
+#define BENCH_CORPUS_SAMPLES 2000
+
+// Message bodies the benchmarks compress, stored back to back in `data`.
+typedef struct {
+    unsigned char *data;
+    size_t *sizes;
+    size_t *offsets;
+    size_t count;
+    size_t total;
+} bench_corpus_t;
+
+static inline void
+bench_corpus_add(bench_corpus_t *c, const char *body, size_t len, size_t *cap)
+{
+    if (c->count == *cap) {
+        *cap *= 2;
+        c->sizes = (size_t*)realloc(c->sizes, *cap * sizeof(size_t));
+        c->offsets = (size_t*)realloc(c->offsets, *cap * sizeof(size_t));
+    }
+    c->data = (unsigned char*)realloc(c->data, c->total + len);
+    memcpy(c->data + c->total, body, len);
+    c->offsets[c->count] = c->total;
+    c->sizes[c->count] = len;
+    c->total += len;
+    c->count++;
+}
+
+static inline void
+bench_corpus_load(bench_corpus_t *c)
+{
+    size_t cap = 256;
+    memset(c, 0, sizeof(bench_corpus_t));
+    c->sizes = (size_t*)malloc(cap * sizeof(size_t));
+    c->offsets = (size_t*)malloc(cap * sizeof(size_t));
+
+    const char *path = getenv(BENCH_CORPUS_ENV);
+    FILE *f = path ? fopen(path, "rb") : NULL;
+    if (f) {
+        char line[64 * 1024];
+        while (fgets(line, sizeof(line), f)) {
+            size_t len = strcspn(line, "\r\n");
+            if (len > 0) {
+                bench_corpus_add(c, line, len, &cap);
+            }
+        }
+        fclose(f);
+        return;
+    }
+
+    static const char *names[] = {"knight", "archer", "mage", "rogue", "paladin"};
+    static const char *items[] = {"sword", "shield", "potion", "bow", "staff", "ring"};
+    char body[1024];
+    for (int i = 0; i < BENCH_CORPUS_SAMPLES; ++i) {
+        int n = snprintf(body, sizeof(body),
+                         "{\"code\":200,\"player\":{\"id\":%d,\"name\":\"%s_%d\",\"level\":%d,\"gold\":%d,"
+                         "\"guild\":\"%s\"},\"items\":[",
+                         100000 + i * 7, names[i % 5], i, 1 + i % 60, (i * 131) % 100000, names[(i / 5) % 5]);
+        for (int j = 0; j < 1 + i % 4; ++j) {
+            n += snprintf(body + n, sizeof(body) - n, "%s{\"id\":%d,\"type\":\"%s\",\"quantity\":%d}",
+                          j ? "," : "", (i + j) % 500, items[(i + j) % 6], 1 + (i * j) % 9);
+        }
+        n += snprintf(body + n, sizeof(body) - n, "],\"timestamp\":%d}", 1700000000 + i * 13);
+        bench_corpus_add(c, body, (size_t)n, &cap);
+    }
+}
+
+static inline void
+bench_corpus_free(bench_corpus_t *c)
+{
+    free(c->data);
+    free(c->sizes);
+    free(c->offsets);
+}
+
+#endif // BENCH_COMMON_H
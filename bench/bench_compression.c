@@ -0,0 +1,174 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pc_lib.h>
+#include "pr_gzip.h"
+
+#include "bench_common.h"
+
+static char *g_sizes[] = {
+    "64", "1024", "16384", "102400", "1048576", "16777216", NULL
+};
+
+static MunitParameterEnum g_params[] = {
+    { "size", g_sizes },
+    { NULL, NULL },
+};
+
+typedef struct {
+    size_t size;
+    unsigned char *payload;
+    unsigned char *compressed;
+    size_t compressed_size;
+} bench_data_t;
+
+static void *
+setup(const MunitParameter params[], void *data)
+{
+    Unused(data);
+    bench_data_t *d = (bench_data_t*)calloc(1, sizeof(bench_data_t));
+    d->size = (size_t)strtoul(munit_parameters_get(params, "size"), NULL, 10);
+    d->payload = (unsigned char*)malloc(d->size);
+    bench_fill_json((char*)d->payload, d->size);
+
+    int ret = pr_compress(&d->compressed, &d->compressed_size, d->payload, d->size);
+    munit_assert_int(ret, ==, 0);
+    return d;
+}
+
+static void
+teardown(void *fixture)
+{
+    bench_data_t *d = (bench_data_t*)fixture;
+    pc_lib_free(d->compressed);
+    free(d->payload);
+    free(d);
+}
+
+static MunitResult
+test_compress_oneshot(const MunitParameter params[], void *fixture)
+{
+    Unused(params);
+    bench_data_t *d = (bench_data_t*)fixture;
+    int iterations = bench_iterations(d->size);
+
+    uint64_t start = uv_hrtime();
+    for (int i = 0; i < iterations; ++i) {
+        unsigned char *out = NULL;
+        size_t out_size;
+        munit_assert_int(pr_compress(&out, &out_size, d->payload, d->size), ==, 0);
+        pc_lib_free(out);
+    }
+    bench_report("compress/oneshot", d->size, iterations, uv_hrtime() - start);
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_compress_engine(const MunitParameter params[], void *fixture)
+{
+    Unused(params);
+    bench_data_t *d = (bench_data_t*)fixture;
+    int iterations = bench_iterations(d->size);
+
+    pr_gzip_engine_t engine;
+    pr_gzip_engine_init(&engine, Z_DEFAULT_COMPRESSION);
+
+    uint64_t start = uv_hrtime();
+    for (int i = 0; i < iterations; ++i) {
+        unsigned char *out = NULL;
+        size_t out_size;
+        munit_assert_int(pr_gzip_engine_compress(&engine, NULL, &out, &out_size, d->payload, d->size), ==, 0);
+        pc_lib_free(out);
+    }
+    bench_report("compress/engine", d->size, iterations, uv_hrtime() - start);
+
+    pr_gzip_engine_cleanup(&engine);
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_decompress_oneshot(const MunitParameter params[], void *fixture)
+{
+    Unused(params);
+    bench_data_t *d = (bench_data_t*)fixture;
+    int iterations = bench_iterations(d->size);
+
+    uint64_t start = uv_hrtime();
+    for (int i = 0; i < iterations; ++i) {
+        unsigned char *out = NULL;
+        size_t out_size;
+        munit_assert_int(pr_decompress(&out, &out_size, d->compressed, d->compressed_size), ==, 0);
+        munit_assert_size(out_size, ==, d->size);
+        pc_lib_free(out);
+    }
+    bench_report("decompress/oneshot", d->size, iterations, uv_hrtime() - start);
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_decompress_engine(const MunitParameter params[], void *fixture)
+{
+    Unused(params);
+    bench_data_t *d = (bench_data_t*)fixture;
+    int iterations = bench_iterations(d->size);
+
+    pr_gzip_engine_t engine;
+    pr_gzip_engine_init(&engine, Z_DEFAULT_COMPRESSION);
+
+    uint64_t start = uv_hrtime();
+    for (int i = 0; i < iterations; ++i) {
+        unsigned char *out = NULL;
+        size_t out_size;
+        munit_assert_int(pr_gzip_engine_decompress(&engine, NULL, &out, &out_size, d->compressed, d->compressed_size), ==, 0);
+        munit_assert_size(out_size, ==, d->size);
+        pr_gzip_engine_trim(&engine);
+    }
+    bench_report("decompress/engine", d->size, iterations, uv_hrtime() - start);
+
+    pr_gzip_engine_cleanup(&engine);
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_roundtrip_engine(const MunitParameter params[], void *fixture)
+{
+    Unused(params);
+    bench_data_t *d = (bench_data_t*)fixture;
+
+    pr_gzip_engine_t engine;
+    pr_gzip_engine_init(&engine, Z_DEFAULT_COMPRESSION);
+
+    unsigned char *compressed = NULL;
+    size_t compressed_size;
+    munit_assert_int(pr_gzip_engine_compress(&engine, NULL, &compressed, &compressed_size, d->payload, d->size), ==, 0);
+
+    unsigned char *out = NULL;
+    size_t out_size;
+    munit_assert_int(pr_gzip_engine_decompress(&engine, NULL, &out, &out_size, compressed, compressed_size), ==, 0);
+    munit_assert_size(out_size, ==, d->size);
+    munit_assert_memory_equal(d->size, out, d->payload);
+
+    // Truncated input must fail instead of returning partial data.
+    if (compressed_size > 4) {
+        munit_assert_int(pr_gzip_engine_decompress(&engine, NULL, &out, &out_size, compressed, compressed_size / 2), !=, 0);
+    }
+
+    pc_lib_free(compressed);
+    pr_gzip_engine_cleanup(&engine);
+    return MUNIT_OK;
+}
+
+static MunitTest tests[] = {
+    {"/roundtrip", test_roundtrip_engine, setup, teardown, MUNIT_TEST_OPTION_NONE, g_params},
+    {"/compress/oneshot", test_compress_oneshot, setup, teardown, MUNIT_TEST_OPTION_NONE, g_params},
+    {"/compress/engine", test_compress_engine, setup, teardown, MUNIT_TEST_OPTION_NONE, g_params},
+    {"/decompress/oneshot", test_decompress_oneshot, setup, teardown, MUNIT_TEST_OPTION_NONE, g_params},
+    {"/decompress/engine", test_decompress_engine, setup, teardown, MUNIT_TEST_OPTION_NONE, g_params},
+    {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}
+};
+
+const MunitSuite compression_bench_suite = {
+    "/compression", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
@@ -0,0 +1,147 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <pitaya.h>
+
+#include "bench_common.h"
+#include "local_server.h"
+
+#define BENCH_CONNECT_RECONNECTS 100
+// emulated round trip, far longer than the cpu time of a resumed handshake
+#define BENCH_CONNECT_LATENCY_MS 5
+#define BENCH_CONNECT_TIMEOUT 10
+
+static char *g_early_data[] = {
+    "off", "on", "rejected", NULL
+};
+
+static MunitParameterEnum g_params[] = {
+    { "early_data", g_early_data },
+    { NULL, NULL },
+};
+
+typedef struct {
+    uv_sem_t event;
+    uv_sem_t responded;
+} bench_client_t;
+
+static void
+event_cb(pc_client_t* client, int ev_type, void* ex_data, const char* arg1, const char* arg2)
+{
+    Unused(client); Unused(arg1); Unused(arg2);
+    bench_client_t *bc = (bench_client_t*)ex_data;
+
+    if (ev_type == PC_EV_CONNECTED || ev_type == PC_EV_DISCONNECT) {
+        uv_sem_post(&bc->event);
+    }
+}
+
+static void
+request_cb(const pc_request_t* req, const pc_buf_t *resp)
+{
+    Unused(resp);
+    bench_client_t *bc = (bench_client_t*)pc_request_ex_data(req);
+    uv_sem_post(&bc->responded);
+}
+
+static void
+request_error_cb(const pc_request_t* req, const pc_error_t *error)
+{
+    munit_errorf("request failed with code %d", error->code);
+}
+
+// Connects and disconnects again, after a request so that the tickets the
+// server sends once the handshake is done have arrived. Returns the time
+// from tcp connected to the handshake response.
+static uint64_t
+connect_once(bench_client_t *bc, pc_client_t *client, local_server_t *server)
+{
+    pc_client_stats_t stats;
+    uint8_t body[] = "{}";
+
+    munit_assert_int(pc_client_connect(client, "127.0.0.1", local_server_port(server), NULL), ==, PC_RC_OK);
+    uv_sem_wait(&bc->event);
+
+    munit_assert_int(pc_binary_request_with_timeout(client, "bench.connect", body, sizeof(body) - 1, bc,
+                                                    BENCH_CONNECT_TIMEOUT, request_cb, request_error_cb), ==, PC_RC_OK);
+    uv_sem_wait(&bc->responded);
+
+    munit_assert_int(pc_client_stats(client, &stats), ==, PC_RC_OK);
+    munit_assert_int(pc_client_disconnect(client), ==, PC_RC_OK);
+    uv_sem_wait(&bc->event);
+
+    return stats.last_handshake_us;
+}
+
+// TLS reconnects resuming a session, with the handshake package sent as
+// early data or not, or sent early but rejected by the server and sent
+// again. Reports the time from tcp connected to the handshake response,
+// with the server emulating a round trip of BENCH_CONNECT_LATENCY_MS.
+static MunitResult
+test_reconnect(const MunitParameter params[], void *fixture)
+{
+    Unused(fixture);
+
+    const char *early_data = munit_parameters_get(params, "early_data");
+    local_server_t *server = local_server_start_ex(60, NULL, NULL, 0, 0, 1);
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+    pc_client_stats_t stats;
+    bench_client_t bc;
+    uint64_t total = 0;
+
+    config.transport_name = PC_TR_NAME_UV_TLS;
+    config.disable_compression = 1;
+    config.tls_early_data = strcmp(early_data, "off") != 0;
+    munit_assert_int(tr_uv_tls_set_ca_file(BENCH_FIXTURES_DIR "/myCA.pem", NULL), ==, PC_RC_OK);
+    tr_uv_tls_clear_session_cache();
+
+    uv_sem_init(&bc.event, 0);
+    uv_sem_init(&bc.responded, 0);
+
+    pc_client_init_result_t res = pc_client_init(&bc, &config);
+    munit_assert_int(res.rc, ==, PC_RC_OK);
+    pc_client_add_ev_handler(res.client, event_cb, &bc, NULL);
+
+    // the first connection does a full handshake and gets the tickets
+    connect_once(&bc, res.client, server);
+    local_server_reject_early_data(server, strcmp(early_data, "rejected") == 0);
+    local_server_set_latency(server, BENCH_CONNECT_LATENCY_MS);
+
+    for (int i = 0; i < BENCH_CONNECT_RECONNECTS; ++i) {
+        total += connect_once(&bc, res.client, server);
+    }
+
+    munit_assert_int(pc_client_stats(res.client, &stats), ==, PC_RC_OK);
+    munit_assert_int(pc_client_cleanup(res.client), ==, PC_RC_OK);
+    uv_sem_destroy(&bc.event);
+    uv_sem_destroy(&bc.responded);
+    local_server_stop(server);
+
+    munit_logf(MUNIT_LOG_INFO, "early_data=%-8s %4d reconnects %8.1f us to handshake response, "
+               "%llu resumed, %llu early accepted, %llu early rejected",
+               early_data, BENCH_CONNECT_RECONNECTS, (double)total / BENCH_CONNECT_RECONNECTS,
+               (unsigned long long)stats.tls_resumed_handshakes,
+               (unsigned long long)stats.tls_early_data_accepted,
+               (unsigned long long)stats.tls_early_data_rejected);
+
+    munit_assert_uint64(stats.tls_resumed_handshakes, ==, BENCH_CONNECT_RECONNECTS);
+    if (strcmp(early_data, "on") == 0) {
+        munit_assert_uint64(stats.tls_early_data_accepted, ==, BENCH_CONNECT_RECONNECTS);
+    } else if (strcmp(early_data, "rejected") == 0) {
+        munit_assert_uint64(stats.tls_early_data_rejected, ==, BENCH_CONNECT_RECONNECTS);
+    } else {
+        munit_assert_uint64(stats.tls_early_data_accepted + stats.tls_early_data_rejected, ==, 0);
+    }
+    return MUNIT_OK;
+}
+
+static MunitTest tests[] = {
+    {"/reconnect", test_reconnect, NULL, NULL, MUNIT_TEST_OPTION_NONE, g_params},
+    {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}
+};
+
+const MunitSuite connect_bench_suite = {
+    "/connect", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
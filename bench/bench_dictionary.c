@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pc_lib.h>
+#include "pr_gzip.h"
+#include "trainer.h"
+
+#include "bench_common.h"
+
+static char *g_dict_sizes[] = {
+    "2048", "8192", "32768", NULL
+};
+
+static MunitParameterEnum g_params[] = {
+    { "dict_size", g_dict_sizes },
+    { NULL, NULL },
+};
+
+typedef struct {
+    size_t in;
+    size_t out;
+    uint64_t compress_ns;
+    uint64_t decompress_ns;
+} result_t;
+
+static void
+run(pr_gzip_engine_t *engine, const pr_dict_t *dict, const pr_dict_store_t *store,
+    const bench_corpus_t *c, size_t first, result_t *r)
+{
+    memset(r, 0, sizeof(result_t));
+    for (size_t i = first; i < c->count; ++i) {
+        const unsigned char *body = c->data + c->offsets[i];
+        unsigned char *compressed = NULL;
+        size_t compressed_size, out_size;
+        unsigned char *out;
+
+        uint64_t start = uv_hrtime();
+        munit_assert_int(pr_gzip_engine_compress(engine, dict, &compressed, &compressed_size, body, c->sizes[i]), ==, 0);
+        uint64_t mid = uv_hrtime();
+        munit_assert_int(pr_gzip_engine_decompress(engine, store, &out, &out_size, compressed, compressed_size), ==, 0);
+        uint64_t end = uv_hrtime();
+
+        munit_assert_size(out_size, ==, c->sizes[i]);
+        munit_assert_memory_equal(out_size, out, body);
+
+        r->in += c->sizes[i];
+        r->out += compressed_size;
+        r->compress_ns += mid - start;
+        r->decompress_ns += end - mid;
+        pc_lib_free(compressed);
+    }
+}
+
+static void
+report(const char *name, const result_t *r, size_t msgs)
+{
+    munit_logf(MUNIT_LOG_INFO, "%-12s msgs=%-6zu ratio=%5.1f%%  compress=%8.1f ns/msg  decompress=%8.1f ns/msg",
+               name, msgs, 100.0 * (double)r->out / (double)r->in,
+               (double)r->compress_ns / msgs, (double)r->decompress_ns / msgs);
+}
+
+static MunitResult
+test_dictionary(const MunitParameter params[], void *fixture)
+{
+    Unused(fixture);
+    size_t dict_size = (size_t)strtoul(munit_parameters_get(params, "dict_size"), NULL, 10);
+
+    bench_corpus_t c;
+    bench_corpus_load(&c);
+    munit_assert_size(c.count, >=, 2);
+
+    // Train with the first half of the corpus and measure with the second one.
+    size_t half = c.count / 2;
+    trainer_samples_t samples = {c.data, c.sizes, half};
+
+    pr_dict_t dict;
+    memset(&dict, 0, sizeof(pr_dict_t));
+    dict.data = (unsigned char*)malloc(dict_size);
+    dict.len = trainer_build(&samples, dict.data, dict_size);
+    dict.id = (uint32_t)adler32(adler32(0L, Z_NULL, 0), dict.data, (uInt)dict.len);
+    dict.accepted = 1;
+
+    pr_dict_store_t store;
+    pr_dict_store_init(&store);
+    store.dicts = &dict;
+    store.global = &dict;
+
+    pr_gzip_engine_t engine;
+    pr_gzip_engine_init(&engine, Z_DEFAULT_COMPRESSION);
+
+    result_t plain, with_dict;
+    run(&engine, NULL, NULL, &c, half, &plain);
+    run(&engine, &dict, &store, &c, half, &with_dict);
+
+    size_t msgs = c.count - half;
+    munit_logf(MUNIT_LOG_INFO, "corpus: %s, dictionary: %zu bytes",
+               getenv(BENCH_CORPUS_ENV) ? getenv(BENCH_CORPUS_ENV) : "generated", dict.len);
+    report("no dict", &plain, msgs);
+    report("dict", &with_dict, msgs);
+
+    munit_assert_size(with_dict.out, <, plain.out);
+
+    pr_gzip_engine_cleanup(&engine);
+    store.dicts = NULL;
+    store.global = NULL;
+    pr_dict_store_cleanup(&store);
+    free(dict.data);
+    bench_corpus_free(&c);
+    return MUNIT_OK;
+}
+
+static MunitTest tests[] = {
+    {"/train", test_dictionary, NULL, NULL, MUNIT_TEST_OPTION_NONE, g_params},
+    {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}
+};
+
+const MunitSuite dictionary_bench_suite = {
+    "/dictionary", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
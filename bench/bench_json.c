@@ -0,0 +1,172 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "pc_JSON.h"
+
+#include "bench_common.h"
+
+static char *g_fixture[] = {
+    "handshake", "dictionary", NULL
+};
+
+static char *g_routes[] = {
+    "1000", "5000", NULL
+};
+
+static char *g_mode[] = {
+    "heap", "arena", NULL
+};
+
+static MunitParameterEnum g_parse_params[] = {
+    { "fixture", g_fixture },
+    { "routes", g_routes },
+    { "mode", g_mode },
+    { NULL, NULL },
+};
+
+static MunitParameterEnum g_lookup_params[] = {
+    { "routes", g_routes },
+    { NULL, NULL },
+};
+
+static void
+route_name(char *buf, size_t size, int i)
+{
+    snprintf(buf, size, "area%d.handler%d.method%d", i % 7, i / 16, i);
+}
+
+static pc_JSON *
+make_route_to_code(int routes)
+{
+    pc_JSON *obj = pc_JSON_CreateObject();
+    char route[64];
+    for (int i = 0; i < routes; ++i) {
+        route_name(route, sizeof(route), i);
+        pc_JSON_AddNumberToObject(obj, route, i + 1);
+    }
+    return obj;
+}
+
+// The handshake fixture is the compact response of a server with a route
+// dictionary, the dictionary fixture is the indented local storage the
+// client keeps it in between runs.
+static char *
+make_fixture(const char *fixture, int routes)
+{
+    pc_JSON *root = pc_JSON_CreateObject();
+    char route[64];
+    char code[16];
+    char *text;
+
+    if (strcmp(fixture, "handshake") == 0) {
+        pc_JSON *sys = pc_JSON_CreateObject();
+        pc_JSON_AddNumberToObject(root, "code", 200);
+        pc_JSON_AddNumberToObject(sys, "heartbeat", 30);
+        pc_JSON_AddStringToObject(sys, "serializer", "json");
+        pc_JSON_AddTrueToObject(sys, "useDict");
+        pc_JSON_AddItemToObject(sys, "dict", make_route_to_code(routes));
+        pc_JSON_AddItemToObject(root, "sys", sys);
+        text = pc_JSON_PrintUnformatted(root);
+    } else {
+        pc_JSON *code_to_route = pc_JSON_CreateObject();
+        for (int i = 0; i < routes; ++i) {
+            route_name(route, sizeof(route), i);
+            snprintf(code, sizeof(code), "%d", i + 1);
+            pc_JSON_AddStringToObject(code_to_route, code, route);
+        }
+        pc_JSON_AddItemToObject(root, "routeToCode", make_route_to_code(routes));
+        pc_JSON_AddItemToObject(root, "codeToRoute", code_to_route);
+        text = pc_JSON_Print(root);
+    }
+
+    pc_JSON_Delete(root);
+    return text;
+}
+
+static MunitResult
+test_parse(const MunitParameter params[], void *fixture)
+{
+    Unused(fixture);
+
+    const char *name = munit_parameters_get(params, "fixture");
+    const int routes = atoi(munit_parameters_get(params, "routes"));
+    const int arena = strcmp(munit_parameters_get(params, "mode"), "arena") == 0;
+
+    char *text = make_fixture(name, routes);
+    const size_t size = strlen(text);
+    const int iterations = bench_iterations(size);
+
+    uint64_t start = uv_hrtime();
+    for (int i = 0; i < iterations; ++i) {
+        pc_JSON *root = arena ? pc_JSON_ParseArena(text, NULL, 1) : pc_JSON_ParseWithOpts(text, NULL, 1);
+        munit_assert_not_null(root);
+        if (arena) {
+            pc_JSON_DeleteArena(root);
+        } else {
+            pc_JSON_Delete(root);
+        }
+    }
+    uint64_t elapsed_ns = uv_hrtime() - start;
+
+    char label[64];
+    snprintf(label, sizeof(label), "%s/%s/%d", name, arena ? "arena" : "heap", routes);
+    bench_report(label, size, iterations, elapsed_ns);
+
+    free(text);
+    return MUNIT_OK;
+}
+
+// Resolves every route of the dictionary once per iteration, walking the
+// members like the lookup did before objects were indexed and then through
+// pc_JSON_GetObjectItem, whose first call builds the index.
+static MunitResult
+test_lookup(const MunitParameter params[], void *fixture)
+{
+    Unused(fixture);
+
+    const int routes = atoi(munit_parameters_get(params, "routes"));
+    const int iterations = 20;
+    pc_JSON *dict = make_route_to_code(routes);
+    char route[64];
+    uint64_t sum = 0;
+
+    uint64_t start = uv_hrtime();
+    for (int n = 0; n < iterations; ++n) {
+        for (int i = 0; i < routes; ++i) {
+            route_name(route, sizeof(route), i);
+            pc_JSON *c = dict->child;
+            while (c && strcmp(c->string, route)) c = c->next;
+            sum += (uint64_t)c->valueint;
+        }
+    }
+    uint64_t linear_ns = uv_hrtime() - start;
+
+    start = uv_hrtime();
+    for (int n = 0; n < iterations; ++n) {
+        for (int i = 0; i < routes; ++i) {
+            route_name(route, sizeof(route), i);
+            sum -= (uint64_t)pc_JSON_GetObjectItem(dict, route)->valueint;
+        }
+    }
+    uint64_t indexed_ns = uv_hrtime() - start;
+    munit_assert_uint64(sum, ==, 0);
+
+    const double lookups = (double)iterations * routes;
+    munit_logf(MUNIT_LOG_INFO, "routes=%-6d linear %9.1f ns/lookup  indexed %7.1f ns/lookup",
+               routes, linear_ns / lookups, indexed_ns / lookups);
+
+    pc_JSON_Delete(dict);
+    return MUNIT_OK;
+}
+
+static MunitTest tests[] = {
+    {"/parse", test_parse, NULL, NULL, MUNIT_TEST_OPTION_NONE, g_parse_params},
+    {"/lookup", test_lookup, NULL, NULL, MUNIT_TEST_OPTION_NONE, g_lookup_params},
+    {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}
+};
+
+const MunitSuite json_bench_suite = {
+    "/json", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
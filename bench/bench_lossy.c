@@ -0,0 +1,148 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <pitaya.h>
+
+#include "bench_common.h"
+
+// The ports of test/mock-servers/mock-kcp-server.js behind its lossy link,
+// 10% of the datagrams lost each way and 20 ms of delay. The tcp one models
+// a lost write holding back what follows it for a retransmission timeout,
+// as tcp segments can not be dropped from userspace.
+#define BENCH_LOSSY_KCP_PORT 4701
+#define BENCH_LOSSY_TCP_PORT 4702
+#define BENCH_LOSSY_REQUESTS 200
+#define BENCH_LOSSY_TIMEOUT 60
+
+static char *g_transport[] = {
+    "kcp", "tcp", NULL
+};
+
+static MunitParameterEnum g_params[] = {
+    { "transport", g_transport },
+    { NULL, NULL },
+};
+
+typedef struct {
+    uv_sem_t connected;
+    uv_sem_t responded;
+    int ev_type;
+} bench_client_t;
+
+static void
+event_cb(pc_client_t* client, int ev_type, void* ex_data, const char* arg1, const char* arg2)
+{
+    Unused(client); Unused(arg1); Unused(arg2);
+    bench_client_t *bc = (bench_client_t*)ex_data;
+
+    if (ev_type == PC_EV_CONNECTED || ev_type == PC_EV_CONNECT_ERROR || ev_type == PC_EV_CONNECT_FAILED) {
+        bc->ev_type = ev_type;
+        uv_sem_post(&bc->connected);
+    }
+}
+
+static void
+request_cb(const pc_request_t* req, const pc_buf_t *resp)
+{
+    Unused(resp);
+    bench_client_t *bc = (bench_client_t*)pc_request_ex_data(req);
+    uv_sem_post(&bc->responded);
+}
+
+static void
+request_error_cb(const pc_request_t* req, const pc_error_t *error)
+{
+    Unused(req);
+    munit_errorf("request failed with code %d", error->code);
+}
+
+static int
+compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Small requests one after the other over kcp in its fast mode or over tcp,
+// the tail of their latency being what head of line blocking costs. Needs
+// the kcp mock server running, skipped otherwise.
+static MunitResult
+test_latency(const MunitParameter params[], void *fixture)
+{
+    Unused(fixture);
+
+    int kcp = strcmp(munit_parameters_get(params, "transport"), "kcp") == 0;
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+    config.enable_reconn = 0;
+    config.disable_compression = 1;
+    if (kcp) {
+        config.transport_name = PC_TR_NAME_UV_KCP;
+        config.kcp_nodelay = 1;
+        config.kcp_interval = 10;
+        config.kcp_fast_resend = 2;
+        config.kcp_no_cwnd = 1;
+    }
+
+    bench_client_t bc;
+    memset(&bc, 0, sizeof(bench_client_t));
+    uv_sem_init(&bc.connected, 0);
+    uv_sem_init(&bc.responded, 0);
+
+    pc_client_init_result_t res = pc_client_init(&bc, &config);
+    munit_assert_int(res.rc, ==, PC_RC_OK);
+    pc_client_t *client = res.client;
+    pc_client_add_ev_handler(client, event_cb, &bc, NULL);
+
+    munit_assert_int(pc_client_connect(client, "127.0.0.1", kcp ? BENCH_LOSSY_KCP_PORT : BENCH_LOSSY_TCP_PORT,
+                                       NULL), ==, PC_RC_OK);
+    uv_sem_wait(&bc.connected);
+    if (bc.ev_type != PC_EV_CONNECTED) {
+        munit_assert_int(pc_client_cleanup(client), ==, PC_RC_OK);
+        uv_sem_destroy(&bc.connected);
+        uv_sem_destroy(&bc.responded);
+        return MUNIT_SKIP;
+    }
+
+    uint64_t *rtts = (uint64_t*)malloc(sizeof(uint64_t) * BENCH_LOSSY_REQUESTS);
+    uint64_t total = 0;
+
+    for (int i = 0; i < BENCH_LOSSY_REQUESTS; ++i) {
+        uint64_t start = uv_hrtime();
+        munit_assert_int(pc_string_request_with_timeout(client, "echo.lossy", "{\"tick\":true}", &bc,
+                                                        BENCH_LOSSY_TIMEOUT, request_cb,
+                                                        request_error_cb), ==, PC_RC_OK);
+        uv_sem_wait(&bc.responded);
+        rtts[i] = uv_hrtime() - start;
+        total += rtts[i];
+    }
+
+    pc_client_stats_t stats;
+    munit_assert_int(pc_client_stats(client, &stats), ==, PC_RC_OK);
+    munit_assert_int(pc_client_cleanup(client), ==, PC_RC_OK);
+    uv_sem_destroy(&bc.connected);
+    uv_sem_destroy(&bc.responded);
+
+    qsort(rtts, BENCH_LOSSY_REQUESTS, sizeof(uint64_t), compare_u64);
+    munit_logf(MUNIT_LOG_INFO, "transport=%-3s latency %7.1f ms mean %7.1f ms p50 %7.1f ms p99 %7.1f ms max"
+               " resends=%llu",
+               munit_parameters_get(params, "transport"),
+               (double)total / BENCH_LOSSY_REQUESTS / 1e6,
+               (double)rtts[BENCH_LOSSY_REQUESTS / 2] / 1e6,
+               (double)rtts[BENCH_LOSSY_REQUESTS * 99 / 100] / 1e6,
+               (double)rtts[BENCH_LOSSY_REQUESTS - 1] / 1e6,
+               (unsigned long long)(stats.kcp_retransmits + stats.kcp_fast_resends));
+    free(rtts);
+    return MUNIT_OK;
+}
+
+static MunitTest tests[] = {
+    {"/latency", test_latency, NULL, NULL, MUNIT_TEST_OPTION_NONE, g_params},
+    {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}
+};
+
+const MunitSuite lossy_bench_suite = {
+    "/lossy", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
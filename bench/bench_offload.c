@@ -0,0 +1,188 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <pitaya.h>
+
+#include "bench_common.h"
+#include "local_server.h"
+
+#define BENCH_OFFLOAD_PAYLOAD (10 * 1024 * 1024)
+#define BENCH_OFFLOAD_REQUESTS 8
+#define BENCH_OFFLOAD_JITTER_SECS 6
+#define BENCH_OFFLOAD_TIMEOUT 60
+
+// compression_offload_min_size, 0 keeps (de)compression inline.
+static char *g_offload[] = {
+    "0", "65536", NULL
+};
+
+static MunitParameterEnum g_params[] = {
+    { "offload", g_offload },
+    { NULL, NULL },
+};
+
+typedef struct {
+    uv_sem_t connected;
+    uv_sem_t responded;
+    uint64_t pushes;
+} bench_client_t;
+
+static void
+event_cb(pc_client_t* client, int ev_type, void* ex_data, const char* arg1, const char* arg2)
+{
+    Unused(client); Unused(arg1); Unused(arg2);
+    bench_client_t *bc = (bench_client_t*)ex_data;
+
+    if (ev_type == PC_EV_CONNECTED) {
+        uv_sem_post(&bc->connected);
+    }
+}
+
+static void
+push_cb(pc_client_t *client, const char *route, const pc_buf_t *payload)
+{
+    Unused(route); Unused(payload);
+    bench_client_t *bc = (bench_client_t*)pc_client_ex_data(client);
+    bc->pushes++;
+}
+
+static void
+request_cb(const pc_request_t* req, const pc_buf_t *resp)
+{
+    Unused(resp);
+    bench_client_t *bc = (bench_client_t*)pc_request_ex_data(req);
+    uv_sem_post(&bc->responded);
+}
+
+static void
+request_error_cb(const pc_request_t* req, const pc_error_t *error)
+{
+    munit_errorf("request failed with code %d", error->code);
+}
+
+static pc_client_t *
+client_connect(bench_client_t *bc, local_server_t *server, const MunitParameter params[])
+{
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+    config.compression_offload_min_size = atoi(munit_parameters_get(params, "offload"));
+
+    memset(bc, 0, sizeof(bench_client_t));
+    uv_sem_init(&bc->connected, 0);
+    uv_sem_init(&bc->responded, 0);
+
+    pc_client_init_result_t res = pc_client_init(bc, &config);
+    munit_assert_int(res.rc, ==, PC_RC_OK);
+
+    pc_client_add_ev_handler(res.client, event_cb, bc, NULL);
+    pc_client_set_push_handler(res.client, push_cb);
+    munit_assert_int(pc_client_connect(res.client, "127.0.0.1", local_server_port(server), NULL), ==, PC_RC_OK);
+    uv_sem_wait(&bc->connected);
+
+    return res.client;
+}
+
+static void
+client_close(bench_client_t *bc, pc_client_t *client)
+{
+    munit_assert_int(pc_client_disconnect(client), ==, PC_RC_OK);
+    munit_assert_int(pc_client_cleanup(client), ==, PC_RC_OK);
+    uv_sem_destroy(&bc->connected);
+    uv_sem_destroy(&bc->responded);
+}
+
+static char *
+make_payload(void)
+{
+    char *payload = (char*)malloc(BENCH_OFFLOAD_PAYLOAD + 1);
+    bench_fill_json(payload, BENCH_OFFLOAD_PAYLOAD);
+    payload[BENCH_OFFLOAD_PAYLOAD] = '\0';
+    return payload;
+}
+
+// Time the thread sending a 10 MiB request spends inside the request call,
+// and the time until its response arrives.
+static MunitResult
+test_latency(const MunitParameter params[], void *fixture)
+{
+    Unused(fixture);
+
+    local_server_t *server = local_server_start(1, NULL, NULL, 0, 0);
+    bench_client_t bc;
+    pc_client_t *client = client_connect(&bc, server, params);
+    char *payload = make_payload();
+
+    uint64_t call_ns = 0, call_max_ns = 0, total_ns = 0;
+    for (int i = 0; i < BENCH_OFFLOAD_REQUESTS; ++i) {
+        uint64_t start = uv_hrtime();
+        munit_assert_int(pc_string_request_with_timeout(client, "bench.upload", payload, &bc, BENCH_OFFLOAD_TIMEOUT,
+                                                        request_cb, request_error_cb), ==, PC_RC_OK);
+        uint64_t called = uv_hrtime();
+        uv_sem_wait(&bc.responded);
+        uint64_t end = uv_hrtime();
+
+        call_ns += called - start;
+        call_max_ns = called - start > call_max_ns ? called - start : call_max_ns;
+        total_ns += end - start;
+    }
+
+    munit_logf(MUNIT_LOG_INFO, "offload=%-8s caller avg=%8.2f ms max=%8.2f ms  round trip avg=%8.2f ms",
+               munit_parameters_get(params, "offload"),
+               (double)call_ns / BENCH_OFFLOAD_REQUESTS / 1e6, (double)call_max_ns / 1e6,
+               (double)total_ns / BENCH_OFFLOAD_REQUESTS / 1e6);
+
+    client_close(&bc, client);
+    local_server_stop(server);
+    free(payload);
+    return MUNIT_OK;
+}
+
+// Deviation of the heartbeats the client sends from their 1 s interval while
+// the server pushes compressed 10 MiB bodies back to back.
+static MunitResult
+test_jitter(const MunitParameter params[], void *fixture)
+{
+    Unused(fixture);
+
+    char *payload = make_payload();
+    local_server_t *server = local_server_start(1, "bench.push", payload, BENCH_OFFLOAD_PAYLOAD, 1);
+    bench_client_t bc;
+    pc_client_t *client = client_connect(&bc, server, params);
+
+    uv_sleep(BENCH_OFFLOAD_JITTER_SECS * 1000);
+
+    uint64_t times[LOCAL_SERVER_MAX_HEARTBEATS];
+    size_t n = local_server_heartbeats(server, times, ArrayCount(times));
+    uint64_t pushes = bc.pushes;
+
+    client_close(&bc, client);
+    local_server_stop(server);
+    free(payload);
+
+    munit_assert_size(n, >=, 2);
+
+    double sum = 0, max = 0;
+    for (size_t i = 1; i < n; ++i) {
+        double delta_ms = (double)(times[i] - times[i - 1]) / 1e6;
+        double jitter = delta_ms > 1000 ? delta_ms - 1000 : 1000 - delta_ms;
+        sum += jitter;
+        max = jitter > max ? jitter : max;
+    }
+
+    munit_logf(MUNIT_LOG_INFO, "offload=%-8s heartbeats=%zu jitter avg=%8.2f ms max=%8.2f ms  pushes=%llu",
+               munit_parameters_get(params, "offload"), n, sum / (double)(n - 1), max,
+               (unsigned long long)pushes);
+
+    return MUNIT_OK;
+}
+
+static MunitTest tests[] = {
+    {"/latency", test_latency, NULL, NULL, MUNIT_TEST_OPTION_NONE, g_params},
+    {"/jitter", test_jitter, NULL, NULL, MUNIT_TEST_OPTION_NONE, g_params},
+    {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}
+};
+
+const MunitSuite offload_bench_suite = {
+    "/offload", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
@@ -0,0 +1,150 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <pitaya.h>
+
+#include "bench_common.h"
+#include "local_server.h"
+
+#define BENCH_PREPARED_SENDS 20000
+#define BENCH_PREPARED_IN_FLIGHT 128
+#define BENCH_PREPARED_TIMEOUT 60
+
+static char *g_mode[] = {
+    "regular", "prepared", NULL
+};
+
+static char *g_size[] = {
+    "256", "4096", NULL
+};
+
+static MunitParameterEnum g_params[] = {
+    { "mode", g_mode },
+    { "size", g_size },
+    { NULL, NULL },
+};
+
+typedef struct {
+    uv_sem_t connected;
+    // Posted for each response, bounds the requests in flight.
+    uv_sem_t slots;
+} bench_client_t;
+
+static void
+event_cb(pc_client_t* client, int ev_type, void* ex_data, const char* arg1, const char* arg2)
+{
+    Unused(client); Unused(arg1); Unused(arg2);
+    bench_client_t *bc = (bench_client_t*)ex_data;
+
+    if (ev_type == PC_EV_CONNECTED) {
+        uv_sem_post(&bc->connected);
+    }
+}
+
+static void
+request_cb(const pc_request_t* req, const pc_buf_t *resp)
+{
+    Unused(resp);
+    bench_client_t *bc = (bench_client_t*)pc_request_ex_data(req);
+    uv_sem_post(&bc->slots);
+}
+
+static void
+request_error_cb(const pc_request_t* req, const pc_error_t *error)
+{
+    munit_errorf("request failed with code %d", error->code);
+}
+
+static uint64_t
+cpu_ns(void)
+{
+    uv_rusage_t ru;
+    uv_getrusage(&ru);
+    return (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ull
+        + (uint64_t)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ull;
+}
+
+// Sends the same compressible body over and over, either encoding it on
+// each request or through a single prepared message, and reports the sends
+// per second of wall time and per second of CPU time of the process, which
+// includes the network thread and the in process server.
+static MunitResult
+test_sends(const MunitParameter params[], void *fixture)
+{
+    Unused(fixture);
+
+    const int prepared = strcmp(munit_parameters_get(params, "mode"), "prepared") == 0;
+    const size_t size = (size_t)atoi(munit_parameters_get(params, "size"));
+
+    local_server_t *server = local_server_start(30, NULL, NULL, 0, 0);
+    bench_client_t bc;
+    uv_sem_init(&bc.connected, 0);
+    uv_sem_init(&bc.slots, BENCH_PREPARED_IN_FLIGHT);
+
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+    pc_client_init_result_t res = pc_client_init(&bc, &config);
+    munit_assert_int(res.rc, ==, PC_RC_OK);
+    pc_client_t *client = res.client;
+
+    pc_client_add_ev_handler(client, event_cb, &bc, NULL);
+    munit_assert_int(pc_client_connect(client, "127.0.0.1", local_server_port(server), NULL), ==, PC_RC_OK);
+    uv_sem_wait(&bc.connected);
+
+    char *body = (char*)malloc(size + 1);
+    bench_fill_json(body, size);
+    body[size] = '\0';
+
+    pc_prepared_msg_t *msg = pc_prepared_msg_new("bench.prepared", (const uint8_t*)body, (int64_t)size, NULL);
+    munit_assert_not_null(msg);
+
+    uint64_t call_ns = 0;
+    uint64_t cpu_start = cpu_ns();
+    uint64_t start = uv_hrtime();
+
+    for (int i = 0; i < BENCH_PREPARED_SENDS; ++i) {
+        uv_sem_wait(&bc.slots);
+
+        uint64_t call_start = uv_hrtime();
+        int rc = prepared
+            ? pc_prepared_request_with_timeout(client, msg, &bc, BENCH_PREPARED_TIMEOUT, request_cb, request_error_cb)
+            : pc_string_request_with_timeout(client, "bench.prepared", body, &bc, BENCH_PREPARED_TIMEOUT,
+                                             request_cb, request_error_cb);
+        call_ns += uv_hrtime() - call_start;
+        munit_assert_int(rc, ==, PC_RC_OK);
+    }
+
+    for (int i = 0; i < BENCH_PREPARED_IN_FLIGHT; ++i) {
+        uv_sem_wait(&bc.slots);
+    }
+
+    uint64_t elapsed_ns = uv_hrtime() - start;
+    uint64_t cpu_elapsed_ns = cpu_ns() - cpu_start;
+
+    munit_logf(MUNIT_LOG_INFO, "mode=%-8s size=%-6zu %10.0f sends/s %10.0f sends/cpu-s  caller %7.0f ns/send",
+               munit_parameters_get(params, "mode"), size,
+               BENCH_PREPARED_SENDS / ((double)elapsed_ns / 1e9),
+               BENCH_PREPARED_SENDS / ((double)cpu_elapsed_ns / 1e9),
+               (double)call_ns / BENCH_PREPARED_SENDS);
+
+    pc_prepared_msg_release(msg);
+    free(body);
+
+    munit_assert_int(pc_client_disconnect(client), ==, PC_RC_OK);
+    munit_assert_int(pc_client_cleanup(client), ==, PC_RC_OK);
+    local_server_stop(server);
+    uv_sem_destroy(&bc.connected);
+    uv_sem_destroy(&bc.slots);
+
+    return MUNIT_OK;
+}
+
+static MunitTest tests[] = {
+    {"/sends", test_sends, NULL, NULL, MUNIT_TEST_OPTION_NONE, g_params},
+    {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}
+};
+
+const MunitSuite prepared_bench_suite = {
+    "/prepared", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
@@ -0,0 +1,396 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <pitaya.h>
+
+#include "bench_common.h"
+#include "local_server.h"
+#include "tr_uv_uring.h"
+
+#define BENCH_THROUGHPUT_PAYLOAD (1024 * 1024)
+#define BENCH_THROUGHPUT_DOWNLOAD_SECS 3
+#define BENCH_THROUGHPUT_REQUESTS 256
+#define BENCH_THROUGHPUT_TIMEOUT 60
+#define BENCH_THROUGHPUT_BURSTS 200
+#define BENCH_THROUGHPUT_BURST_MSGS 50
+#define BENCH_THROUGHPUT_BURST_BODY 40
+#define BENCH_THROUGHPUT_CLIENTS 32
+#define BENCH_THROUGHPUT_ROUNDS 500
+#define BENCH_THROUGHPUT_PINGS 5000
+
+static char *g_transport[] = {
+    "tcp", "tls", "ktls",
+#ifndef _WIN32
+    "uds",
+#endif
+#ifdef TR_UV_URING_SUPPORTED
+    "uring",
+#endif
+    NULL
+};
+
+static MunitParameterEnum g_params[] = {
+    { "transport", g_transport },
+    { NULL, NULL },
+};
+
+typedef struct {
+    uv_sem_t connected;
+    uv_sem_t responded;
+    uint64_t push_bytes;
+} bench_client_t;
+
+static void
+event_cb(pc_client_t* client, int ev_type, void* ex_data, const char* arg1, const char* arg2)
+{
+    Unused(client); Unused(arg1); Unused(arg2);
+    bench_client_t *bc = (bench_client_t*)ex_data;
+
+    if (ev_type == PC_EV_CONNECTED) {
+        uv_sem_post(&bc->connected);
+    }
+}
+
+static void
+push_cb(pc_client_t *client, const char *route, const pc_buf_t *payload)
+{
+    Unused(route);
+    bench_client_t *bc = (bench_client_t*)pc_client_ex_data(client);
+    bc->push_bytes += payload->len;
+}
+
+static void
+request_cb(const pc_request_t* req, const pc_buf_t *resp)
+{
+    Unused(resp);
+    bench_client_t *bc = (bench_client_t*)pc_request_ex_data(req);
+    uv_sem_post(&bc->responded);
+}
+
+static void
+request_error_cb(const pc_request_t* req, const pc_error_t *error)
+{
+    munit_errorf("request failed with code %d", error->code);
+}
+
+static void
+notify_error_cb(const pc_notify_t* notify, const pc_error_t *error)
+{
+    munit_errorf("notify failed with code %d", error->code);
+}
+
+static int
+use_tls(const MunitParameter params[])
+{
+    const char *transport = munit_parameters_get(params, "transport");
+    return strcmp(transport, "tls") == 0 || strcmp(transport, "ktls") == 0;
+}
+
+static int
+use_ktls(const MunitParameter params[])
+{
+    return strcmp(munit_parameters_get(params, "transport"), "ktls") == 0;
+}
+
+// user and system cpu time of the process, server threads included
+static uint64_t
+cpu_time_ns(void)
+{
+    uv_rusage_t ru;
+    munit_assert_int(uv_getrusage(&ru), ==, 0);
+    return ((uint64_t)ru.ru_utime.tv_sec + (uint64_t)ru.ru_stime.tv_sec) * 1000000000ULL +
+           ((uint64_t)ru.ru_utime.tv_usec + (uint64_t)ru.ru_stime.tv_usec) * 1000ULL;
+}
+
+static pc_client_t *
+client_connect(bench_client_t *bc, local_server_t *server, const MunitParameter params[])
+{
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+    // Bodies go out as they are, measuring the transport instead of zlib.
+    config.disable_compression = 1;
+    if (use_tls(params)) {
+        config.transport_name = PC_TR_NAME_UV_TLS;
+        munit_assert_int(tr_uv_tls_set_ca_file(BENCH_FIXTURES_DIR "/myCA.pem", NULL), ==, PC_RC_OK);
+    }
+    config.tls_ktls = use_ktls(params);
+#ifdef TR_UV_URING_SUPPORTED
+    if (strcmp(munit_parameters_get(params, "transport"), "uring") == 0) {
+        config.transport_name = PC_TR_NAME_UV_URING;
+    }
+#endif
+
+    memset(bc, 0, sizeof(bench_client_t));
+    uv_sem_init(&bc->connected, 0);
+    uv_sem_init(&bc->responded, 0);
+
+    pc_client_init_result_t res = pc_client_init(bc, &config);
+    munit_assert_int(res.rc, ==, PC_RC_OK);
+
+    pc_client_add_ev_handler(res.client, event_cb, bc, NULL);
+    pc_client_set_push_handler(res.client, push_cb);
+    if (strcmp(munit_parameters_get(params, "transport"), "uds") == 0) {
+        char host[128];
+        munit_assert_not_null(local_server_unix_path(server));
+        snprintf(host, sizeof(host), PC_HOST_UNIX_PREFIX "%s", local_server_unix_path(server));
+        munit_assert_int(pc_client_connect(res.client, host, 0, NULL), ==, PC_RC_OK);
+    } else {
+        munit_assert_int(pc_client_connect(res.client, "127.0.0.1", local_server_port(server), NULL), ==, PC_RC_OK);
+    }
+    uv_sem_wait(&bc->connected);
+
+    return res.client;
+}
+
+static void
+client_close(bench_client_t *bc, pc_client_t *client)
+{
+    munit_assert_int(pc_client_disconnect(client), ==, PC_RC_OK);
+    munit_assert_int(pc_client_cleanup(client), ==, PC_RC_OK);
+    uv_sem_destroy(&bc->connected);
+    uv_sem_destroy(&bc->responded);
+}
+
+static char *
+make_payload(void)
+{
+    char *payload = (char*)malloc(BENCH_THROUGHPUT_PAYLOAD + 1);
+    bench_fill_json(payload, BENCH_THROUGHPUT_PAYLOAD);
+    payload[BENCH_THROUGHPUT_PAYLOAD] = '\0';
+    return payload;
+}
+
+// The cpu time covers the server too, so it compares transports rather than
+// measuring the client alone. offload tells whether the kernel encrypted the
+// client sends.
+static void
+log_throughput(const MunitParameter params[], const char *direction, uint64_t bytes, uint64_t elapsed_ns,
+               uint64_t cpu_ns, pc_client_t *client)
+{
+    pc_client_stats_t stats;
+    double secs = (double)elapsed_ns / 1e9;
+    double mib = (double)bytes / (1024.0 * 1024.0);
+
+    munit_assert_int(pc_client_stats(client, &stats), ==, PC_RC_OK);
+    munit_logf(MUNIT_LOG_INFO, "transport=%-4s %-8s %9.1f MiB in %6.2f s %9.1f MiB/s %7.2f cpu ms/MiB offload=%d",
+               munit_parameters_get(params, "transport"), direction, mib, secs,
+               secs > 0 ? mib / secs : 0.0,
+               mib > 0 ? (double)cpu_ns / 1e6 / mib : 0.0,
+               (int)stats.tls_ktls_tx);
+}
+
+// Uncompressed 1 MiB pushes received per second while the server sends them
+// back to back.
+static MunitResult
+test_download(const MunitParameter params[], void *fixture)
+{
+    Unused(fixture);
+
+    char *payload = make_payload();
+    local_server_t *server = local_server_start_ex(60, "bench.push", payload, BENCH_THROUGHPUT_PAYLOAD, 0,
+                                                   use_tls(params));
+    bench_client_t bc;
+    pc_client_t *client = client_connect(&bc, server, params);
+
+    uint64_t start = uv_hrtime();
+    uint64_t start_cpu = cpu_time_ns();
+    uint64_t start_bytes = bc.push_bytes;
+    uv_sleep(BENCH_THROUGHPUT_DOWNLOAD_SECS * 1000);
+    uint64_t bytes = bc.push_bytes - start_bytes;
+    uint64_t cpu = cpu_time_ns() - start_cpu;
+    uint64_t elapsed = uv_hrtime() - start;
+
+    munit_assert_uint64(bytes, >, 0);
+    log_throughput(params, "download", bytes, elapsed, cpu, client);
+
+    client_close(&bc, client);
+    local_server_stop(server);
+    free(payload);
+    return MUNIT_OK;
+}
+
+// 1 MiB requests sent all at once, until every response arrives.
+static MunitResult
+test_upload(const MunitParameter params[], void *fixture)
+{
+    Unused(fixture);
+
+    local_server_t *server = local_server_start_ex(60, NULL, NULL, 0, 0, use_tls(params));
+    bench_client_t bc;
+    pc_client_t *client = client_connect(&bc, server, params);
+    char *payload = make_payload();
+
+    uint64_t start = uv_hrtime();
+    uint64_t start_cpu = cpu_time_ns();
+    for (int i = 0; i < BENCH_THROUGHPUT_REQUESTS; ++i) {
+        munit_assert_int(pc_binary_request_with_timeout(client, "bench.upload", (uint8_t*)payload,
+                                                        BENCH_THROUGHPUT_PAYLOAD, &bc, BENCH_THROUGHPUT_TIMEOUT,
+                                                        request_cb, request_error_cb), ==, PC_RC_OK);
+    }
+    for (int i = 0; i < BENCH_THROUGHPUT_REQUESTS; ++i) {
+        uv_sem_wait(&bc.responded);
+    }
+    uint64_t cpu = cpu_time_ns() - start_cpu;
+    uint64_t elapsed = uv_hrtime() - start;
+
+    log_throughput(params, "upload", (uint64_t)BENCH_THROUGHPUT_REQUESTS * BENCH_THROUGHPUT_PAYLOAD, elapsed,
+                   cpu, client);
+
+    client_close(&bc, client);
+    local_server_stop(server);
+    free(payload);
+    return MUNIT_OK;
+}
+
+// Bursts of small notifies: TLS records and bytes on the wire per message.
+static MunitResult
+test_burst(const MunitParameter params[], void *fixture)
+{
+    Unused(fixture);
+
+    local_server_t *server = local_server_start_ex(60, NULL, NULL, 0, 0, use_tls(params));
+    bench_client_t bc;
+    pc_client_t *client = client_connect(&bc, server, params);
+    uint8_t body[BENCH_THROUGHPUT_BURST_BODY];
+    pc_client_stats_t before, after;
+
+    memset(body, 'x', sizeof(body));
+    munit_assert_int(pc_client_stats(client, &before), ==, PC_RC_OK);
+
+    uint64_t start = uv_hrtime();
+    for (int i = 0; i < BENCH_THROUGHPUT_BURSTS; ++i) {
+        for (int j = 0; j < BENCH_THROUGHPUT_BURST_MSGS; ++j) {
+            munit_assert_int(pc_binary_notify_with_timeout(client, "bench.notify", body, sizeof(body), NULL,
+                                                           BENCH_THROUGHPUT_TIMEOUT, notify_error_cb), ==, PC_RC_OK);
+        }
+        // writes keep their order, the response comes after the burst is sent
+        munit_assert_int(pc_binary_request_with_timeout(client, "bench.burst", body, sizeof(body), &bc,
+                                                        BENCH_THROUGHPUT_TIMEOUT, request_cb,
+                                                        request_error_cb), ==, PC_RC_OK);
+        uv_sem_wait(&bc.responded);
+    }
+    uint64_t elapsed = uv_hrtime() - start;
+
+    munit_assert_int(pc_client_stats(client, &after), ==, PC_RC_OK);
+    client_close(&bc, client);
+    local_server_stop(server);
+
+    double msgs = (double)BENCH_THROUGHPUT_BURSTS * (BENCH_THROUGHPUT_BURST_MSGS + 1);
+    munit_logf(MUNIT_LOG_INFO, "transport=%-4s burst    %6.3f records/msg %7.1f bytes/msg %6.2f writes/burst %8.1f ns/msg",
+               munit_parameters_get(params, "transport"),
+               (double)(after.tls_records - before.tls_records) / msgs,
+               (double)(after.socket_bytes - before.socket_bytes) / msgs,
+               (double)(after.socket_writes - before.socket_writes) / BENCH_THROUGHPUT_BURSTS,
+               (double)elapsed / msgs);
+    return MUNIT_OK;
+}
+
+// Small requests over many connections at once, one in flight on each: cpu
+// time and io_uring_enter calls per message. Every client has its own server,
+// which only takes one connection.
+static MunitResult
+test_many(const MunitParameter params[], void *fixture)
+{
+    Unused(fixture);
+
+    local_server_t *servers[BENCH_THROUGHPUT_CLIENTS];
+    bench_client_t bcs[BENCH_THROUGHPUT_CLIENTS];
+    pc_client_t *clients[BENCH_THROUGHPUT_CLIENTS];
+    uint8_t body[BENCH_THROUGHPUT_BURST_BODY];
+    uint64_t enters = 0;
+    pc_client_stats_t stats;
+
+    memset(body, 'x', sizeof(body));
+    for (int i = 0; i < BENCH_THROUGHPUT_CLIENTS; ++i) {
+        servers[i] = local_server_start_ex(60, NULL, NULL, 0, 0, use_tls(params));
+        clients[i] = client_connect(&bcs[i], servers[i], params);
+    }
+
+    uint64_t start = uv_hrtime();
+    uint64_t start_cpu = cpu_time_ns();
+    for (int r = 0; r < BENCH_THROUGHPUT_ROUNDS; ++r) {
+        for (int i = 0; i < BENCH_THROUGHPUT_CLIENTS; ++i) {
+            munit_assert_int(pc_binary_request_with_timeout(clients[i], "bench.many", body, sizeof(body), &bcs[i],
+                                                            BENCH_THROUGHPUT_TIMEOUT, request_cb,
+                                                            request_error_cb), ==, PC_RC_OK);
+        }
+        for (int i = 0; i < BENCH_THROUGHPUT_CLIENTS; ++i) {
+            uv_sem_wait(&bcs[i].responded);
+        }
+    }
+    uint64_t cpu = cpu_time_ns() - start_cpu;
+    uint64_t elapsed = uv_hrtime() - start;
+
+    for (int i = 0; i < BENCH_THROUGHPUT_CLIENTS; ++i) {
+        munit_assert_int(pc_client_stats(clients[i], &stats), ==, PC_RC_OK);
+        enters += stats.uring_enters;
+        client_close(&bcs[i], clients[i]);
+        local_server_stop(servers[i]);
+    }
+
+    double msgs = (double)BENCH_THROUGHPUT_ROUNDS * BENCH_THROUGHPUT_CLIENTS;
+    munit_logf(MUNIT_LOG_INFO, "transport=%-5s many     %d clients %8.1f cpu ns/msg %8.1f ns/msg %6.2f enters/msg",
+               munit_parameters_get(params, "transport"), BENCH_THROUGHPUT_CLIENTS,
+               (double)cpu / msgs, (double)elapsed / msgs, (double)enters / msgs);
+    return MUNIT_OK;
+}
+
+static int
+compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Small requests one after the other: the round trip of a message through
+// the client, the transport and the server.
+static MunitResult
+test_latency(const MunitParameter params[], void *fixture)
+{
+    Unused(fixture);
+
+    local_server_t *server = local_server_start_ex(60, NULL, NULL, 0, 0, use_tls(params));
+    bench_client_t bc;
+    pc_client_t *client = client_connect(&bc, server, params);
+    uint64_t *rtts = (uint64_t*)malloc(sizeof(uint64_t) * BENCH_THROUGHPUT_PINGS);
+    uint8_t body[BENCH_THROUGHPUT_BURST_BODY];
+    uint64_t total = 0;
+
+    memset(body, 'x', sizeof(body));
+    for (int i = 0; i < BENCH_THROUGHPUT_PINGS; ++i) {
+        uint64_t start = uv_hrtime();
+        munit_assert_int(pc_binary_request_with_timeout(client, "bench.ping", body, sizeof(body), &bc,
+                                                        BENCH_THROUGHPUT_TIMEOUT, request_cb,
+                                                        request_error_cb), ==, PC_RC_OK);
+        uv_sem_wait(&bc.responded);
+        rtts[i] = uv_hrtime() - start;
+        total += rtts[i];
+    }
+
+    client_close(&bc, client);
+    local_server_stop(server);
+
+    qsort(rtts, BENCH_THROUGHPUT_PINGS, sizeof(uint64_t), compare_u64);
+    munit_logf(MUNIT_LOG_INFO, "transport=%-5s latency  %8.1f us mean %8.1f us p50 %8.1f us p99",
+               munit_parameters_get(params, "transport"),
+               (double)total / BENCH_THROUGHPUT_PINGS / 1e3,
+               (double)rtts[BENCH_THROUGHPUT_PINGS / 2] / 1e3,
+               (double)rtts[BENCH_THROUGHPUT_PINGS * 99 / 100] / 1e3);
+    free(rtts);
+    return MUNIT_OK;
+}
+
+static MunitTest tests[] = {
+    {"/download", test_download, NULL, NULL, MUNIT_TEST_OPTION_NONE, g_params},
+    {"/upload", test_upload, NULL, NULL, MUNIT_TEST_OPTION_NONE, g_params},
+    {"/burst", test_burst, NULL, NULL, MUNIT_TEST_OPTION_NONE, g_params},
+    {"/many", test_many, NULL, NULL, MUNIT_TEST_OPTION_NONE, g_params},
+    {"/latency", test_latency, NULL, NULL, MUNIT_TEST_OPTION_NONE, g_params},
+    {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}
+};
+
+const MunitSuite throughput_bench_suite = {
+    "/throughput", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <pitaya.h>
+#include "bench_common.h"
+
+extern const MunitSuite compression_bench_suite;
+extern const MunitSuite dictionary_bench_suite;
+extern const MunitSuite codec_bench_suite;
+extern const MunitSuite offload_bench_suite;
+extern const MunitSuite prepared_bench_suite;
+extern const MunitSuite json_bench_suite;
+extern const MunitSuite throughput_bench_suite;
+extern const MunitSuite connect_bench_suite;
+extern const MunitSuite lossy_bench_suite;
+
+static const MunitSuite null_suite = {
+    NULL, NULL, NULL, 0, MUNIT_SUITE_OPTION_NONE
+};
+
+int main(int argc, char **argv)
+{
+    MunitSuite suites_array[] = {
+        compression_bench_suite,
+        dictionary_bench_suite,
+        codec_bench_suite,
+        offload_bench_suite,
+        prepared_bench_suite,
+        json_bench_suite,
+        throughput_bench_suite,
+        connect_bench_suite,
+        lossy_bench_suite,
+        // IMPORTANT: always has to end with a null suite
+        null_suite,
+    };
+
+    MunitSuite main_suite;
+    main_suite.prefix = "/bench";
+    main_suite.tests = NULL;
+    main_suite.suites = suites_array;
+    main_suite.iterations = 1;
+    main_suite.options = MUNIT_SUITE_OPTION_NONE;
+
+    pc_lib_client_info_t client_info;
+    client_info.platform = "bench";
+    client_info.build_number = "1";
+    client_info.version = "1.0";
+
+    pc_lib_init(NULL, NULL, NULL, NULL, client_info);
+    pc_lib_set_default_log_level(PC_LOG_DISABLE);
+
+    int ret = munit_suite_main(&main_suite, NULL, argc, argv);
+
+    pc_lib_cleanup();
+    return ret;
+}
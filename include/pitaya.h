@@ -88,6 +88,20 @@ typedef struct pc_notify_s pc_notify_t;
  */
 #define PC_TR_NAME_UV_TCP 0
 #define PC_TR_NAME_UV_TLS 1
+/* tcp through io_uring, only registered on Linux */
+#define PC_TR_NAME_UV_URING 2
+/*
+ * websocket, plain or over tls, for the websocket acceptor of pitaya. The
+ * connection is upgraded with a GET of "/" and packages go in binary frames.
+ */
+#define PC_TR_NAME_UV_WS 3
+#define PC_TR_NAME_UV_WSS 4
+/*
+ * reliable udp, the ARQ of KCP in stream mode carrying the packages, for
+ * servers with a KCP acceptor. Tuned with the kcp_* fields of
+ * pc_client_config_t.
+ */
+#define PC_TR_NAME_UV_KCP 5
 #define PC_TR_NAME_DUMMY 7
 
 /**
@@ -121,6 +135,32 @@ PC_EXPORT void pc_buf_free(pc_buf_t *buf);
 PC_EXPORT pc_buf_t pc_buf_from_string(const char *str);
 PC_EXPORT void pc_buf_debug_print(const pc_buf_t *buf);
 
+/**
+ * Lazily decompressed bodies
+ *
+ * When `lazy_decompression` is set in pc_client_config_t, the payload given
+ * to the response and push callbacks is the body as received, which may be
+ * compressed. pc_body_from_payload returns the handle holding it, which can
+ * only be used for such payloads and only during the callback.
+ */
+typedef struct pc_body_s pc_body_t;
+
+PC_EXPORT const pc_body_t* pc_body_from_payload(const pc_buf_t *payload);
+PC_EXPORT int pc_body_is_compressed(const pc_body_t *body);
+
+/**
+ * The body as received, compressed if pc_body_is_compressed.
+ */
+PC_EXPORT const pc_buf_t *pc_body_raw(const pc_body_t *body);
+
+/**
+ * Writes the decompressed body into `buf` and its size into `*len`.
+ * If it does not fit in `cap` bytes, returns PC_RC_INVALID_ARG with the
+ * size needed in `*len`, so a NULL `buf` can be used to query the size.
+ * Returns PC_RC_ERROR if the body can not be decompressed.
+ */
+PC_EXPORT int pc_body_read(const pc_body_t *body, uint8_t *buf, size_t cap, size_t *len);
+
 /**
  * Push
  */
@@ -145,6 +185,143 @@ typedef struct {
     int transport_name;
     
     int disable_compression;
+
+    /**
+     * Compression policy, 0 selects the default of each field.
+     *
+     * compression_level - zlib level (1-9) used to compress message bodies.
+     * compression_min_size - bodies smaller than this many bytes are sent uncompressed.
+     * compression_min_savings - percentage of bytes compression has to save,
+     *                           otherwise the body is sent uncompressed.
+     */
+    int compression_level;
+    int compression_min_size;
+    int compression_min_savings;
+
+    /**
+     * Comma separated list of codecs offered to the server in the handshake,
+     * most preferred first, e.g. "lz4,zlib". NULL only uses zlib, which is
+     * also used when the server does not pick any of them. The string must
+     * outlive the client.
+     */
+    const char* compression_codecs;
+
+    /**
+     * Bodies of at least this many bytes are compressed and decompressed on
+     * the libuv thread pool instead of the calling thread and the network
+     * thread, so large messages do not stall heartbeats and smaller messages.
+     * 0 disables it.
+     */
+    int compression_offload_min_size;
+
+    /**
+     * Compressed response and push bodies are handed to the callbacks as
+     * received and only decompressed when the application reads them, see
+     * pc_body_from_payload.
+     */
+    int lazy_decompression;
+
+    /**
+     * Host name resolution, whose results are cached for all the clients of
+     * the process. 0 selects the default of each field.
+     *
+     * dns_cache_ttl - seconds a resolved host is reused for (60), it is
+     *                 refreshed in the background shortly before expiring.
+     *                 Negative disables the cache for this client.
+     * dns_negative_ttl - seconds a failed resolution is remembered for (5).
+     *                    Negative disables it.
+     * dns_preresolve_hosts - NULL terminated list of hosts pc_client_init
+     *                        starts resolving in the background, so that
+     *                        the first connect finds them in the cache.
+     *                        Only read by pc_client_init.
+     */
+    int dns_cache_ttl;
+    int dns_negative_ttl;
+    const char* const* dns_preresolve_hosts;
+
+    /**
+     * When the host resolves to several addresses, they are raced as in
+     * RFC 8305 (Happy Eyeballs): the next address, alternating between IPv6
+     * and IPv4, is tried every `conn_attempt_delay` milliseconds, or as soon
+     * as an attempt fails, until one connects. 0 selects the default of
+     * 250 ms, negative only tries the first address.
+     */
+    int conn_attempt_delay;
+
+    /**
+     * Socket options of the connections, 0 leaves the system default of
+     * each one. Options the platform does not have are ignored, the values
+     * the system applied are reported by pc_client_stats.
+     *
+     * sock_sndbuf, sock_rcvbuf - send and receive buffer sizes, in bytes.
+     * tcp_keepalive - seconds a connection stays idle before keepalive
+     *                 probes are sent (60), negative disables keepalive.
+     * tcp_keepalive_interval - seconds between keepalive probes.
+     * tcp_notsent_lowat - bytes of unsent data the kernel takes before the
+     *                     socket stops being writable (TCP_NOTSENT_LOWAT),
+     *                     so later writes wait in the client instead of
+     *                     piling up in the kernel.
+     * tcp_quickack - acknowledge received data right away instead of
+     *                delaying the acks (TCP_QUICKACK, Linux).
+     * sock_busy_poll - microseconds reads busy poll the device for data
+     *                  (SO_BUSY_POLL, Linux).
+     * tcp_user_timeout - milliseconds sent data may stay unacknowledged
+     *                    before the connection is dropped (TCP_USER_TIMEOUT,
+     *                    Linux), detecting a dead server sooner than missed
+     *                    heartbeats do.
+     */
+    int sock_sndbuf;
+    int sock_rcvbuf;
+    int tcp_keepalive;
+    int tcp_keepalive_interval;
+    int tcp_notsent_lowat;
+    int tcp_quickack;
+    int sock_busy_poll;
+    int tcp_user_timeout;
+
+    /**
+     * TLS connections hand the encryption of what they send to the kernel
+     * once the handshake is done (kTLS, Linux with OpenSSL 3), so writes
+     * take the plain tcp path. Where the kernel, the cipher or the OpenSSL
+     * build can not, OpenSSL goes on encrypting. Decryption stays in
+     * OpenSSL. pc_client_stats tells whether the connection is offloaded.
+     */
+    int tls_ktls;
+
+    /**
+     * TLS reconnects resuming a TLS 1.3 session the server allows early
+     * data for send the handshake package with the ClientHello (0-RTT),
+     * saving a round trip. Nothing else goes early, as early data may be
+     * replayed and the handshake package is the only one that does no harm
+     * twice. When the server rejects it, the package goes again once the
+     * tls handshake is done.
+     */
+    int tls_early_data;
+
+    /**
+     * How aggressive the reliable udp transport is, see PC_TR_NAME_UV_KCP.
+     * 0 selects the default of each field, the normal mode of KCP. Its fast
+     * mode is nodelay 1, interval 10, fast resend 2 and no_cwnd 1.
+     *
+     * kcp_nodelay - 1 lowers the least retransmission timeout from 100 to
+     *               30 ms and grows it by half on each timeout instead of
+     *               doubling it, 2 grows it by half the round trip time.
+     * kcp_interval - milliseconds between flushes while data is in flight
+     *                (100, 10 to 5000), which also bounds the timeout.
+     * kcp_fast_resend - a segment is sent again, without waiting for its
+     *                   timeout, once acks of this many segments sent
+     *                   after it arrived. 0 disables it.
+     * kcp_no_cwnd - ignore the congestion window, only the send and the
+     *               receive windows bound what is in flight.
+     * kcp_snd_wnd, kcp_rcv_wnd - windows, in segments of up to 1376
+     *                            bytes (32 and 128).
+     */
+    int kcp_nodelay;
+    int kcp_interval;
+    int kcp_fast_resend;
+    int kcp_no_cwnd;
+    int kcp_snd_wnd;
+    int kcp_rcv_wnd;
 } pc_client_config_t;
 
 #define PC_CLIENT_CONFIG_DEFAULT                      \
@@ -159,7 +336,33 @@ typedef struct {
     NULL, /* local_storage_cb */                      \
     NULL, /* ls_ex_data */                            \
     PC_TR_NAME_UV_TCP, /* transport_name */           \
-    0 /* disable_compression */                       \
+    0, /* disable_compression */                      \
+    0, /* compression_level */                        \
+    0, /* compression_min_size */                     \
+    0, /* compression_min_savings */                  \
+    NULL, /* compression_codecs */                    \
+    0, /* compression_offload_min_size */             \
+    0, /* lazy_decompression */                       \
+    0, /* dns_cache_ttl */                            \
+    0, /* dns_negative_ttl */                         \
+    NULL, /* dns_preresolve_hosts */                  \
+    0, /* conn_attempt_delay */                       \
+    0, /* sock_sndbuf */                              \
+    0, /* sock_rcvbuf */                              \
+    0, /* tcp_keepalive */                            \
+    0, /* tcp_keepalive_interval */                   \
+    0, /* tcp_notsent_lowat */                        \
+    0, /* tcp_quickack */                             \
+    0, /* sock_busy_poll */                           \
+    0, /* tcp_user_timeout */                         \
+    0, /* tls_ktls */                                 \
+    0, /* tls_early_data */                           \
+    0, /* kcp_nodelay */                              \
+    0, /* kcp_interval */                             \
+    0, /* kcp_fast_resend */                          \
+    0, /* kcp_no_cwnd */                              \
+    0, /* kcp_snd_wnd */                              \
+    0 /* kcp_rcv_wnd */                               \
 }
 
 PC_EXPORT int pc_lib_version(void);
@@ -212,7 +415,67 @@ typedef struct {
 
 PC_EXPORT size_t pc_client_size(void);
 PC_EXPORT pc_client_init_result_t pc_client_init(void* ex_data, const pc_client_config_t* config);
+
+/**
+ * Like pc_client_init, but places the client in `mem` instead of allocating
+ * it. `mem` must be at least pc_client_size() bytes, aligned as malloc would
+ * align it, and outlive the client: pc_client_cleanup leaves it to the
+ * caller to free. The transport is still allocated by its plugin.
+ * Fails with PC_RC_INVALID_ARG if `mem` is NULL or too small.
+ */
+PC_EXPORT pc_client_init_result_t pc_client_init_inplace(void* mem, size_t size, void* ex_data,
+                                                         const pc_client_config_t* config);
+
+/**
+ * `host` may also be PC_HOST_UNIX_PREFIX followed by the path of a unix
+ * domain socket, e.g. "unix:/run/gateway.sock", to reach a server on the
+ * same host without the tcp stack. `port` is then ignored. Not on Windows.
+ */
+#define PC_HOST_UNIX_PREFIX "unix:"
+
 PC_EXPORT int pc_client_connect(pc_client_t* client, const char* host, int port, const char* handshake_opts);
+
+/**
+ * Several endpoints serving the same application, e.g. one per frontend.
+ */
+#define PC_MAX_ENDPOINTS 16
+
+typedef struct {
+    const char* host;
+    int port;
+    int weight; /* share of the connects among healthy endpoints, 0 is 1 */
+} pc_endpoint_t;
+
+/**
+ * Same as pc_client_connect, connecting to one of `count` endpoints, which
+ * are copied.
+ *
+ * Each endpoint keeps a health score out of its connect latency, heartbeat
+ * rtt and failed connects and handshakes in a row. Connects and reconnects
+ * go to a healthy endpoint, picked according to the weights and the scores.
+ * An endpoint that fails is backed off, for reconn_delay doubled with each
+ * failure in a row up to reconn_delay_max, and the reconnect fails over to
+ * another healthy endpoint at once. Once every endpoint is backed off the
+ * client waits for the first one to be healthy again. Each failover counts
+ * as a retry of reconn_max_retry.
+ */
+PC_EXPORT int pc_client_connect_endpoints(pc_client_t* client, const pc_endpoint_t* endpoints, int count,
+                                          const char* handshake_opts);
+
+typedef struct {
+    int score;          /* lower is better, -1 while the endpoint is backed off */
+    int connect_ms;     /* average tcp connect latency, -1 if it never connected */
+    int rtt_ms;         /* average heartbeat rtt, -1 if unknown */
+    int failures;       /* failed connects and handshakes in a row */
+    uint64_t connects;  /* completed handshakes */
+    int current;        /* 1 for the endpoint the client is using or trying */
+} pc_endpoint_health_t;
+
+/**
+ * Fills `health` with the health of the endpoint `index` given to
+ * pc_client_connect_endpoints.
+ */
+PC_EXPORT int pc_client_endpoint_health(pc_client_t* client, int index, pc_endpoint_health_t* health);
 PC_EXPORT int pc_client_disconnect(pc_client_t* client);
 PC_EXPORT int pc_client_cleanup(pc_client_t* client);
 PC_EXPORT int pc_client_poll(pc_client_t* client);
@@ -230,6 +493,82 @@ PC_EXPORT const char *pc_client_serializer(pc_client_t *client);
 // Free serializer
 PC_EXPORT void pc_client_free_serializer(const char *serializer);
 
+/**
+ * Client statistics
+ */
+typedef struct {
+    /* compression of sent message bodies */
+    uint64_t compress_msgs;          /* bodies sent compressed */
+    uint64_t compress_skipped;       /* bodies the compression policy did not try to compress */
+    uint64_t compress_rejected;      /* bodies compressed but sent as is for not saving enough */
+    uint64_t compress_time_us;       /* time spent compressing */
+    uint64_t compress_bytes_saved;
+    uint64_t compress_dict_msgs;     /* bodies compressed with a preset dictionary */
+
+    /* decompression of received message bodies */
+    uint64_t decompress_msgs;
+    uint64_t decompress_time_us;
+    uint64_t decompress_bytes_saved; /* bytes not transferred thanks to compression */
+
+    uint64_t offload_msgs;           /* bodies (de)compressed on the thread pool */
+
+    /* host name resolution of connects and reconnects */
+    uint64_t dns_lookups;            /* host names sent to the resolver */
+    uint64_t dns_cache_hits;         /* connects that reused a cached resolution */
+
+    /* connection setup */
+    uint64_t conn_attempts;          /* tcp connects started, racing ones included */
+    uint64_t last_conn_setup_us;     /* connect to tcp connected of the last connection, lookup included */
+    uint64_t endpoint_failovers;     /* reconnects that moved to another endpoint */
+
+    uint64_t socket_writes;          /* writes handed to the socket, each one a batch of packets */
+    uint64_t first_send_us;          /* pc_client_connect to the first request or notify on the wire */
+
+    /* socket options of the last connection as applied, 0 if left alone, see pc_client_config_t */
+    uint64_t sock_sndbuf;
+    uint64_t sock_rcvbuf;
+    uint64_t tcp_keepalive;
+    uint64_t tcp_keepalive_interval;
+    uint64_t tcp_notsent_lowat;
+    uint64_t tcp_quickack;
+    uint64_t sock_busy_poll;
+    uint64_t tcp_user_timeout;
+
+    /* tls handshakes, full ones and those resuming a cached session, 0 for tcp */
+    uint64_t tls_full_handshakes;
+    uint64_t tls_resumed_handshakes;
+
+    uint64_t socket_bytes;           /* bytes handed to the socket, tls record overhead included */
+    uint64_t tls_records;            /* tls records of application data written, 0 for tcp */
+    uint64_t tls_ktls_tx;            /* 1 if the kernel encrypts what the connection sends, see tls_ktls */
+
+    uint64_t last_handshake_us;      /* tcp connected to the handshake response of the last connection */
+    uint64_t tls_early_data_accepted; /* handshake packages the server took as early data, see tls_early_data */
+    uint64_t tls_early_data_rejected;
+
+    /* io_uring transport, 0 for the others */
+    uint64_t uring_active;           /* 1 if the connection reads and writes through io_uring */
+    uint64_t uring_enters;           /* io_uring_enter calls, each one submitting a receive or a write */
+
+    /* websocket transports, 0 for the others */
+    uint64_t ws_frames_sent;         /* frames written, control frames included */
+    uint64_t ws_frames_recv;         /* frames read, control frames and continuations included */
+    uint64_t ws_pings;               /* pings of the server answered with a pong */
+
+    /* reliable udp transport, 0 for the others */
+    uint64_t kcp_segs_sent;          /* data segments sent, those sent again included */
+    uint64_t kcp_retransmits;        /* segments sent again after their timeout */
+    uint64_t kcp_fast_resends;       /* segments sent again after acks of later ones, see kcp_fast_resend */
+    uint64_t kcp_dropped;            /* datagrams read that were not of the conversation or malformed */
+    uint64_t kcp_srtt_ms;            /* smoothed round trip time of the last connection */
+} pc_client_stats_t;
+
+/**
+ * Fills `stats` with the counters of the client since it was initialized.
+ * Returns PC_RC_ERROR if the transport does not keep statistics.
+ */
+PC_EXPORT int pc_client_stats(pc_client_t* client, pc_client_stats_t* stats);
+
 /**
  * Event
  */
@@ -277,6 +616,75 @@ typedef struct {
     int uv_code;
 } pc_error_t;
 
+/**
+ * Per message options
+ */
+
+/**
+ * compression modes
+ */
+#define PC_COMPRESSION_AUTO 0   /* follow the client compression policy */
+#define PC_COMPRESSION_ALWAYS 1 /* compress whenever it makes the body smaller */
+#define PC_COMPRESSION_NEVER 2
+
+/**
+ * Streaming responses
+ *
+ * When `chunk_cb` is set or `chunk_fd` is a file descriptor, not -1, the
+ * body of a successful response is not buffered in memory: it is
+ * decompressed as it arrives and handed in chunks to `chunk_cb` and/or
+ * written to `chunk_fd`. Chunks are delivered from the network thread, even
+ * with polling enabled, in order. Writes to `chunk_fd` run on the libuv
+ * thread pool one after the other, chunks waiting in memory for a slow
+ * descriptor meanwhile. Once the whole body is delivered and written the
+ * success callback is called with an empty payload.
+ *
+ * If `chunk_cb` returns non zero or writing to `chunk_fd` fails, the rest of
+ * the body is discarded and the request fails with PC_RC_ERROR. Error
+ * responses are delivered to the error callback as usual.
+ *
+ * Bodies compressed with a codec other than zlib are decompressed at once
+ * and handed as a single chunk.
+ */
+typedef int (*pc_request_chunk_cb_t)(const pc_request_t* req, const uint8_t* chunk, size_t len);
+
+/**
+ * Caller supplied response buffers
+ *
+ * When `resp_buf` is set, the body of a successful response is decoded, and
+ * decompressed if needed, straight into it as long as it fits in
+ * `resp_buf_cap` bytes. When it does not fit, or there is no `resp_buf`,
+ * `resp_alloc` is asked for memory for the body, e.g. from an arena reached
+ * through the request ex_data. It is called from the network thread and may
+ * return NULL.
+ *
+ * In the success callback pc_request_resp_fits tells whether `resp` is in
+ * that caller memory. If it is not, `resp` is the usual buffer of the
+ * library, only valid during the callback.
+ *
+ * Ignored with lazy decompression, as bodies are read with pc_body_read.
+ */
+typedef void* (*pc_request_alloc_cb_t)(const pc_request_t* req, size_t size);
+
+typedef struct {
+    int compression;
+    pc_request_chunk_cb_t chunk_cb;
+    int chunk_fd;
+    uint8_t* resp_buf;
+    size_t resp_buf_cap;
+    pc_request_alloc_cb_t resp_alloc;
+} pc_request_opts_t;
+
+#define PC_REQUEST_OPTS_DEFAULT                       \
+{                                                     \
+    PC_COMPRESSION_AUTO, /* compression */            \
+    NULL, /* chunk_cb */                              \
+    -1, /* chunk_fd */                                \
+    NULL, /* resp_buf */                              \
+    0, /* resp_buf_cap */                             \
+    NULL, /* resp_alloc */                            \
+}
+
 /**
  * Request
  */
@@ -297,6 +705,7 @@ PC_EXPORT const char* pc_request_route(const pc_request_t* req);
 PC_EXPORT const char* pc_request_msg(const pc_request_t* req);
 PC_EXPORT int pc_request_timeout(const pc_request_t* req);
 PC_EXPORT void* pc_request_ex_data(const pc_request_t* req);
+PC_EXPORT int pc_request_resp_fits(const pc_request_t* req);
 
 /**
  * Initiate a request.
@@ -309,6 +718,19 @@ PC_EXPORT int pc_binary_request_with_timeout(pc_client_t* client, const char* ro
                                              uint8_t *data, int64_t len, void* ex_data, int timeout,
                                              pc_request_success_cb_t success_cb, pc_request_error_cb_t error_cb);
 
+/**
+ * Same as above, `opts` may be NULL to use the default options.
+ */
+PC_EXPORT int pc_string_request_with_opts(pc_client_t* client, const char* route,
+                                          const char *str, void* ex_data, int timeout,
+                                          const pc_request_opts_t* opts,
+                                          pc_request_success_cb_t success_cb, pc_request_error_cb_t error_cb);
+
+PC_EXPORT int pc_binary_request_with_opts(pc_client_t* client, const char* route,
+                                          uint8_t *data, int64_t len, void* ex_data, int timeout,
+                                          const pc_request_opts_t* opts,
+                                          pc_request_success_cb_t success_cb, pc_request_error_cb_t error_cb);
+
 /**
  * Notify
  */
@@ -337,6 +759,48 @@ PC_EXPORT int pc_binary_notify_with_timeout(pc_client_t* client, const char* rou
 PC_EXPORT int pc_string_notify_with_timeout(pc_client_t* client, const char* route, const char *str, 
                                             void* ex_data, int timeout, pc_notify_error_cb_t cb);
 
+/**
+ * Same as above, `opts` may be NULL to use the default options.
+ */
+PC_EXPORT int pc_binary_notify_with_opts(pc_client_t* client, const char* route, uint8_t *data, int64_t len,
+                                         void* ex_data, int timeout, const pc_request_opts_t* opts,
+                                         pc_notify_error_cb_t cb);
+PC_EXPORT int pc_string_notify_with_opts(pc_client_t* client, const char* route, const char *str,
+                                         void* ex_data, int timeout, const pc_request_opts_t* opts,
+                                         pc_notify_error_cb_t cb);
+
+/**
+ * Prepared messages
+ *
+ * A route and body sent many times, by one or many clients, can be prepared
+ * once: the body is copied and, on the first send, encoded together with the
+ * route into an immutable wire image, compressed with zlib according to
+ * `opts->compression` (PC_COMPRESSION_AUTO compresses bodies of 64 bytes or
+ * more that shrink by at least 10%). Each send then only encodes the
+ * message id in front of the shared image.
+ *
+ * The route is always sent as a string, as route dictionaries are per
+ * client. Clients that can not send the image as is, because they
+ * negotiated a codec other than zlib or, unless the mode is
+ * PC_COMPRESSION_ALWAYS, disabled compression, send the body as a regular
+ * message.
+ *
+ * The remaining options of `opts` apply to every request sent with the
+ * prepared message. Prepared messages are reference counted, pending sends
+ * keep them alive, so they may be released right after being sent.
+ */
+typedef struct pc_prepared_msg_s pc_prepared_msg_t;
+
+PC_EXPORT pc_prepared_msg_t* pc_prepared_msg_new(const char* route, const uint8_t* data, int64_t len,
+                                                 const pc_request_opts_t* opts);
+PC_EXPORT void pc_prepared_msg_release(pc_prepared_msg_t* msg);
+
+PC_EXPORT int pc_prepared_request_with_timeout(pc_client_t* client, pc_prepared_msg_t* msg,
+                                               void* ex_data, int timeout,
+                                               pc_request_success_cb_t success_cb, pc_request_error_cb_t error_cb);
+PC_EXPORT int pc_prepared_notify_with_timeout(pc_client_t* client, pc_prepared_msg_t* msg,
+                                              void* ex_data, int timeout, pc_notify_error_cb_t cb);
+
 /**
  * Utilities
  */
@@ -344,6 +808,16 @@ PC_EXPORT const char* pc_client_state_str(int state);
 PC_EXPORT const char* pc_client_ev_str(int ev_type);
 PC_EXPORT const char* pc_client_rc_str(int rc);
 
+#if !defined(PC_NO_UV_TCP_TRANS)
+
+/**
+ * Forgets every host name resolution cached by the tcp and tls transports,
+ * e.g. after the device switched networks.
+ */
+PC_EXPORT void tr_uv_tcp_clear_dns_cache(void);
+
+#endif /* uv_tcp */
+
 /**
  * set ca file for tls transports
  */
@@ -357,6 +831,14 @@ PC_EXPORT const char* pc_client_rc_str(int rc);
  */
 PC_EXPORT int tr_uv_tls_set_ca_file(const char* ca_file, const char* ca_path);
 
+/**
+ * Forgets the TLS sessions cached to resume handshakes on reconnects, so
+ * the next handshake to each server is a full one. Sessions are stored per
+ * host and port, shared by every client, and also written to the local
+ * storage of a client, which reloads them on pc_client_init.
+ */
+PC_EXPORT void tr_uv_tls_clear_session_cache(void);
+
 #endif /* uv_tls */
 
 /**
@@ -39,6 +39,28 @@ struct pc_transport_s {
     void* (*internal_data)(pc_transport_t* trans); /* optional */
     int (*quality)(pc_transport_t* trans); /* optional */
     pc_transport_plugin_t* (*plugin)(pc_transport_t* trans);
+
+    /**
+     * same as send, with the options given to the request or notify. opts may be NULL.
+     */
+    int (*send_with_opts)(pc_transport_t* trans, const char* route, unsigned int seq_num,
+                          pc_buf_t buf, unsigned int req_id, int timeout,
+                          const pc_request_opts_t* opts); /* optional */
+    int (*stats)(pc_transport_t* trans, pc_client_stats_t* stats); /* optional */
+
+    /**
+     * sends a prepared message, the transport keeps a reference to it until
+     * it is written. Without it the body is sent with send_with_opts.
+     */
+    int (*send_prepared)(pc_transport_t* trans, pc_prepared_msg_t* msg, unsigned int seq_num,
+                         unsigned int req_id, int timeout); /* optional */
+
+    /**
+     * same as connect, to one of several endpoints, see pc_client_connect_endpoints.
+     */
+    int (*connect_endpoints)(pc_transport_t* trans, const pc_endpoint_t* endpoints, int count,
+                             const char* handshake_opt); /* optional */
+    int (*endpoint_health)(pc_transport_t* trans, int index, pc_endpoint_health_t* health); /* optional */
 };
 
 struct pc_transport_plugin_s {
@@ -74,6 +96,25 @@ PC_EXPORT void pc_trans_sent(pc_client_t* client, unsigned int seq_num, const pc
  */
 PC_EXPORT void pc_trans_resp(pc_client_t* client, unsigned int req_id, const pc_buf_t *resp, const pc_error_t *error);
 
+/**
+ * when a chunk of a streamed response body is received, transport impl should
+ * invoke this function before the final pc_trans_resp. Returns PC_RC_NOT_FOUND
+ * if the request is gone and PC_RC_ERROR if its chunk callback failed.
+ */
+PC_EXPORT int pc_trans_resp_chunk(pc_client_t* client, unsigned int req_id, const uint8_t *chunk, size_t len);
+
+/**
+ * Caller memory to decode the response body of a request into, see
+ * pc_request_opts_t. pc_trans_resp_buf returns the caller buffer and its
+ * capacity, to decompress into it before knowing the body size.
+ * pc_trans_resp_alloc returns memory for a body of `size` bytes, the caller
+ * buffer if it fits, or else from the caller allocator. Both return NULL
+ * when there is no such memory. Bodies decoded into it are given to
+ * pc_trans_resp as usual.
+ */
+PC_EXPORT uint8_t* pc_trans_resp_buf(pc_client_t* client, unsigned int req_id, size_t* cap);
+PC_EXPORT uint8_t* pc_trans_resp_alloc(pc_client_t* client, unsigned int req_id, size_t size);
+
 
 #ifdef __cplusplus
 }
@@ -23,6 +23,8 @@ MOCK_SERVERS = [
     ('mock-timeout-server.js', 'mock-timeout-server-log'),
     ('mock-destroy-socket-server.js', 'mock-destroy-socket-server-log'),
     ('mock-kill-client-server.js', 'mock-kill-client-server-log'),
+    ('mock-websocket-server.js', 'mock-websocket-server-log'),
+    ('mock-kcp-server.js', 'mock-kcp-server-log'),
 ]
 
 mock_server_processes = []
@@ -34,6 +34,19 @@
 #include <stdlib.h>
 #include <float.h>
 #include <limits.h>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PC_JSON_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define PC_JSON_NEON 1
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 #include "pc_JSON.h"
 
@@ -67,13 +80,100 @@ void pc_JSON_InitHooks(pc_JSON_Hooks* hooks)
     pc_JSON_free     = (hooks->free_fn)?hooks->free_fn:free;
 }
 
+/* Arena for read-only trees: items and strings are bumped out of chained blocks, the first of which starts with the root. */
+typedef struct pc_JSON_Block {struct pc_JSON_Block *next;size_t size,used;double align;} pc_JSON_Block;
+typedef struct pc_JSON_Arena {pc_JSON_Block *head,*tail;} pc_JSON_Arena;
+
+#define PC_JSON_ARENA_MIN_BLOCK 4096
+#define PC_JSON_ARENA_MAX_BLOCK (64*1024)    /* Kept under the usual mmap threshold so blocks are recycled by malloc. */
+
+static pc_JSON_Block *arena_block(size_t size)
+{
+    pc_JSON_Block *b=(pc_JSON_Block*)pc_JSON_malloc(sizeof(pc_JSON_Block)+size);
+    if (b) {b->next=0;b->size=size;b->used=0;}
+    return b;
+}
+
+static void *arena_alloc(pc_JSON_Arena *a,size_t sz)
+{
+    pc_JSON_Block *b=a->tail;void *p;
+    sz=(sz+sizeof(double)-1)&~(sizeof(double)-1);
+    if (b->size-b->used<sz)
+    {
+        size_t size=b->size*2<PC_JSON_ARENA_MAX_BLOCK?b->size*2:PC_JSON_ARENA_MAX_BLOCK;
+        if (!(b=arena_block(size>sz?size:sz))) return 0;
+        a->tail->next=b;a->tail=b;
+    }
+    p=(char*)(b+1)+b->used;b->used+=sz;
+    return p;
+}
+
+static void *json_alloc(pc_JSON_Arena *a,size_t sz) {return a?arena_alloc(a,sz):pc_JSON_malloc(sz);}
+
 /* Internal constructor. */
-static pc_JSON *pc_JSON_New_Item(void)
+static pc_JSON *json_new_item(pc_JSON_Arena *a)
 {
-    pc_JSON* node = (pc_JSON*)pc_JSON_malloc(sizeof(pc_JSON));
+    pc_JSON* node = (pc_JSON*)json_alloc(a,sizeof(pc_JSON));
     if (node) memset(node,0,sizeof(pc_JSON));
     return node;
 }
+static pc_JSON *pc_JSON_New_Item(void) {return json_new_item(0);}
+
+/* Hash index of an object's children: open addressing over a power of two table, the first of duplicate names wins. */
+typedef struct pc_JSON_Index {unsigned mask;pc_JSON *slots[1];} pc_JSON_Index;
+
+static unsigned index_hash(const char *str)
+{
+    unsigned h=2166136261u;
+    while (*str) h=(h^(unsigned char)*str++)*16777619u;
+    return h;
+}
+
+static pc_JSON_Index *index_build(const pc_JSON *object)
+{
+    pc_JSON_Index *idx;pc_JSON *c,*s;unsigned n=0,size=2,i;
+    for (c=object->child;c;c=c->next) n++;
+    while (size<n*2) size<<=1;
+    if (!(idx=(pc_JSON_Index*)pc_JSON_malloc(sizeof(pc_JSON_Index)+(size-1)*sizeof(pc_JSON*)))) return 0;
+    memset(idx->slots,0,size*sizeof(pc_JSON*));idx->mask=size-1;
+    for (c=object->child;c;c=c->next)
+    {
+        if (!c->string) continue;
+        for (i=index_hash(c->string)&idx->mask;(s=idx->slots[i]) && strcmp(s->string,c->string);i=(i+1)&idx->mask);
+        if (!s) idx->slots[i]=c;
+    }
+    return idx;
+}
+
+static pc_JSON *index_find(const pc_JSON_Index *idx,const char *string)
+{
+    pc_JSON *s;unsigned i;
+    for (i=index_hash(string)&idx->mask;(s=idx->slots[i]) && strcmp(s->string,string);i=(i+1)&idx->mask);
+    return s;
+}
+
+/* Lookups may race to build the index of a shared object, so it is read with acquire and published with a CAS. */
+static pc_JSON_Index *index_load(pc_JSON_Index *const *slot)
+{
+#if defined(_MSC_VER)
+    return (pc_JSON_Index*)_InterlockedCompareExchangePointer((void *volatile *)slot,0,0);
+#else
+    return __atomic_load_n(slot,__ATOMIC_ACQUIRE);
+#endif
+}
+
+static int index_publish(pc_JSON_Index **slot,pc_JSON_Index *idx)
+{
+#if defined(_MSC_VER)
+    return _InterlockedCompareExchangePointer((void *volatile *)slot,idx,0)==0;
+#else
+    pc_JSON_Index *expected=0;
+    return __atomic_compare_exchange_n(slot,&expected,idx,0,__ATOMIC_ACQ_REL,__ATOMIC_ACQUIRE);
+#endif
+}
+
+/* Changes to the children of an object make its index stale. */
+static void index_drop(pc_JSON *object) {if (object->index) {pc_JSON_free(object->index);object->index=0;}}
 
 /* Delete a pc_JSON structure. */
 void pc_JSON_Delete(pc_JSON *c)
@@ -85,11 +185,23 @@ void pc_JSON_Delete(pc_JSON *c)
         if (!(c->type&pc_JSON_IsReference) && c->child) pc_JSON_Delete(c->child);
         if (!(c->type&pc_JSON_IsReference) && c->valuestring) pc_JSON_free(c->valuestring);
         if (c->string) pc_JSON_free(c->string);
+        index_drop(c);
         pc_JSON_free(c);
         c=next;
     }
 }
 
+/* Indexes are built after parsing, so they live outside the arena. */
+static void arena_drop_indexes(pc_JSON *c) {for (;c;c=c->next) {index_drop(c);arena_drop_indexes(c->child);}}
+
+void pc_JSON_DeleteArena(pc_JSON *root)
+{
+    pc_JSON_Block *b,*next;
+    if (!root) return;
+    arena_drop_indexes(root);
+    for (b=(pc_JSON_Block*)root-1;b;b=next) {next=b->next;pc_JSON_free(b);}
+}
+
 /* Parse the input text to generate a number, and populate the result into item. */
 static const char *parse_number(pc_JSON *item,const char *num)
 {
@@ -135,6 +247,78 @@ static char *print_number(const pc_JSON *item)
     return str;
 }
 
+/* Scanners for the two hot loops of the parser. The vector versions load whole aligned 16 byte blocks, which never cross
+   a page but may read past the terminator, so they are kept out of AddressSanitizer's view. */
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define PC_JSON_NO_ASAN __attribute__((no_sanitize_address))
+#endif
+#endif
+#if !defined(PC_JSON_NO_ASAN) && defined(__SANITIZE_ADDRESS__)
+#define PC_JSON_NO_ASAN __attribute__((no_sanitize_address))
+#endif
+#ifndef PC_JSON_NO_ASAN
+#define PC_JSON_NO_ASAN
+#endif
+
+#if defined(PC_JSON_SSE2)
+/* One bit per byte. */
+typedef unsigned pc_JSON_Mask;
+#define PC_JSON_MASK_SHIFT 0
+static int mask_first(pc_JSON_Mask m)
+{
+#if defined(_MSC_VER)
+    unsigned long i;_BitScanForward(&i,m);return (int)i;
+#else
+    return __builtin_ctz(m);
+#endif
+}
+static PC_JSON_NO_ASAN pc_JSON_Mask string_mask(const char *blk)
+{
+    __m128i v=_mm_load_si128((const __m128i*)blk);
+    return (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v,_mm_set1_epi8('\"')),_mm_cmpeq_epi8(v,_mm_set1_epi8('\\'))),
+                                                    _mm_cmpeq_epi8(v,_mm_setzero_si128())));
+}
+static PC_JSON_NO_ASAN pc_JSON_Mask space_mask(const char *blk)
+{
+    __m128i v=_mm_load_si128((const __m128i*)blk);
+    return (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(_mm_max_epu8(v,_mm_set1_epi8(33)),v),_mm_cmpeq_epi8(v,_mm_setzero_si128())));
+}
+#elif defined(PC_JSON_NEON)
+/* Four bits per byte, narrowed out of the comparison result. */
+typedef uint64_t pc_JSON_Mask;
+#define PC_JSON_MASK_SHIFT 2
+static int mask_first(pc_JSON_Mask m) {return __builtin_ctzll(m);}
+static pc_JSON_Mask neon_mask(uint8x16_t m) {return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m),4)),0);}
+static PC_JSON_NO_ASAN pc_JSON_Mask string_mask(const char *blk)
+{
+    uint8x16_t v=vld1q_u8((const uint8_t*)blk);
+    return neon_mask(vorrq_u8(vorrq_u8(vceqq_u8(v,vdupq_n_u8('\"')),vceqq_u8(v,vdupq_n_u8('\\'))),vceqq_u8(v,vdupq_n_u8(0))));
+}
+static PC_JSON_NO_ASAN pc_JSON_Mask space_mask(const char *blk)
+{
+    uint8x16_t v=vld1q_u8((const uint8_t*)blk);
+    return neon_mask(vorrq_u8(vcgtq_u8(v,vdupq_n_u8(32)),vceqq_u8(v,vdupq_n_u8(0))));
+}
+#endif
+
+#if defined(PC_JSON_SSE2) || defined(PC_JSON_NEON)
+/* Walk aligned blocks from the one holding str, ignoring the bytes before it. */
+#define PC_JSON_SCAN(str,mask_fn) \
+    const char *blk=(const char*)((uintptr_t)(str)&~(uintptr_t)15); \
+    pc_JSON_Mask m=mask_fn(blk)&((pc_JSON_Mask)~(pc_JSON_Mask)0<<(((str)-blk)<<PC_JSON_MASK_SHIFT)); \
+    while (!m) {blk+=16;m=mask_fn(blk);} \
+    return blk+(mask_first(m)>>PC_JSON_MASK_SHIFT)
+
+/* First quote, backslash or terminator at or after str. */
+static const char *scan_string(const char *str) {PC_JSON_SCAN(str,string_mask);}
+/* First char after str that is not whitespace, or the terminator. */
+static const char *scan_space(const char *str) {PC_JSON_SCAN(str,space_mask);}
+#else
+static const char *scan_string(const char *str) {return str+strcspn(str,"\"\\");}
+static const char *scan_space(const char *str) {while (*str && (unsigned char)*str<=32) str++; return str;}
+#endif
+
 static unsigned parse_hex4(const char *str)
 {
     unsigned h=0;
@@ -150,23 +334,29 @@ static unsigned parse_hex4(const char *str)
 
 /* Parse the input text into an unescaped cstring, and populate item. */
 static const unsigned char firstByteMark[7] = { 0x00, 0x00, 0xC0, 0xE0, 0xF0, 0xF8, 0xFC };
-static const char *parse_string(pc_JSON *item,const char *str)
+static const char *parse_string(pc_JSON *item,const char *str,pc_JSON_Arena *a)
 {
-    const char *ptr=str+1;char *ptr2;char *out;int len=0;unsigned uc,uc2;
+    const char *ptr=str+1,*run;char *ptr2;char *out;int len=0;unsigned uc,uc2;
     if (*str!='\"') {ep=str;return 0;}    /* not a string! */
 
-    while (*ptr!='\"' && *ptr && ++len) if (*ptr++ == '\\') ptr++;    /* Skip escaped quotes. */
+    for (;;)    /* Jump over plain runs, counting each escape as one char. */
+    {
+        run=scan_string(ptr);len+=(int)(run-ptr);ptr=run;
+        if (*ptr!='\\' || !ptr[1]) break;
+        len++;ptr+=2;
+    }
 
-    out=(char*)pc_JSON_malloc(len+1);    /* This is how long we need for the string, roughly. */
+    out=(char*)json_alloc(a,len+1);    /* This is how long we need for the string, roughly. */
     if (!out) return 0;
 
     ptr=str+1;ptr2=out;
     while (*ptr!='\"' && *ptr)
     {
-        if (*ptr!='\\') *ptr2++=*ptr++;
+        if (*ptr!='\\') {run=scan_string(ptr);memcpy(ptr2,ptr,run-ptr);ptr2+=run-ptr;ptr=run;}
         else
         {
             ptr++;
+            if (!*ptr) break;    /* dangling escape at the terminator. */
             switch (*ptr)
             {
                 case 'b': *ptr2++='\b';    break;
@@ -248,50 +438,67 @@ static char *print_string_ptr(const char *str)
 static char *print_string(const pc_JSON *item)    {return print_string_ptr(item->valuestring);}
 
 /* Predeclare these prototypes. */
-static const char *parse_value(pc_JSON *item,const char *value);
+static const char *parse_value(pc_JSON *item,const char *value,pc_JSON_Arena *a);
 static char *print_value(const pc_JSON *item,int depth,int fmt);
-static const char *parse_array(pc_JSON *item,const char *value);
+static const char *parse_array(pc_JSON *item,const char *value,pc_JSON_Arena *a);
 static char *print_array(const pc_JSON *item,int depth,int fmt);
-static const char *parse_object(pc_JSON *item,const char *value);
+static const char *parse_object(pc_JSON *item,const char *value,pc_JSON_Arena *a);
 static char *print_object(const pc_JSON *item,int depth,int fmt);
 
 /* Utility to jump whitespace and cr/lf */
-static const char *skip(const char *in) {while (in && *in && (unsigned char)*in<=32) in++; return in;}
+static const char *skip(const char *in) {if (!in || !*in || (unsigned char)*in>32) return in; return scan_space(in+1);}
+
+/* Parse a value into root, which is freed by the caller on failure. */
+static const char *parse_root(pc_JSON *root,const char *value,const char **return_parse_end,int require_null_terminated,pc_JSON_Arena *a)
+{
+    const char *end=parse_value(root,skip(value),a);
+    if (!end) return 0;    /* parse failure. ep is set. */
+
+    /* if we require null-terminated JSON without appended garbage, skip and then check for a null terminator */
+    if (require_null_terminated) {end=skip(end);if (*end) {ep=end;return 0;}}
+    if (return_parse_end) *return_parse_end=end;
+    return end;
+}
 
 /* Parse an object - create a new root, and populate. */
 pc_JSON *pc_JSON_ParseWithOpts(const char *value,const char **return_parse_end,int require_null_terminated)
 {
-    const char *end=0;
     pc_JSON *c=pc_JSON_New_Item();
     ep=0;
     if (!c) return 0;       /* memory fail */
-
-    end=parse_value(c,skip(value));
-    if (!end)    {pc_JSON_Delete(c);return 0;}    /* parse failure. ep is set. */
-
-    /* if we require null-terminated JSON without appended garbage, skip and then check for a null terminator */
-    if (require_null_terminated) {end=skip(end);if (*end) {pc_JSON_Delete(c);ep=end;return 0;}}
-    if (return_parse_end) *return_parse_end=end;
+    if (!parse_root(c,value,return_parse_end,require_null_terminated,0)) {pc_JSON_Delete(c);return 0;}
     return c;
 }
 /* Default options for pc_JSON_Parse */
 pc_JSON *pc_JSON_Parse(const char *value) {return pc_JSON_ParseWithOpts(value,0,0);}
 
+/* Same, into an arena. The text need not be terminated right after the value, so blocks start small and double. */
+pc_JSON *pc_JSON_ParseArena(const char *value,const char **return_parse_end,int require_null_terminated)
+{
+    pc_JSON_Arena a;pc_JSON *c;
+    ep=0;
+    if (!value) return 0;
+    if (!(a.head=a.tail=arena_block(PC_JSON_ARENA_MIN_BLOCK))) return 0;
+    c=json_new_item(&a);    /* The root is the first allocation, right after the block header. */
+    if (!parse_root(c,value,return_parse_end,require_null_terminated,&a)) {pc_JSON_DeleteArena(c);return 0;}
+    return c;
+}
+
 /* Render a pc_JSON item/entity/structure to text. */
 char *pc_JSON_Print(const pc_JSON *item)                {return print_value(item,0,1);}
 char *pc_JSON_PrintUnformatted(const pc_JSON *item)    {return print_value(item,0,0);}
 
 /* Parser core - when encountering text, process appropriately. */
-static const char *parse_value(pc_JSON *item,const char *value)
+static const char *parse_value(pc_JSON *item,const char *value,pc_JSON_Arena *a)
 {
     if (!value)                        return 0;    /* Fail on null. */
     if (!strncmp(value,"null",4))    { item->type=pc_JSON_NULL;  return value+4; }
     if (!strncmp(value,"false",5))    { item->type=pc_JSON_False; return value+5; }
     if (!strncmp(value,"true",4))    { item->type=pc_JSON_True; item->valueint=1;    return value+4; }
-    if (*value=='\"')                { return parse_string(item,value); }
+    if (*value=='\"')                { return parse_string(item,value,a); }
     if (*value=='-' || (*value>='0' && *value<='9'))    { return parse_number(item,value); }
-    if (*value=='[')                { return parse_array(item,value); }
-    if (*value=='{')                { return parse_object(item,value); }
+    if (*value=='[')                { return parse_array(item,value,a); }
+    if (*value=='{')                { return parse_object(item,value,a); }
 
     ep=value;return 0;    /* failure. */
 }
@@ -315,7 +522,7 @@ static char *print_value(const pc_JSON *item,int depth,int fmt)
 }
 
 /* Build an array from input text. */
-static const char *parse_array(pc_JSON *item,const char *value)
+static const char *parse_array(pc_JSON *item,const char *value,pc_JSON_Arena *a)
 {
     pc_JSON *child;
     if (*value!='[')    {ep=value;return 0;}    /* not an array! */
@@ -324,17 +531,17 @@ static const char *parse_array(pc_JSON *item,const char *value)
     value=skip(value+1);
     if (*value==']') return value+1;    /* empty array. */
 
-    item->child=child=pc_JSON_New_Item();
+    item->child=child=json_new_item(a);
     if (!item->child) return 0;         /* memory fail */
-    value=skip(parse_value(child,skip(value)));    /* skip any spacing, get the value. */
+    value=skip(parse_value(child,skip(value),a));    /* skip any spacing, get the value. */
     if (!value) return 0;
 
     while (*value==',')
     {
         pc_JSON *new_item;
-        if (!(new_item=pc_JSON_New_Item())) return 0;     /* memory fail */
+        if (!(new_item=json_new_item(a))) return 0;     /* memory fail */
         child->next=new_item;new_item->prev=child;child=new_item;
-        value=skip(parse_value(child,skip(value+1)));
+        value=skip(parse_value(child,skip(value+1),a));
         if (!value) return 0;    /* memory fail */
     }
 
@@ -401,7 +608,7 @@ static char *print_array(const pc_JSON *item,int depth,int fmt)
 }
 
 /* Build an object from the text. */
-static const char *parse_object(pc_JSON *item,const char *value)
+static const char *parse_object(pc_JSON *item,const char *value,pc_JSON_Arena *a)
 {
     pc_JSON *child;
     if (*value!='{')    {ep=value;return 0;}    /* not an object! */
@@ -410,25 +617,25 @@ static const char *parse_object(pc_JSON *item,const char *value)
     value=skip(value+1);
     if (*value=='}') return value+1;    /* empty array. */
 
-    item->child=child=pc_JSON_New_Item();
+    item->child=child=json_new_item(a);
     if (!item->child) return 0;
-    value=skip(parse_string(child,skip(value)));
+    value=skip(parse_string(child,skip(value),a));
     if (!value) return 0;
     child->string=child->valuestring;child->valuestring=0;
     if (*value!=':') {ep=value;return 0;}    /* fail! */
-    value=skip(parse_value(child,skip(value+1)));    /* skip any spacing, get the value. */
+    value=skip(parse_value(child,skip(value+1),a));    /* skip any spacing, get the value. */
     if (!value) return 0;
 
     while (*value==',')
     {
         pc_JSON *new_item;
-        if (!(new_item=pc_JSON_New_Item()))    return 0; /* memory fail */
+        if (!(new_item=json_new_item(a)))    return 0; /* memory fail */
         child->next=new_item;new_item->prev=child;child=new_item;
-        value=skip(parse_string(child,skip(value+1)));
+        value=skip(parse_string(child,skip(value+1),a));
         if (!value) return 0;
         child->string=child->valuestring;child->valuestring=0;
         if (*value!=':') {ep=value;return 0;}    /* fail! */
-        value=skip(parse_value(child,skip(value+1)));    /* skip any spacing, get the value. */
+        value=skip(parse_value(child,skip(value+1),a));    /* skip any spacing, get the value. */
         if (!value) return 0;
     }
 
@@ -507,27 +714,38 @@ static char *print_object(const pc_JSON *item,int depth,int fmt)
 /* Get Array size/item / object item. */
 int    pc_JSON_GetArraySize(const pc_JSON *array)                            {pc_JSON *c=array->child;int i=0;while(c)i++,c=c->next;return i;}
 pc_JSON *pc_JSON_GetArrayItem(const pc_JSON *array,int item)                {pc_JSON *c=array->child;  while (c && item>0) item--,c=c->next; return c;}
-pc_JSON *pc_JSON_GetObjectItem(const pc_JSON *object,const char *string)    {pc_JSON *c=object->child; while (c && strcmp(c->string,string)) c=c->next; return c;}
+
+/* Small objects are searched in order; past PC_JSON_INDEX_MIN_ITEMS members the object is hashed once and looked up through the index. */
+pc_JSON *pc_JSON_GetObjectItem(const pc_JSON *object,const char *string)
+{
+    pc_JSON *c=object->child;pc_JSON_Index *idx=index_load(&object->index);int i;
+    if (idx) return index_find(idx,string);
+    for (i=0;c && i<PC_JSON_INDEX_MIN_ITEMS;i++,c=c->next) if (!strcmp(c->string,string)) return c;
+    if (!c) return 0;
+    if (!(idx=index_build(object))) {while (c && strcmp(c->string,string)) c=c->next;return c;}    /* memory fail, keep walking. */
+    if (!index_publish(&((pc_JSON*)object)->index,idx)) {pc_JSON_free(idx);idx=index_load(&object->index);}
+    return index_find(idx,string);
+}
 
 /* Utility for array list handling. */
 static void suffix_object(pc_JSON *prev,pc_JSON *item) {prev->next=item;item->prev=prev;}
 /* Utility for handling references. */
-static pc_JSON *create_reference(pc_JSON *item) {pc_JSON *ref=pc_JSON_New_Item();if (!ref) return 0;memcpy(ref,item,sizeof(pc_JSON));ref->string=0;ref->type|=pc_JSON_IsReference;ref->next=ref->prev=0;return ref;}
+static pc_JSON *create_reference(pc_JSON *item) {pc_JSON *ref=pc_JSON_New_Item();if (!ref) return 0;memcpy(ref,item,sizeof(pc_JSON));ref->string=0;ref->type|=pc_JSON_IsReference;ref->next=ref->prev=0;ref->index=0;return ref;}
 
 /* Add item to array/object. */
-void   pc_JSON_AddItemToArray(pc_JSON *array, pc_JSON *item)                        {pc_JSON *c=array->child;if (!item) return; if (!c) {array->child=item;} else {while (c && c->next) c=c->next; suffix_object(c,item);}}
+void   pc_JSON_AddItemToArray(pc_JSON *array, pc_JSON *item)                        {pc_JSON *c=array->child;if (!item) return; index_drop(array); if (!c) {array->child=item;} else {while (c && c->next) c=c->next; suffix_object(c,item);}}
 void   pc_JSON_AddItemToObject(pc_JSON *object,const char *string,pc_JSON *item)    {if (!item) return; if (item->string) pc_JSON_free(item->string);item->string=pc_JSON_strdup(string);pc_JSON_AddItemToArray(object,item);}
 void    pc_JSON_AddItemReferenceToArray(pc_JSON *array, pc_JSON *item)                        {pc_JSON_AddItemToArray(array,create_reference(item));}
 void    pc_JSON_AddItemReferenceToObject(pc_JSON *object,const char *string,pc_JSON *item)    {pc_JSON_AddItemToObject(object,string,create_reference(item));}
 
-pc_JSON *pc_JSON_DetachItemFromArray(pc_JSON *array,int which)            {pc_JSON *c=array->child;while (c && which>0) c=c->next,which--;if (!c) return 0;
+pc_JSON *pc_JSON_DetachItemFromArray(pc_JSON *array,int which)            {pc_JSON *c=array->child;while (c && which>0) c=c->next,which--;if (!c) return 0;index_drop(array);
     if (c->prev) c->prev->next=c->next;if (c->next) c->next->prev=c->prev;if (c==array->child) array->child=c->next;c->prev=c->next=0;return c;}
 void   pc_JSON_DeleteItemFromArray(pc_JSON *array,int which)            {pc_JSON_Delete(pc_JSON_DetachItemFromArray(array,which));}
 pc_JSON *pc_JSON_DetachItemFromObject(pc_JSON *object,const char *string) {int i=0;pc_JSON *c=object->child;while (c && strcmp(c->string,string)) i++,c=c->next;if (c) return pc_JSON_DetachItemFromArray(object,i);return 0;}
 void   pc_JSON_DeleteItemFromObject(pc_JSON *object,const char *string) {pc_JSON_Delete(pc_JSON_DetachItemFromObject(object,string));}
 
 /* Replace array/object items with new ones. */
-void   pc_JSON_ReplaceItemInArray(pc_JSON *array,int which,pc_JSON *newitem)        {pc_JSON *c=array->child;while (c && which>0) c=c->next,which--;if (!c) return;
+void   pc_JSON_ReplaceItemInArray(pc_JSON *array,int which,pc_JSON *newitem)        {pc_JSON *c=array->child;while (c && which>0) c=c->next,which--;if (!c) return;index_drop(array);
     newitem->next=c->next;newitem->prev=c->prev;if (newitem->next) newitem->next->prev=newitem;
     if (c==array->child) array->child=newitem; else newitem->prev->next=newitem;c->next=c->prev=0;pc_JSON_Delete(c);}
 void   pc_JSON_ReplaceItemInObject(pc_JSON *object,const char *string,pc_JSON *newitem){int i=0;pc_JSON *c=object->child;while(c && strcmp(c->string,string))i++,c=c->next;if(c){newitem->string=pc_JSON_strdup(string);pc_JSON_ReplaceItemInArray(object,i,newitem);}}
@@ -56,6 +56,8 @@ typedef struct pc_JSON {
     double valuedouble;            /* The item's number, if type==pc_JSON_Number */
 
     char *string;                /* The item's name string, if this item is the child of, or is in the list of subitems of an object. */
+
+    struct pc_JSON_Index *index;    /* Hash index over the children of a large object, built by the first GetObjectItem that needs it. */
 } pc_JSON;
 
 typedef struct pc_JSON_Hooks {
@@ -80,7 +82,9 @@ extern void   pc_JSON_Delete(pc_JSON *c);
 extern int      pc_JSON_GetArraySize(const pc_JSON *array);
 /* Retrieve item number "item" from array "array". Returns NULL if unsuccessful. */
 extern pc_JSON *pc_JSON_GetArrayItem(const pc_JSON *array,int item);
-/* Get item "string" from object. Case insensitive. */
+/* Get item "string" from object. Case sensitive. Objects with PC_JSON_INDEX_MIN_ITEMS or more members are hashed on first lookup;
+   concurrent lookups are safe, lookups concurrent with changes to the object are not. */
+#define PC_JSON_INDEX_MIN_ITEMS 16
 extern pc_JSON *pc_JSON_GetObjectItem(const pc_JSON *object,const char *string);
 
 /* For analysing failed parses. This returns a pointer to the parse error. You'll probably need to look a few chars back to make sense of it. Defined when pc_JSON_Parse() returns 0. 0 when pc_JSON_Parse() succeeds. */
@@ -128,6 +132,12 @@ The item->next and ->prev pointers are always zero on return from Duplicate. */
 /* ParseWithOpts allows you to require (and check) that the JSON is null terminated, and to retrieve the pointer to the final byte parsed. */
 extern pc_JSON *pc_JSON_ParseWithOpts(const char *value,const char **return_parse_end,int require_null_terminated);
 
+/* ParseArena takes the same options, but carves every item and string of the tree out of a few large blocks instead of
+   one allocation each. The tree is read-only: do not add, detach, replace or delete items of it, and release the whole
+   tree with a single call to pc_JSON_DeleteArena. */
+extern pc_JSON *pc_JSON_ParseArena(const char *value,const char **return_parse_end,int require_null_terminated);
+extern void   pc_JSON_DeleteArena(pc_JSON *root);
+
 extern void pc_JSON_Minify(char *json);
 
 /* Macros for creating things quickly. */
@@ -43,6 +43,15 @@ pc__error_reset()
     return err;
 }
 
+static pc_error_t
+pc__error_local()
+{
+    pc_error_t err = {0};
+    err.code = PC_RC_ERROR;
+    err.payload.len = -1;
+    return err;
+}
+
 static pc_error_t
 pc__error_dup(const pc_error_t *err)
 {
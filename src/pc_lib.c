@@ -28,6 +28,18 @@
 #    include "tr/uv/tr_uv_tls.h"
 #  endif /* tls */
 
+#  if !defined(PC_NO_UV_URING_TRANS)
+#    include "tr/uv/tr_uv_uring.h"
+#  endif /* uring */
+
+#  if !defined(PC_NO_UV_WS_TRANS)
+#    include "tr/uv/tr_uv_ws.h"
+#  endif /* ws */
+
+#  if !defined(PC_NO_UV_KCP_TRANS)
+#    include "tr/uv/tr_uv_kcp.h"
+#  endif /* kcp */
+
 #endif /* tcp */
 
 #define PC_MAX_PINNED_KEYS 10
@@ -168,6 +180,26 @@ void pc_lib_init(void (*pc_log)(int level, const char* msg, ...),
     tp = pc_tr_uv_tls_trans_plugin();
     pc_transport_plugin_register(tp);
     pc_lib_log(PC_LOG_INFO, "pc_lib_init - register tls plugin");
+#endif
+#if !defined(PC_NO_UV_URING_TRANS) && defined(TR_UV_URING_SUPPORTED)
+    tp = pc_tr_uv_uring_trans_plugin();
+    pc_transport_plugin_register(tp);
+    pc_lib_log(PC_LOG_INFO, "pc_lib_init - register uring plugin");
+#endif
+#if !defined(PC_NO_UV_WS_TRANS)
+    tp = pc_tr_uv_ws_trans_plugin();
+    pc_transport_plugin_register(tp);
+    pc_lib_log(PC_LOG_INFO, "pc_lib_init - register ws plugin");
+#if !defined(PC_NO_UV_TLS_TRANS)
+    tp = pc_tr_uv_wss_trans_plugin();
+    pc_transport_plugin_register(tp);
+    pc_lib_log(PC_LOG_INFO, "pc_lib_init - register wss plugin");
+#endif
+#endif
+#if !defined(PC_NO_UV_KCP_TRANS)
+    tp = pc_tr_uv_kcp_trans_plugin();
+    pc_transport_plugin_register(tp);
+    pc_lib_log(PC_LOG_INFO, "pc_lib_init - register kcp plugin");
 #endif
     srand((unsigned int)time(0));
 
@@ -200,6 +232,25 @@ void pc_lib_cleanup(void) {
     pc_lib_log(PC_LOG_INFO, "pc_lib_cleanup - deregister tls plugin");
 #endif
 
+#if !defined(PC_NO_UV_URING_TRANS) && defined(TR_UV_URING_SUPPORTED)
+    pc_transport_plugin_deregister(PC_TR_NAME_UV_URING);
+    pc_lib_log(PC_LOG_INFO, "pc_lib_cleanup - deregister uring plugin");
+#endif
+
+#if !defined(PC_NO_UV_WS_TRANS)
+    pc_transport_plugin_deregister(PC_TR_NAME_UV_WS);
+    pc_lib_log(PC_LOG_INFO, "pc_lib_cleanup - deregister ws plugin");
+#if !defined(PC_NO_UV_TLS_TRANS)
+    pc_transport_plugin_deregister(PC_TR_NAME_UV_WSS);
+    pc_lib_log(PC_LOG_INFO, "pc_lib_cleanup - deregister wss plugin");
+#endif
+#endif
+
+#if !defined(PC_NO_UV_KCP_TRANS)
+    pc_transport_plugin_deregister(PC_TR_NAME_UV_KCP);
+    pc_lib_log(PC_LOG_INFO, "pc_lib_cleanup - deregister kcp plugin");
+#endif
+
 #endif
 }
 
@@ -26,13 +26,26 @@ size_t pc_client_size()
     return sizeof(pc_client_t);
 }
 
-pc_client_init_result_t pc_client_init(void* ex_data, const pc_client_config_t* config)
+/*
+ * Frees the memory of a client unless the embedder placed it with
+ * pc_client_init_inplace.
+ */
+static void pc__client_free(pc_client_t* client)
+{
+    if (!client->is_inplace) {
+        pc_lib_free(client);
+    }
+}
+
+static pc_client_init_result_t pc__client_init(pc_client_t* client, int is_inplace,
+                                               void* ex_data, const pc_client_config_t* config)
 {
     pc_client_init_result_t res = {0};
 
     res.rc = PC_RC_ERROR;
-    res.client = (pc_client_t*)pc_lib_malloc(pc_client_size());
+    res.client = client;
     memset(res.client, 0, pc_client_size());
+    res.client->is_inplace = is_inplace;
 
     if (!config) {
         res.client->config = pc__default_config;
@@ -44,7 +57,7 @@ pc_client_init_result_t pc_client_init(void* ex_data, const pc_client_config_t*
 
     if (!tp) {
         pc_lib_log(PC_LOG_ERROR, "pc_client_init - no registered transport plugin found, transport plugin: %d", config->transport_name);
-        pc_lib_free(res.client);
+        pc__client_free(res.client);
         res.client = NULL;
         res.rc = PC_RC_NO_TRANS;
         return res;
@@ -56,7 +69,7 @@ pc_client_init_result_t pc_client_init(void* ex_data, const pc_client_config_t*
     pc_transport_t *trans = tp->transport_create(tp);
     if (!trans) {
         pc_lib_log(PC_LOG_ERROR, "pc_client_init - create transport error");
-        pc_lib_free(res.client);
+        pc__client_free(res.client);
         res.client = NULL;
         res.rc = PC_RC_ERROR;
         return res;
@@ -69,7 +82,7 @@ pc_client_init_result_t pc_client_init(void* ex_data, const pc_client_config_t*
     if (res.client->trans->init(res.client->trans, res.client)) {
         pc_lib_log(PC_LOG_ERROR, "pc_client_init - init transport error");
         tp->transport_release(tp, trans);
-        pc_lib_free(res.client);
+        pc__client_free(res.client);
         res.client = NULL;
         res.rc = PC_RC_ERROR;
         return res;
@@ -127,16 +140,35 @@ pc_client_init_result_t pc_client_init(void* ex_data, const pc_client_config_t*
     return res;
 }
 
-int pc_client_connect(pc_client_t* client, const char* host, int port, const char* handshake_opts)
+pc_client_init_result_t pc_client_init(void* ex_data, const pc_client_config_t* config)
 {
-    int state;
-    int ret;
+    return pc__client_init((pc_client_t*)pc_lib_malloc(pc_client_size()), 0, ex_data, config);
+}
 
-    if (!client || !host || port < 0 || port > (1 << 16) - 1) {
-        pc_lib_log(PC_LOG_ERROR, "pc_client_connect - invalid args");
-        return PC_RC_INVALID_ARG;
+pc_client_init_result_t pc_client_init_inplace(void* mem, size_t size, void* ex_data, const pc_client_config_t* config)
+{
+    pc_client_init_result_t res = {0};
+
+    if (!mem || size < pc_client_size()) {
+        pc_lib_log(PC_LOG_ERROR, "pc_client_init_inplace - invalid args, size: %lu, needed: %lu",
+                   (unsigned long)size, (unsigned long)pc_client_size());
+        res.rc = PC_RC_INVALID_ARG;
+        return res;
     }
 
+    return pc__client_init((pc_client_t*)mem, 1, ex_data, config);
+}
+
+/*
+ * Connects to host and port, or to one of `count` endpoints if endpoints is
+ * not NULL.
+ */
+static int pc__client_connect(pc_client_t* client, const char* host, int port,
+                              const pc_endpoint_t* endpoints, int count, const char* handshake_opts)
+{
+    int state;
+    int ret;
+
     if (client->config.enable_polling) {
         pc_client_poll(client);
     }
@@ -159,7 +191,11 @@ int pc_client_connect(pc_client_t* client, const char* host, int port, const cha
         client->state = PC_ST_CONNECTING;
         pc_mutex_unlock(&client->state_mutex);
 
-        ret = client->trans->connect(client->trans, host, port, handshake_opts);
+        if (endpoints) {
+            ret = client->trans->connect_endpoints(client->trans, endpoints, count, handshake_opts);
+        } else {
+            ret = client->trans->connect(client->trans, host, port, handshake_opts);
+        }
 
         if (ret != PC_RC_OK) {
             pc_lib_log(PC_LOG_ERROR, "pc_client_connect - transport connect error, rc: %s", pc_client_rc_str(ret));
@@ -174,6 +210,66 @@ int pc_client_connect(pc_client_t* client, const char* host, int port, const cha
     return PC_RC_ERROR;
 }
 
+int pc_client_connect(pc_client_t* client, const char* host, int port, const char* handshake_opts)
+{
+    if (!client || !host || port < 0 || port > (1 << 16) - 1) {
+        pc_lib_log(PC_LOG_ERROR, "pc_client_connect - invalid args");
+        return PC_RC_INVALID_ARG;
+    }
+
+    return pc__client_connect(client, host, port, NULL, 0, handshake_opts);
+}
+
+int pc_client_connect_endpoints(pc_client_t* client, const pc_endpoint_t* endpoints, int count,
+                                const char* handshake_opts)
+{
+    int i;
+
+    if (!client || !endpoints || count <= 0 || count > PC_MAX_ENDPOINTS) {
+        pc_lib_log(PC_LOG_ERROR, "pc_client_connect_endpoints - invalid args");
+        return PC_RC_INVALID_ARG;
+    }
+
+    for (i = 0; i < count; ++i) {
+        if (!endpoints[i].host || endpoints[i].port < 0 || endpoints[i].port > (1 << 16) - 1
+                || endpoints[i].weight < 0) {
+            pc_lib_log(PC_LOG_ERROR, "pc_client_connect_endpoints - invalid endpoint %d", i);
+            return PC_RC_INVALID_ARG;
+        }
+    }
+
+    pc_assert(client->trans);
+
+    if (!client->trans->connect_endpoints) {
+        if (count == 1) {
+            return pc__client_connect(client, endpoints[0].host, endpoints[0].port, NULL, 0, handshake_opts);
+        }
+        pc_lib_log(PC_LOG_ERROR, "pc_client_connect_endpoints - transport doesn't support endpoints");
+        return PC_RC_ERROR;
+    }
+
+    return pc__client_connect(client, NULL, 0, endpoints, count, handshake_opts);
+}
+
+int pc_client_endpoint_health(pc_client_t* client, int index, pc_endpoint_health_t* health)
+{
+    if (!client || !health) {
+        pc_lib_log(PC_LOG_ERROR, "pc_client_endpoint_health - invalid args");
+        return PC_RC_INVALID_ARG;
+    }
+
+    pc_assert(client->trans);
+
+    memset(health, 0, sizeof(pc_endpoint_health_t));
+
+    if (client->trans->endpoint_health) {
+        return client->trans->endpoint_health(client->trans, index, health);
+    }
+
+    pc_lib_log(PC_LOG_ERROR, "pc_client_endpoint_health - transport doesn't support endpoints");
+    return PC_RC_ERROR;
+}
+
 int pc_client_disconnect(pc_client_t* client)
 {
     int state;
@@ -284,7 +380,7 @@ int pc_client_cleanup(pc_client_t* client)
     client->req_id_seq = 1;
     client->seq_num = 0;
 
-    pc_lib_free(client);
+    pc__client_free(client);
 
     return PC_RC_OK;
 }
@@ -294,15 +390,18 @@ static void pc__handle_event(pc_client_t* client, pc_event_t* ev)
     pc_assert(PC_EV_IS_RESP(ev->type) || PC_EV_IS_NOTIFY_SENT(ev->type) || PC_EV_IS_NET_EVENT(ev->type));
 
     if (PC_EV_IS_RESP(ev->type)) {
-        pc__trans_resp(client, ev->data.req.req_id, &ev->data.req.resp, &ev->data.req.error);
+        pc__trans_resp(client, ev->data.req.req_id, &ev->data.req.resp.raw,
+                       ev->data.req.error.code ? &ev->data.req.error : NULL);
         pc_lib_log(PC_LOG_DEBUG, "pc__handle_event - fire pending trans resp, req_id: %u",
                 ev->data.req.req_id);
 
         pc__error_free(&ev->data.req.error);
 
-        pc_lib_free((char* )ev->data.req.resp.base);
-        ev->data.req.resp.base = NULL;
-        ev->data.req.resp.len = -1;
+        if (!ev->data.req.resp_fits) {
+            pc_lib_free((char* )ev->data.req.resp.raw.base);
+        }
+        ev->data.req.resp.raw.base = NULL;
+        ev->data.req.resp.raw.len = -1;
 
     } else if (PC_EV_IS_NOTIFY_SENT(ev->type)) {
         pc__trans_sent(client, ev->data.notify.seq_num, &ev->data.notify.error);
@@ -311,12 +410,13 @@ static void pc__handle_event(pc_client_t* client, pc_event_t* ev)
 
         pc__error_free(&ev->data.notify.error);
     } else if (PC_EV_IS_PUSH(ev->type)) {
-        pc__trans_push(client, ev->data.push.route, &ev->data.push.buf);
+        pc__trans_push(client, ev->data.push.route, &ev->data.push.body.raw);
 
         pc_lib_log(PC_LOG_DEBUG, "pc__handle_event - fire pending trans sent, seq_num: %u, rc: %s",
                 ev->data.notify.seq_num, ev->data.notify.error.code);
 
         pc_lib_free((char*)ev->data.push.route);
+        pc_buf_free(&ev->data.push.body.raw);
     } else {
         pc__trans_fire_event(client, ev->data.ev.ev_type, ev->data.ev.arg1, ev->data.ev.arg2);
         pc_lib_log(PC_LOG_DEBUG, "pc__handle_event - fire pending trans event: %s, arg1: %s",
@@ -492,6 +592,25 @@ int pc_client_conn_quality(pc_client_t* client)
     return PC_RC_ERROR;
 }
 
+int pc_client_stats(pc_client_t* client, pc_client_stats_t* stats)
+{
+    if (!client || !stats) {
+        pc_lib_log(PC_LOG_ERROR, "pc_client_stats - invalid args");
+        return PC_RC_INVALID_ARG;
+    }
+
+    pc_assert(client->trans);
+
+    memset(stats, 0, sizeof(pc_client_stats_t));
+
+    if (client->trans->stats) {
+        return client->trans->stats(client->trans, stats);
+    }
+
+    pc_lib_log(PC_LOG_ERROR, "pc_client_stats - transport doesn't support stats");
+    return PC_RC_ERROR;
+}
+
 void* pc_client_trans_data(pc_client_t* client)
 {
     if (!client) {
@@ -527,20 +646,37 @@ void pc_client_free_serializer(const char *serializer)
 }
 
 static int pc__request_with_timeout(pc_client_t* client, const char* route, 
-                                    pc_buf_t msg_buf, void* ex_data, int timeout, 
+                                    pc_buf_t msg_buf, void* ex_data, int timeout, const pc_request_opts_t* opts,
+                                    pc_prepared_msg_t* prepared,
                                     pc_request_success_cb_t success_cb, pc_request_error_cb_t error_cb);
 
 int pc_string_request_with_timeout(pc_client_t* client, const char* route, 
                                    const char *str, void* ex_data, int timeout, 
                                    pc_request_success_cb_t success_cb, pc_request_error_cb_t error_cb)
 {
-    pc_buf_t buf = pc_buf_from_string(str);
-    return pc__request_with_timeout(client, route, buf, ex_data, timeout, success_cb, error_cb);
+    return pc_string_request_with_opts(client, route, str, ex_data, timeout, NULL, success_cb, error_cb);
 }
 
 int pc_binary_request_with_timeout(pc_client_t* client, const char* route, 
                                    uint8_t *data, int64_t len, void* ex_data, int timeout,
                                    pc_request_success_cb_t success_cb, pc_request_error_cb_t error_cb)
+{
+    return pc_binary_request_with_opts(client, route, data, len, ex_data, timeout, NULL, success_cb, error_cb);
+}
+
+int pc_string_request_with_opts(pc_client_t* client, const char* route,
+                                const char *str, void* ex_data, int timeout,
+                                const pc_request_opts_t* opts,
+                                pc_request_success_cb_t success_cb, pc_request_error_cb_t error_cb)
+{
+    pc_buf_t buf = pc_buf_from_string(str);
+    return pc__request_with_timeout(client, route, buf, ex_data, timeout, opts, NULL, success_cb, error_cb);
+}
+
+int pc_binary_request_with_opts(pc_client_t* client, const char* route,
+                                uint8_t *data, int64_t len, void* ex_data, int timeout,
+                                const pc_request_opts_t* opts,
+                                pc_request_success_cb_t success_cb, pc_request_error_cb_t error_cb)
 {
     if (len < 0) {
         return PC_RC_INVALID_ARG;
@@ -550,11 +686,46 @@ int pc_binary_request_with_timeout(pc_client_t* client, const char* route,
     buf.len = len;
     buf.base = pc_lib_malloc((size_t)len);
     memcpy(buf.base, data, len);
-    return pc__request_with_timeout(client, route, buf, ex_data, timeout, success_cb, error_cb);
+    return pc__request_with_timeout(client, route, buf, ex_data, timeout, opts, NULL, success_cb, error_cb);
+}
+
+int pc_prepared_request_with_timeout(pc_client_t* client, pc_prepared_msg_t* msg,
+                                     void* ex_data, int timeout,
+                                     pc_request_success_cb_t success_cb, pc_request_error_cb_t error_cb)
+{
+    pc_buf_t empty = {0};
+
+    if (!msg) {
+        pc_lib_log(PC_LOG_ERROR, "pc_prepared_request_with_timeout - invalid args");
+        return PC_RC_INVALID_ARG;
+    }
+    return pc__request_with_timeout(client, msg->route, empty, ex_data, timeout, &msg->opts, msg, success_cb, error_cb);
+}
+
+/*
+ * Sends through the transport, passing the options only if the transport
+ * understands them. Prepared messages the transport can not send as such
+ * are sent as regular messages with their body.
+ */
+static int pc__trans_send(pc_client_t* client, const char* route, unsigned int seq_num,
+                          pc_buf_t msg_buf, unsigned int req_id, int timeout, const pc_request_opts_t* opts,
+                          pc_prepared_msg_t* prepared)
+{
+    if (prepared && client->trans->send_prepared) {
+        return client->trans->send_prepared(client->trans, prepared, seq_num, req_id, timeout);
+    }
+    if (prepared) {
+        msg_buf = prepared->body;
+    }
+    if (opts && client->trans->send_with_opts) {
+        return client->trans->send_with_opts(client->trans, route, seq_num, msg_buf, req_id, timeout, opts);
+    }
+    return client->trans->send(client->trans, route, seq_num, msg_buf, req_id, timeout);
 }
 
 static int pc__request_with_timeout(pc_client_t* client, const char* route, 
-                                    pc_buf_t msg_buf, void* ex_data, int timeout, 
+                                    pc_buf_t msg_buf, void* ex_data, int timeout, const pc_request_opts_t* opts,
+                                    pc_prepared_msg_t* prepared,
                                     pc_request_success_cb_t cb, pc_request_error_cb_t error_cb)
 {
     if (!client || !route || !cb) {
@@ -608,6 +779,10 @@ static int pc__request_with_timeout(pc_client_t* client, const char* route,
 
     req->base.route = pc_lib_strdup(route);
     req->base.msg_buf = msg_buf;
+    req->base.prepared = prepared;
+    if (prepared) {
+        pc__prepared_msg_retain(prepared);
+    }
 
     req->base.seq_num = client->seq_num++;
     req->base.timeout = timeout;
@@ -618,12 +793,19 @@ static int pc__request_with_timeout(pc_client_t* client, const char* route,
     req->req_id = client->req_id_seq++;
     req->cb = cb;
     req->error_cb = error_cb;
+    req->chunk_cb = opts ? opts->chunk_cb : NULL;
+    req->resp_buf = opts ? opts->resp_buf : NULL;
+    req->resp_buf_cap = opts ? opts->resp_buf_cap : 0;
+    req->resp_alloc = opts ? opts->resp_alloc : NULL;
+    req->resp_mem = NULL;
+    req->resp_fits = 0;
 
     pc_mutex_unlock(&client->req_mutex);
 
     pc_lib_log(PC_LOG_INFO, "pc_request_with_timeout - add request to queue, req id: %u", req->req_id);
 
-    int ret = client->trans->send(client->trans, req->base.route, req->base.seq_num, req->base.msg_buf, req->req_id, req->base.timeout);
+    int ret = pc__trans_send(client, req->base.route, req->base.seq_num, req->base.msg_buf, req->req_id, req->base.timeout, opts,
+                             req->base.prepared);
 
     pc_lib_log(PC_LOG_DEBUG, "pc_request_with_timeout - transport send function CALLED");
 
@@ -635,10 +817,12 @@ static int pc__request_with_timeout(pc_client_t* client, const char* route,
 
         pc_buf_free(&req->base.msg_buf);
         pc_lib_free((char* )req->base.route);
+        pc_prepared_msg_release(req->base.prepared);
 
         req->base.msg_buf.base = NULL;
         req->base.msg_buf.len = -1;
         req->base.route = NULL;
+        req->base.prepared = NULL;
 
         QUEUE_REMOVE(&req->base.queue);
         QUEUE_INIT(&req->base.queue);
@@ -670,6 +854,9 @@ const char* pc_request_route(const pc_request_t* req)
 const char* pc_request_msg(const pc_request_t* req)
 {
     pc_assert(req);
+    if (req->base.prepared) {
+        return (const char*)req->base.prepared->body.base;
+    }
     return (const char*)req->base.msg_buf.base;
 }
 
@@ -685,28 +872,62 @@ void* pc_request_ex_data(const pc_request_t* req)
     return req->base.ex_data;
 }
 
+int pc_request_resp_fits(const pc_request_t* req)
+{
+    pc_assert(req);
+    return req->resp_fits;
+}
+
 static int pc__notify_with_timeout(pc_client_t* client, const char* route, pc_buf_t msg_buf, void* ex_data,
-                                   int timeout, pc_notify_error_cb_t cb);
+                                   int timeout, const pc_request_opts_t* opts, pc_prepared_msg_t* prepared,
+                                   pc_notify_error_cb_t cb);
 
 int pc_binary_notify_with_timeout(pc_client_t* client, const char* route, uint8_t *data, int64_t len,
                                   void* ex_data, int timeout, pc_notify_error_cb_t cb)
+{
+    return pc_binary_notify_with_opts(client, route, data, len, ex_data, timeout, NULL, cb);
+}
+
+int pc_string_notify_with_timeout(pc_client_t* client, const char* route, const char *str, 
+                                  void* ex_data, int timeout, pc_notify_error_cb_t cb)
+{
+    return pc_string_notify_with_opts(client, route, str, ex_data, timeout, NULL, cb);
+}
+
+int pc_binary_notify_with_opts(pc_client_t* client, const char* route, uint8_t *data, int64_t len,
+                               void* ex_data, int timeout, const pc_request_opts_t* opts,
+                               pc_notify_error_cb_t cb)
 {
     pc_buf_t buf;
     buf.len = len;
     buf.base = pc_lib_malloc(len);
     memcpy(buf.base, data, len);
-    return pc__notify_with_timeout(client, route, buf, ex_data, timeout, cb);
+    return pc__notify_with_timeout(client, route, buf, ex_data, timeout, opts, NULL, cb);
 }
 
-int pc_string_notify_with_timeout(pc_client_t* client, const char* route, const char *str, 
-                                  void* ex_data, int timeout, pc_notify_error_cb_t cb)
+int pc_string_notify_with_opts(pc_client_t* client, const char* route, const char *str,
+                               void* ex_data, int timeout, const pc_request_opts_t* opts,
+                               pc_notify_error_cb_t cb)
 {
     pc_buf_t buf = pc_buf_from_string(str);
-    return pc__notify_with_timeout(client, route, buf, ex_data, timeout, cb);
+    return pc__notify_with_timeout(client, route, buf, ex_data, timeout, opts, NULL, cb);
+}
+
+int pc_prepared_notify_with_timeout(pc_client_t* client, pc_prepared_msg_t* msg,
+                                    void* ex_data, int timeout, pc_notify_error_cb_t cb)
+{
+    pc_buf_t empty = {0};
+
+    if (!msg) {
+        pc_lib_log(PC_LOG_ERROR, "pc_prepared_notify_with_timeout - invalid args");
+        return PC_RC_INVALID_ARG;
+    }
+    return pc__notify_with_timeout(client, msg->route, empty, ex_data, timeout, &msg->opts, msg, cb);
 }
 
 static int pc__notify_with_timeout(pc_client_t* client, const char* route, pc_buf_t msg_buf, void* ex_data,
-                                   int timeout, pc_notify_error_cb_t cb)
+                                   int timeout, const pc_request_opts_t* opts, pc_prepared_msg_t* prepared,
+                                   pc_notify_error_cb_t cb)
 {
     pc_notify_t* notify;
     int i;
@@ -766,6 +987,10 @@ static int pc__notify_with_timeout(pc_client_t* client, const char* route, pc_bu
 
     notify->base.route = pc_lib_strdup(route);
     notify->base.msg_buf = msg_buf;
+    notify->base.prepared = prepared;
+    if (prepared) {
+        pc__prepared_msg_retain(prepared);
+    }
 
     notify->base.seq_num = client->seq_num++;
 
@@ -778,8 +1003,9 @@ static int pc__notify_with_timeout(pc_client_t* client, const char* route, pc_bu
 
     pc_lib_log(PC_LOG_INFO, "pc_notify_with_timeout - add notify to queue, seq num: %u", notify->base.seq_num);
 
-    ret = client->trans->send(client->trans, notify->base.route, notify->base.seq_num,
-                              notify->base.msg_buf, PC_NOTIFY_PUSH_REQ_ID, notify->base.timeout);
+    ret = pc__trans_send(client, notify->base.route, notify->base.seq_num,
+                         notify->base.msg_buf, PC_NOTIFY_PUSH_REQ_ID, notify->base.timeout, opts,
+                         notify->base.prepared);
 
     if (ret != PC_RC_OK) {
         pc_lib_log(PC_LOG_ERROR, "pc_notify_with_timeout - send to transport error,"
@@ -789,10 +1015,12 @@ static int pc__notify_with_timeout(pc_client_t* client, const char* route, pc_bu
 
         pc_buf_free(&notify->base.msg_buf);
         pc_lib_free((char* )notify->base.route);
+        pc_prepared_msg_release(notify->base.prepared);
 
         notify->base.msg_buf.base = NULL;
         notify->base.msg_buf.len = -1;
         notify->base.route = NULL;
+        notify->base.prepared = NULL;
 
         QUEUE_REMOVE(&notify->base.queue);
         QUEUE_INIT(&notify->base.queue);
@@ -823,6 +1051,9 @@ const char* pc_notify_route(const pc_notify_t* notify)
 const pc_buf_t *pc_notify_msg(const pc_notify_t* notify)
 {
     pc_assert(notify);
+    if (notify->base.prepared) {
+        return &notify->base.prepared->body;
+    }
     return &notify->base.msg_buf;
 }
 
@@ -838,6 +1069,66 @@ void* pc_notify_ex_data(const pc_notify_t* notify)
     return notify->base.ex_data;
 }
 
+pc_prepared_msg_t* pc_prepared_msg_new(const char* route, const uint8_t* data, int64_t len,
+                                       const pc_request_opts_t* opts)
+{
+    pc_request_opts_t default_opts = PC_REQUEST_OPTS_DEFAULT;
+    pc_prepared_msg_t* msg;
+
+    if (!route || len < 0 || (len > 0 && !data)) {
+        pc_lib_log(PC_LOG_ERROR, "pc_prepared_msg_new - invalid args");
+        return NULL;
+    }
+
+    msg = (pc_prepared_msg_t* )pc_lib_malloc(sizeof(pc_prepared_msg_t));
+    memset(msg, 0, sizeof(pc_prepared_msg_t));
+
+    pc_mutex_init(&msg->mutex);
+    msg->refs = 1;
+    msg->route = pc_lib_strdup(route);
+    msg->opts = opts ? *opts : default_opts;
+
+    /* NUL terminated for pc_request_msg */
+    msg->body.base = (uint8_t* )pc_lib_malloc((size_t)len + 1);
+    msg->body.len = len;
+    if (len > 0) {
+        memcpy(msg->body.base, data, (size_t)len);
+    }
+    msg->body.base[len] = '\0';
+
+    return msg;
+}
+
+void pc__prepared_msg_retain(pc_prepared_msg_t* msg)
+{
+    pc_mutex_lock(&msg->mutex);
+    msg->refs++;
+    pc_mutex_unlock(&msg->mutex);
+}
+
+void pc_prepared_msg_release(pc_prepared_msg_t* msg)
+{
+    int refs;
+
+    if (!msg) {
+        return;
+    }
+
+    pc_mutex_lock(&msg->mutex);
+    refs = --msg->refs;
+    pc_mutex_unlock(&msg->mutex);
+
+    if (refs > 0) {
+        return;
+    }
+
+    pc_lib_free((char* )msg->route);
+    pc_buf_free(&msg->body);
+    pc_buf_free(&msg->wire);
+    pc_mutex_destroy(&msg->mutex);
+    pc_lib_free(msg);
+}
+
 pc_buf_t pc_buf_copy(const pc_buf_t *buf)
 {
     if (!buf->base) {
@@ -909,6 +1200,58 @@ void pc_buf_debug_print(const pc_buf_t *buf)
     printf("]\n");
 }
 
+pc_body_t pc__body_copy(const pc_client_t* client, const pc_buf_t* payload)
+{
+    pc_body_t body;
+
+    if (client->config.lazy_decompression) {
+        body = *pc_body_from_payload(payload);
+    } else {
+        memset(&body, 0, sizeof(pc_body_t));
+    }
+    body.raw = pc_buf_copy(payload);
+
+    return body;
+}
+
+const pc_body_t* pc_body_from_payload(const pc_buf_t *payload)
+{
+    return (const pc_body_t*)payload;
+}
+
+int pc_body_is_compressed(const pc_body_t *body)
+{
+    return body->compressed;
+}
+
+const pc_buf_t *pc_body_raw(const pc_body_t *body)
+{
+    return &body->raw;
+}
+
+int pc_body_read(const pc_body_t *body, uint8_t *buf, size_t cap, size_t *len)
+{
+    if (!body || !len || (!buf && cap > 0)) {
+        pc_lib_log(PC_LOG_ERROR, "pc_body_read - invalid arguments");
+        return PC_RC_INVALID_ARG;
+    }
+
+    if (body->compressed) {
+        pc_assert(body->inflate);
+        return body->inflate(body, buf, cap, len);
+    }
+
+    *len = body->raw.len > 0 ? (size_t)body->raw.len : 0;
+    if (*len > cap) {
+        return PC_RC_INVALID_ARG;
+    }
+
+    if (*len > 0) {
+        memcpy(buf, body->raw.base, *len);
+    }
+    return PC_RC_OK;
+}
+
 void pc_client_set_push_handler(pc_client_t *client, pc_push_handler_cb_t cb)
 {
     client->push_handler = cb;
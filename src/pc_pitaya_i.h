@@ -67,8 +67,50 @@ typedef struct {
     unsigned int seq_num;
     int timeout;
     void* ex_data;
+
+    /* set for prepared messages, whose body is not copied to msg_buf */
+    pc_prepared_msg_t* prepared;
 } pc_common_req_t;
 
+struct pc_prepared_msg_s {
+    pc_mutex_t mutex;
+    int refs;
+
+    const char* route;
+    pc_buf_t body;
+    pc_request_opts_t opts;
+
+    /*
+     * route and body in the wire format of the transport, encoded by the
+     * first send with pc_prepared_msg_wire and immutable afterwards.
+     */
+    pc_buf_t wire;
+    int wire_compressed;
+};
+
+void pc__prepared_msg_retain(pc_prepared_msg_t* msg);
+
+/**
+ * A response or push body, see pc_body_from_payload.
+ *
+ * The transport fills `inflate` and `inflate_data` for compressed bodies.
+ */
+struct pc_body_s {
+    /* given to the callbacks as their payload, must be the first member */
+    pc_buf_t raw;
+    int compressed;
+
+    int (*inflate)(const pc_body_t* body, uint8_t* buf, size_t cap, size_t* len);
+    const void* inflate_data;
+    const void* inflate_dicts;
+};
+
+/**
+ * Copies `payload` to an owned body, keeping the handle of lazily
+ * decompressed bodies.
+ */
+pc_body_t pc__body_copy(const pc_client_t* client, const pc_buf_t* payload);
+
 typedef struct {
     QUEUE queue;
     void* ex_data;
@@ -83,6 +125,14 @@ struct pc_request_s {
     unsigned int req_id;
     pc_request_success_cb_t cb;
     pc_request_error_cb_t error_cb;
+    pc_request_chunk_cb_t chunk_cb; /* streamed response, may be NULL */
+
+    /* caller memory for the response body, see pc_request_opts_t */
+    uint8_t* resp_buf;
+    size_t resp_buf_cap;
+    pc_request_alloc_cb_t resp_alloc;
+    void* resp_mem; /* last memory returned by resp_alloc */
+    int resp_fits;
 };
 
 struct pc_notify_s {
@@ -104,12 +154,14 @@ typedef struct {
         struct {
             int req_id;
             pc_error_t error;
-            pc_buf_t resp;
+            pc_body_t resp;
+            /* resp is in caller memory and is not freed */
+            int resp_fits;
         } req;
 
         struct {
             const char *route;
-            pc_buf_t buf;
+            pc_body_t body;
         } push;
 
         struct {
@@ -149,6 +201,9 @@ struct pc_client_s {
     pc_event_t pending_events[PC_PRE_ALLOC_EVENT_SLOT_COUNT];
     QUEUE pending_ev_queue;
     int is_in_poll;
+
+    /* placed in memory of the embedder, which frees it */
+    int is_inplace;
 };
 
 void pc__trans_resp(pc_client_t *client, unsigned int req_id, const pc_buf_t *resp, const pc_error_t *error);
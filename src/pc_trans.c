@@ -226,7 +226,7 @@ void pc__trans_queue_push(pc_client_t *client, const char *route, const pc_buf_t
 
     PC_EV_SET_PUSH(ev->type);
     ev->data.push.route = pc_lib_strdup(route);
-    ev->data.push.buf = pc_buf_copy(buf);
+    ev->data.push.body = pc__body_copy(client, buf);
 
     QUEUE_INSERT_TAIL(&client->pending_ev_queue, &ev->queue);
 
@@ -284,6 +284,8 @@ void pc__trans_sent(pc_client_t* client, unsigned int seq_num, const pc_error_t
         }
 
         pc_buf_free(&target->base.msg_buf);
+        pc_prepared_msg_release(target->base.prepared);
+        target->base.prepared = NULL;
 
         pc_lib_free((char*)target->base.route);
         target->base.route = NULL;
@@ -376,6 +378,95 @@ void pc_trans_resp(pc_client_t* client, unsigned int req_id, const pc_buf_t *res
     }
 }
 
+/*
+ * Returns the pending request `req_id`, or NULL.
+ *
+ * The request is only released after the transport calls pc_trans_resp for
+ * it, so the transport can use it unlocked until then.
+ */
+static pc_request_t* pc__find_request(pc_client_t* client, unsigned int req_id)
+{
+    QUEUE* q = NULL;
+    pc_request_t *target = NULL;
+
+    pc_mutex_lock(&client->req_mutex);
+    QUEUE_FOREACH(q, &client->req_queue) {
+        pc_request_t *req = (pc_request_t* )QUEUE_DATA(q, pc_common_req_t, queue);
+        if (req->req_id == req_id) {
+            target = req;
+            break;
+        }
+    }
+    pc_mutex_unlock(&client->req_mutex);
+
+    return target;
+}
+
+/*
+ * Tells whether `resp` is in the caller memory of `req`.
+ */
+static int pc__resp_fits(const pc_request_t* req, const pc_buf_t* resp)
+{
+    return resp && resp->base
+        && ((req->resp_buf && resp->base == req->resp_buf) || (req->resp_mem && resp->base == req->resp_mem));
+}
+
+uint8_t* pc_trans_resp_buf(pc_client_t* client, unsigned int req_id, size_t* cap)
+{
+    pc_request_t *req = client ? pc__find_request(client, req_id) : NULL;
+
+    if (!req || !req->resp_buf) {
+        return NULL;
+    }
+
+    *cap = req->resp_buf_cap;
+    return req->resp_buf;
+}
+
+uint8_t* pc_trans_resp_alloc(pc_client_t* client, unsigned int req_id, size_t size)
+{
+    pc_request_t *req = client ? pc__find_request(client, req_id) : NULL;
+
+    if (!req) {
+        return NULL;
+    }
+
+    if (req->resp_buf && size <= req->resp_buf_cap) {
+        return req->resp_buf;
+    }
+
+    if (req->resp_alloc) {
+        req->resp_mem = req->resp_alloc(req, size);
+        return (uint8_t* )req->resp_mem;
+    }
+
+    pc_lib_log(PC_LOG_DEBUG, "pc_trans_resp_alloc - response does not fit, req_id: %u, size: %lu",
+               req_id, (unsigned long)size);
+    return NULL;
+}
+
+int pc_trans_resp_chunk(pc_client_t* client, unsigned int req_id, const uint8_t *chunk, size_t len)
+{
+    pc_request_t *target = NULL;
+
+    if (!client) {
+        pc_lib_log(PC_LOG_ERROR, "pc_trans_resp_chunk - client is null");
+        return PC_RC_INVALID_ARG;
+    }
+
+    target = pc__find_request(client, req_id);
+    if (!target) {
+        pc_lib_log(PC_LOG_ERROR, "pc_trans_resp_chunk - no pending request found, req id: %u", req_id);
+        return PC_RC_NOT_FOUND;
+    }
+
+    if (target->chunk_cb && target->chunk_cb(target, chunk, len)) {
+        return PC_RC_ERROR;
+    }
+
+    return PC_RC_OK;
+}
+
 void pc__trans_queue_resp(pc_client_t* client, unsigned int req_id, const pc_buf_t *resp, const pc_error_t *error)
 {
     pc_mutex_lock(&client->event_mutex);
@@ -402,8 +493,25 @@ void pc__trans_queue_resp(pc_client_t* client, unsigned int req_id, const pc_buf
 
     QUEUE_INIT(&ev->queue);
     ev->data.req.req_id = req_id;
-    ev->data.req.resp = pc_buf_copy(resp);
-    ev->data.req.error = pc__error_dup(error);
+    if (error) {
+        memset(&ev->data.req.resp, 0, sizeof(pc_body_t));
+        ev->data.req.resp_fits = 0;
+        ev->data.req.resp.raw = pc_buf_copy(resp);
+        ev->data.req.error = pc__error_dup(error);
+    } else {
+        pc_request_t *req = pc__find_request(client, req_id);
+
+        /* bodies in caller memory are not copied */
+        ev->data.req.resp_fits = req && pc__resp_fits(req, resp);
+        if (ev->data.req.resp_fits) {
+            memset(&ev->data.req.resp, 0, sizeof(pc_body_t));
+            ev->data.req.resp.raw = *resp;
+        } else {
+            ev->data.req.resp = pc__body_copy(client, resp);
+        }
+        /* a zero error code tells pc__handle_event the request succeeded */
+        memset(&ev->data.req.error, 0, sizeof(pc_error_t));
+    }
 
     QUEUE_INSERT_TAIL(&client->pending_ev_queue, &ev->queue);
 
@@ -440,13 +548,16 @@ void pc__trans_resp(pc_client_t* client, unsigned int req_id, const pc_buf_t *re
         if (error && target->error_cb) {
             target->error_cb(target, error);
         } else if (!error) {
+            target->resp_fits = pc__resp_fits(target, resp);
             target->cb(target, resp);
         }
 
         pc_buf_free(&target->base.msg_buf);
         pc_lib_free((char*)target->base.route);
+        pc_prepared_msg_release(target->base.prepared);
 
         target->base.route = NULL;
+        target->base.prepared = NULL;
 
         if (PC_IS_PRE_ALLOC(target->base.type)) {
             pc_mutex_lock(&client->req_mutex);
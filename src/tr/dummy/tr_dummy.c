@@ -97,6 +97,11 @@ static pc_transport_t* dummy_trans_create(pc_transport_plugin_t* plugin)
     trans->internal_data = dummy_internal_data;
     trans->plugin = dummy_plugin;
     trans->quality = dummy_conn_quality;
+    trans->send_with_opts = NULL;
+    trans->stats = NULL;
+    trans->send_prepared = NULL;
+    trans->connect_endpoints = NULL;
+    trans->endpoint_health = NULL;
 
     return trans;
 }
@@ -0,0 +1,250 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#include <string.h>
+
+#include <pitaya.h>
+#include <pc_lib.h>
+
+#include "pr_codec.h"
+#include "pr_gzip.h"
+#include "pr_lz4.h"
+
+static const pr_codec_t* pr__codecs[PR_CODEC_MAX] = {
+    &pr_codec_zlib,
+    &pr_codec_lz4,
+};
+static int pr__codec_count = 2;
+
+/*
+ * LZ4 codec. The body is the compressed block prefixed by the
+ * uncompressed size, see pr_lz4.h.
+ */
+static int pr__lz4_compress(pr_gzip_engine_t* engine, const pr_dict_t* dict,
+                            unsigned char** output, size_t* output_size,
+                            const unsigned char* data, size_t size)
+{
+    size_t cap = 4 + PR_LZ4_BOUND(size);
+    unsigned char* out;
+    size_t len;
+
+    (void)dict;
+
+    if (size > PR_LZ4_MAX_OUTPUT) {
+        pc_lib_log(PC_LOG_ERROR, "pr__lz4_compress - body too big: %lu bytes", (unsigned long)size);
+        return -1;
+    }
+
+    if (!engine->lz4_table) {
+        engine->lz4_table = (uint32_t*)pc_lib_malloc(PR_LZ4_HASH_SIZE * sizeof(uint32_t));
+    }
+
+    out = (unsigned char*)pc_lib_malloc(cap);
+    out[0] = (unsigned char)(size & 0xff);
+    out[1] = (unsigned char)((size >> 8) & 0xff);
+    out[2] = (unsigned char)((size >> 16) & 0xff);
+    out[3] = (unsigned char)((size >> 24) & 0xff);
+
+    len = pr_lz4_compress_block(engine->lz4_table, data, size, out + 4, cap - 4);
+    if (len == 0) {
+        pc_lib_log(PC_LOG_ERROR, "pr__lz4_compress - output does not fit in the bound");
+        pc_lib_free(out);
+        return -1;
+    }
+
+    *output = out;
+    *output_size = len + 4;
+    return 0;
+}
+
+static int pr__lz4_decompress(pr_gzip_engine_t* engine, const pr_dict_store_t* dicts,
+                              unsigned char** output, size_t* output_size,
+                              const unsigned char* data, size_t size)
+{
+    size_t expected;
+    int64_t len;
+
+    (void)dicts;
+
+    if (size < 4) {
+        pc_lib_log(PC_LOG_ERROR, "pr__lz4_decompress - body too short");
+        return -1;
+    }
+
+    expected = (size_t)data[0] | ((size_t)data[1] << 8) | ((size_t)data[2] << 16) | ((size_t)data[3] << 24);
+    if (expected > PR_LZ4_MAX_OUTPUT) {
+        pc_lib_log(PC_LOG_ERROR, "pr__lz4_decompress - invalid size: %lu", (unsigned long)expected);
+        return -1;
+    }
+
+    pr_gzip_engine_reserve(engine, expected);
+
+    len = pr_lz4_decompress_block(data + 4, size - 4, engine->inflate_buf, expected);
+    if (len < 0 || (size_t)len != expected) {
+        pc_lib_log(PC_LOG_ERROR, "pr__lz4_decompress - malformed block");
+        return -1;
+    }
+
+    *output = engine->inflate_buf;
+    *output_size = expected;
+    return 0;
+}
+
+static int pr__lz4_decompress_to(const pr_dict_store_t* dicts, unsigned char* out, size_t cap,
+                                 size_t* output_size, const unsigned char* data, size_t size)
+{
+    size_t expected;
+    int64_t len;
+
+    (void)dicts;
+
+    if (size < 4) {
+        pc_lib_log(PC_LOG_ERROR, "pr__lz4_decompress_to - body too short");
+        return -1;
+    }
+
+    expected = (size_t)data[0] | ((size_t)data[1] << 8) | ((size_t)data[2] << 16) | ((size_t)data[3] << 24);
+    if (expected > PR_LZ4_MAX_OUTPUT) {
+        pc_lib_log(PC_LOG_ERROR, "pr__lz4_decompress_to - invalid size: %lu", (unsigned long)expected);
+        return -1;
+    }
+
+    *output_size = expected;
+    if (expected > cap) {
+        return PR_CODEC_SHORT_BUFFER;
+    }
+
+    len = pr_lz4_decompress_block(data + 4, size - 4, out, expected);
+    if (len < 0 || (size_t)len != expected) {
+        pc_lib_log(PC_LOG_ERROR, "pr__lz4_decompress_to - malformed block");
+        return -1;
+    }
+
+    return 0;
+}
+
+const pr_codec_t pr_codec_lz4 = {
+    PR_CODEC_LZ4,
+    0, /* supports_dict */
+    pr__lz4_compress,
+    pr__lz4_decompress,
+    pr__lz4_decompress_to,
+};
+
+int pr_codec_register(const pr_codec_t* codec)
+{
+    if (!codec || !codec->name || !codec->compress || !codec->decompress) {
+        return PC_RC_INVALID_ARG;
+    }
+
+    if (pr_codec_find(codec->name) || pr__codec_count == PR_CODEC_MAX) {
+        pc_lib_log(PC_LOG_ERROR, "pr_codec_register - cannot register codec %s", codec->name);
+        return PC_RC_INVALID_ARG;
+    }
+
+    pr__codecs[pr__codec_count++] = codec;
+    return PC_RC_OK;
+}
+
+const pr_codec_t* pr_codec_find(const char* name)
+{
+    int i;
+    for (i = 0; i < pr__codec_count; ++i) {
+        if (strcmp(pr__codecs[i]->name, name) == 0) {
+            return pr__codecs[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Calls `cb` with every registered codec of the comma separated `preference`,
+ * in order. Returns the number of codecs found.
+ */
+static int pr__for_each_preferred(const char* preference, void (*cb)(const pr_codec_t*, void*), void* ex)
+{
+    const char* p = preference;
+    int found = 0;
+
+    while (p && *p) {
+        const char* end = strchr(p, ',');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        char name[32];
+
+        while (len > 0 && *p == ' ') {
+            p++;
+            len--;
+        }
+
+        if (len > 0 && len < sizeof(name)) {
+            const pr_codec_t* codec;
+            memcpy(name, p, len);
+            name[len] = '\0';
+
+            codec = pr_codec_find(name);
+            if (codec) {
+                cb(codec, ex);
+                found++;
+            } else {
+                pc_lib_log(PC_LOG_WARN, "pr__for_each_preferred - unknown codec %s", name);
+            }
+        }
+
+        p = end ? end + 1 : NULL;
+    }
+
+    return found;
+}
+
+static void pr__add_name(const pr_codec_t* codec, void* ex)
+{
+    pc_JSON_AddItemToArray((pc_JSON*)ex, pc_JSON_CreateString(codec->name));
+}
+
+pc_JSON* pr_codec_handshake_names(const char* preference)
+{
+    pc_JSON* names;
+
+    if (!preference || strcmp(preference, PR_CODEC_ZLIB) == 0) {
+        return NULL;
+    }
+
+    names = pc_JSON_CreateArray();
+    pr__for_each_preferred(preference, pr__add_name, names);
+    return names;
+}
+
+typedef struct {
+    const char* chosen;
+    const pr_codec_t* codec;
+} pr__negotiation_t;
+
+static void pr__match_chosen(const pr_codec_t* codec, void* ex)
+{
+    pr__negotiation_t* n = (pr__negotiation_t*)ex;
+    if (strcmp(codec->name, n->chosen) == 0) {
+        n->codec = codec;
+    }
+}
+
+const pr_codec_t* pr_codec_negotiate(const char* preference, const char* chosen)
+{
+    pr__negotiation_t n;
+
+    if (!chosen || strcmp(chosen, PR_CODEC_ZLIB) == 0) {
+        return &pr_codec_zlib;
+    }
+
+    n.chosen = chosen;
+    n.codec = NULL;
+    pr__for_each_preferred(preference, pr__match_chosen, &n);
+
+    if (!n.codec) {
+        pc_lib_log(PC_LOG_WARN, "pr_codec_negotiate - server chose codec %s, which was not offered", chosen);
+        return &pr_codec_zlib;
+    }
+
+    return n.codec;
+}
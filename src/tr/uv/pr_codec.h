@@ -0,0 +1,92 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifndef PR_CODEC_H
+#define PR_CODEC_H
+
+#include <stddef.h>
+
+#include <pc_JSON.h>
+
+#include "pr_dict.h"
+
+#define PR_CODEC_ZLIB "zlib"
+#define PR_CODEC_LZ4 "lz4"
+
+#define PR_CODEC_MAX 8
+
+/**
+ * Returned by `decompress_to` when the output does not fit.
+ */
+#define PR_CODEC_SHORT_BUFFER (-100)
+
+struct pr_gzip_engine_s;
+
+/**
+ * Algorithm used to compress message bodies.
+ *
+ * The `data_compressed` bit of a message only tells the body is compressed,
+ * the codec is the one negotiated in the handshake: the client offers the
+ * codecs it is configured with in `sys.codecs` and the server answers with
+ * the chosen one in `sys.codec`. Servers that do not answer get zlib.
+ *
+ * Both functions work on the state kept in the engine and return 0 on
+ * success. `compress` is called with the engine deflate mutex held and
+ * allocates `*output`, while `decompress` writes into the engine pooled
+ * buffer. Codecs that do not support preset dictionaries ignore them.
+ */
+typedef struct pr_codec_s {
+    const char* name;
+    int supports_dict;
+
+    int (*compress)(struct pr_gzip_engine_s* engine, const pr_dict_t* dict,
+                    unsigned char** output, size_t* output_size,
+                    const unsigned char* data, size_t size);
+    int (*decompress)(struct pr_gzip_engine_s* engine, const pr_dict_store_t* dicts,
+                      unsigned char** output, size_t* output_size,
+                      const unsigned char* data, size_t size);
+
+    /**
+     * Optional. Decompresses into the caller buffer `out` without touching
+     * any engine, so it can be called from any thread. When the output does
+     * not fit in `cap` bytes it returns PR_CODEC_SHORT_BUFFER with the size
+     * needed in `*output_size`.
+     */
+    int (*decompress_to)(const pr_dict_store_t* dicts, unsigned char* out, size_t cap,
+                         size_t* output_size, const unsigned char* data, size_t size);
+} pr_codec_t;
+
+extern const pr_codec_t pr_codec_zlib;
+extern const pr_codec_t pr_codec_lz4;
+
+/**
+ * Adds a codec to the registry. The registry is not locked, as the loop
+ * threads look codecs up on every handshake, so codecs are only to be
+ * registered before pc_lib_init.
+ *
+ * Returns PC_RC_INVALID_ARG if the name is already taken or the registry is full.
+ */
+int pr_codec_register(const pr_codec_t* codec);
+
+/**
+ * Returns the registered codec with the given name, or NULL.
+ */
+const pr_codec_t* pr_codec_find(const char* name);
+
+/**
+ * Returns the json array of codec names offered in the handshake for the
+ * comma separated `preference` list, or NULL when only zlib would be offered,
+ * in which case nothing is sent and the handshake is the same as before
+ * codecs were negotiated. Unknown names are logged and ignored.
+ */
+pc_JSON* pr_codec_handshake_names(const char* preference);
+
+/**
+ * Returns the codec to use given the `preference` list and the name chosen
+ * by the server, which may be NULL. Falls back to zlib.
+ */
+const pr_codec_t* pr_codec_negotiate(const char* preference, const char* chosen);
+
+#endif /* PR_CODEC_H */
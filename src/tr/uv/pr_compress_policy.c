@@ -0,0 +1,222 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#include <string.h>
+
+#include <pitaya.h>
+#include <pc_lib.h>
+
+#include "pr_compress_policy.h"
+
+static uint32_t pr__route_hash(const char* route)
+{
+    /* FNV-1a */
+    uint32_t h = 2166136261u;
+    for (; *route; ++route) {
+        h ^= (uint8_t)*route;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/*
+ * Finds the entry of `route`, creating it when `create` is set.
+ * Must be called with the policy mutex held.
+ */
+static pr_compress_route_t* pr__route_get(pr_compress_policy_t* policy, const char* route, int create)
+{
+    uint32_t hash = pr__route_hash(route);
+    pr_compress_route_t** bucket = &policy->routes[hash % PR_COMPRESS_ROUTE_BUCKETS];
+    pr_compress_route_t* r;
+
+    for (r = *bucket; r; r = r->next) {
+        if (r->hash == hash && strcmp(r->route, route) == 0) {
+            return r;
+        }
+    }
+
+    if (!create || policy->route_count >= PR_COMPRESS_MAX_ROUTES) {
+        return NULL;
+    }
+
+    r = (pr_compress_route_t*)pc_lib_malloc(sizeof(pr_compress_route_t));
+    memset(r, 0, sizeof(pr_compress_route_t));
+    r->route = (char*)pc_lib_strdup(route);
+    r->hash = hash;
+    r->next = *bucket;
+    *bucket = r;
+    policy->route_count++;
+
+    return r;
+}
+
+static int pr__route_is_poor(const pr_compress_policy_t* policy, const pr_compress_route_t* r)
+{
+    return r->samples >= PR_COMPRESS_WARMUP_SAMPLES
+        && r->ratio > (uint32_t)(1000 - policy->min_savings * 10);
+}
+
+void pr_compress_policy_init(pr_compress_policy_t* policy, const pc_client_config_t* config)
+{
+    memset(policy, 0, sizeof(pr_compress_policy_t));
+    pc_mutex_init(&policy->mutex);
+    pr_dict_store_init(&policy->dicts);
+
+    policy->enabled = !config->disable_compression;
+    policy->min_size = config->compression_min_size > 0
+        ? (size_t)config->compression_min_size
+        : PR_COMPRESS_DEFAULT_MIN_SIZE;
+    policy->min_savings = config->compression_min_savings > 0
+        ? config->compression_min_savings
+        : PR_COMPRESS_DEFAULT_MIN_SAVINGS;
+
+    if (policy->min_savings > 99) {
+        pc_lib_log(PC_LOG_WARN, "pr_compress_policy_init - invalid compression_min_savings %d, using 99",
+                   policy->min_savings);
+        policy->min_savings = 99;
+    }
+}
+
+void pr_compress_policy_cleanup(pr_compress_policy_t* policy)
+{
+    int i;
+    for (i = 0; i < PR_COMPRESS_ROUTE_BUCKETS; ++i) {
+        pr_compress_route_t* r = policy->routes[i];
+        while (r) {
+            pr_compress_route_t* next = r->next;
+            pc_lib_free(r->route);
+            pc_lib_free(r);
+            r = next;
+        }
+        policy->routes[i] = NULL;
+    }
+    policy->route_count = 0;
+
+    pr_dict_store_cleanup(&policy->dicts);
+    pc_mutex_destroy(&policy->mutex);
+}
+
+int pr_compress_policy_should_compress(pr_compress_policy_t* policy, const char* route,
+                                       size_t size, int mode)
+{
+    int ret = 1;
+
+    if (size == 0) {
+        return 0;
+    }
+
+    /* an explicit request always wins over the client policy */
+    if (mode == PC_COMPRESSION_ALWAYS) {
+        return 1;
+    }
+
+    pc_mutex_lock(&policy->mutex);
+
+    if (mode == PC_COMPRESSION_NEVER || !policy->enabled || size < policy->min_size) {
+        ret = 0;
+    } else if (route) {
+        pr_compress_route_t* r = pr__route_get(policy, route, 0);
+        if (r && pr__route_is_poor(policy, r)) {
+            if (++r->skipped < PR_COMPRESS_RESAMPLE_INTERVAL) {
+                ret = 0;
+            } else {
+                r->skipped = 0;
+            }
+        }
+    }
+
+    if (!ret) {
+        policy->compress_skipped++;
+    }
+
+    pc_mutex_unlock(&policy->mutex);
+    return ret;
+}
+
+int pr_compress_policy_accepts(const pr_compress_policy_t* policy, size_t size,
+                               size_t compressed_size, int mode)
+{
+    if (compressed_size >= size) {
+        return 0;
+    }
+
+    if (mode == PC_COMPRESSION_ALWAYS) {
+        return 1;
+    }
+
+    /* min_savings is read only after init, so no locking is needed */
+    return (size - compressed_size) * 100 >= size * (size_t)policy->min_savings;
+}
+
+void pr_compress_policy_record(pr_compress_policy_t* policy, const char* route, size_t size,
+                               size_t compressed_size, uint64_t elapsed_ns, int accepted,
+                               int with_dict)
+{
+    pc_mutex_lock(&policy->mutex);
+
+    policy->compress_time_ns += elapsed_ns;
+    if (accepted) {
+        policy->compress_msgs++;
+        policy->compress_bytes_saved += size - compressed_size;
+        if (with_dict) {
+            policy->compress_dict_msgs++;
+        }
+    } else {
+        policy->compress_rejected++;
+    }
+
+    if (route && size > 0) {
+        pr_compress_route_t* r = pr__route_get(policy, route, 1);
+        if (r) {
+            uint64_t ratio = (uint64_t)compressed_size * 1000 / size;
+            if (ratio > 1000) {
+                ratio = 1000;
+            }
+            r->ratio = r->samples == 0
+                ? (uint32_t)ratio
+                : (uint32_t)((r->ratio * 3 + ratio) / 4);
+            if (r->samples < PR_COMPRESS_WARMUP_SAMPLES) {
+                r->samples++;
+            }
+        }
+    }
+
+    pc_mutex_unlock(&policy->mutex);
+}
+
+void pr_compress_policy_record_inflate(pr_compress_policy_t* policy, size_t compressed_size,
+                                       size_t size, uint64_t elapsed_ns)
+{
+    pc_mutex_lock(&policy->mutex);
+    policy->decompress_msgs++;
+    policy->decompress_time_ns += elapsed_ns;
+    if (size > compressed_size) {
+        policy->decompress_bytes_saved += size - compressed_size;
+    }
+    pc_mutex_unlock(&policy->mutex);
+}
+
+void pr_compress_policy_record_offload(pr_compress_policy_t* policy)
+{
+    pc_mutex_lock(&policy->mutex);
+    policy->offload_msgs++;
+    pc_mutex_unlock(&policy->mutex);
+}
+
+void pr_compress_policy_stats(pr_compress_policy_t* policy, pc_client_stats_t* stats)
+{
+    pc_mutex_lock(&policy->mutex);
+    stats->compress_msgs = policy->compress_msgs;
+    stats->compress_skipped = policy->compress_skipped;
+    stats->compress_rejected = policy->compress_rejected;
+    stats->compress_time_us = policy->compress_time_ns / 1000;
+    stats->compress_bytes_saved = policy->compress_bytes_saved;
+    stats->compress_dict_msgs = policy->compress_dict_msgs;
+    stats->decompress_msgs = policy->decompress_msgs;
+    stats->decompress_time_us = policy->decompress_time_ns / 1000;
+    stats->decompress_bytes_saved = policy->decompress_bytes_saved;
+    stats->offload_msgs = policy->offload_msgs;
+    pc_mutex_unlock(&policy->mutex);
+}
@@ -0,0 +1,122 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifndef PR_COMPRESS_POLICY_H
+#define PR_COMPRESS_POLICY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <pitaya.h>
+#include <pc_mutex.h>
+
+#include "pr_dict.h"
+
+/**
+ * Defaults used when the matching pc_client_config_t field is 0.
+ */
+#define PR_COMPRESS_DEFAULT_MIN_SIZE 64
+#define PR_COMPRESS_DEFAULT_MIN_SAVINGS 10 /* percent */
+
+/**
+ * A route is only judged after this many samples.
+ */
+#define PR_COMPRESS_WARMUP_SAMPLES 4
+
+/**
+ * Routes that do not compress well are still sampled once every
+ * PR_COMPRESS_RESAMPLE_INTERVAL messages, so they can recover if
+ * their payloads change.
+ */
+#define PR_COMPRESS_RESAMPLE_INTERVAL 32
+
+#define PR_COMPRESS_ROUTE_BUCKETS 64
+#define PR_COMPRESS_MAX_ROUTES 1024
+
+typedef struct pr_compress_route_s {
+    struct pr_compress_route_s* next;
+    char* route;
+    uint32_t hash;
+
+    uint32_t samples;
+    /* moving average of compressed size / original size, in per mille */
+    uint32_t ratio;
+    /* messages skipped since the last sample */
+    uint32_t skipped;
+} pr_compress_route_t;
+
+/**
+ * Decides which message bodies are worth compressing and keeps the
+ * counters reported by pc_client_stats.
+ *
+ * Messages are encoded on the threads calling the request/notify functions,
+ * so every access goes through `mutex`.
+ */
+typedef struct {
+    pc_mutex_t mutex;
+
+    int enabled;
+    size_t min_size;
+    int min_savings;
+
+    pr_compress_route_t* routes[PR_COMPRESS_ROUTE_BUCKETS];
+    int route_count;
+
+    /* preset dictionaries, global or per route */
+    pr_dict_store_t dicts;
+
+    uint64_t compress_msgs;
+    uint64_t compress_skipped;
+    uint64_t compress_rejected;
+    uint64_t compress_time_ns;
+    uint64_t compress_bytes_saved;
+    uint64_t compress_dict_msgs;
+
+    uint64_t decompress_msgs;
+    uint64_t decompress_time_ns;
+    uint64_t decompress_bytes_saved;
+
+    uint64_t offload_msgs;
+} pr_compress_policy_t;
+
+void pr_compress_policy_init(pr_compress_policy_t* policy, const pc_client_config_t* config);
+void pr_compress_policy_cleanup(pr_compress_policy_t* policy);
+
+/**
+ * Returns true if a body of `size` bytes sent to `route` should be compressed.
+ * `mode` is one of the PC_COMPRESSION_* values of pc_request_opts_t.
+ */
+int pr_compress_policy_should_compress(pr_compress_policy_t* policy, const char* route,
+                                       size_t size, int mode);
+
+/**
+ * Returns true if compressing `size` bytes into `compressed_size` bytes saves
+ * enough to be worth sending compressed.
+ */
+int pr_compress_policy_accepts(const pr_compress_policy_t* policy, size_t size,
+                               size_t compressed_size, int mode);
+
+/**
+ * Records the result of compressing a body sent to `route`, `with_dict`
+ * tells if a preset dictionary was used.
+ */
+void pr_compress_policy_record(pr_compress_policy_t* policy, const char* route, size_t size,
+                               size_t compressed_size, uint64_t elapsed_ns, int accepted,
+                               int with_dict);
+
+/**
+ * Records a body received compressed.
+ */
+void pr_compress_policy_record_inflate(pr_compress_policy_t* policy, size_t compressed_size,
+                                       size_t size, uint64_t elapsed_ns);
+
+/**
+ * Records a body (de)compressed on the thread pool.
+ */
+void pr_compress_policy_record_offload(pr_compress_policy_t* policy);
+
+void pr_compress_policy_stats(pr_compress_policy_t* policy, pc_client_stats_t* stats);
+
+#endif /* PR_COMPRESS_POLICY_H */
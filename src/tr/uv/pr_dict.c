@@ -0,0 +1,228 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#include <pc_assert.h>
+#include <string.h>
+#include <zlib.h>
+
+#include <pitaya.h>
+#include <pc_lib.h>
+
+#include "pr_dict.h"
+
+static int pr__base64_value(char c)
+{
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+/*
+ * Decodes the base64 string `in`, returning a new buffer or NULL if it is not valid base64.
+ */
+static unsigned char* pr__base64_decode(const char* in, size_t* out_len)
+{
+    size_t len = strlen(in);
+    unsigned char* out;
+    size_t i, n = 0;
+    uint32_t acc = 0;
+    int bits = 0;
+
+    while (len > 0 && in[len - 1] == '=') {
+        len--;
+    }
+
+    out = (unsigned char*)pc_lib_malloc(len * 3 / 4 + 1);
+
+    for (i = 0; i < len; ++i) {
+        int v = pr__base64_value(in[i]);
+        if (v < 0) {
+            pc_lib_free(out);
+            return NULL;
+        }
+        acc = (acc << 6) | (uint32_t)v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out[n++] = (unsigned char)(acc >> bits);
+        }
+    }
+
+    *out_len = n;
+    return out;
+}
+
+static void pr__add_dict(pr_dict_store_t* store, const char* route, const pc_JSON* item)
+{
+    pr_dict_t* d;
+    unsigned char* data;
+    size_t len = 0;
+
+    if (!item || item->type != pc_JSON_String || !item->valuestring) {
+        pc_lib_log(PC_LOG_WARN, "pr_dict_store_load - invalid dictionary for route %s", route ? route : "(global)");
+        return;
+    }
+
+    data = pr__base64_decode(item->valuestring, &len);
+    if (!data || len == 0) {
+        pc_lib_log(PC_LOG_WARN, "pr_dict_store_load - dictionary for route %s is not valid base64", route ? route : "(global)");
+        pc_lib_free(data);
+        return;
+    }
+
+    if (len > PR_DICT_MAX_SIZE) {
+        /* zlib would ignore the beginning anyway */
+        memmove(data, data + len - PR_DICT_MAX_SIZE, PR_DICT_MAX_SIZE);
+        len = PR_DICT_MAX_SIZE;
+    }
+
+    d = (pr_dict_t*)pc_lib_malloc(sizeof(pr_dict_t));
+    memset(d, 0, sizeof(pr_dict_t));
+    d->route = route ? (char*)pc_lib_strdup(route) : NULL;
+    d->data = data;
+    d->len = len;
+    d->id = (uint32_t)adler32(adler32(0L, Z_NULL, 0), data, (uInt)len);
+
+    d->next = store->dicts;
+    store->dicts = d;
+    if (!route) {
+        store->global = d;
+    }
+
+    pc_lib_log(PC_LOG_INFO, "pr_dict_store_load - loaded dictionary %u for route %s, %lu bytes",
+               d->id, route ? route : "(global)", (unsigned long)len);
+}
+
+void pr_dict_store_init(pr_dict_store_t* store)
+{
+    memset(store, 0, sizeof(pr_dict_store_t));
+    pc_mutex_init(&store->mutex);
+}
+
+void pr_dict_store_cleanup(pr_dict_store_t* store)
+{
+    pr_dict_t* d = store->dicts;
+    while (d) {
+        pr_dict_t* next = d->next;
+        pc_lib_free(d->route);
+        pc_lib_free(d->data);
+        pc_lib_free(d);
+        d = next;
+    }
+    store->dicts = NULL;
+    store->global = NULL;
+
+    pc_JSON_Delete(store->ls_json);
+    store->ls_json = NULL;
+
+    pc_mutex_destroy(&store->mutex);
+}
+
+void pr_dict_store_load(pr_dict_store_t* store, pc_JSON* json)
+{
+    pc_JSON* routes;
+    pc_JSON* item;
+
+    pc_assert(!store->dicts && !store->ls_json);
+
+    if (!json) {
+        return;
+    }
+
+    store->ls_json = json;
+
+    pr__add_dict(store, NULL, pc_JSON_GetObjectItem(json, "global"));
+
+    routes = pc_JSON_GetObjectItem(json, "routes");
+    if (routes && routes->type == pc_JSON_Object) {
+        for (item = routes->child; item; item = item->next) {
+            pr__add_dict(store, item->string, item);
+        }
+    }
+}
+
+int pr_dict_store_empty(const pr_dict_store_t* store)
+{
+    return store->dicts == NULL;
+}
+
+pc_JSON* pr_dict_store_handshake_ids(pr_dict_store_t* store)
+{
+    pc_JSON* ids = pc_JSON_CreateArray();
+    pr_dict_t* d;
+
+    pc_mutex_lock(&store->mutex);
+    for (d = store->dicts; d; d = d->next) {
+        d->accepted = 0;
+        pc_JSON_AddItemToArray(ids, pc_JSON_CreateNumber((double)d->id));
+    }
+    pc_mutex_unlock(&store->mutex);
+
+    return ids;
+}
+
+void pr_dict_store_accept(pr_dict_store_t* store, const pc_JSON* ids)
+{
+    pc_JSON* item;
+    pr_dict_t* d;
+
+    if (!ids || ids->type != pc_JSON_Array) {
+        return;
+    }
+
+    pc_mutex_lock(&store->mutex);
+    for (item = ids->child; item; item = item->next) {
+        if (item->type != pc_JSON_Number) {
+            continue;
+        }
+        for (d = store->dicts; d; d = d->next) {
+            if (d->id == (uint32_t)item->valuedouble) {
+                d->accepted = 1;
+                pc_lib_log(PC_LOG_INFO, "pr_dict_store_accept - server accepted dictionary %u", d->id);
+            }
+        }
+    }
+    pc_mutex_unlock(&store->mutex);
+}
+
+const pr_dict_t* pr_dict_store_for_route(pr_dict_store_t* store, const char* route)
+{
+    const pr_dict_t* found = NULL;
+    pr_dict_t* d;
+
+    if (!store->dicts) {
+        return NULL;
+    }
+
+    pc_mutex_lock(&store->mutex);
+    if (route) {
+        for (d = store->dicts; d; d = d->next) {
+            if (d->route && d->accepted && strcmp(d->route, route) == 0) {
+                found = d;
+                break;
+            }
+        }
+    }
+    if (!found && store->global && store->global->accepted) {
+        found = store->global;
+    }
+    pc_mutex_unlock(&store->mutex);
+
+    return found;
+}
+
+const pr_dict_t* pr_dict_store_by_id(const pr_dict_store_t* store, uint32_t id)
+{
+    const pr_dict_t* d;
+    for (d = store->dicts; d; d = d->next) {
+        if (d->id == id) {
+            return d;
+        }
+    }
+    return NULL;
+}
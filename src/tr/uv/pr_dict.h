@@ -0,0 +1,96 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifndef PR_DICT_H
+#define PR_DICT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <pc_JSON.h>
+#include <pc_mutex.h>
+
+/**
+ * Key of the compression dictionaries in the local storage json.
+ *
+ * The value has the following format, with the dictionaries encoded in base64:
+ *
+ *   "compressionDicts": {
+ *       "global": "...",
+ *       "routes": { "room.room.join": "..." }
+ *   }
+ */
+#define PR_DICT_LCK "compressionDicts"
+
+/**
+ * zlib only looks at the last 32 KiB of a preset dictionary.
+ */
+#define PR_DICT_MAX_SIZE (32 * 1024)
+
+typedef struct pr_dict_s {
+    struct pr_dict_s* next;
+
+    /* route using this dictionary, NULL for the global one */
+    char* route;
+
+    /* adler32 of the data, the same id zlib writes in the stream header */
+    uint32_t id;
+    unsigned char* data;
+    size_t len;
+
+    /* the server told in the handshake it knows this dictionary */
+    int accepted;
+} pr_dict_t;
+
+/**
+ * Preset dictionaries known by a transport.
+ *
+ * Dictionaries are loaded once, before the uv thread starts, and are never
+ * modified afterwards. Only the `accepted` flags change on every handshake,
+ * therefore they are guarded by `mutex`.
+ */
+typedef struct {
+    pc_mutex_t mutex;
+    pr_dict_t* dicts;
+    pr_dict_t* global;
+
+    /* original local storage entry, written back when the local storage is updated */
+    pc_JSON* ls_json;
+} pr_dict_store_t;
+
+void pr_dict_store_init(pr_dict_store_t* store);
+void pr_dict_store_cleanup(pr_dict_store_t* store);
+
+/**
+ * Loads the dictionaries of the local storage entry `json`. The store takes
+ * ownership of `json`. Invalid entries are logged and ignored.
+ */
+void pr_dict_store_load(pr_dict_store_t* store, pc_JSON* json);
+
+int pr_dict_store_empty(const pr_dict_store_t* store);
+
+/**
+ * Returns the json array with the ids of all dictionaries, sent in the handshake.
+ * Also forgets which dictionaries were accepted by the previous server.
+ */
+pc_JSON* pr_dict_store_handshake_ids(pr_dict_store_t* store);
+
+/**
+ * Marks the dictionaries listed in the handshake response `ids` as accepted.
+ */
+void pr_dict_store_accept(pr_dict_store_t* store, const pc_JSON* ids);
+
+/**
+ * Returns the accepted dictionary used to compress bodies sent to `route`:
+ * the route dictionary if any, otherwise the global one. NULL if none.
+ */
+const pr_dict_t* pr_dict_store_for_route(pr_dict_store_t* store, const char* route);
+
+/**
+ * Returns the dictionary with the given id, NULL if unknown.
+ */
+const pr_dict_t* pr_dict_store_by_id(const pr_dict_store_t* store, uint32_t id);
+
+#endif /* PR_DICT_H */
@@ -1,75 +1,502 @@
 #include <pc_assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include <zlib.h>
 
 #include "pc_lib.h"
 #include "pr_gzip.h"
 
+// The windowBits parameter is the base two logarithm of the window size (the size of the history buffer).
+// It should be in the range 8..15 for this version of the library.
+// Larger values of this parameter result in better compression at the expense of memory usage.
+// This range of values also changes the decoding type:
+//  -8 to -15 for raw deflate
+//  8 to 15 for zlib
+// (8 to 15) + 16 for gzip
+// (8 to 15) + 32 to automatically detect gzip/zlib header
+#define PR_GZIP_INFLATE_WINDOW_BITS (15 + 32) // auto with windowbits of 15
+
+// Smallest output buffer used when decompressing.
+#define PR_GZIP_MIN_INFLATE_BYTES 1024
+
+// Initial guess of the expansion ratio of compressed data.
+#define PR_GZIP_DEFAULT_RATIO 4
+
+static void pr__init_stream(z_stream* s)
+{
+    memset(s, 0, sizeof(z_stream));
+    s->zalloc = Z_NULL;
+    s->zfree = Z_NULL;
+    s->opaque = Z_NULL;
+    s->next_in = Z_NULL;
+    s->avail_in = 0;
+}
+
+/*
+ * Deflates the whole input with a single call to `deflate`, since the output
+ * buffer is allocated with `deflateBound` and is therefore always big enough.
+ */
+static int pr__deflate(z_stream* strm, unsigned char** output, size_t* output_size,
+                       const unsigned char* data, size_t size)
+{
+    uLong bound = deflateBound(strm, (uLong)size);
+    unsigned char* out = (unsigned char*)pc_lib_malloc(bound);
+
+    strm->next_in = (Bytef*)data;
+    strm->avail_in = (uInt)size;
+    strm->next_out = out;
+    strm->avail_out = (uInt)bound;
+
+    int ret = deflate(strm, Z_FINISH);
+    if (ret != Z_STREAM_END) {
+        pc_lib_log(PC_LOG_ERROR, "pr__deflate - error compressing data: %s; ret: %d",
+                   strm->msg ? strm->msg : "", ret);
+        pc_lib_free(out);
+        *output = NULL;
+        *output_size = 0;
+        return ret == Z_OK ? Z_BUF_ERROR : ret;
+    }
+
+    *output = out;
+    *output_size = strm->total_out;
+    return Z_OK;
+}
+
+/*
+ * Sets the dictionary the stream asks for, its id is in strm->adler.
+ */
+static int pr__inflate_set_dict(z_stream* strm, const pr_dict_store_t* dicts)
+{
+    const pr_dict_t* dict = dicts ? pr_dict_store_by_id(dicts, (uint32_t)strm->adler) : NULL;
+    int ret;
+
+    if (!dict) {
+        pc_lib_log(PC_LOG_ERROR, "pr__inflate - unknown dictionary %lu", (unsigned long)strm->adler);
+        return Z_NEED_DICT;
+    }
+
+    ret = inflateSetDictionary(strm, dict->data, (uInt)dict->len);
+    if (ret != Z_OK) {
+        pc_lib_log(PC_LOG_ERROR, "pr__inflate - failed to set dictionary: %d", ret);
+    }
+    return ret;
+}
+
+/*
+ * Inflates the whole input into `*buf`, growing it geometrically when it is
+ * too small. `*cap` holds the current capacity of `*buf`.
+ */
+static int pr__inflate(z_stream* strm, const pr_dict_store_t* dicts,
+                       unsigned char** buf, size_t* cap, size_t* output_size,
+                       const unsigned char* data, size_t size)
+{
+    strm->next_in = (Bytef*)data;
+    strm->avail_in = (uInt)size;
+
+    size_t total = 0;
+    for (;;) {
+        strm->next_out = *buf + total;
+        strm->avail_out = (uInt)(*cap - total);
+
+        int ret = inflate(strm, Z_FINISH);
+        total = *cap - strm->avail_out;
+
+        if (ret == Z_STREAM_END) {
+            break;
+        }
+
+        if (ret == Z_NEED_DICT) {
+            ret = pr__inflate_set_dict(strm, dicts);
+            if (ret != Z_OK) {
+                *output_size = 0;
+                return ret;
+            }
+            continue;
+        }
+
+        if ((ret == Z_BUF_ERROR || ret == Z_OK) && strm->avail_out == 0) {
+            // The output buffer is full, double it and keep going.
+            size_t new_cap = *cap * 2;
+            *buf = (unsigned char*)pc_lib_realloc(*buf, new_cap);
+            *cap = new_cap;
+            continue;
+        }
+
+        pc_lib_log(PC_LOG_ERROR, "pr__inflate - error decompressing: %s; ret: %d",
+                   strm->msg ? strm->msg : "truncated input", ret);
+        *output_size = 0;
+        return ret == Z_OK || ret == Z_BUF_ERROR ? Z_DATA_ERROR : ret;
+    }
+
+    *output_size = total;
+    return Z_OK;
+}
+
+void pr_gzip_engine_init(pr_gzip_engine_t* engine, int level)
+{
+    memset(engine, 0, sizeof(pr_gzip_engine_t));
+    pc_mutex_init(&engine->deflate_mutex);
+    engine->codec = &pr_codec_zlib;
+    engine->level = level;
+    engine->inflate_ratio = PR_GZIP_DEFAULT_RATIO;
+}
+
+void pr_gzip_engine_cleanup(pr_gzip_engine_t* engine)
+{
+    if (engine->deflate_ready) {
+        deflateEnd(&engine->deflate_s);
+        engine->deflate_ready = 0;
+    }
+
+    if (engine->inflate_ready) {
+        inflateEnd(&engine->inflate_s);
+        engine->inflate_ready = 0;
+    }
+
+    pc_lib_free(engine->inflate_buf);
+    engine->inflate_buf = NULL;
+    engine->inflate_buf_cap = 0;
+
+    pc_lib_free(engine->lz4_table);
+    engine->lz4_table = NULL;
+
+    pc_mutex_destroy(&engine->deflate_mutex);
+}
+
+void pr_gzip_engine_set_codec(pr_gzip_engine_t* engine, const pr_codec_t* codec)
+{
+    pc_mutex_lock(&engine->deflate_mutex);
+    engine->codec = codec;
+    pc_mutex_unlock(&engine->deflate_mutex);
+}
+
+const pr_codec_t* pr_gzip_engine_codec(pr_gzip_engine_t* engine)
+{
+    const pr_codec_t* codec;
+    pc_mutex_lock(&engine->deflate_mutex);
+    codec = engine->codec;
+    pc_mutex_unlock(&engine->deflate_mutex);
+    return codec;
+}
+
+void pr_gzip_engine_reserve(pr_gzip_engine_t* engine, size_t size)
+{
+    if (size < PR_GZIP_MIN_INFLATE_BYTES) {
+        size = PR_GZIP_MIN_INFLATE_BYTES;
+    }
+
+    if (size > engine->inflate_buf_cap) {
+        // The previous contents are not needed, so avoid the copy made by realloc.
+        pc_lib_free(engine->inflate_buf);
+        engine->inflate_buf = (unsigned char*)pc_lib_malloc(size);
+        engine->inflate_buf_cap = size;
+    }
+}
+
+int pr_gzip_engine_compress(pr_gzip_engine_t* engine,
+                            const pr_dict_t* dict,
+                            unsigned char** output,
+                            size_t* output_size,
+                            const unsigned char* data,
+                            size_t size)
+{
+    int ret;
+
+    pc_mutex_lock(&engine->deflate_mutex);
+    ret = engine->codec->compress(engine, dict, output, output_size, data, size);
+    pc_mutex_unlock(&engine->deflate_mutex);
+
+    return ret;
+}
+
+int pr_gzip_engine_decompress(pr_gzip_engine_t* engine,
+                              const pr_dict_store_t* dicts,
+                              unsigned char** output,
+                              size_t* output_size,
+                              const unsigned char* data,
+                              size_t size)
+{
+    int ret = engine->codec->decompress(engine, dicts, output, output_size, data, size);
+    if (ret != 0) {
+        *output = NULL;
+    }
+    return ret;
+}
+
+/*
+ * zlib codec, called with the deflate mutex held.
+ */
+static int pr__zlib_compress(pr_gzip_engine_t* engine,
+                             const pr_dict_t* dict,
+                             unsigned char** output,
+                             size_t* output_size,
+                             const unsigned char* data,
+                             size_t size)
+{
+    int ret;
+
+    if (!engine->deflate_ready) {
+        pr__init_stream(&engine->deflate_s);
+        ret = deflateInit(&engine->deflate_s, engine->level);
+        if (ret != Z_OK) {
+            pc_lib_log(PC_LOG_ERROR, "pr__zlib_compress - deflateInit failed: %d", ret);
+            return ret;
+        }
+        engine->deflate_ready = 1;
+    } else {
+        deflateReset(&engine->deflate_s);
+    }
+
+    if (dict) {
+        ret = deflateSetDictionary(&engine->deflate_s, dict->data, (uInt)dict->len);
+        if (ret != Z_OK) {
+            pc_lib_log(PC_LOG_ERROR, "pr__zlib_compress - deflateSetDictionary failed: %d", ret);
+            return ret;
+        }
+    }
+
+    return pr__deflate(&engine->deflate_s, output, output_size, data, size);
+}
+
+static int pr__zlib_decompress(pr_gzip_engine_t* engine,
+                               const pr_dict_store_t* dicts,
+                               unsigned char** output,
+                               size_t* output_size,
+                               const unsigned char* data,
+                               size_t size)
+{
+    int ret;
+
+    if (!engine->inflate_ready) {
+        pr__init_stream(&engine->inflate_s);
+        ret = inflateInit2(&engine->inflate_s, PR_GZIP_INFLATE_WINDOW_BITS);
+        if (ret != Z_OK) {
+            pc_lib_log(PC_LOG_ERROR, "pr__zlib_decompress - inflateInit2 failed: %d", ret);
+            return ret;
+        }
+        engine->inflate_ready = 1;
+    } else {
+        inflateReset(&engine->inflate_s);
+    }
+
+    pr_gzip_engine_reserve(engine, size * engine->inflate_ratio);
+
+    ret = pr__inflate(&engine->inflate_s, dicts, &engine->inflate_buf, &engine->inflate_buf_cap,
+                      output_size, data, size);
+    if (ret != Z_OK) {
+        return ret;
+    }
+
+    // Learn the expansion ratio, rounding up so the next buffer is more likely to fit.
+    if (size > 0) {
+        size_t ratio = *output_size / size + 1;
+        engine->inflate_ratio = ratio > engine->inflate_ratio
+            ? ratio
+            : (engine->inflate_ratio * 3 + ratio) / 4;
+        if (engine->inflate_ratio == 0) {
+            engine->inflate_ratio = 1;
+        }
+    }
+
+    *output = engine->inflate_buf;
+    return Z_OK;
+}
+
+/*
+ * Inflates with a stream of its own into `out`. Once `out` is full the rest
+ * is inflated into a scratch buffer, only to learn the decompressed size.
+ */
+static int pr__zlib_decompress_to(const pr_dict_store_t* dicts, unsigned char* out, size_t cap,
+                                  size_t* output_size, const unsigned char* data, size_t size)
+{
+    unsigned char scratch[4096];
+    z_stream strm;
+    size_t total = 0;
+    size_t avail;
+    int ret;
+
+    pr__init_stream(&strm);
+    ret = inflateInit2(&strm, PR_GZIP_INFLATE_WINDOW_BITS);
+    if (ret != Z_OK) {
+        pc_lib_log(PC_LOG_ERROR, "pr__zlib_decompress_to - inflateInit2 failed: %d", ret);
+        return ret;
+    }
+
+    strm.next_in = (Bytef*)data;
+    strm.avail_in = (uInt)size;
+
+    for (;;) {
+        if (total < cap) {
+            strm.next_out = out + total;
+            avail = cap - total;
+        } else {
+            strm.next_out = scratch;
+            avail = sizeof(scratch);
+        }
+        strm.avail_out = (uInt)avail;
+
+        ret = inflate(&strm, Z_NO_FLUSH);
+        total += avail - strm.avail_out;
+
+        if (ret == Z_STREAM_END) {
+            break;
+        }
+
+        if (ret == Z_NEED_DICT) {
+            ret = pr__inflate_set_dict(&strm, dicts);
+            if (ret != Z_OK) {
+                inflateEnd(&strm);
+                return ret;
+            }
+            continue;
+        }
+
+        if ((ret == Z_OK || ret == Z_BUF_ERROR) && strm.avail_out == 0) {
+            continue;
+        }
+
+        pc_lib_log(PC_LOG_ERROR, "pr__zlib_decompress_to - error decompressing: %s; ret: %d",
+                   strm.msg ? strm.msg : "truncated input", ret);
+        inflateEnd(&strm);
+        return ret == Z_OK || ret == Z_BUF_ERROR ? Z_DATA_ERROR : ret;
+    }
+
+    inflateEnd(&strm);
+    *output_size = total;
+    return total > cap ? PR_CODEC_SHORT_BUFFER : Z_OK;
+}
+
+const pr_codec_t pr_codec_zlib = {
+    PR_CODEC_ZLIB,
+    1, /* supports_dict */
+    pr__zlib_compress,
+    pr__zlib_decompress,
+    pr__zlib_decompress_to,
+};
+
+int pr_inflate_stream_init(pr_inflate_stream_t* s, const pr_dict_store_t* dicts)
+{
+    int ret;
+
+    pr__init_stream(&s->strm);
+    s->dicts = dicts;
+    s->done = 0;
+    s->out = NULL;
+
+    ret = inflateInit2(&s->strm, PR_GZIP_INFLATE_WINDOW_BITS);
+    if (ret != Z_OK) {
+        pc_lib_log(PC_LOG_ERROR, "pr_inflate_stream_init - inflateInit2 failed: %d", ret);
+        return ret;
+    }
+
+    s->out = (unsigned char*)pc_lib_malloc(PR_GZIP_STREAM_CHUNK_BYTES);
+    return Z_OK;
+}
+
+void pr_inflate_stream_end(pr_inflate_stream_t* s)
+{
+    if (s->out) {
+        inflateEnd(&s->strm);
+        pc_lib_free(s->out);
+        s->out = NULL;
+    }
+}
+
+int pr_inflate_stream_feed(pr_inflate_stream_t* s, const unsigned char* data, size_t size,
+                           pr_inflate_chunk_cb_t cb, void* cb_data)
+{
+    int ret;
+
+    pc_assert(s->out);
+
+    if (s->done) {
+        return Z_OK;
+    }
+
+    s->strm.next_in = (Bytef*)data;
+    s->strm.avail_in = (uInt)size;
+
+    /* a full output buffer may leave output pending even once the input is consumed */
+    for (;;) {
+        s->strm.next_out = s->out;
+        s->strm.avail_out = PR_GZIP_STREAM_CHUNK_BYTES;
+
+        ret = inflate(&s->strm, Z_NO_FLUSH);
+
+        if (ret == Z_NEED_DICT) {
+            ret = pr__inflate_set_dict(&s->strm, s->dicts);
+            if (ret != Z_OK) {
+                return ret;
+            }
+            continue;
+        }
+
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            pc_lib_log(PC_LOG_ERROR, "pr_inflate_stream_feed - error decompressing: %s; ret: %d",
+                       s->strm.msg ? s->strm.msg : "", ret);
+            return ret;
+        }
+
+        size_t produced = PR_GZIP_STREAM_CHUNK_BYTES - s->strm.avail_out;
+        if (produced > 0 && cb(cb_data, s->out, produced)) {
+            return Z_STREAM_ERROR;
+        }
+
+        if (ret == Z_STREAM_END) {
+            s->done = 1;
+            break;
+        }
+
+        if (s->strm.avail_in == 0 && s->strm.avail_out > 0) {
+            break;
+        }
+    }
+
+    return Z_OK;
+}
+
+int pr_inflate_stream_done(const pr_inflate_stream_t* s)
+{
+    return s->done;
+}
+
+void pr_gzip_engine_trim(pr_gzip_engine_t* engine)
+{
+    if (engine->inflate_buf_cap > PR_GZIP_POOL_KEEP_BYTES) {
+        pc_lib_free(engine->inflate_buf);
+        engine->inflate_buf = NULL;
+        engine->inflate_buf_cap = 0;
+    }
+}
+
 int pr_decompress(unsigned char** output,
                size_t* output_size,
                unsigned char* data,
                size_t size)
 {
     z_stream inflate_s;
-    
-    inflate_s.zalloc = Z_NULL;
-    inflate_s.zfree = Z_NULL;
-    inflate_s.opaque = Z_NULL;
-    inflate_s.avail_in = 0;
-    inflate_s.next_in = Z_NULL;
-    
-    // The windowBits parameter is the base two logarithm of the window size (the size of the history buffer).
-    // It should be in the range 8..15 for this version of the library.
-    // Larger values of this parameter result in better compression at the expense of memory usage.
-    // This range of values also changes the decoding type:
-    //  -8 to -15 for raw deflate
-    //  8 to 15 for zlib
-    // (8 to 15) + 16 for gzip
-    // (8 to 15) + 32 to automatically detect gzip/zlib header
-    const int window_bits = 15 + 32; // auto with windowbits of 15
-
-    if (inflateInit2(&inflate_s, window_bits) != Z_OK)
+    pr__init_stream(&inflate_s);
+
+    *output = NULL;
+
+    if (inflateInit2(&inflate_s, PR_GZIP_INFLATE_WINDOW_BITS) != Z_OK)
     {
         return 1;
     }
 
-    *output = NULL;
-
-    inflate_s.next_in = (Bytef *)data;
-    inflate_s.avail_in = (unsigned int)size;
+    size_t cap = size * PR_GZIP_DEFAULT_RATIO;
+    if (cap < PR_GZIP_MIN_INFLATE_BYTES) {
+        cap = PR_GZIP_MIN_INFLATE_BYTES;
+    }
+    *output = (unsigned char*)pc_lib_malloc(cap);
 
-    size_t size_uncompressed = 0;
-    do
-    {
-        size_t resize_to = size_uncompressed + 2 * size;
-        {
-            unsigned char *new_output = (unsigned char*)pc_lib_realloc(*output, resize_to);
-            if (!new_output) {
-                // If it fails to reallocate (no memory left), return a memory error.
-                // The client is responsible for cleaning up the memory.
-                return Z_MEM_ERROR;
-            }
-            *output = new_output;
-        }
+    int ret = pr__inflate(&inflate_s, NULL, output, &cap, output_size, data, size);
+    inflateEnd(&inflate_s);
 
-        inflate_s.avail_out = (unsigned int)(2 * size);
-        inflate_s.next_out = (Bytef *)(*output + size_uncompressed);
-        int ret = inflate(&inflate_s, Z_FINISH);
-        if (ret != Z_STREAM_END && ret != Z_OK && ret != Z_BUF_ERROR)
-        {
-            char * error_msg = inflate_s.msg;
-            printf("error decompressing: %s\n", error_msg);
-            return inflateEnd(&inflate_s);
-        }
-        
-        size_uncompressed += (2 * size - inflate_s.avail_out);
-        *output_size = size_uncompressed;
-    } while (inflate_s.avail_out == 0);
-    return inflateEnd(&inflate_s);
+    // NOTE: on error the client is responsible for cleaning up the memory.
+    return ret;
 }
 
-#define CHUNK 64
-
 int pr_compress(unsigned char** output,
                 size_t* output_size,
                 unsigned char* data,
@@ -77,49 +504,17 @@ int pr_compress(unsigned char** output,
 {
     int ret;
     z_stream strm;
-    
-    strm.zalloc = Z_NULL;
-    strm.zfree = Z_NULL;
-    strm.opaque = Z_NULL;
+    pr__init_stream(&strm);
+
     ret = deflateInit(&strm, Z_DEFAULT_COMPRESSION);
     if (ret != Z_OK)
         return ret;
-    
-    *output_size = CHUNK;
-    
-    strm.avail_in = (unsigned int)size;
-    strm.next_in = data;
-    strm.next_out = *output = (unsigned char*) pc_lib_realloc(*output, *output_size);
-    strm.avail_out = (unsigned int)*output_size;
-    
-    int flush = strm.next_in + strm.avail_in == data + size ? Z_FINISH : Z_NO_FLUSH;
-    
-    do {
-        
-        do {
-            ret = deflate(&strm, flush);
-            while (ret == Z_BUF_ERROR) { // buffer too small, must realloc it
-                long offset = strm.next_out - *output;
-                strm.avail_out += CHUNK;
-                *output_size += CHUNK;
-                *output = (unsigned char*)pc_lib_realloc(*output, *output_size);
-                strm.next_out = *output + offset;
-                ret = deflate(&strm, flush);
-            }
-            if (ret != Z_STREAM_END && ret != Z_OK) {
-                char * error_msg = strm.msg;
-                printf("error compressing data: %s; ret: %d\n", error_msg, ret);
-                return deflateEnd(&strm);
-            }
-        } while (strm.avail_out == 0);
-        
-        *output_size -= strm.avail_out;
-    } while (flush != Z_FINISH);
-    
+
+    pc_lib_free(*output);
+    ret = pr__deflate(&strm, output, output_size, data, size);
     deflateEnd(&strm);
-    *output = (unsigned char*) pc_lib_realloc(*output, *output_size);
 
-    return Z_OK;
+    return ret;
 }
 
 int is_compressed(unsigned char* data, size_t size)
@@ -9,8 +9,135 @@
 #define pr_gzip_h
 
 #include <stdio.h>
+#include <stdint.h>
+#include <zlib.h>
 
-#endif /* pr_gzip_h */
+#include <pc_mutex.h>
+
+#include "pr_codec.h"
+#include "pr_dict.h"
+
+/**
+ * Decompressed buffers up to this size are kept by the engine between
+ * messages, bigger ones are released by pr_gzip_engine_trim.
+ */
+#define PR_GZIP_POOL_KEEP_BYTES (256 * 1024)
+
+/**
+ * Long lived compression state owned by a transport.
+ *
+ * Bodies are compressed with `codec`, zlib unless the handshake negotiated
+ * another one. The state of every codec is created on first use and kept
+ * for the following messages: zlib streams are reused through
+ * deflateReset/inflateReset, avoiding the allocation of the zlib internal
+ * state for every message, and LZ4 keeps its hash table.
+ *
+ * Compression may happen on any thread that sends a message, therefore the
+ * compression side and `codec` are protected by `deflate_mutex`.
+ * Decompression only happens on the uv loop thread and needs no locking.
+ */
+typedef struct pr_gzip_engine_s {
+    pc_mutex_t deflate_mutex;
+    const pr_codec_t* codec;
+
+    z_stream deflate_s;
+    int deflate_ready;
+    int level;
+
+    z_stream inflate_s;
+    int inflate_ready;
+
+    /* pooled output buffer for decompression */
+    unsigned char* inflate_buf;
+    size_t inflate_buf_cap;
+
+    /* learned expansion ratio (output / input) of decompressed data */
+    size_t inflate_ratio;
+
+    /* match finder of the LZ4 codec */
+    uint32_t* lz4_table;
+} pr_gzip_engine_t;
+
+void pr_gzip_engine_init(pr_gzip_engine_t* engine, int level);
+void pr_gzip_engine_cleanup(pr_gzip_engine_t* engine);
+
+/**
+ * Changes the codec used by the engine, called when the handshake finishes.
+ */
+void pr_gzip_engine_set_codec(pr_gzip_engine_t* engine, const pr_codec_t* codec);
+const pr_codec_t* pr_gzip_engine_codec(pr_gzip_engine_t* engine);
+
+/**
+ * Compresses `data` with the engine codec into a newly allocated buffer,
+ * sized with deflateBound for zlib.
+ * The caller owns `*output` and should release it with pc_lib_free.
+ * `dict` is the preset dictionary to use, or NULL.
+ */
+int pr_gzip_engine_compress(pr_gzip_engine_t* engine,
+                            const pr_dict_t* dict,
+                            unsigned char** output,
+                            size_t* output_size,
+                            const unsigned char* data,
+                            size_t size);
+
+/**
+ * Decompresses `data` with the engine codec into the engine's pooled buffer. `*output` is owned
+ * by the engine and is only valid until the next call to
+ * pr_gzip_engine_decompress or pr_gzip_engine_trim.
+ * Streams compressed with a preset dictionary are looked up in `dicts`,
+ * which may be NULL.
+ */
+int pr_gzip_engine_decompress(pr_gzip_engine_t* engine,
+                              const pr_dict_store_t* dicts,
+                              unsigned char** output,
+                              size_t* output_size,
+                              const unsigned char* data,
+                              size_t size);
+
+/**
+ * Makes the pooled decompression buffer hold at least `size` bytes, used by
+ * the codecs. Its previous contents are lost.
+ */
+void pr_gzip_engine_reserve(pr_gzip_engine_t* engine, size_t size);
+
+/**
+ * Releases the pooled decompression buffer if it grew beyond
+ * PR_GZIP_POOL_KEEP_BYTES.
+ */
+void pr_gzip_engine_trim(pr_gzip_engine_t* engine);
+
+/**
+ * Incremental zlib decompression of a body received in pieces, used to
+ * stream big responses. The output goes through a buffer of
+ * PR_GZIP_STREAM_CHUNK_BYTES, each time it fills up or the stream ends it
+ * is handed to `cb`, a non zero return from `cb` stops the decompression.
+ */
+#define PR_GZIP_STREAM_CHUNK_BYTES (16 * 1024)
+
+typedef int (*pr_inflate_chunk_cb_t)(void* data, const unsigned char* chunk, size_t len);
+
+typedef struct {
+    z_stream strm;
+    const pr_dict_store_t* dicts;
+    unsigned char* out;
+    int done;
+} pr_inflate_stream_t;
+
+int pr_inflate_stream_init(pr_inflate_stream_t* s, const pr_dict_store_t* dicts);
+void pr_inflate_stream_end(pr_inflate_stream_t* s);
+
+/**
+ * Decompresses the next piece of the body. Returns 0 on success, non zero
+ * on a decompression error or when `cb` stopped it. Input past the end of
+ * the compressed stream is ignored.
+ */
+int pr_inflate_stream_feed(pr_inflate_stream_t* s, const unsigned char* data, size_t size,
+                           pr_inflate_chunk_cb_t cb, void* cb_data);
+
+/**
+ * Tells whether the whole compressed stream was fed.
+ */
+int pr_inflate_stream_done(const pr_inflate_stream_t* s);
 
 int pr_compress(unsigned char** output,
              size_t* output_size,
@@ -26,3 +153,5 @@ int pr_decompress(unsigned char** output,
 // It is possible non-compressed data also returns true,
 // but not in our case (our data is JSON).
 int is_compressed(unsigned char* data, size_t size);
+
+#endif /* pr_gzip_h */
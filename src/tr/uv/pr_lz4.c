@@ -0,0 +1,244 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#include <string.h>
+
+#include "pr_lz4.h"
+
+#ifdef PITAYA_LZ4
+
+#include <lz4.h>
+
+size_t pr_lz4_compress_block(uint32_t* table, const uint8_t* src, size_t size,
+                             uint8_t* dst, size_t dst_cap)
+{
+    int len;
+
+    (void)table; /* upstream keeps its own */
+
+    len = LZ4_compress_default((const char*)src, (char*)dst, (int)size, (int)dst_cap);
+    return len > 0 ? (size_t)len : 0;
+}
+
+int64_t pr_lz4_decompress_block(const uint8_t* src, size_t size,
+                                uint8_t* dst, size_t dst_cap)
+{
+    int len = LZ4_decompress_safe((const char*)src, (char*)dst, (int)size, (int)dst_cap);
+    return len < 0 ? -1 : len;
+}
+
+#else
+
+#define PR_LZ4_MIN_MATCH 4
+#define PR_LZ4_MAX_DISTANCE 65535
+
+/* the last match has to start at least 12 bytes before the end of the block */
+#define PR_LZ4_MF_LIMIT 12
+
+/* and the last 5 bytes are always literals */
+#define PR_LZ4_LAST_LITERALS 5
+
+/* how fast the search skips ahead on data that does not match */
+#define PR_LZ4_SKIP_TRIGGER 6
+
+static uint32_t pr__read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t pr__hash(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - PR_LZ4_HASH_LOG);
+}
+
+static uint8_t* pr__write_length(uint8_t* op, size_t len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+static uint8_t* pr__write_sequence(uint8_t* op, uint8_t* oend,
+                                   const uint8_t* literals, size_t lit_len,
+                                   size_t offset, size_t match_len)
+{
+    /* token, lengths, literals and offset */
+    size_t needed = 1 + lit_len / 255 + 1 + lit_len + 2 + match_len / 255 + 1;
+    uint8_t* token = op;
+
+    if ((size_t)(oend - op) < needed) {
+        return NULL;
+    }
+
+    op++;
+    if (lit_len >= 15) {
+        *token = 15 << 4;
+        op = pr__write_length(op, lit_len - 15);
+    } else {
+        *token = (uint8_t)(lit_len << 4);
+    }
+
+    memcpy(op, literals, lit_len);
+    op += lit_len;
+
+    if (!offset) {
+        return op;
+    }
+
+    *op++ = (uint8_t)(offset & 0xff);
+    *op++ = (uint8_t)(offset >> 8);
+
+    match_len -= PR_LZ4_MIN_MATCH;
+    if (match_len >= 15) {
+        *token |= 15;
+        op = pr__write_length(op, match_len - 15);
+    } else {
+        *token |= (uint8_t)match_len;
+    }
+
+    return op;
+}
+
+size_t pr_lz4_compress_block(uint32_t* table, const uint8_t* src, size_t size,
+                             uint8_t* dst, size_t dst_cap)
+{
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* iend = src + size;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + dst_cap;
+
+    if (size > PR_LZ4_MF_LIMIT) {
+        const uint8_t* mf_limit = iend - PR_LZ4_MF_LIMIT;
+        const uint8_t* match_limit = iend - PR_LZ4_LAST_LITERALS;
+        uint32_t attempts = 1 << PR_LZ4_SKIP_TRIGGER;
+
+        memset(table, 0, PR_LZ4_HASH_SIZE * sizeof(uint32_t));
+        ip++;
+
+        while (ip <= mf_limit) {
+            uint32_t h = pr__hash(pr__read32(ip));
+            const uint8_t* ref = src + table[h];
+            size_t len;
+
+            table[h] = (uint32_t)(ip - src);
+
+            if (ref >= ip || ip - ref > PR_LZ4_MAX_DISTANCE || pr__read32(ref) != pr__read32(ip)) {
+                ip += attempts++ >> PR_LZ4_SKIP_TRIGGER;
+                continue;
+            }
+
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+
+            len = PR_LZ4_MIN_MATCH;
+            while (ip + len < match_limit && ip[len] == ref[len]) {
+                len++;
+            }
+
+            op = pr__write_sequence(op, oend, anchor, (size_t)(ip - anchor), (size_t)(ip - ref), len);
+            if (!op) {
+                return 0;
+            }
+
+            ip += len;
+            anchor = ip;
+            attempts = 1 << PR_LZ4_SKIP_TRIGGER;
+
+            if (ip <= mf_limit) {
+                table[pr__hash(pr__read32(ip - 2))] = (uint32_t)(ip - 2 - src);
+            }
+        }
+    }
+
+    op = pr__write_sequence(op, oend, anchor, (size_t)(iend - anchor), 0, 0);
+    return op ? (size_t)(op - dst) : 0;
+}
+
+int64_t pr_lz4_decompress_block(const uint8_t* src, size_t size,
+                                uint8_t* dst, size_t dst_cap)
+{
+    const uint8_t* ip = src;
+    const uint8_t* iend = src + size;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + dst_cap;
+
+    while (ip < iend) {
+        unsigned token = *ip++;
+        size_t lit_len = token >> 4;
+        size_t match_len;
+        size_t offset;
+        uint8_t b;
+
+        if (lit_len == 15) {
+            do {
+                if (ip >= iend) {
+                    return -1;
+                }
+                b = *ip++;
+                lit_len += b;
+            } while (b == 255);
+        }
+
+        if (lit_len > (size_t)(iend - ip) || lit_len > (size_t)(oend - op)) {
+            return -1;
+        }
+        memcpy(op, ip, lit_len);
+        op += lit_len;
+        ip += lit_len;
+
+        /* the last sequence only has literals */
+        if (ip == iend) {
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return -1;
+        }
+        offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) {
+            return -1;
+        }
+
+        match_len = token & 15;
+        if (match_len == 15) {
+            do {
+                if (ip >= iend) {
+                    return -1;
+                }
+                b = *ip++;
+                match_len += b;
+            } while (b == 255);
+        }
+        match_len += PR_LZ4_MIN_MATCH;
+
+        if (match_len > (size_t)(oend - op)) {
+            return -1;
+        }
+
+        if (offset >= match_len) {
+            memcpy(op, op - offset, match_len);
+            op += match_len;
+        } else {
+            /* overlapping copy, repeats the last `offset` bytes */
+            const uint8_t* ref = op - offset;
+            while (match_len--) {
+                *op++ = *ref++;
+            }
+        }
+    }
+
+    return (int64_t)(op - dst);
+}
+
+#endif /* PITAYA_LZ4 */
@@ -0,0 +1,49 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifndef PR_LZ4_H
+#define PR_LZ4_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Implementation of the LZ4 block format, see
+ * https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+ * Built with PITAYA_LZ4_DIR, upstream LZ4 found there does the work instead.
+ *
+ * Bodies are sent as a block prefixed with the uncompressed size as a
+ * 32 bits little endian integer, the same layout produced by the
+ * "size prepended" mode of most LZ4 bindings.
+ */
+
+#define PR_LZ4_HASH_LOG 12
+#define PR_LZ4_HASH_SIZE (1 << PR_LZ4_HASH_LOG)
+
+/**
+ * Largest size accepted in the size prefix when decompressing.
+ */
+#define PR_LZ4_MAX_OUTPUT (64 * 1024 * 1024)
+
+/**
+ * Worst case size of compressing `size` bytes, not counting the size prefix.
+ */
+#define PR_LZ4_BOUND(size) ((size) + (size) / 255 + 16)
+
+/**
+ * Compresses `src` into `dst` using `table`, which holds PR_LZ4_HASH_SIZE
+ * entries. Returns the compressed size, or 0 if it does not fit in `dst_cap`.
+ */
+size_t pr_lz4_compress_block(uint32_t* table, const uint8_t* src, size_t size,
+                             uint8_t* dst, size_t dst_cap);
+
+/**
+ * Decompresses the block `src` into `dst`. Returns the decompressed size,
+ * or -1 if the block is malformed or does not fit in `dst_cap`.
+ */
+int64_t pr_lz4_decompress_block(const uint8_t* src, size_t size,
+                                uint8_t* dst, size_t dst_cap);
+
+#endif /* PR_LZ4_H */
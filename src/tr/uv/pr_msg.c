@@ -9,6 +9,7 @@
 #include <stdio.h>
 
 #include <pc_lib.h>
+#include <pc_pitaya_i.h>
 
 #include "pr_msg.h"
 #include "tr_uv_tcp_i.h"
@@ -141,7 +142,32 @@ static pc__msg_raw_t *pc_msg_decode_to_raw(const pc_buf_t* buf)
     return msg;
 }
 
-pc_msg_t pc_default_msg_decode(const pc_JSON* code2route, const pc_buf_t* buf)
+int pc_default_msg_peek_resp(const uint8_t* data, size_t len, uint32_t* id, int* compressed, size_t* header_len)
+{
+    if (len < PC_MSG_FLAG_BYTES) {
+        return 0;
+    }
+
+    const pc_message_flag* flag = (const pc_message_flag*)data;
+    if (flag->message_type != PC_MSG_RESPONSE || flag->error) {
+        return 0;
+    }
+
+    uint32_t value = 0;
+    for (size_t i = PC_MSG_FLAG_BYTES; i < len && i < PC_MSG_FLAG_BYTES + 5; ++i) {
+        value += (uint32_t)(data[i] & 0x7F) << (7 * (i - PC_MSG_FLAG_BYTES));
+        if (data[i] < 128) {
+            *id = value;
+            *compressed = flag->data_compressed;
+            *header_len = i + 1;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+pc_msg_t pc_default_msg_decode_header(const pc_JSON* code2route, const pc_buf_t* buf, int* compressed)
 {
     pc_msg_t msg = {
         .id = PC_INVALID_REQ_ID,
@@ -151,6 +177,8 @@ pc_msg_t pc_default_msg_decode(const pc_JSON* code2route, const pc_buf_t* buf)
             .base = NULL,
             .len = -1,
         },
+        .is_buf_borrowed = 0,
+        .compression = PC_COMPRESSION_AUTO,
     };
 
     pc_assert(buf && buf->base);
@@ -198,32 +226,127 @@ pc_msg_t pc_default_msg_decode(const pc_JSON* code2route, const pc_buf_t* buf)
         return msg;
     }
 
-    if (raw_msg->is_gzipped && raw_msg->body.len > 0) {
-        uint8_t *decompressed_data = NULL;
-        size_t decompressed_len;
-        int err = pr_decompress(&decompressed_data, &decompressed_len,
-                                raw_msg->body.base, raw_msg->body.len);
+    // NOTE: raw_msg->body points into the buffer being decoded, it is lent to the caller.
+    msg.buf = raw_msg->body;
+    msg.is_buf_borrowed = 1;
+    *compressed = raw_msg->is_gzipped && raw_msg->body.len > 0;
+
+    pc_msg_free_raw_msg(raw_msg);
 
-        if (err) {
-            pc_lib_log(PC_LOG_ERROR, "pc_default_msg_decode - gzip inflate error");
+    return msg;
+}
+
+int pc_default_msg_inflate(pr_gzip_engine_t* gzip, pr_compress_policy_t* policy, pc_msg_t* msg)
+{
+    uint8_t *decompressed_data = NULL;
+    size_t decompressed_len;
+    uint64_t start = uv_hrtime();
+    int err = gzip
+        ? pr_gzip_engine_decompress(gzip, policy ? &policy->dicts : NULL, &decompressed_data, &decompressed_len,
+                                    msg->buf.base, msg->buf.len)
+        : pr_decompress(&decompressed_data, &decompressed_len,
+                        msg->buf.base, msg->buf.len);
+
+    if (err) {
+        pc_lib_log(PC_LOG_ERROR, "pc_default_msg_inflate - gzip inflate error");
+        if (!gzip) {
             pc_lib_free(decompressed_data);
-            pc_msg_free_raw_msg(raw_msg);
-            msg.id = PC_INVALID_REQ_ID;
-            return msg;
         }
+        return err;
+    }
 
-        msg.buf.base = decompressed_data;
-        msg.buf.len = decompressed_len;
-        pc_lib_log(PC_LOG_DEBUG, "pc_default_msg_decode decompressed msg: %lu -> %lld bytes", raw_msg->body.len, msg.buf.len);
+    if (policy) {
+        pr_compress_policy_record_inflate(policy, msg->buf.len, decompressed_len, uv_hrtime() - start);
+    }
+
+    pc_lib_log(PC_LOG_DEBUG, "pc_default_msg_inflate decompressed msg: %lld -> %lu bytes", msg->buf.len, decompressed_len);
+
+    if (!msg->is_buf_borrowed) {
+        pc_buf_free(&msg->buf);
+    }
+    msg->buf.base = decompressed_data;
+    msg->buf.len = decompressed_len;
+    // With an engine the data lives in its pooled buffer.
+    msg->is_buf_borrowed = gzip != NULL;
+    return 0;
+}
+
+static int pr__body_inflate(const pc_body_t* body, uint8_t* buf, size_t cap, size_t* len)
+{
+    const pr_codec_t* codec = (const pr_codec_t*)body->inflate_data;
+    const pr_dict_store_t* dicts = (const pr_dict_store_t*)body->inflate_dicts;
+    int ret;
+
+    if (codec->decompress_to) {
+        ret = codec->decompress_to(dicts, buf, cap, len, body->raw.base, (size_t)body->raw.len);
     } else {
-        // NOTE(leo): Since raw_msg->body points to an internal libuv buffer, we have to make a copy here, in order to match
-        // the copy made by zlib when the message was decompressed.
-        // PERFORMANCE(leo): Maybe a more efficient approach would be to return a variable saying if the buffer is malloced or not, but that would
-        // hurt readability and mantainability.
-        msg.buf = pc_buf_copy(&raw_msg->body);
+        /* codecs without decompress_to go through an engine of their own */
+        pr_gzip_engine_t engine;
+        unsigned char* out = NULL;
+
+        pr_gzip_engine_init(&engine, Z_DEFAULT_COMPRESSION);
+        pr_gzip_engine_set_codec(&engine, codec);
+        ret = pr_gzip_engine_decompress(&engine, dicts, &out, len, body->raw.base, (size_t)body->raw.len);
+        if (!ret) {
+            if (*len > cap) {
+                ret = PR_CODEC_SHORT_BUFFER;
+            } else {
+                memcpy(buf, out, *len);
+            }
+        }
+        pr_gzip_engine_cleanup(&engine);
     }
 
-    pc_msg_free_raw_msg(raw_msg);
+    if (ret == PR_CODEC_SHORT_BUFFER) {
+        return PC_RC_INVALID_ARG;
+    }
+
+    if (ret) {
+        pc_lib_log(PC_LOG_ERROR, "pr__body_inflate - failed to decompress body with %s", codec->name);
+        return PC_RC_ERROR;
+    }
+    return PC_RC_OK;
+}
+
+void pc_default_msg_lazy_body(pc_body_t* body, const pc_msg_t* msg, int compressed,
+                              pr_gzip_engine_t* gzip, pr_compress_policy_t* policy)
+{
+    memset(body, 0, sizeof(pc_body_t));
+    body->raw = msg->buf;
+    body->compressed = compressed;
+
+    if (compressed) {
+        body->inflate = pr__body_inflate;
+        body->inflate_data = pr_gzip_engine_codec(gzip);
+        body->inflate_dicts = &policy->dicts;
+    }
+}
+
+pc_msg_t pc_default_msg_decode(pr_gzip_engine_t* gzip, pr_compress_policy_t* policy,
+                               const pc_JSON* code2route, const pc_buf_t* buf)
+{
+    int compressed = 0;
+    pc_msg_t msg = pc_default_msg_decode_header(code2route, buf, &compressed);
+
+    if (msg.id == PC_INVALID_REQ_ID) {
+        return msg;
+    }
+
+    if (compressed) {
+        if (pc_default_msg_inflate(gzip, policy, &msg)) {
+            pc_lib_free((char*)msg.route);
+            msg.route = NULL;
+            msg.buf.base = NULL;
+            msg.buf.len = -1;
+            msg.is_buf_borrowed = 0;
+            msg.id = PC_INVALID_REQ_ID;
+        }
+    } else if (!gzip) {
+        // NOTE(leo): Since the body points to an internal libuv buffer, we have to make a copy here, in order to match
+        // the copy made by zlib when the message was decompressed.
+        msg.buf = pc_buf_copy(&msg.buf);
+        msg.is_buf_borrowed = 0;
+    }
 
     return msg;
 }
@@ -355,16 +478,23 @@ static uint8_t pc__msg_id_length(uint32_t id)
     return len;
 }
 
-pc_buf_t pc_default_msg_encode(const pc_JSON* route2code, const pc_msg_t* msg, bool compress_data)
+pc_buf_t pc_default_msg_encode_body(pr_gzip_engine_t* gzip, pr_compress_policy_t* policy,
+                                    const pc_msg_t* msg, bool* was_body_compressed)
 {
     pc_assert(msg && msg->route);
 
-    bool was_body_compressed = false;
+    *was_body_compressed = false;
+    bool compress_data = policy && msg->buf.len > 0
+        && pr_compress_policy_should_compress(policy, msg->route, (size_t)msg->buf.len, msg->compression);
 
-    pc_buf_t body_buf = (compress_data && msg->buf.len > 0)
-        ? pc_body_json_encode(msg->buf, &was_body_compressed)
+    return compress_data
+        ? pc_body_json_encode(gzip, policy, msg->route, msg->buf, msg->compression, was_body_compressed)
         : pc_buf_copy(&msg->buf);
+}
 
+pc_buf_t pc_default_msg_encode_header(const pc_JSON* route2code, const pc_msg_t* msg,
+                                      pc_buf_t body_buf, bool was_body_compressed)
+{
     pc_buf_t msg_buf;
     msg_buf.base = NULL;
     msg_buf.len = -1;
@@ -403,15 +533,102 @@ pc_buf_t pc_default_msg_encode(const pc_JSON* route2code, const pc_msg_t* msg, b
         }
     }
 
+    return msg_buf;
+}
+
+pc_buf_t pc_default_msg_encode(pr_gzip_engine_t* gzip, pr_compress_policy_t* policy,
+                               const pc_JSON* route2code, const pc_msg_t* msg)
+{
+    bool was_body_compressed = false;
+    pc_buf_t body_buf = pc_default_msg_encode_body(gzip, policy, msg, &was_body_compressed);
+    pc_buf_t msg_buf = pc_default_msg_encode_header(route2code, msg, body_buf, was_body_compressed);
+
     pc_buf_free(&body_buf);
 
     return msg_buf;
 }
 
+static int pc__prepared_msg_compress(const pc_prepared_msg_t* prepared, pc_buf_t* out)
+{
+    unsigned char* data = NULL;
+    size_t size = 0;
+    size_t len = (size_t)prepared->body.len;
+    int mode = prepared->opts.compression;
+
+    if (len == 0 || mode == PC_COMPRESSION_NEVER
+            || (mode == PC_COMPRESSION_AUTO && len < PR_COMPRESS_DEFAULT_MIN_SIZE)) {
+        return 0;
+    }
+
+    if (pr_compress(&data, &size, prepared->body.base, len) != Z_OK) {
+        pc_lib_free(data);
+        return 0;
+    }
+
+    if (size >= len || (mode == PC_COMPRESSION_AUTO
+            && (len - size) * 100 < len * PR_COMPRESS_DEFAULT_MIN_SAVINGS)) {
+        pc_lib_free(data);
+        return 0;
+    }
+
+    out->base = data;
+    out->len = (int64_t)size;
+    return 1;
+}
+
+const pc_buf_t* pc_prepared_msg_wire(pc_prepared_msg_t* prepared, int* compressed)
+{
+    pc_buf_t body;
+    int was_compressed;
+    size_t route_len;
+
+    pc_mutex_lock(&prepared->mutex);
+
+    if (!prepared->wire.base) {
+        route_len = strlen(prepared->route);
+        if (route_len > 0xff) {
+            pc_mutex_unlock(&prepared->mutex);
+            pc_lib_log(PC_LOG_ERROR, "pc_prepared_msg_wire - route too long: %s", prepared->route);
+            return NULL;
+        }
+
+        was_compressed = pc__prepared_msg_compress(prepared, &body);
+        if (!was_compressed) {
+            body = prepared->body;
+        }
+
+        prepared->wire.len = PC_MSG_ROUTE_LEN_BYTES + route_len + body.len;
+        prepared->wire.base = (uint8_t* )pc_lib_malloc((size_t)prepared->wire.len);
+        pc__msg_encode_route(prepared->route, (uint16_t)route_len, prepared->wire.base, 0);
+        memcpy(prepared->wire.base + PC_MSG_ROUTE_LEN_BYTES + route_len, body.base, (size_t)body.len);
+        prepared->wire_compressed = was_compressed;
+
+        if (was_compressed) {
+            pc_buf_free(&body);
+        }
+    }
+
+    pc_mutex_unlock(&prepared->mutex);
+
+    *compressed = prepared->wire_compressed;
+    return &prepared->wire;
+}
+
+size_t pc_prepared_msg_encode_head(uint32_t id, int compressed, uint8_t* base)
+{
+    pc_msg_type type = (id == PC_NOTIFY_PUSH_REQ_ID) ? PC_MSG_NOTIFY : PC_MSG_REQUEST;
+    size_t offset = pc__msg_encode_flag(type, 0, compressed, base, 0);
+
+    if (PC_MSG_HAS_ID(type)) {
+        offset = pc__msg_encode_id(id, base, offset);
+    }
+    return offset;
+}
+
 /* for transport plugin */
 uv_buf_t pr_default_msg_encoder(tr_uv_tcp_transport_t* tt, const pc_msg_t* msg)
 {
-    pc_buf_t pb = pc_default_msg_encode(tt->route_to_code, msg, !tt->config->disable_compression);
+    pc_buf_t pb = pc_default_msg_encode(&tt->gzip, &tt->compress_policy, tt->route_to_code, msg);
     uv_buf_t ub;
     ub.base = (char*)pb.base;
     ub.len = pb.len;
@@ -427,5 +644,5 @@ pc_msg_t pr_default_msg_decoder(tr_uv_tcp_transport_t* tt, const uv_buf_t* buf)
     pb.base = (uint8_t*)buf->base;
     pb.len = buf->len;
 
-    return pc_default_msg_decode(tt->code_to_route, &pb);
+    return pc_default_msg_decode(&tt->gzip, &tt->compress_policy, tt->code_to_route, &pb);
 }
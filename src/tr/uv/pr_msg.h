@@ -9,6 +9,8 @@
 #include <stdint.h>
 
 #include "pr_pkg.h"
+#include "pr_gzip.h"
+#include "pr_compress_policy.h"
 #include <pc_JSON.h>
 
 typedef struct tr_uv_tcp_transport_s tr_uv_tcp_transport_t;
@@ -18,6 +20,10 @@ typedef struct {
     int error;
     const char* route;
     pc_buf_t buf;
+    /* buf is borrowed (from the package parser or the gzip engine) and must not be freed */
+    int is_buf_borrowed;
+    /* PC_COMPRESSION_* mode requested for the body, only used when encoding */
+    int compression;
 } pc_msg_t;
 
 uv_buf_t pr_default_msg_encoder(tr_uv_tcp_transport_t* tt, const pc_msg_t* msg);
@@ -34,10 +40,64 @@ typedef struct {
     char unused:2;
 } pc_message_flag;
 
-pc_buf_t pc_default_msg_encode(const pc_JSON* route2code, const pc_msg_t* msg, bool compress_data);
-pc_msg_t pc_default_msg_decode(const pc_JSON* code2route, const pc_buf_t* buf);
+/**
+ * When `policy` is NULL message bodies are never compressed.
+ */
+pc_buf_t pc_default_msg_encode(pr_gzip_engine_t* gzip, pr_compress_policy_t* policy,
+                               const pc_JSON* route2code, const pc_msg_t* msg);
+pc_msg_t pc_default_msg_decode(pr_gzip_engine_t* gzip, pr_compress_policy_t* policy,
+                               const pc_JSON* code2route, const pc_buf_t* buf);
+
+/**
+ * The two steps of pc_default_msg_encode, so the body can be compressed on
+ * a worker thread: pc_default_msg_encode_body returns the body to send, and
+ * pc_default_msg_encode_header prepends the message header to it.
+ */
+pc_buf_t pc_default_msg_encode_body(pr_gzip_engine_t* gzip, pr_compress_policy_t* policy,
+                                    const pc_msg_t* msg, bool* was_body_compressed);
+pc_buf_t pc_default_msg_encode_header(const pc_JSON* route2code, const pc_msg_t* msg,
+                                      pc_buf_t body_buf, bool was_body_compressed);
+
+/**
+ * The two steps of pc_default_msg_decode. pc_default_msg_decode_header
+ * lends the body of `buf` to the returned message and tells whether it is
+ * compressed, in which case pc_default_msg_inflate replaces it with the
+ * decompressed body. pc_default_msg_inflate returns non zero on error and
+ * leaves the message untouched.
+ */
+pc_msg_t pc_default_msg_decode_header(const pc_JSON* code2route, const pc_buf_t* buf, int* compressed);
+int pc_default_msg_inflate(pr_gzip_engine_t* gzip, pr_compress_policy_t* policy, pc_msg_t* msg);
+
+/**
+ * Parses the header of a message from its first `len` bytes. Returns non
+ * zero if it is a successful response whose header fits in them, filling
+ * its id, whether the body is compressed and the size of the header.
+ */
+int pc_default_msg_peek_resp(const uint8_t* data, size_t len, uint32_t* id, int* compressed, size_t* header_len);
+
+/**
+ * Wraps the body of a message returned by pc_default_msg_decode_header
+ * for lazy decompression, see pc_body_from_payload. `body` borrows the
+ * message buffer and decompresses it with the codec `gzip` is using.
+ */
+void pc_default_msg_lazy_body(pc_body_t* body, const pc_msg_t* msg, int compressed,
+                              pr_gzip_engine_t* gzip, pr_compress_policy_t* policy);
+
+/**
+ * Prepared messages, see pc_prepared_msg_new. pc_prepared_msg_wire returns
+ * the part of the message shared by every send, the route as a string and
+ * the body, compressed with zlib if `compressed` is set, encoding it on the
+ * first call. NULL if it can not be encoded. pc_prepared_msg_encode_head
+ * writes the flag and the id preceding it, at most
+ * PC_PREPARED_MSG_HEAD_MAX_BYTES, and returns their size.
+ */
+#define PC_PREPARED_MSG_HEAD_MAX_BYTES 6
+
+const pc_buf_t* pc_prepared_msg_wire(pc_prepared_msg_t* prepared, int* compressed);
+size_t pc_prepared_msg_encode_head(uint32_t id, int compressed, uint8_t* base);
 
-pc_buf_t pc_body_json_encode(pc_buf_t buf, bool *was_body_compressed);
+pc_buf_t pc_body_json_encode(pr_gzip_engine_t* gzip, pr_compress_policy_t* policy, const char* route,
+                             pc_buf_t buf, int mode, bool *was_body_compressed);
 pc_JSON *pc_body_json_decode(const char *data, size_t offset, size_t len, int gzipped);
 
 #endif
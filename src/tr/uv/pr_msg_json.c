@@ -18,13 +18,25 @@
 // by having a flag specifying if the contents were compressed or not, then the client could
 // decide if the buffer should be freed or not. This would however make the code harder to understand,
 // therefore it is not implemented.
-pc_buf_t pc_body_json_encode(pc_buf_t buf, bool *was_body_compressed)
+pc_buf_t pc_body_json_encode(pr_gzip_engine_t* gzip, pr_compress_policy_t* policy, const char* route,
+                             pc_buf_t buf, int mode, bool *was_body_compressed)
 {
     pc_buf_t out_buf;
     out_buf.base = NULL;
     out_buf.len = -1;
 
-    int compress_err = pr_compress((unsigned char**)&out_buf.base, (size_t*)&out_buf.len, (unsigned char*)buf.base, buf.len);
+    if (was_body_compressed) *was_body_compressed = false;
+
+    uint64_t start = uv_hrtime();
+    const pr_dict_t* dict = policy && gzip && pr_gzip_engine_codec(gzip)->supports_dict
+        ? pr_dict_store_for_route(&policy->dicts, route)
+        : NULL;
+
+    size_t out_len = 0;
+    int compress_err = gzip
+        ? pr_gzip_engine_compress(gzip, dict, (unsigned char**)&out_buf.base, &out_len, buf.base, buf.len)
+        : pr_compress((unsigned char**)&out_buf.base, &out_len, (unsigned char*)buf.base, buf.len);
+    out_buf.len = (int64_t)out_len;
 
     if (compress_err) {
         pc_lib_log(PC_LOG_ERROR, "pc_body_json_encode - error compressing data");
@@ -32,12 +44,18 @@ pc_buf_t pc_body_json_encode(pc_buf_t buf, bool *was_body_compressed)
         return pc_buf_copy(&buf);
     }
 
-    // TODO, NOTE(leo): This check could be more specialized. For example, the compressed buffer is only used if it 
-    // is at least 30% smaller than the original buffer.
-    if (out_buf.len >= buf.len) {
-        pc_lib_log(PC_LOG_DEBUG, "pc_body_json_encode - compressed is larger (%d > %d)", out_buf.len, buf.len);
+    // The compressed buffer is only used if it saves at least the minimum percentage required by the policy.
+    int accepted = policy
+        ? pr_compress_policy_accepts(policy, (size_t)buf.len, out_len, mode)
+        : out_buf.len < buf.len;
+
+    if (policy) {
+        pr_compress_policy_record(policy, route, (size_t)buf.len, out_len, uv_hrtime() - start, accepted, dict != NULL);
+    }
+
+    if (!accepted) {
+        pc_lib_log(PC_LOG_DEBUG, "pc_body_json_encode - compression does not save enough (%lld -> %lld)", buf.len, out_buf.len);
         pc_buf_free(&out_buf); // free the buffers, since it will not be used.
-        if (was_body_compressed) *was_body_compressed = false;
         return pc_buf_copy(&buf);
     }
     
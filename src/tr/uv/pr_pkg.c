@@ -32,16 +32,26 @@ void pc_pkg_parser_init(pc_pkg_parser_t *parser, pc_on_pkg_handler_t handler, vo
     parser->pkg_offset = 0;
     parser->pkg_size = 0;
     parser->state = PC_PKG_HEAD;
+    parser->chunk_handler = NULL;
+    parser->streaming = 0;
+}
+
+void pc_pkg_parser_set_chunk_handler(pc_pkg_parser_t *parser, pc_on_pkg_chunk_handler_t handler)
+{
+    parser->chunk_handler = handler;
 }
 
 void pc_pkg_parser_reset(pc_pkg_parser_t *parser)
 {
-    pc_lib_free(parser->pkg_buf);
+    if (parser->pkg_buf != parser->peek_buf) {
+        pc_lib_free(parser->pkg_buf);
+    }
     parser->head_offset = 0;
     parser->pkg_buf = NULL;
     parser->pkg_offset = 0;
     parser->pkg_size = 0;
     parser->state = PC_PKG_HEAD;
+    parser->streaming = 0;
 }
 
 void pc_pkg_parser_feed(pc_pkg_parser_t *parser, const char *data, size_t nread)
@@ -77,7 +87,12 @@ static size_t pc__parse_pkg_head(pc_pkg_parser_t *parser, const char *data, size
             pkg_len += parser->head_buf[i] & 0xff;
         }
 
-        if (pkg_len > 0) {
+        if (parser->chunk_handler && pc__pkg_type(parser->head_buf) == PC_PKG_DATA
+                && pkg_len > PC_PKG_PEEK_BYTES) {
+            /* the body is only allocated if the chunk handler does not stream it */
+            parser->pkg_buf = parser->peek_buf;
+            parser->streaming = PC_PKG_PEEK;
+        } else if (pkg_len > 0) {
             parser->pkg_buf = (char *)pc_lib_malloc(pkg_len);
             memset(parser->pkg_buf, 0, pkg_len);
         }
@@ -96,7 +111,51 @@ static size_t pc__parse_pkg_body(pc_pkg_parser_t *parser, const char *data, size
     size_t data_len = nread - offset;
     size_t len = MIN(need_len, data_len);
 
+    if (parser->streaming == PC_PKG_STREAM) {
+        parser->pkg_offset += len;
+        parser->chunk_handler(data + offset, len, parser->pkg_offset - len, parser->pkg_size, parser->ex_data);
+        if (parser->pkg_offset == parser->pkg_size) {
+            pc_pkg_parser_reset(parser);
+        }
+        return offset + len;
+    }
+
+    if (parser->streaming == PC_PKG_PEEK) {
+        len = MIN(len, PC_PKG_PEEK_BYTES - parser->pkg_offset);
+        memcpy(parser->peek_buf + parser->pkg_offset, data + offset, len);
+        parser->pkg_offset += len;
+
+        if (parser->pkg_offset == PC_PKG_PEEK_BYTES) {
+            if (parser->chunk_handler(parser->peek_buf, PC_PKG_PEEK_BYTES, 0, parser->pkg_size, parser->ex_data)) {
+                parser->streaming = PC_PKG_STREAM;
+            } else {
+                parser->pkg_buf = (char *)pc_lib_malloc(parser->pkg_size);
+                memcpy(parser->pkg_buf, parser->peek_buf, PC_PKG_PEEK_BYTES);
+                parser->streaming = 0;
+            }
+        }
+        return offset + len;
+    }
+
     memcpy(parser->pkg_buf + parser->pkg_offset, data + offset, len);
+    pc_pkg_parser_commit(parser, len);
+
+    return offset + len;
+}
+
+char* pc_pkg_parser_body_buf(pc_pkg_parser_t *parser, size_t* len)
+{
+    if (parser->state != PC_PKG_BODY || parser->streaming || parser->pkg_offset == parser->pkg_size) {
+        return NULL;
+    }
+
+    *len = parser->pkg_size - parser->pkg_offset;
+    return parser->pkg_buf + parser->pkg_offset;
+}
+
+void pc_pkg_parser_commit(pc_pkg_parser_t *parser, size_t len)
+{
+    pc_assert(parser->pkg_offset + len <= parser->pkg_size);
     parser->pkg_offset += len;
 
     if(parser->pkg_offset == parser->pkg_size) {
@@ -105,8 +164,17 @@ static size_t pc__parse_pkg_body(pc_pkg_parser_t *parser, const char *data, size
                 parser->pkg_buf, parser->pkg_size, parser->ex_data);
         pc_pkg_parser_reset(parser);
     }
+}
 
-    return offset + len;
+void pc_pkg_encode_head(pc_pkg_type type, size_t len, char* base)
+{
+    int i;
+
+    base[0] = type & PC_PKG_TYPE_MASK;
+    for (i = PC_PKG_BODY_LEN_BYTES; i > 0; i--) {
+        base[i] = len & 0xff;
+        len >>= 8;
+    }
 }
 
 uv_buf_t pc_pkg_encode(pc_pkg_type type, const char *data, size_t len)
@@ -48,8 +48,22 @@ typedef enum {
     PC_PKG_BODY,            /* parsing body */
 } pc_pkg_parser_state;
 
+#define PC_PKG_PEEK 1   /* collecting the first bytes of the body */
+#define PC_PKG_STREAM 2 /* handing the body to the chunk handler */
+
 typedef void (*pc_on_pkg_handler_t)(pc_pkg_type type, const char* data, size_t len, void* ex_data);
 
+/**
+ * Bytes of a data package body parsed before asking the chunk handler
+ * whether to stream it, enough for the message flag and id.
+ */
+#define PC_PKG_PEEK_BYTES 8
+
+/**
+ * Optional handler to stream big data packages, see pc_pkg_parser_set_chunk_handler.
+ */
+typedef int (*pc_on_pkg_chunk_handler_t)(const char* data, size_t len, size_t offset, size_t pkg_len, void* ex_data);
+
 /**
  * package handler for pkg parser
  */
@@ -71,12 +85,41 @@ typedef struct {
     void* ex_data;
 
     pc_pkg_parser_state state;
+
+    pc_on_pkg_chunk_handler_t chunk_handler;
+    char peek_buf[PC_PKG_PEEK_BYTES];
+    int streaming; /* 0, PC_PKG_PEEK or PC_PKG_STREAM */
 } pc_pkg_parser_t;
 
 void pc_pkg_parser_init(pc_pkg_parser_t *parser, pc_on_pkg_handler_t handler, void* ex_data);
 void pc_pkg_parser_reset(pc_pkg_parser_t *parser);
 void pc_pkg_parser_feed(pc_pkg_parser_t* parser, const char* data, size_t len);
 
+/**
+ * For readers that can write in place, e.g. decrypting, returns where the
+ * next bytes of the package body being buffered go and sets `*len` to how
+ * many are missing. Returns NULL if no body is being buffered, the bytes
+ * must then be given to pc_pkg_parser_feed. pc_pkg_parser_commit parses the
+ * `len` bytes written there.
+ */
+char* pc_pkg_parser_body_buf(pc_pkg_parser_t* parser, size_t* len);
+void pc_pkg_parser_commit(pc_pkg_parser_t* parser, size_t len);
+
+/**
+ * Once the first PC_PKG_PEEK_BYTES bytes of a data package bigger than that
+ * are parsed, `handler` is called with them and offset 0. If it returns non
+ * zero the rest of the body is handed to `handler` as it arrives instead of
+ * being buffered, the last call having `offset + len == pkg_len`. Otherwise
+ * the package goes to the package handler as usual.
+ */
+void pc_pkg_parser_set_chunk_handler(pc_pkg_parser_t* parser, pc_on_pkg_chunk_handler_t handler);
+
 uv_buf_t pc_pkg_encode(pc_pkg_type type, const char *data, size_t len);
 
+/**
+ * Writes the PC_PKG_HEAD_BYTES header of a package whose body of `len`
+ * bytes is written separately.
+ */
+void pc_pkg_encode_head(pc_pkg_type type, size_t len, char* base);
+
 #endif
@@ -0,0 +1,336 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#include <pc_assert.h>
+#include <string.h>
+
+#include <pitaya.h>
+#include <pc_lib.h>
+#include <pc_mutex.h>
+#include <queue.h>
+
+#include "tr_uv_dns.h"
+
+typedef struct {
+    QUEUE queue;
+    char* host;
+    int status;
+    tr_uv_dns_result_t res;
+    uint64_t expires_at;
+    uint64_t refresh_at;
+    int refreshing;
+} tr_uv_dns_entry_t;
+
+struct tr_uv_dns_req_s {
+    uv_getaddrinfo_t req;
+    QUEUE queue;
+    char* host;
+    tr_uv_dns_opts_t opts;
+    int refresh;
+    tr_uv_dns_cb cb;
+    void* data;
+};
+
+/*
+ * The cache and the lookups in flight of every loop, entries are kept most
+ * recently stored first and the last one is evicted when the cache is full.
+ */
+static pc_mutex_t tr_uv_dns__mutex;
+/* the plugins sharing the cache, they register and deregister on one thread */
+static int tr_uv_dns__refs = 0;
+static QUEUE tr_uv_dns__entries;
+static int tr_uv_dns__entry_count = 0;
+static QUEUE tr_uv_dns__reqs;
+
+static uint64_t tr_uv_dns__now_ms(void)
+{
+    return uv_hrtime() / 1000000;
+}
+
+static void tr_uv_dns__entry_free(tr_uv_dns_entry_t* e)
+{
+    QUEUE_REMOVE(&e->queue);
+    tr_uv_dns__entry_count--;
+    pc_lib_free(e->host);
+    pc_lib_free(e);
+}
+
+static tr_uv_dns_entry_t* tr_uv_dns__find(const char* host)
+{
+    QUEUE* q;
+    tr_uv_dns_entry_t* e;
+
+    QUEUE_FOREACH(q, &tr_uv_dns__entries) {
+        e = QUEUE_DATA(q, tr_uv_dns_entry_t, queue);
+        if (strcmp(e->host, host) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static int tr_uv_dns__numeric(const char* host, tr_uv_dns_result_t* res)
+{
+    memset(res, 0, sizeof(tr_uv_dns_result_t));
+    if (uv_ip4_addr(host, 0, (struct sockaddr_in*)&res->addrs[0]) == 0
+            || uv_ip6_addr(host, 0, (struct sockaddr_in6*)&res->addrs[0]) == 0) {
+        res->count = 1;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Returns 1 and fills status and res if host has a live entry this lookup
+ * may use, and sets refresh if the caller should refresh it.
+ */
+static int tr_uv_dns__get(const char* host, const tr_uv_dns_opts_t* opts,
+                          int* status, tr_uv_dns_result_t* res, int* refresh)
+{
+    tr_uv_dns_entry_t* e;
+    uint64_t now = tr_uv_dns__now_ms();
+    int hit = 0;
+
+    *refresh = 0;
+
+    pc_mutex_lock(&tr_uv_dns__mutex);
+    e = tr_uv_dns__find(host);
+    if (e && now >= e->expires_at && !e->refreshing) {
+        tr_uv_dns__entry_free(e);
+        e = NULL;
+    }
+
+    if (e && now < e->expires_at && (e->status ? opts->negative_ttl_ms : opts->ttl_ms)) {
+        hit = 1;
+        *status = e->status;
+        *res = e->res;
+        if (!e->status && now >= e->refresh_at && !e->refreshing) {
+            e->refreshing = 1;
+            *refresh = 1;
+        }
+    }
+    pc_mutex_unlock(&tr_uv_dns__mutex);
+
+    return hit;
+}
+
+static void tr_uv_dns__store(const tr_uv_dns_req_t* r, int status, const tr_uv_dns_result_t* res)
+{
+    tr_uv_dns_entry_t* e;
+    uint64_t ttl = status ? r->opts.negative_ttl_ms : r->opts.ttl_ms;
+    uint64_t now = tr_uv_dns__now_ms();
+
+    pc_mutex_lock(&tr_uv_dns__mutex);
+    e = tr_uv_dns__find(r->host);
+
+    if (r->refresh && e) {
+        e->refreshing = 0;
+    }
+
+    /* a failed refresh leaves the addresses in place until they expire */
+    if (!ttl || status == UV_EAI_CANCELED || (status && r->refresh && e && !e->status)) {
+        pc_mutex_unlock(&tr_uv_dns__mutex);
+        return;
+    }
+
+    if (e) {
+        QUEUE_REMOVE(&e->queue);
+    } else {
+        if (tr_uv_dns__entry_count >= TR_UV_DNS_CACHE_MAX_HOSTS) {
+            tr_uv_dns__entry_free(QUEUE_DATA(QUEUE_PREV(&tr_uv_dns__entries), tr_uv_dns_entry_t, queue));
+        }
+        e = (tr_uv_dns_entry_t*)pc_lib_malloc(sizeof(tr_uv_dns_entry_t));
+        e->host = (char*)pc_lib_strdup(r->host);
+        e->refreshing = 0;
+        tr_uv_dns__entry_count++;
+    }
+    QUEUE_INSERT_HEAD(&tr_uv_dns__entries, &e->queue);
+
+    e->status = status;
+    e->res = *res;
+    e->expires_at = now + ttl;
+    e->refresh_at = now + ttl / 4 * 3;
+    pc_mutex_unlock(&tr_uv_dns__mutex);
+}
+
+static void tr_uv_dns__done(uv_getaddrinfo_t* req, int status, struct addrinfo* ai)
+{
+    tr_uv_dns_req_t* r = (tr_uv_dns_req_t*)req->data;
+    tr_uv_dns_result_t res;
+    struct addrinfo* rp;
+
+    pc_mutex_lock(&tr_uv_dns__mutex);
+    QUEUE_REMOVE(&r->queue);
+    pc_mutex_unlock(&tr_uv_dns__mutex);
+
+    memset(&res, 0, sizeof(tr_uv_dns_result_t));
+    if (!status) {
+        for (rp = ai; rp && res.count < TR_UV_DNS_MAX_ADDRS; rp = rp->ai_next) {
+            if ((rp->ai_family == AF_INET || rp->ai_family == AF_INET6)
+                    && rp->ai_addrlen <= sizeof(struct sockaddr_storage)) {
+                memcpy(&res.addrs[res.count++], rp->ai_addr, rp->ai_addrlen);
+            }
+        }
+        if (!res.count) {
+            status = UV_EAI_NODATA;
+        }
+    }
+    uv_freeaddrinfo(ai);
+
+    if (status && status != UV_EAI_CANCELED) {
+        pc_lib_log(PC_LOG_WARN, "tr_uv_dns__done - resolve %s failed: %s", r->host, uv_strerror(status));
+    }
+
+    tr_uv_dns__store(r, status, &res);
+
+    if (r->cb) {
+        r->cb(r->data, status, &res);
+    }
+
+    pc_lib_free(r->host);
+    pc_lib_free(r);
+}
+
+static int tr_uv_dns__start(uv_loop_t* loop, const char* host, const tr_uv_dns_opts_t* opts, int refresh,
+                            tr_uv_dns_cb cb, void* data, tr_uv_dns_req_t** req)
+{
+    struct addrinfo hints;
+    tr_uv_dns_req_t* r;
+    int ret;
+
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_flags = AI_ADDRCONFIG;
+    hints.ai_socktype = SOCK_STREAM;
+
+    r = (tr_uv_dns_req_t*)pc_lib_malloc(sizeof(tr_uv_dns_req_t));
+    r->host = (char*)pc_lib_strdup(host);
+    r->opts = *opts;
+    r->refresh = refresh;
+    r->cb = cb;
+    r->data = data;
+    r->req.data = r;
+
+    pc_mutex_lock(&tr_uv_dns__mutex);
+    QUEUE_INSERT_TAIL(&tr_uv_dns__reqs, &r->queue);
+    ret = uv_getaddrinfo(loop, &r->req, tr_uv_dns__done, r->host, NULL, &hints);
+    if (ret) {
+        QUEUE_REMOVE(&r->queue);
+    }
+    pc_mutex_unlock(&tr_uv_dns__mutex);
+
+    if (ret) {
+        pc_lib_log(PC_LOG_ERROR, "tr_uv_dns__start - start resolving %s failed: %s", host, uv_strerror(ret));
+        if (refresh) {
+            tr_uv_dns__store(r, UV_EAI_CANCELED, NULL);
+        }
+        pc_lib_free(r->host);
+        pc_lib_free(r);
+        return ret;
+    }
+
+    if (req) {
+        *req = r;
+    }
+    return TR_UV_DNS_PENDING;
+}
+
+void tr_uv_dns_init(void)
+{
+    if (tr_uv_dns__refs++) {
+        return;
+    }
+    pc_mutex_init(&tr_uv_dns__mutex);
+    QUEUE_INIT(&tr_uv_dns__entries);
+    QUEUE_INIT(&tr_uv_dns__reqs);
+}
+
+void tr_uv_dns_cleanup(void)
+{
+    if (!tr_uv_dns__refs || --tr_uv_dns__refs) {
+        return;
+    }
+    tr_uv_dns_clear();
+    pc_mutex_destroy(&tr_uv_dns__mutex);
+}
+
+void tr_uv_dns_clear(void)
+{
+    pc_mutex_lock(&tr_uv_dns__mutex);
+    while (!QUEUE_EMPTY(&tr_uv_dns__entries)) {
+        tr_uv_dns__entry_free(QUEUE_DATA(QUEUE_HEAD(&tr_uv_dns__entries), tr_uv_dns_entry_t, queue));
+    }
+    pc_mutex_unlock(&tr_uv_dns__mutex);
+}
+
+void tr_uv_dns_put(const char* host, const tr_uv_dns_result_t* res, uint64_t ttl_ms)
+{
+    tr_uv_dns_req_t r;
+
+    pc_assert(host && res && res->count > 0);
+
+    memset(&r, 0, sizeof(tr_uv_dns_req_t));
+    r.host = (char*)host;
+    r.opts.ttl_ms = ttl_ms;
+    tr_uv_dns__store(&r, 0, res);
+}
+
+int tr_uv_dns_resolve(uv_loop_t* loop, const char* host, const tr_uv_dns_opts_t* opts,
+                      tr_uv_dns_cb cb, void* data, tr_uv_dns_req_t** req)
+{
+    tr_uv_dns_result_t res;
+    int status;
+    int refresh;
+
+    pc_assert(loop && host && opts);
+
+    if (req) {
+        *req = NULL;
+    }
+
+    if (tr_uv_dns__numeric(host, &res)) {
+        if (cb) {
+            cb(data, 0, &res);
+        }
+        return TR_UV_DNS_NUMERIC;
+    }
+
+    if (tr_uv_dns__get(host, opts, &status, &res, &refresh)) {
+        if (refresh) {
+            pc_lib_log(PC_LOG_DEBUG, "tr_uv_dns_resolve - refreshing %s in the background", host);
+            tr_uv_dns__start(loop, host, opts, 1, NULL, NULL, NULL);
+        }
+        if (cb) {
+            cb(data, status, &res);
+        }
+        return TR_UV_DNS_CACHED;
+    }
+
+    return tr_uv_dns__start(loop, host, opts, 0, cb, data, req);
+}
+
+void tr_uv_dns_cancel(tr_uv_dns_req_t* req)
+{
+    pc_assert(req);
+
+    req->cb = NULL;
+    uv_cancel((uv_req_t*)&req->req);
+}
+
+void tr_uv_dns_cancel_all(uv_loop_t* loop)
+{
+    QUEUE* q;
+    tr_uv_dns_req_t* r;
+
+    pc_mutex_lock(&tr_uv_dns__mutex);
+    QUEUE_FOREACH(q, &tr_uv_dns__reqs) {
+        r = QUEUE_DATA(q, tr_uv_dns_req_t, queue);
+        if (r->req.loop == loop) {
+            r->cb = NULL;
+            uv_cancel((uv_req_t*)&r->req);
+        }
+    }
+    pc_mutex_unlock(&tr_uv_dns__mutex);
+}
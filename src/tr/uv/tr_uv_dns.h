@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifndef TR_UV_DNS_H
+#define TR_UV_DNS_H
+
+#include <uv.h>
+
+/**
+ * Host name resolution for the tcp transports.
+ *
+ * Lookups go through uv_getaddrinfo on the libuv thread pool, so a slow
+ * resolver never blocks the loop, and their results are kept in a cache
+ * shared by every client of the process:
+ *
+ *   - successful lookups are kept for `ttl_ms`; once three quarters of it
+ *     went by, the next use still gets the cached addresses but also starts
+ *     a refresh in the background.
+ *   - failed lookups are kept for `negative_ttl_ms`, so a client that keeps
+ *     reconnecting to a bad host does not hit the resolver every time.
+ *
+ * Numeric addresses are converted in place and never reach the resolver.
+ */
+
+#define TR_UV_DNS_MAX_ADDRS 8
+#define TR_UV_DNS_CACHE_MAX_HOSTS 64
+
+#define TR_UV_DNS_DEFAULT_TTL 60          /* seconds */
+#define TR_UV_DNS_DEFAULT_NEGATIVE_TTL 5  /* seconds */
+
+typedef struct {
+    struct sockaddr_storage addrs[TR_UV_DNS_MAX_ADDRS];
+    int count;
+} tr_uv_dns_result_t;
+
+/**
+ * Cache lifetimes of a lookup, 0 does not cache it.
+ */
+typedef struct {
+    uint64_t ttl_ms;
+    uint64_t negative_ttl_ms;
+} tr_uv_dns_opts_t;
+
+/**
+ * status is 0 or a UV_EAI_* error. res, in the resolver's order and with
+ * the ports left at 0, is only valid during the call.
+ */
+typedef void (*tr_uv_dns_cb)(void* data, int status, const tr_uv_dns_result_t* res);
+
+typedef struct tr_uv_dns_req_s tr_uv_dns_req_t;
+
+/* how tr_uv_dns_resolve answered */
+#define TR_UV_DNS_PENDING 0
+#define TR_UV_DNS_CACHED 1
+#define TR_UV_DNS_NUMERIC 2
+
+/* counted, the cache goes with the last cleanup of the plugins using it */
+void tr_uv_dns_init(void);
+void tr_uv_dns_cleanup(void);
+
+/**
+ * Drops every cached entry, lookups in flight still store their results.
+ */
+void tr_uv_dns_clear(void);
+
+/**
+ * Stores `res` for `host` as if a lookup had just returned it, pinning the
+ * host to known addresses for `ttl_ms`.
+ */
+void tr_uv_dns_put(const char* host, const tr_uv_dns_result_t* res, uint64_t ttl_ms);
+
+/**
+ * Resolves `host` on `loop`, which must be the calling thread's loop or one
+ * that is not running yet.
+ *
+ * Numeric addresses and cache hits call `cb` before returning and return
+ * TR_UV_DNS_NUMERIC or TR_UV_DNS_CACHED. Otherwise a lookup is started,
+ * `*req` is set to it and TR_UV_DNS_PENDING is returned, and `cb` is called
+ * from the loop once it finishes, unless it is cancelled first. A negative
+ * value is a libuv error starting the lookup. `cb` may be NULL to only fill
+ * the cache, and `req` may be NULL if the lookup will not be cancelled.
+ */
+int tr_uv_dns_resolve(uv_loop_t* loop, const char* host, const tr_uv_dns_opts_t* opts,
+                      tr_uv_dns_cb cb, void* data, tr_uv_dns_req_t** req);
+
+/**
+ * The callback of `req` will not be called. The lookup itself is only
+ * stopped if it did not reach the thread pool yet, otherwise its result
+ * still goes to the cache. Must be called from the loop of `req`.
+ */
+void tr_uv_dns_cancel(tr_uv_dns_req_t* req);
+
+/**
+ * Cancels every lookup started on `loop`, including background refreshes,
+ * so that closing the loop does not wait for a slow resolver.
+ */
+void tr_uv_dns_cancel_all(uv_loop_t* loop);
+
+#endif /* TR_UV_DNS_H */
@@ -0,0 +1,231 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#include <pc_assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pc_lib.h>
+#include <uv.h>
+
+#include "tr_uv_endpoints.h"
+
+static int tr_uv_endpoints__score(const tr_uv_endpoint_t* ep)
+{
+    int score = ep->failures * TR_UV_ENDPOINT_FAILURE_PENALTY;
+
+    if (ep->connect_ms > 0) {
+        score += ep->connect_ms;
+    }
+    if (ep->rtt_ms > 0) {
+        score += ep->rtt_ms;
+    }
+    return score;
+}
+
+/* weighs the last sample as a third, like the heartbeat rtt */
+static int tr_uv_endpoints__average(int avg, int sample)
+{
+    return avg < 0 ? sample : (avg * 2 + sample) / 3;
+}
+
+/* xorshift32, a uniform double in [0, 1) */
+static double tr_uv_endpoints__random(tr_uv_endpoints_t* eps)
+{
+    uint32_t x = eps->seed;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    eps->seed = x;
+    return x / 4294967296.0;
+}
+
+static void tr_uv_endpoints__reset(tr_uv_endpoints_t* eps)
+{
+    eps->list = NULL;
+    eps->count = 0;
+    eps->current = 0;
+}
+
+void tr_uv_endpoints_init(tr_uv_endpoints_t* eps)
+{
+    pc_mutex_init(&eps->mutex);
+    tr_uv_endpoints__reset(eps);
+
+    /* clients created together pick differently */
+    eps->seed = (uint32_t)(uv_hrtime() ^ (uint64_t)(uintptr_t)eps);
+    if (!eps->seed) {
+        eps->seed = 1;
+    }
+}
+
+void tr_uv_endpoints_cleanup(tr_uv_endpoints_t* eps)
+{
+    tr_uv_endpoints_clear(eps);
+    pc_mutex_destroy(&eps->mutex);
+}
+
+void tr_uv_endpoints_set(tr_uv_endpoints_t* eps, const pc_endpoint_t* endpoints, int count)
+{
+    tr_uv_endpoint_t* ep;
+    int i;
+
+    pc_assert(endpoints && count > 0);
+
+    pc_mutex_lock(&eps->mutex);
+    tr_uv_endpoints_clear(eps);
+
+    eps->list = (tr_uv_endpoint_t*)pc_lib_malloc(sizeof(tr_uv_endpoint_t) * count);
+    memset(eps->list, 0, sizeof(tr_uv_endpoint_t) * count);
+    eps->count = count;
+
+    for (i = 0; i < count; ++i) {
+        ep = &eps->list[i];
+        ep->host = (char*)pc_lib_strdup(endpoints[i].host);
+        ep->port = endpoints[i].port;
+        ep->weight = endpoints[i].weight > 0 ? endpoints[i].weight : 1;
+        ep->connect_ms = -1;
+        ep->rtt_ms = -1;
+    }
+    pc_mutex_unlock(&eps->mutex);
+}
+
+void tr_uv_endpoints_clear(tr_uv_endpoints_t* eps)
+{
+    int i;
+
+    pc_mutex_lock(&eps->mutex);
+    for (i = 0; i < eps->count; ++i) {
+        pc_lib_free(eps->list[i].host);
+    }
+    pc_lib_free(eps->list);
+    tr_uv_endpoints__reset(eps);
+    pc_mutex_unlock(&eps->mutex);
+}
+
+int tr_uv_endpoints_pick(tr_uv_endpoints_t* eps, uint64_t now, uint64_t* wait_ms)
+{
+    const tr_uv_endpoint_t* ep;
+    double share[PC_MAX_ENDPOINTS];
+    double total = 0;
+    double r;
+    int first_up = 0;
+    int i;
+
+    pc_mutex_lock(&eps->mutex);
+    pc_assert(eps->count > 0 && eps->count <= PC_MAX_ENDPOINTS);
+
+    *wait_ms = 0;
+
+    for (i = 0; i < eps->count; ++i) {
+        ep = &eps->list[i];
+        share[i] = 0;
+        if (now >= ep->down_until) {
+            share[i] = (double)ep->weight / (TR_UV_ENDPOINT_FAILURE_PENALTY + tr_uv_endpoints__score(ep));
+            total += share[i];
+        } else if (ep->down_until < eps->list[first_up].down_until) {
+            first_up = i;
+        }
+    }
+
+    if (total == 0) {
+        *wait_ms = eps->list[first_up].down_until - now;
+        pc_mutex_unlock(&eps->mutex);
+        return first_up;
+    }
+
+    r = total * tr_uv_endpoints__random(eps);
+    for (i = 0; i < eps->count; ++i) {
+        if (share[i] > 0 && (r -= share[i]) < 0) {
+            pc_mutex_unlock(&eps->mutex);
+            return i;
+        }
+    }
+
+    /* rounding, the last healthy endpoint */
+    for (i = eps->count - 1; share[i] == 0; --i) {
+    }
+    pc_mutex_unlock(&eps->mutex);
+    return i;
+}
+
+void tr_uv_endpoints_on_tcp_connected(tr_uv_endpoints_t* eps, int connect_ms)
+{
+    tr_uv_endpoint_t* ep;
+
+    pc_mutex_lock(&eps->mutex);
+    ep = &eps->list[eps->current];
+    ep->connect_ms = tr_uv_endpoints__average(ep->connect_ms, connect_ms);
+    pc_mutex_unlock(&eps->mutex);
+}
+
+void tr_uv_endpoints_on_handshake(tr_uv_endpoints_t* eps)
+{
+    tr_uv_endpoint_t* ep;
+
+    pc_mutex_lock(&eps->mutex);
+    ep = &eps->list[eps->current];
+    ep->failures = 0;
+    ep->down_until = 0;
+    ep->connects++;
+    pc_mutex_unlock(&eps->mutex);
+}
+
+void tr_uv_endpoints_on_rtt(tr_uv_endpoints_t* eps, int rtt_ms)
+{
+    tr_uv_endpoint_t* ep;
+
+    pc_mutex_lock(&eps->mutex);
+    ep = &eps->list[eps->current];
+    ep->rtt_ms = tr_uv_endpoints__average(ep->rtt_ms, rtt_ms);
+    pc_mutex_unlock(&eps->mutex);
+}
+
+void tr_uv_endpoints_on_failure(tr_uv_endpoints_t* eps, uint64_t now,
+                                uint64_t backoff_ms, uint64_t backoff_max_ms)
+{
+    tr_uv_endpoint_t* ep;
+    uint64_t backoff = backoff_ms;
+    int i;
+
+    pc_mutex_lock(&eps->mutex);
+    ep = &eps->list[eps->current];
+    for (i = 0; i < ep->failures && backoff < backoff_max_ms; ++i) {
+        backoff <<= 1;
+    }
+    if (backoff > backoff_max_ms) {
+        backoff = backoff_max_ms;
+    }
+
+    ep->failures++;
+    ep->down_until = now + backoff;
+
+    pc_lib_log(PC_LOG_INFO, "tr_uv_endpoints_on_failure - %s:%d failed %d time(s) in a row, backing off for %d ms",
+               ep->host, ep->port, ep->failures, (int)backoff);
+    pc_mutex_unlock(&eps->mutex);
+}
+
+int tr_uv_endpoints_health(tr_uv_endpoints_t* eps, int index, uint64_t now,
+                           pc_endpoint_health_t* health)
+{
+    const tr_uv_endpoint_t* ep;
+
+    pc_mutex_lock(&eps->mutex);
+    if (index < 0 || index >= eps->count) {
+        pc_mutex_unlock(&eps->mutex);
+        return PC_RC_INVALID_ARG;
+    }
+
+    ep = &eps->list[index];
+    health->score = now >= ep->down_until ? tr_uv_endpoints__score(ep) : -1;
+    health->connect_ms = ep->connect_ms;
+    health->rtt_ms = ep->rtt_ms;
+    health->failures = ep->failures;
+    health->connects = ep->connects;
+    health->current = index == eps->current;
+    pc_mutex_unlock(&eps->mutex);
+    return PC_RC_OK;
+}
@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifndef TR_UV_ENDPOINTS_H
+#define TR_UV_ENDPOINTS_H
+
+#include <stdint.h>
+
+#include <pitaya.h>
+#include <pc_mutex.h>
+
+/**
+ * The endpoints a client given to pc_client_connect_endpoints connects to,
+ * with the health of each one.
+ *
+ * Connects go to a healthy endpoint, picked at random with a chance
+ * proportional to its weight and inversely proportional to its score. An
+ * endpoint that fails to connect or to handshake is not healthy until its
+ * backoff, doubling with each failure in a row, is over. The functions
+ * lock the list, as tr_uv_endpoints_health runs on the application thread
+ * while the loop thread updates it. Code reading `list` directly holds
+ * `mutex`, which is recursive.
+ */
+
+/* score added per failure in a row, in the unit of the latencies */
+#define TR_UV_ENDPOINT_FAILURE_PENALTY 1000
+
+typedef struct {
+    char* host;
+    int port;
+    int weight;
+
+    int connect_ms;      /* average connect latency, -1 if unknown */
+    int rtt_ms;          /* average heartbeat rtt, -1 if unknown */
+    int failures;        /* failed connects and handshakes in a row */
+    uint64_t down_until; /* loop time the backoff after the last failure ends at */
+    uint64_t connects;
+} tr_uv_endpoint_t;
+
+typedef struct {
+    pc_mutex_t mutex;
+    tr_uv_endpoint_t* list;
+    int count;
+    int current;
+    /* of the random picks, rand() is shared and reseeded by pc_lib_init */
+    uint32_t seed;
+} tr_uv_endpoints_t;
+
+void tr_uv_endpoints_init(tr_uv_endpoints_t* eps);
+void tr_uv_endpoints_cleanup(tr_uv_endpoints_t* eps);
+void tr_uv_endpoints_set(tr_uv_endpoints_t* eps, const pc_endpoint_t* endpoints, int count);
+void tr_uv_endpoints_clear(tr_uv_endpoints_t* eps);
+
+/**
+ * Returns the index of the endpoint to connect to next, and sets `*wait_ms`
+ * to how long until it is healthy, 0 unless every endpoint is backed off.
+ */
+int tr_uv_endpoints_pick(tr_uv_endpoints_t* eps, uint64_t now, uint64_t* wait_ms);
+
+void tr_uv_endpoints_on_tcp_connected(tr_uv_endpoints_t* eps, int connect_ms);
+void tr_uv_endpoints_on_handshake(tr_uv_endpoints_t* eps);
+void tr_uv_endpoints_on_rtt(tr_uv_endpoints_t* eps, int rtt_ms);
+
+/**
+ * Backs the current endpoint off for `backoff_ms` doubled for each earlier
+ * failure in a row, up to `backoff_max_ms`.
+ */
+void tr_uv_endpoints_on_failure(tr_uv_endpoints_t* eps, uint64_t now,
+                                uint64_t backoff_ms, uint64_t backoff_max_ms);
+
+/**
+ * `now` is the monotonic clock in milliseconds, the loop time is not to be
+ * read off the loop thread.
+ */
+int tr_uv_endpoints_health(tr_uv_endpoints_t* eps, int index, uint64_t now,
+                           pc_endpoint_health_t* health);
+
+#endif /* TR_UV_ENDPOINTS_H */
@@ -0,0 +1,13 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifndef TR_UV_KCP_H
+#define TR_UV_KCP_H
+
+#include <pitaya_trans.h>
+
+pc_transport_plugin_t* pc_tr_uv_kcp_trans_plugin();
+
+#endif /* TR_UV_KCP_H */
@@ -0,0 +1,664 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#include "tr_uv_kcp_arq.h"
+
+#include <string.h>
+
+#include <pitaya.h>
+#include <pc_lib.h>
+
+#define TR_UV_KCP_ASK_SEND 1
+#define TR_UV_KCP_ASK_TELL 2
+
+#define TR_UV_KCP_THRESH_INIT 2
+#define TR_UV_KCP_THRESH_MIN 2
+
+#define TR_UV_KCP_PROBE_INIT 7000
+#define TR_UV_KCP_PROBE_LIMIT 120000
+
+/* fast resends of a segment, then only its timeout sends it again */
+#define TR_UV_KCP_FASTACK_LIMIT 5
+
+static int32_t tr_uv_kcp_arq__diff(uint32_t later, uint32_t earlier)
+{
+    return (int32_t)(later - earlier);
+}
+
+static char* tr_uv_kcp_arq__encode32(char* p, uint32_t v)
+{
+    p[0] = (char)(v & 0xff);
+    p[1] = (char)((v >> 8) & 0xff);
+    p[2] = (char)((v >> 16) & 0xff);
+    p[3] = (char)((v >> 24) & 0xff);
+    return p + 4;
+}
+
+static uint32_t tr_uv_kcp_arq__decode32(const char* p)
+{
+    const unsigned char* u = (const unsigned char*)p;
+    return (uint32_t)u[0] | ((uint32_t)u[1] << 8) | ((uint32_t)u[2] << 16) | ((uint32_t)u[3] << 24);
+}
+
+static tr_uv_kcp_seg_t* tr_uv_kcp_arq__seg_new(void)
+{
+    tr_uv_kcp_seg_t* seg = (tr_uv_kcp_seg_t*)pc_lib_malloc(sizeof(tr_uv_kcp_seg_t));
+
+    memset(seg, 0, offsetof(tr_uv_kcp_seg_t, data));
+    QUEUE_INIT(&seg->queue);
+    return seg;
+}
+
+static void tr_uv_kcp_arq__free_queue(QUEUE* h)
+{
+    QUEUE* q;
+
+    while (!QUEUE_EMPTY(h)) {
+        q = QUEUE_HEAD(h);
+        QUEUE_REMOVE(q);
+        pc_lib_free(QUEUE_DATA(q, tr_uv_kcp_seg_t, queue));
+    }
+}
+
+static uint32_t tr_uv_kcp_arq__wnd_unused(const tr_uv_kcp_arq_t* arq)
+{
+    return arq->nrcv_que < arq->rcv_wnd ? arq->rcv_wnd - arq->nrcv_que : 0;
+}
+
+static uint32_t tr_uv_kcp_arq__cwnd(const tr_uv_kcp_arq_t* arq)
+{
+    uint32_t cwnd = arq->snd_wnd < arq->rmt_wnd ? arq->snd_wnd : arq->rmt_wnd;
+
+    if (!arq->nocwnd && arq->cwnd < cwnd) {
+        cwnd = arq->cwnd;
+    }
+    return cwnd;
+}
+
+void tr_uv_kcp_arq_init(tr_uv_kcp_arq_t* arq, uint32_t conv, tr_uv_kcp_output_fn output, void* ex_data)
+{
+    memset(arq, 0, offsetof(tr_uv_kcp_arq_t, buffer));
+
+    arq->conv = conv;
+    arq->snd_wnd = TR_UV_KCP_WND_SND;
+    arq->rcv_wnd = TR_UV_KCP_WND_RCV;
+    arq->rmt_wnd = TR_UV_KCP_WND_RCV;
+    /* KCP starts at 0, which holds the first flush back */
+    arq->cwnd = 1;
+    arq->incr = TR_UV_KCP_MSS;
+    arq->ssthresh = TR_UV_KCP_THRESH_INIT;
+    arq->rx_rto = TR_UV_KCP_RTO_DEF;
+    arq->rx_minrto = TR_UV_KCP_RTO_MIN;
+    arq->interval = TR_UV_KCP_INTERVAL;
+
+    QUEUE_INIT(&arq->snd_queue);
+    QUEUE_INIT(&arq->snd_buf);
+    QUEUE_INIT(&arq->rcv_queue);
+    QUEUE_INIT(&arq->rcv_buf);
+
+    arq->output = output;
+    arq->ex_data = ex_data;
+    arq->buffer_len = 0;
+}
+
+void tr_uv_kcp_arq_release(tr_uv_kcp_arq_t* arq)
+{
+    tr_uv_kcp_arq__free_queue(&arq->snd_queue);
+    tr_uv_kcp_arq__free_queue(&arq->snd_buf);
+    tr_uv_kcp_arq__free_queue(&arq->rcv_queue);
+    tr_uv_kcp_arq__free_queue(&arq->rcv_buf);
+    pc_lib_free(arq->acklist);
+    arq->acklist = NULL;
+    arq->ackcount = 0;
+    arq->ackblock = 0;
+}
+
+void tr_uv_kcp_arq_nodelay(tr_uv_kcp_arq_t* arq, int nodelay, int interval, int resend, int nc)
+{
+    if (nodelay > 0) {
+        arq->nodelay = nodelay;
+        arq->rx_minrto = TR_UV_KCP_RTO_NDL;
+    }
+    if (interval > 0) {
+        arq->interval = interval < 10 ? 10 : (interval > 5000 ? 5000 : (uint32_t)interval);
+    }
+    if (resend > 0) {
+        arq->fastresend = (uint32_t)resend;
+    }
+    if (nc > 0) {
+        arq->nocwnd = 1;
+    }
+}
+
+void tr_uv_kcp_arq_wndsize(tr_uv_kcp_arq_t* arq, int snd_wnd, int rcv_wnd)
+{
+    if (snd_wnd > 0) {
+        arq->snd_wnd = (uint32_t)snd_wnd;
+    }
+    if (rcv_wnd > 0) {
+        arq->rcv_wnd = (uint32_t)rcv_wnd;
+    }
+}
+
+void tr_uv_kcp_arq_send(tr_uv_kcp_arq_t* arq, const char* data, size_t len)
+{
+    tr_uv_kcp_seg_t* seg;
+    size_t n;
+
+    /* stream mode, the last segment is filled up first */
+    if (!QUEUE_EMPTY(&arq->snd_queue)) {
+        seg = QUEUE_DATA(QUEUE_PREV(&arq->snd_queue), tr_uv_kcp_seg_t, queue);
+        n = TR_UV_KCP_MSS - seg->len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(seg->data + seg->len, data, n);
+        seg->len += (uint32_t)n;
+        data += n;
+        len -= n;
+    }
+
+    while (len > 0) {
+        n = len < TR_UV_KCP_MSS ? len : TR_UV_KCP_MSS;
+        seg = tr_uv_kcp_arq__seg_new();
+        memcpy(seg->data, data, n);
+        seg->len = (uint32_t)n;
+        QUEUE_INSERT_TAIL(&arq->snd_queue, &seg->queue);
+        arq->nsnd_que++;
+        data += n;
+        len -= n;
+    }
+}
+
+static void tr_uv_kcp_arq__update_ack(tr_uv_kcp_arq_t* arq, int32_t rtt)
+{
+    int32_t delta;
+    int32_t rto;
+
+    if (arq->rx_srtt == 0) {
+        arq->rx_srtt = rtt;
+        arq->rx_rttval = rtt / 2;
+    } else {
+        delta = rtt - arq->rx_srtt;
+        if (delta < 0) {
+            delta = -delta;
+        }
+        arq->rx_rttval = (3 * arq->rx_rttval + delta) / 4;
+        arq->rx_srtt = (7 * arq->rx_srtt + rtt) / 8;
+        if (arq->rx_srtt < 1) {
+            arq->rx_srtt = 1;
+        }
+    }
+
+    rto = arq->rx_srtt + ((int32_t)arq->interval > 4 * arq->rx_rttval ? (int32_t)arq->interval : 4 * arq->rx_rttval);
+    if (rto < arq->rx_minrto) {
+        rto = arq->rx_minrto;
+    } else if (rto > TR_UV_KCP_RTO_MAX) {
+        rto = TR_UV_KCP_RTO_MAX;
+    }
+    arq->rx_rto = rto;
+}
+
+static void tr_uv_kcp_arq__shrink_buf(tr_uv_kcp_arq_t* arq)
+{
+    if (!QUEUE_EMPTY(&arq->snd_buf)) {
+        arq->snd_una = QUEUE_DATA(QUEUE_HEAD(&arq->snd_buf), tr_uv_kcp_seg_t, queue)->sn;
+    } else {
+        arq->snd_una = arq->snd_nxt;
+    }
+}
+
+static void tr_uv_kcp_arq__parse_ack(tr_uv_kcp_arq_t* arq, uint32_t sn)
+{
+    tr_uv_kcp_seg_t* seg;
+    QUEUE* q;
+
+    if (tr_uv_kcp_arq__diff(sn, arq->snd_una) < 0 || tr_uv_kcp_arq__diff(sn, arq->snd_nxt) >= 0) {
+        return;
+    }
+
+    QUEUE_FOREACH(q, &arq->snd_buf) {
+        seg = QUEUE_DATA(q, tr_uv_kcp_seg_t, queue);
+        if (seg->sn == sn) {
+            QUEUE_REMOVE(q);
+            pc_lib_free(seg);
+            arq->nsnd_buf--;
+            break;
+        }
+        if (tr_uv_kcp_arq__diff(sn, seg->sn) < 0) {
+            break;
+        }
+    }
+}
+
+static void tr_uv_kcp_arq__parse_una(tr_uv_kcp_arq_t* arq, uint32_t una)
+{
+    tr_uv_kcp_seg_t* seg;
+    QUEUE* q;
+
+    while (!QUEUE_EMPTY(&arq->snd_buf)) {
+        q = QUEUE_HEAD(&arq->snd_buf);
+        seg = QUEUE_DATA(q, tr_uv_kcp_seg_t, queue);
+        if (tr_uv_kcp_arq__diff(una, seg->sn) <= 0) {
+            break;
+        }
+        QUEUE_REMOVE(q);
+        pc_lib_free(seg);
+        arq->nsnd_buf--;
+    }
+}
+
+/* the segments sent before the latest one acknowledged were skipped once more */
+static void tr_uv_kcp_arq__parse_fastack(tr_uv_kcp_arq_t* arq, uint32_t sn)
+{
+    tr_uv_kcp_seg_t* seg;
+    QUEUE* q;
+
+    if (tr_uv_kcp_arq__diff(sn, arq->snd_una) < 0 || tr_uv_kcp_arq__diff(sn, arq->snd_nxt) >= 0) {
+        return;
+    }
+
+    QUEUE_FOREACH(q, &arq->snd_buf) {
+        seg = QUEUE_DATA(q, tr_uv_kcp_seg_t, queue);
+        if (tr_uv_kcp_arq__diff(sn, seg->sn) <= 0) {
+            break;
+        }
+        seg->fastack++;
+    }
+}
+
+static void tr_uv_kcp_arq__ack_push(tr_uv_kcp_arq_t* arq, uint32_t sn, uint32_t ts)
+{
+    if (arq->ackcount == arq->ackblock) {
+        arq->ackblock = arq->ackblock ? arq->ackblock * 2 : 8;
+        arq->acklist = (uint32_t*)pc_lib_realloc(arq->acklist, sizeof(uint32_t) * 2 * arq->ackblock);
+    }
+    arq->acklist[arq->ackcount * 2] = sn;
+    arq->acklist[arq->ackcount * 2 + 1] = ts;
+    arq->ackcount++;
+}
+
+static void tr_uv_kcp_arq__move_rcv_buf(tr_uv_kcp_arq_t* arq)
+{
+    tr_uv_kcp_seg_t* seg;
+    QUEUE* q;
+
+    while (!QUEUE_EMPTY(&arq->rcv_buf)) {
+        q = QUEUE_HEAD(&arq->rcv_buf);
+        seg = QUEUE_DATA(q, tr_uv_kcp_seg_t, queue);
+        if (seg->sn != arq->rcv_nxt || arq->nrcv_que >= arq->rcv_wnd) {
+            break;
+        }
+        QUEUE_REMOVE(q);
+        QUEUE_INSERT_TAIL(&arq->rcv_queue, q);
+        arq->nrcv_buf--;
+        arq->nrcv_que++;
+        arq->rcv_nxt++;
+    }
+}
+
+static void tr_uv_kcp_arq__parse_data(tr_uv_kcp_arq_t* arq, uint32_t sn, const char* data, uint32_t len)
+{
+    tr_uv_kcp_seg_t* seg;
+    tr_uv_kcp_seg_t* newseg;
+    QUEUE* q;
+
+    if (tr_uv_kcp_arq__diff(sn, arq->rcv_nxt + arq->rcv_wnd) >= 0 || tr_uv_kcp_arq__diff(sn, arq->rcv_nxt) < 0) {
+        return;
+    }
+
+    /* segments mostly come in order, the place is looked for from the end */
+    for (q = QUEUE_PREV(&arq->rcv_buf); q != &arq->rcv_buf; q = QUEUE_PREV(q)) {
+        seg = QUEUE_DATA(q, tr_uv_kcp_seg_t, queue);
+        if (seg->sn == sn) {
+            return;
+        }
+        if (tr_uv_kcp_arq__diff(sn, seg->sn) > 0) {
+            break;
+        }
+    }
+
+    newseg = tr_uv_kcp_arq__seg_new();
+    newseg->sn = sn;
+    newseg->len = len;
+    memcpy(newseg->data, data, len);
+    QUEUE_INSERT_HEAD(q, &newseg->queue);
+    arq->nrcv_buf++;
+
+    tr_uv_kcp_arq__move_rcv_buf(arq);
+}
+
+int tr_uv_kcp_arq_input(tr_uv_kcp_arq_t* arq, const char* data, size_t len, uint32_t current)
+{
+    uint32_t prev_una = arq->snd_una;
+    uint32_t maxack = 0;
+    int got_ack = 0;
+    uint32_t conv, ts, sn, una, seg_len;
+    uint8_t cmd;
+    uint16_t wnd;
+    uint32_t mss = TR_UV_KCP_MSS;
+
+    if (len < TR_UV_KCP_OVERHEAD) {
+        return -1;
+    }
+
+    while (len >= TR_UV_KCP_OVERHEAD) {
+        conv = tr_uv_kcp_arq__decode32(data);
+        cmd = (uint8_t)data[4];
+        wnd = (uint16_t)((unsigned char)data[6] | ((unsigned char)data[7] << 8));
+        ts = tr_uv_kcp_arq__decode32(data + 8);
+        sn = tr_uv_kcp_arq__decode32(data + 12);
+        una = tr_uv_kcp_arq__decode32(data + 16);
+        seg_len = tr_uv_kcp_arq__decode32(data + 20);
+
+        data += TR_UV_KCP_OVERHEAD;
+        len -= TR_UV_KCP_OVERHEAD;
+
+        /* segments longer than ours would come from a peer with a larger mtu */
+        if (conv != arq->conv || seg_len > len || seg_len > TR_UV_KCP_MSS
+                || cmd < TR_UV_KCP_CMD_PUSH || cmd > TR_UV_KCP_CMD_WINS) {
+            return -1;
+        }
+
+        arq->rmt_wnd = wnd;
+        tr_uv_kcp_arq__parse_una(arq, una);
+        tr_uv_kcp_arq__shrink_buf(arq);
+
+        switch (cmd) {
+        case TR_UV_KCP_CMD_ACK:
+            if (tr_uv_kcp_arq__diff(current, ts) >= 0) {
+                tr_uv_kcp_arq__update_ack(arq, tr_uv_kcp_arq__diff(current, ts));
+            }
+            tr_uv_kcp_arq__parse_ack(arq, sn);
+            tr_uv_kcp_arq__shrink_buf(arq);
+            if (!got_ack || tr_uv_kcp_arq__diff(sn, maxack) > 0) {
+                maxack = sn;
+                got_ack = 1;
+            }
+            break;
+        case TR_UV_KCP_CMD_PUSH:
+            if (tr_uv_kcp_arq__diff(sn, arq->rcv_nxt + arq->rcv_wnd) < 0) {
+                tr_uv_kcp_arq__ack_push(arq, sn, ts);
+                tr_uv_kcp_arq__parse_data(arq, sn, data, seg_len);
+            }
+            break;
+        case TR_UV_KCP_CMD_WASK:
+            arq->probe |= TR_UV_KCP_ASK_TELL;
+            break;
+        default:
+            /* TR_UV_KCP_CMD_WINS only carries the window */
+            break;
+        }
+
+        data += seg_len;
+        len -= seg_len;
+    }
+
+    if (got_ack) {
+        tr_uv_kcp_arq__parse_fastack(arq, maxack);
+    }
+
+    /* congestion window, slow start then congestion avoidance */
+    if (tr_uv_kcp_arq__diff(arq->snd_una, prev_una) > 0 && arq->cwnd < arq->rmt_wnd) {
+        if (arq->cwnd < arq->ssthresh) {
+            arq->cwnd++;
+            arq->incr += mss;
+        } else {
+            if (arq->incr < mss) {
+                arq->incr = mss;
+            }
+            arq->incr += (mss * mss) / arq->incr + (mss / 16);
+            if ((arq->cwnd + 1) * mss <= arq->incr) {
+                arq->cwnd = (arq->incr + mss - 1) / mss;
+            }
+        }
+        if (arq->cwnd > arq->rmt_wnd) {
+            arq->cwnd = arq->rmt_wnd;
+            arq->incr = arq->rmt_wnd * mss;
+        }
+    }
+
+    return 0;
+}
+
+tr_uv_kcp_seg_t* tr_uv_kcp_arq_recv(tr_uv_kcp_arq_t* arq)
+{
+    tr_uv_kcp_seg_t* seg;
+    QUEUE* q;
+    int recover;
+
+    if (QUEUE_EMPTY(&arq->rcv_queue)) {
+        return NULL;
+    }
+
+    recover = arq->nrcv_que >= arq->rcv_wnd;
+
+    q = QUEUE_HEAD(&arq->rcv_queue);
+    QUEUE_REMOVE(q);
+    QUEUE_INIT(q);
+    seg = QUEUE_DATA(q, tr_uv_kcp_seg_t, queue);
+    arq->nrcv_que--;
+
+    tr_uv_kcp_arq__move_rcv_buf(arq);
+
+    /* the peer stopped for want of room, it is told there is some again */
+    if (recover && arq->nrcv_que < arq->rcv_wnd) {
+        arq->probe |= TR_UV_KCP_ASK_TELL;
+    }
+    return seg;
+}
+
+static void tr_uv_kcp_arq__output(tr_uv_kcp_arq_t* arq)
+{
+    if (arq->buffer_len) {
+        arq->output(arq->buffer, arq->buffer_len, arq->ex_data);
+        arq->buffer_len = 0;
+    }
+}
+
+/* adds a segment to the datagram being made, sending it first if full */
+static void tr_uv_kcp_arq__put(tr_uv_kcp_arq_t* arq, uint8_t cmd, uint32_t ts, uint32_t sn,
+                               const char* data, uint32_t len)
+{
+    uint32_t wnd = tr_uv_kcp_arq__wnd_unused(arq);
+    char* p;
+
+    if (arq->buffer_len + TR_UV_KCP_OVERHEAD + len > TR_UV_KCP_MTU) {
+        tr_uv_kcp_arq__output(arq);
+    }
+
+    p = arq->buffer + arq->buffer_len;
+    p = tr_uv_kcp_arq__encode32(p, arq->conv);
+    *p++ = (char)cmd;
+    *p++ = 0; /* frg, always 0 in stream mode */
+    *p++ = (char)(wnd & 0xff);
+    *p++ = (char)((wnd >> 8) & 0xff);
+    p = tr_uv_kcp_arq__encode32(p, ts);
+    p = tr_uv_kcp_arq__encode32(p, sn);
+    p = tr_uv_kcp_arq__encode32(p, arq->rcv_nxt);
+    p = tr_uv_kcp_arq__encode32(p, len);
+    if (len) {
+        memcpy(p, data, len);
+    }
+    arq->buffer_len += TR_UV_KCP_OVERHEAD + len;
+}
+
+void tr_uv_kcp_arq_flush(tr_uv_kcp_arq_t* arq, uint32_t current)
+{
+    tr_uv_kcp_seg_t* seg;
+    QUEUE* q;
+    uint32_t cwnd;
+    uint32_t resent;
+    uint32_t rtomin;
+    uint32_t inflight;
+    uint32_t i;
+    int needsend;
+    int change = 0;
+    int lost = 0;
+
+    for (i = 0; i < arq->ackcount; ++i) {
+        tr_uv_kcp_arq__put(arq, TR_UV_KCP_CMD_ACK, arq->acklist[i * 2 + 1], arq->acklist[i * 2], NULL, 0);
+    }
+    arq->ackcount = 0;
+
+    /* the peer has no room, its window is asked for less and less often */
+    if (arq->rmt_wnd == 0) {
+        if (arq->probe_wait == 0) {
+            arq->probe_wait = TR_UV_KCP_PROBE_INIT;
+            arq->ts_probe = current + arq->probe_wait;
+        } else if (tr_uv_kcp_arq__diff(current, arq->ts_probe) >= 0) {
+            if (arq->probe_wait < TR_UV_KCP_PROBE_INIT) {
+                arq->probe_wait = TR_UV_KCP_PROBE_INIT;
+            }
+            arq->probe_wait += arq->probe_wait / 2;
+            if (arq->probe_wait > TR_UV_KCP_PROBE_LIMIT) {
+                arq->probe_wait = TR_UV_KCP_PROBE_LIMIT;
+            }
+            arq->ts_probe = current + arq->probe_wait;
+            arq->probe |= TR_UV_KCP_ASK_SEND;
+        }
+    } else {
+        arq->ts_probe = 0;
+        arq->probe_wait = 0;
+    }
+
+    if (arq->probe & TR_UV_KCP_ASK_SEND) {
+        tr_uv_kcp_arq__put(arq, TR_UV_KCP_CMD_WASK, 0, 0, NULL, 0);
+    }
+    if (arq->probe & TR_UV_KCP_ASK_TELL) {
+        tr_uv_kcp_arq__put(arq, TR_UV_KCP_CMD_WINS, 0, 0, NULL, 0);
+    }
+    arq->probe = 0;
+
+    cwnd = tr_uv_kcp_arq__cwnd(arq);
+    while (tr_uv_kcp_arq__diff(arq->snd_nxt, arq->snd_una + cwnd) < 0 && !QUEUE_EMPTY(&arq->snd_queue)) {
+        q = QUEUE_HEAD(&arq->snd_queue);
+        QUEUE_REMOVE(q);
+        QUEUE_INSERT_TAIL(&arq->snd_buf, q);
+        arq->nsnd_que--;
+        arq->nsnd_buf++;
+
+        seg = QUEUE_DATA(q, tr_uv_kcp_seg_t, queue);
+        seg->sn = arq->snd_nxt++;
+        seg->ts = current;
+        seg->resendts = current;
+        seg->rto = (uint32_t)arq->rx_rto;
+        seg->fastack = 0;
+        seg->xmit = 0;
+    }
+
+    resent = arq->fastresend > 0 ? arq->fastresend : 0xffffffff;
+    rtomin = arq->nodelay ? 0 : (uint32_t)(arq->rx_rto >> 3);
+
+    QUEUE_FOREACH(q, &arq->snd_buf) {
+        seg = QUEUE_DATA(q, tr_uv_kcp_seg_t, queue);
+        needsend = 0;
+
+        if (seg->xmit == 0) {
+            needsend = 1;
+            seg->rto = (uint32_t)arq->rx_rto;
+            seg->resendts = current + seg->rto + rtomin;
+        } else if (tr_uv_kcp_arq__diff(current, seg->resendts) >= 0) {
+            needsend = 1;
+            /* nodelay backs off by half instead of doubling */
+            if (arq->nodelay == 0) {
+                seg->rto += seg->rto > (uint32_t)arq->rx_rto ? seg->rto : (uint32_t)arq->rx_rto;
+            } else {
+                seg->rto += (arq->nodelay < 2 ? seg->rto : (uint32_t)arq->rx_rto) / 2;
+            }
+            seg->resendts = current + seg->rto;
+            arq->retransmits++;
+            lost = 1;
+        } else if (seg->fastack >= resent && seg->xmit <= TR_UV_KCP_FASTACK_LIMIT) {
+            needsend = 1;
+            seg->fastack = 0;
+            seg->resendts = current + seg->rto;
+            arq->fast_resends++;
+            change = 1;
+        }
+
+        if (needsend) {
+            seg->xmit++;
+            seg->ts = current;
+            tr_uv_kcp_arq__put(arq, TR_UV_KCP_CMD_PUSH, seg->ts, seg->sn, seg->data, seg->len);
+            arq->segs_sent++;
+            if (seg->xmit >= TR_UV_KCP_DEAD_LINK) {
+                arq->dead = 1;
+            }
+        }
+    }
+
+    tr_uv_kcp_arq__output(arq);
+
+    if (change) {
+        inflight = arq->snd_nxt - arq->snd_una;
+        arq->ssthresh = inflight / 2;
+        if (arq->ssthresh < TR_UV_KCP_THRESH_MIN) {
+            arq->ssthresh = TR_UV_KCP_THRESH_MIN;
+        }
+        arq->cwnd = arq->ssthresh + resent;
+        arq->incr = arq->cwnd * TR_UV_KCP_MSS;
+    }
+
+    if (lost) {
+        arq->ssthresh = cwnd / 2;
+        if (arq->ssthresh < TR_UV_KCP_THRESH_MIN) {
+            arq->ssthresh = TR_UV_KCP_THRESH_MIN;
+        }
+        arq->cwnd = 1;
+        arq->incr = TR_UV_KCP_MSS;
+    }
+
+    if (arq->cwnd < 1) {
+        arq->cwnd = 1;
+        arq->incr = TR_UV_KCP_MSS;
+    }
+}
+
+int tr_uv_kcp_arq_check(const tr_uv_kcp_arq_t* arq, uint32_t current)
+{
+    tr_uv_kcp_seg_t* seg;
+    QUEUE* q;
+    int32_t next = (int32_t)arq->interval;
+    int32_t diff;
+
+    if (arq->ackcount || arq->probe) {
+        return 0;
+    }
+
+    if (!QUEUE_EMPTY(&arq->snd_queue)) {
+        if (tr_uv_kcp_arq__diff(arq->snd_nxt, arq->snd_una + tr_uv_kcp_arq__cwnd(arq)) < 0) {
+            return 0;
+        }
+        if (arq->rmt_wnd == 0) {
+            if (arq->probe_wait == 0) {
+                return 0;
+            }
+            diff = tr_uv_kcp_arq__diff(arq->ts_probe, current);
+            if (diff < next) {
+                next = diff < 0 ? 0 : diff;
+            }
+        }
+    } else if (QUEUE_EMPTY(&arq->snd_buf)) {
+        return TR_UV_KCP_IDLE;
+    }
+
+    QUEUE_FOREACH(q, &arq->snd_buf) {
+        seg = QUEUE_DATA(q, tr_uv_kcp_seg_t, queue);
+        diff = tr_uv_kcp_arq__diff(seg->resendts, current);
+        if (diff <= 0) {
+            return 0;
+        }
+        if (diff < next) {
+            next = diff;
+        }
+    }
+    return (int)next;
+}
+
+uint32_t tr_uv_kcp_arq_waitsnd(const tr_uv_kcp_arq_t* arq)
+{
+    return arq->nsnd_buf + arq->nsnd_que;
+}
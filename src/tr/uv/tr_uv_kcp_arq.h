@@ -0,0 +1,159 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifndef TR_UV_KCP_ARQ_H
+#define TR_UV_KCP_ARQ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <queue.h>
+
+/*
+ * The ARQ of KCP (https://github.com/skywind3000/kcp) in stream mode, with
+ * the same segments on the wire, so KCP servers talk to it:
+ *
+ *   conv:4 cmd:1 frg:1 wnd:2 ts:4 sn:4 una:4 len:4 data:len
+ *
+ * all little endian. Only the ARQ is here, the datagrams go through the
+ * output callback and the time is given by the caller, in milliseconds.
+ */
+
+#define TR_UV_KCP_OVERHEAD 24
+#define TR_UV_KCP_MTU 1400
+#define TR_UV_KCP_MSS (TR_UV_KCP_MTU - TR_UV_KCP_OVERHEAD)
+
+#define TR_UV_KCP_CMD_PUSH 81
+#define TR_UV_KCP_CMD_ACK 82
+#define TR_UV_KCP_CMD_WASK 83 /* asks the window of the peer */
+#define TR_UV_KCP_CMD_WINS 84 /* tells our window */
+
+#define TR_UV_KCP_RTO_NDL 30
+#define TR_UV_KCP_RTO_MIN 100
+#define TR_UV_KCP_RTO_DEF 200
+#define TR_UV_KCP_RTO_MAX 60000
+
+#define TR_UV_KCP_WND_SND 32
+#define TR_UV_KCP_WND_RCV 128
+#define TR_UV_KCP_INTERVAL 100
+
+/* sends of the same segment after which the peer is taken for gone */
+#define TR_UV_KCP_DEAD_LINK 20
+
+/* returned by tr_uv_kcp_arq_check when nothing waits for a flush */
+#define TR_UV_KCP_IDLE -1
+
+typedef struct {
+    QUEUE queue;
+    uint32_t sn;
+    uint32_t ts;
+    uint32_t resendts;
+    uint32_t rto;
+    uint32_t fastack;
+    uint32_t xmit;
+    uint32_t len;
+    char data[TR_UV_KCP_MSS];
+} tr_uv_kcp_seg_t;
+
+/* sends a datagram, which may be lost like any other */
+typedef void (*tr_uv_kcp_output_fn)(const char* data, size_t len, void* ex_data);
+
+typedef struct {
+    uint32_t conv;
+    uint32_t snd_una;
+    uint32_t snd_nxt;
+    uint32_t rcv_nxt;
+
+    uint32_t ssthresh;
+    uint32_t cwnd;
+    uint32_t incr;
+    uint32_t rmt_wnd;
+    uint32_t snd_wnd;
+    uint32_t rcv_wnd;
+
+    int32_t rx_srtt;
+    int32_t rx_rttval;
+    int32_t rx_rto;
+    int32_t rx_minrto;
+
+    /* window probing once the peer has no room left */
+    int probe;
+    uint32_t ts_probe;
+    uint32_t probe_wait;
+
+    int nodelay;
+    uint32_t interval;
+    uint32_t fastresend;
+    int nocwnd;
+
+    /* written by the caller, sent once in the window */
+    QUEUE snd_queue;
+    /* sent, waiting to be acknowledged */
+    QUEUE snd_buf;
+    /* received in order, waiting for tr_uv_kcp_arq_recv */
+    QUEUE rcv_queue;
+    /* received out of order */
+    QUEUE rcv_buf;
+    uint32_t nsnd_que;
+    uint32_t nsnd_buf;
+    uint32_t nrcv_que;
+    uint32_t nrcv_buf;
+
+    /* sn and ts pairs to acknowledge with the next flush */
+    uint32_t* acklist;
+    uint32_t ackcount;
+    uint32_t ackblock;
+
+    int dead;
+
+    uint64_t segs_sent;
+    uint64_t retransmits;
+    uint64_t fast_resends;
+
+    tr_uv_kcp_output_fn output;
+    void* ex_data;
+    char buffer[TR_UV_KCP_MTU];
+    size_t buffer_len;
+} tr_uv_kcp_arq_t;
+
+void tr_uv_kcp_arq_init(tr_uv_kcp_arq_t* arq, uint32_t conv, tr_uv_kcp_output_fn output, void* ex_data);
+void tr_uv_kcp_arq_release(tr_uv_kcp_arq_t* arq);
+
+/*
+ * Tunes how aggressive it is, see the kcp_* fields of pc_client_config_t.
+ * 0 keeps the default of a value, the windows are in segments.
+ */
+void tr_uv_kcp_arq_nodelay(tr_uv_kcp_arq_t* arq, int nodelay, int interval, int resend, int nc);
+void tr_uv_kcp_arq_wndsize(tr_uv_kcp_arq_t* arq, int snd_wnd, int rcv_wnd);
+
+/* appends `len` bytes to the stream, sent by the next flushes */
+void tr_uv_kcp_arq_send(tr_uv_kcp_arq_t* arq, const char* data, size_t len);
+
+/*
+ * Takes in a datagram of the peer, returns 0 or -1 if it is not one of
+ * ours or is malformed, in which case what came before the bad segment
+ * was still taken in.
+ */
+int tr_uv_kcp_arq_input(tr_uv_kcp_arq_t* arq, const char* data, size_t len, uint32_t current);
+
+/*
+ * Next segment of the stream, in order, NULL if none. It is the caller's
+ * and is released with pc_lib_free.
+ */
+tr_uv_kcp_seg_t* tr_uv_kcp_arq_recv(tr_uv_kcp_arq_t* arq);
+
+/* sends the acks, the new segments the windows allow and those due again */
+void tr_uv_kcp_arq_flush(tr_uv_kcp_arq_t* arq, uint32_t current);
+
+/*
+ * Milliseconds until the next flush is due, TR_UV_KCP_IDLE if there is
+ * nothing to send nor to acknowledge.
+ */
+int tr_uv_kcp_arq_check(const tr_uv_kcp_arq_t* arq, uint32_t current);
+
+/* segments written and not acknowledged yet */
+uint32_t tr_uv_kcp_arq_waitsnd(const tr_uv_kcp_arq_t* arq);
+
+#endif /* TR_UV_KCP_ARQ_H */
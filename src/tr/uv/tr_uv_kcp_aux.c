@@ -0,0 +1,251 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#include "tr_uv_kcp_aux.h"
+
+#include <string.h>
+
+#include <pc_assert.h>
+#include <pc_lib.h>
+
+#include "tr_uv_tcp_aux.h"
+
+#define GET_KT tr_uv_kcp_transport_t* kt = (tr_uv_kcp_transport_t* )tt; pc_assert(kt)
+
+static uint32_t kcp__now(tr_uv_kcp_transport_t* kt)
+{
+    return (uint32_t)uv_now(&kt->base.uv_loop);
+}
+
+static void kcp__output(const char* data, size_t len, void* ex_data)
+{
+    tr_uv_kcp_transport_t* kt = (tr_uv_kcp_transport_t* )ex_data;
+    uv_buf_t buf = uv_buf_init((char* )data, (unsigned int)len);
+    int ret;
+
+    /* a full socket buffer loses the datagram like the network would, it is sent again */
+    ret = uv_udp_try_send(&kt->udp, &buf, 1, NULL);
+    if (ret < 0 && ret != UV_EAGAIN && !kt->send_error) {
+        kt->send_error = ret;
+    }
+}
+
+static void kcp__flush_timer_cb(uv_timer_t* t);
+
+/* flushes at the start of the next loop iteration, once what is read now was taken in */
+static void kcp__schedule(tr_uv_kcp_transport_t* kt)
+{
+    uv_timer_start(&kt->flush_timer, kcp__flush_timer_cb, 0, 0);
+}
+
+static void kcp__flush(tr_uv_kcp_transport_t* kt)
+{
+    tr_uv_tcp_transport_t* tt = &kt->base;
+    uint32_t now = kcp__now(kt);
+    int next;
+    int err;
+
+    tr_uv_kcp_arq_flush(&kt->arq, now);
+
+    if (kt->arq.dead || kt->send_error) {
+        err = kt->send_error ? kt->send_error : UV_ETIMEDOUT;
+        pc_lib_log(PC_LOG_ERROR, "kcp__flush - %s", kt->arq.dead ? "segment never acknowledged" : "send error");
+        tcp__on_read_error(tt, err);
+        return;
+    }
+
+    if (kt->write_pending && tr_uv_kcp_arq_waitsnd(&kt->arq) < 2 * kt->arq.snd_wnd) {
+        kt->write_pending = 0;
+        tcp__on_write_done(tt, 0);
+    }
+
+    next = tr_uv_kcp_arq_check(&kt->arq, now);
+    if (next == TR_UV_KCP_IDLE) {
+        uv_timer_stop(&kt->flush_timer);
+    } else {
+        uv_timer_start(&kt->flush_timer, kcp__flush_timer_cb, (uint64_t)next, 0);
+    }
+}
+
+static void kcp__flush_timer_cb(uv_timer_t* t)
+{
+    tr_uv_kcp_transport_t* kt = (tr_uv_kcp_transport_t* )t->data;
+
+    if (kt->active) {
+        kcp__flush(kt);
+    }
+}
+
+static void kcp__alloc_cb(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf)
+{
+    tr_uv_kcp_transport_t* kt = (tr_uv_kcp_transport_t* )handle->data;
+
+    (void)suggested_size;
+    buf->base = kt->recv_buf;
+    buf->len = sizeof(kt->recv_buf);
+}
+
+static void kcp__recv_cb(uv_udp_t* handle, ssize_t nread, const uv_buf_t* buf,
+                         const struct sockaddr* addr, unsigned flags)
+{
+    tr_uv_kcp_transport_t* kt = (tr_uv_kcp_transport_t* )handle->data;
+    tr_uv_tcp_transport_t* tt = &kt->base;
+    tr_uv_kcp_seg_t* seg;
+
+    (void)addr;
+
+    /* nothing more to read for now */
+    if (nread == 0 || !kt->active) {
+        return;
+    }
+
+    if (nread < 0) {
+        tcp__on_read_error(tt, (int)nread);
+        return;
+    }
+
+    /* the socket is connected, anything else is of an older conversation or garbage */
+    if ((flags & UV_UDP_PARTIAL)
+            || tr_uv_kcp_arq_input(&kt->arq, buf->base, (size_t)nread, kcp__now(kt))) {
+        pc_lib_log(PC_LOG_DEBUG, "kcp__recv_cb - dropped a datagram of %d bytes", (int)nread);
+        kt->dropped++;
+        return;
+    }
+
+    /* a package handler may reset the connection, which releases the ARQ */
+    while (kt->active && (seg = tr_uv_kcp_arq_recv(&kt->arq))) {
+        pc_pkg_parser_feed(&tt->pkg_parser, seg->data, seg->len);
+        pc_lib_free(seg);
+    }
+
+    if (kt->active) {
+        kcp__schedule(kt);
+    }
+}
+
+static void kcp__udp_close_cb(uv_handle_t* handle)
+{
+    tr_uv_kcp_transport_t* kt = (tr_uv_kcp_transport_t* )handle->data;
+
+    kt->udp_state = TR_UV_KCP_UDP_NONE;
+}
+
+static void kcp__close_udp(tr_uv_kcp_transport_t* kt)
+{
+    if (kt->udp_state == TR_UV_KCP_UDP_OPEN) {
+        kt->udp_state = TR_UV_KCP_UDP_CLOSING;
+        uv_close((uv_handle_t* )&kt->udp, kcp__udp_close_cb);
+    }
+}
+
+int kcp__open(tr_uv_tcp_transport_t* tt, const struct sockaddr* addr)
+{
+    const pc_client_config_t* config = tt->config;
+    uint32_t conv;
+    int ret;
+    GET_KT;
+
+    /* the socket of the previous connection is closed in the loop iteration that reset it */
+    if (kt->udp_state != TR_UV_KCP_UDP_NONE) {
+        return UV_EBUSY;
+    }
+
+    if (!kt->timer_ready) {
+        uv_timer_init(&tt->uv_loop, &kt->flush_timer);
+        kt->flush_timer.data = kt;
+        kt->timer_ready = 1;
+    }
+
+    ret = uv_udp_init(&tt->uv_loop, &kt->udp);
+    if (ret) {
+        return ret;
+    }
+    kt->udp.data = kt;
+    kt->udp_state = TR_UV_KCP_UDP_OPEN;
+
+    ret = uv_udp_connect(&kt->udp, addr);
+    if (ret) {
+        kcp__close_udp(kt);
+        return ret;
+    }
+
+    /* the server tells the conversations of a client apart by it */
+    if (uv_random(NULL, NULL, &conv, sizeof(conv), 0, NULL)) {
+        conv = (uint32_t)uv_hrtime();
+    }
+
+    tr_uv_kcp_arq_init(&kt->arq, conv, kcp__output, kt);
+    tr_uv_kcp_arq_nodelay(&kt->arq, config->kcp_nodelay, config->kcp_interval,
+                          config->kcp_fast_resend, config->kcp_no_cwnd);
+    tr_uv_kcp_arq_wndsize(&kt->arq, config->kcp_snd_wnd, config->kcp_rcv_wnd);
+    kt->active = 1;
+    kt->write_pending = 0;
+    kt->send_error = 0;
+
+    pc_lib_log(PC_LOG_DEBUG, "kcp__open - conversation %u, nodelay: %d, interval: %u, resend: %u, nc: %d",
+               conv, kt->arq.nodelay, kt->arq.interval, kt->arq.fastresend, kt->arq.nocwnd);
+
+    /* there is nothing to wait for, the handshake is the first datagram */
+    if (tt->conn_done_cb) {
+        tt->conn_done_cb(&tt->conn_req, 0);
+    }
+    return 0;
+}
+
+int kcp__read_start(tr_uv_tcp_transport_t* tt)
+{
+    GET_KT;
+
+    return uv_udp_recv_start(&kt->udp, kcp__alloc_cb, kcp__recv_cb);
+}
+
+int kcp__write(tr_uv_tcp_transport_t* tt, const uv_buf_t* bufs, int buf_cnt)
+{
+    int i;
+    GET_KT;
+
+    if (!kt->active) {
+        return UV_ENOTCONN;
+    }
+
+    pc_assert(!kt->write_pending);
+
+    for (i = 0; i < buf_cnt; ++i) {
+        tr_uv_kcp_arq_send(&kt->arq, bufs[i].base, bufs[i].len);
+    }
+
+    /* tcp__on_write_done may not be called before this returns, the flush does it */
+    kt->write_pending = 1;
+    kcp__schedule(kt);
+    return 0;
+}
+
+void kcp__reset(tr_uv_tcp_transport_t* tt)
+{
+    GET_KT;
+
+    if (kt->active) {
+        kt->segs_sent += kt->arq.segs_sent;
+        kt->retransmits += kt->arq.retransmits;
+        kt->fast_resends += kt->arq.fast_resends;
+        kt->srtt = (uint64_t)kt->arq.rx_srtt;
+        tr_uv_kcp_arq_release(&kt->arq);
+        kt->active = 0;
+    }
+
+    if (kt->timer_ready) {
+        uv_timer_stop(&kt->flush_timer);
+    }
+
+    /* the write items are failed by tcp__reset */
+    if (kt->write_pending) {
+        kt->write_pending = 0;
+        tt->is_writing = 0;
+    }
+
+    kcp__close_udp(kt);
+
+    tcp__reset(tt);
+}
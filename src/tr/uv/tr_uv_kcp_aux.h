@@ -0,0 +1,17 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifndef TR_UV_KCP_AUX_H
+#define TR_UV_KCP_AUX_H
+
+#include "tr_uv_kcp_i.h"
+
+void kcp__reset(tr_uv_tcp_transport_t* tt);
+
+int kcp__open(tr_uv_tcp_transport_t* tt, const struct sockaddr* addr);
+int kcp__read_start(tr_uv_tcp_transport_t* tt);
+int kcp__write(tr_uv_tcp_transport_t* tt, const uv_buf_t* bufs, int buf_cnt);
+
+#endif /* TR_UV_KCP_AUX_H */
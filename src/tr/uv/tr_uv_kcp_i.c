@@ -0,0 +1,104 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#include "tr_uv_kcp_i.h"
+
+#include <string.h>
+
+#include <pc_assert.h>
+#include <pc_lib.h>
+
+#include "tr_uv_kcp.h"
+#include "tr_uv_kcp_aux.h"
+#include "tr_uv_tcp_aux.h"
+
+pc_transport_t* tr_uv_kcp_create(pc_transport_plugin_t* plugin)
+{
+    size_t len = sizeof(tr_uv_kcp_transport_t);
+    tr_uv_kcp_transport_t* kt = (tr_uv_kcp_transport_t* )pc_lib_malloc(len);
+    memset(kt, 0, len);
+
+    (void)plugin; /* unused */
+
+    /* inherit from tr_uv_tcp */
+    kt->base.base.connect = tr_uv_tcp_connect;
+    kt->base.base.connect_endpoints = tr_uv_tcp_connect_endpoints;
+    kt->base.base.endpoint_health = tr_uv_tcp_endpoint_health;
+    kt->base.base.send = tr_uv_tcp_send;
+    kt->base.base.send_with_opts = tr_uv_tcp_send_with_opts;
+    kt->base.base.send_prepared = tr_uv_tcp_send_prepared;
+    kt->base.base.disconnect = tr_uv_tcp_disconnect;
+    kt->base.base.cleanup = tr_uv_tcp_cleanup;
+    kt->base.base.quality = tr_uv_tcp_quality;
+    kt->base.base.serializer = tr_uv_tcp_serializer;
+    kt->base.base.internal_data = tr_uv_tcp_internal_data;
+    kt->base.reconn_fn = tcp__reconn;
+    kt->base.conn_done_cb = tcp__conn_done_cb;
+    kt->base.write_async_cb = tcp__write_async_cb;
+    kt->base.cleanup_async_cb = tcp__cleanup_async_cb;
+    kt->base.write_check_timeout_cb = tcp__write_check_timeout_cb;
+    kt->base.alloc_cb = tcp__alloc_cb;
+    kt->base.on_tcp_read_cb = tcp__on_tcp_read_cb;
+
+    /* reimplemetating method */
+    kt->base.base.init = tr_uv_kcp_init;
+    kt->base.base.plugin = tr_uv_kcp_plugin;
+    kt->base.base.stats = tr_uv_kcp_stats;
+
+    kt->base.reset_fn = kcp__reset;
+    kt->base.open_fn = kcp__open;
+    kt->base.read_start_fn = kcp__read_start;
+    kt->base.write_fn = kcp__write;
+
+    return (pc_transport_t*)kt;
+}
+
+void tr_uv_kcp_release(pc_transport_plugin_t* plugin, pc_transport_t* trans)
+{
+    (void)plugin; /* unused */
+
+    pc_lib_free(trans);
+}
+
+int tr_uv_kcp_init(pc_transport_t* trans, pc_client_t* client)
+{
+    tr_uv_kcp_transport_t* kt = (tr_uv_kcp_transport_t* )trans;
+
+    pc_assert(kt);
+
+    /* the handles are set up by the first connection, on the loop thread */
+    kt->udp_state = TR_UV_KCP_UDP_NONE;
+    kt->timer_ready = 0;
+    kt->active = 0;
+    kt->write_pending = 0;
+
+    return tr_uv_tcp_init(trans, client);
+}
+
+int tr_uv_kcp_stats(pc_transport_t* trans, pc_client_stats_t* stats)
+{
+    tr_uv_kcp_transport_t* kt = (tr_uv_kcp_transport_t* )trans;
+
+    tr_uv_tcp_stats(trans, stats);
+    stats->kcp_segs_sent = kt->segs_sent;
+    stats->kcp_retransmits = kt->retransmits;
+    stats->kcp_fast_resends = kt->fast_resends;
+    stats->kcp_dropped = kt->dropped;
+    stats->kcp_srtt_ms = kt->srtt;
+    if (kt->active) {
+        stats->kcp_segs_sent += kt->arq.segs_sent;
+        stats->kcp_retransmits += kt->arq.retransmits;
+        stats->kcp_fast_resends += kt->arq.fast_resends;
+        stats->kcp_srtt_ms = (uint64_t)kt->arq.rx_srtt;
+    }
+    return PC_RC_OK;
+}
+
+pc_transport_plugin_t* tr_uv_kcp_plugin(pc_transport_t* trans)
+{
+    (void)trans; /* unused */
+
+    return pc_tr_uv_kcp_trans_plugin();
+}
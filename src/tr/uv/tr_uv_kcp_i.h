@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifndef TR_UV_KCP_I_H
+#define TR_UV_KCP_I_H
+
+#include "tr_uv_tcp_i.h"
+#include "tr_uv_kcp_arq.h"
+
+#define TR_UV_KCP_UDP_NONE 0
+#define TR_UV_KCP_UDP_OPEN 1
+#define TR_UV_KCP_UDP_CLOSING 2
+
+/* datagrams are read into this, longer ones are dropped */
+#define TR_UV_KCP_RECV_BUF_SIZE 2048
+
+/**
+ * The reliable udp transport, the ARQ of KCP carrying the same stream of
+ * packages as tcp, so the handshake, heartbeats and message codecs are
+ * the tcp ones.
+ *
+ * The host is resolved like for tcp and a udp socket is connected to the
+ * first address, which is done at once, and the handshake is the first
+ * thing sent. Each connection picks a random conversation id. The ARQ is
+ * flushed at the end of the loop iteration that wrote or read, so acks and
+ * small writes of an iteration share datagrams, and then every
+ * `kcp_interval` milliseconds while data is in flight. Nothing runs when
+ * there is nothing to send or acknowledge.
+ *
+ * A write is done once the ARQ has it, and the next one waits while more
+ * than twice the send window is not acknowledged. A segment sent
+ * TR_UV_KCP_DEAD_LINK times, or an icmp error, ends the connection like
+ * a close of the socket would.
+ */
+typedef struct {
+    tr_uv_tcp_transport_t base;
+
+    uv_udp_t udp;
+    int udp_state;
+    uv_timer_t flush_timer;
+    int timer_ready;
+
+    tr_uv_kcp_arq_t arq;
+    int active;
+    /* write_fn took a write, tcp__on_write_done is called once the ARQ has room */
+    int write_pending;
+    /* the first send error of a flush, icmp errors mostly */
+    int send_error;
+
+    char recv_buf[TR_UV_KCP_RECV_BUF_SIZE];
+
+    /* of the connections before the current one, the ARQ counts its own */
+    uint64_t segs_sent;
+    uint64_t retransmits;
+    uint64_t fast_resends;
+    uint64_t dropped;
+    uint64_t srtt;
+} tr_uv_kcp_transport_t;
+
+pc_transport_t* tr_uv_kcp_create(pc_transport_plugin_t* plugin);
+void tr_uv_kcp_release(pc_transport_plugin_t* plugin, pc_transport_t* trans);
+
+int tr_uv_kcp_init(pc_transport_t* trans, pc_client_t* client);
+int tr_uv_kcp_stats(pc_transport_t* trans, pc_client_stats_t* stats);
+pc_transport_plugin_t* tr_uv_kcp_plugin(pc_transport_t* trans);
+
+#endif /* TR_UV_KCP_I_H */
@@ -0,0 +1,110 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#include <pc_assert.h>
+
+#include <pitaya.h>
+#include <pc_lib.h>
+#include <pc_mutex.h>
+
+#include "tr_uv_rbuf.h"
+
+/* a free buffer links to the next one through its first bytes */
+typedef struct tr_uv_rbuf_s {
+    struct tr_uv_rbuf_s* next;
+} tr_uv_rbuf_t;
+
+static pc_mutex_t tr_uv_rbuf__mutex;
+/* the plugins sharing the pool, they register and deregister on one thread */
+static int tr_uv_rbuf__refs = 0;
+static tr_uv_rbuf_t* tr_uv_rbuf__free = NULL;
+static size_t tr_uv_rbuf__free_count = 0;
+static size_t tr_uv_rbuf__used_count = 0;
+
+void tr_uv_rbuf_init(void)
+{
+    if (tr_uv_rbuf__refs++) {
+        return;
+    }
+    pc_mutex_init(&tr_uv_rbuf__mutex);
+}
+
+void tr_uv_rbuf_cleanup(void)
+{
+    tr_uv_rbuf_t* b;
+
+    if (!tr_uv_rbuf__refs || --tr_uv_rbuf__refs) {
+        return;
+    }
+
+    while (tr_uv_rbuf__free) {
+        b = tr_uv_rbuf__free;
+        tr_uv_rbuf__free = b->next;
+        pc_lib_free(b);
+    }
+    tr_uv_rbuf__free_count = 0;
+
+    pc_mutex_destroy(&tr_uv_rbuf__mutex);
+}
+
+char* tr_uv_rbuf_get(void)
+{
+    tr_uv_rbuf_t* b;
+
+    pc_mutex_lock(&tr_uv_rbuf__mutex);
+    b = tr_uv_rbuf__free;
+    if (b) {
+        tr_uv_rbuf__free = b->next;
+        tr_uv_rbuf__free_count--;
+    }
+    tr_uv_rbuf__used_count++;
+    pc_mutex_unlock(&tr_uv_rbuf__mutex);
+
+    if (!b) {
+        b = (tr_uv_rbuf_t*)pc_lib_malloc(PC_TCP_READ_BUFFER_SIZE);
+    }
+    return (char*)b;
+}
+
+void tr_uv_rbuf_put(char* buf)
+{
+    tr_uv_rbuf_t* b = (tr_uv_rbuf_t*)buf;
+
+    pc_assert(b);
+
+    pc_mutex_lock(&tr_uv_rbuf__mutex);
+    tr_uv_rbuf__used_count--;
+    if (tr_uv_rbuf__free_count < TR_UV_RBUF_POOL_MAX) {
+        b->next = tr_uv_rbuf__free;
+        tr_uv_rbuf__free = b;
+        tr_uv_rbuf__free_count++;
+        b = NULL;
+    }
+    pc_mutex_unlock(&tr_uv_rbuf__mutex);
+
+    if (b) {
+        pc_lib_free(b);
+    }
+}
+
+size_t tr_uv_rbuf_in_use(void)
+{
+    size_t n;
+
+    pc_mutex_lock(&tr_uv_rbuf__mutex);
+    n = tr_uv_rbuf__used_count;
+    pc_mutex_unlock(&tr_uv_rbuf__mutex);
+    return n;
+}
+
+size_t tr_uv_rbuf_pooled(void)
+{
+    size_t n;
+
+    pc_mutex_lock(&tr_uv_rbuf__mutex);
+    n = tr_uv_rbuf__free_count;
+    pc_mutex_unlock(&tr_uv_rbuf__mutex);
+    return n;
+}
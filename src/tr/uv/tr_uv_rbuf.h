@@ -0,0 +1,34 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifndef TR_UV_RBUF_H
+#define TR_UV_RBUF_H
+
+#include <stddef.h>
+
+/**
+ * Read buffers of PC_TCP_READ_BUFFER_SIZE bytes shared by every client of
+ * the process.
+ *
+ * A transport only holds one while a read is being handled, from the alloc
+ * callback to the end of the read callback, so thousands of mostly idle
+ * clients get by with a handful of buffers instead of one each. Released
+ * buffers are kept for the next read, up to TR_UV_RBUF_POOL_MAX of them.
+ */
+
+#define TR_UV_RBUF_POOL_MAX 16
+
+/* counted, the pool goes with the last cleanup of the plugins using it */
+void tr_uv_rbuf_init(void);
+void tr_uv_rbuf_cleanup(void);
+
+char* tr_uv_rbuf_get(void);
+void tr_uv_rbuf_put(char* buf);
+
+/* buffers allocated and not released yet, and the ones kept in the pool */
+size_t tr_uv_rbuf_in_use(void);
+size_t tr_uv_rbuf_pooled(void);
+
+#endif /* TR_UV_RBUF_H */
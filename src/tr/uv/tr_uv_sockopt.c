@@ -0,0 +1,233 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <string.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+#ifdef __linux__
+#include <linux/tls.h>
+#endif
+
+#include <pitaya.h>
+#include <pc_lib.h>
+
+#include "tr_uv_sockopt.h"
+
+#ifdef _WIN32
+typedef int tr_uv_socklen_t;
+#define TR_UV_SOCK_ERROR() uv_translate_sys_error(WSAGetLastError())
+#else
+typedef socklen_t tr_uv_socklen_t;
+#define TR_UV_SOCK_ERROR() uv_translate_sys_error(errno)
+#endif
+
+/* older libc headers miss them */
+#if defined(__linux__) && !defined(TCP_ULP)
+#define TCP_ULP 31
+#endif
+#if defined(__linux__) && !defined(SOL_TLS)
+#define SOL_TLS 282
+#endif
+
+#if defined(TCP_KEEPINTVL) || defined(TCP_NOTSENT_LOWAT) || defined(TCP_QUICKACK) \
+    || defined(SO_BUSY_POLL) || defined(TCP_USER_TIMEOUT)
+static int tr_uv_sockopt__set(uv_os_sock_t sock, int level, int name, const char* what, int value)
+{
+    if (setsockopt(sock, level, name, (const char*)&value, sizeof(value))) {
+        pc_lib_log(PC_LOG_WARN, "tr_uv_sockopt_apply - set %s to %d failed: %s",
+                   what, value, uv_strerror(TR_UV_SOCK_ERROR()));
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Sets an int option to `value` if positive and returns the value the
+ * system holds, 0 if it refused it.
+ */
+static int tr_uv_sockopt__int(uv_os_sock_t sock, int level, int name, const char* what, int value)
+{
+    int ret = 0;
+    tr_uv_socklen_t len = sizeof(ret);
+
+    if (value <= 0 || tr_uv_sockopt__set(sock, level, name, what, value)) {
+        return 0;
+    }
+
+    if (getsockopt(sock, level, name, (char*)&ret, &len)) {
+        return value;
+    }
+    return ret;
+}
+#endif
+
+void tr_uv_sockopt_apply(uv_tcp_t* socket, const pc_client_config_t* config, tr_uv_sockopt_t* applied)
+{
+    uv_os_fd_t fd;
+    uv_os_sock_t sock;
+    int value;
+    int ret;
+
+    memset(applied, 0, sizeof(tr_uv_sockopt_t));
+
+    if (uv_fileno((uv_handle_t*)socket, &fd)) {
+        return ;
+    }
+    sock = (uv_os_sock_t)fd;
+
+    /* uv_*_buffer_size sets the size if positive, otherwise reads it */
+    if (config->sock_sndbuf > 0) {
+        value = config->sock_sndbuf;
+        ret = uv_send_buffer_size((uv_handle_t*)socket, &value);
+        if (ret) {
+            pc_lib_log(PC_LOG_WARN, "tr_uv_sockopt_apply - set send buffer size to %d failed: %s",
+                       config->sock_sndbuf, uv_strerror(ret));
+        } else {
+            value = 0;
+            uv_send_buffer_size((uv_handle_t*)socket, &value);
+            applied->sndbuf = value;
+        }
+    }
+
+    if (config->sock_rcvbuf > 0) {
+        value = config->sock_rcvbuf;
+        ret = uv_recv_buffer_size((uv_handle_t*)socket, &value);
+        if (ret) {
+            pc_lib_log(PC_LOG_WARN, "tr_uv_sockopt_apply - set receive buffer size to %d failed: %s",
+                       config->sock_rcvbuf, uv_strerror(ret));
+        } else {
+            value = 0;
+            uv_recv_buffer_size((uv_handle_t*)socket, &value);
+            applied->rcvbuf = value;
+        }
+    }
+
+#ifndef _WIN32
+    /* unix domain sockets, see PC_HOST_UNIX_PREFIX, only have the buffer sizes */
+    {
+        struct sockaddr_storage addr;
+        tr_uv_socklen_t len = sizeof(addr);
+        if (!getsockname(sock, (struct sockaddr*)&addr, &len) && addr.ss_family == AF_UNIX) {
+            goto out;
+        }
+    }
+#endif
+
+    if (config->tcp_keepalive >= 0) {
+        value = config->tcp_keepalive ? config->tcp_keepalive : TR_UV_SOCKOPT_DEFAULT_KEEPALIVE;
+        ret = uv_tcp_keepalive(socket, 1, value);
+        if (ret) {
+            pc_lib_log(PC_LOG_WARN, "tr_uv_sockopt_apply - enable keepalive failed: %s", uv_strerror(ret));
+        } else {
+            applied->keepalive = value;
+#ifdef TCP_KEEPINTVL
+            applied->keepalive_interval = tr_uv_sockopt__int(sock, IPPROTO_TCP, TCP_KEEPINTVL,
+                                                             "keepalive interval", config->tcp_keepalive_interval);
+#endif
+        }
+    } else {
+        uv_tcp_keepalive(socket, 0, 0);
+    }
+
+#ifdef TCP_NOTSENT_LOWAT
+    applied->notsent_lowat = tr_uv_sockopt__int(sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT,
+                                                "notsent lowat", config->tcp_notsent_lowat);
+#endif
+
+#ifdef TCP_QUICKACK
+    /* not read back, it reads 0 as soon as the kernel leaves quick ack mode */
+    if (config->tcp_quickack > 0) {
+        applied->quickack = !tr_uv_sockopt__set(sock, IPPROTO_TCP, TCP_QUICKACK, "quickack", 1);
+    }
+#endif
+
+#ifdef SO_BUSY_POLL
+    /* more than net.core.busy_read needs CAP_NET_ADMIN */
+    applied->busy_poll = tr_uv_sockopt__int(sock, SOL_SOCKET, SO_BUSY_POLL,
+                                            "busy poll", config->sock_busy_poll);
+#endif
+
+#ifdef TCP_USER_TIMEOUT
+    applied->user_timeout = tr_uv_sockopt__int(sock, IPPROTO_TCP, TCP_USER_TIMEOUT,
+                                               "user timeout", config->tcp_user_timeout);
+#endif
+
+#ifndef _WIN32
+out:
+#endif
+    (void)sock;
+
+    pc_lib_log(PC_LOG_INFO, "tr_uv_sockopt_apply - sndbuf: %d, rcvbuf: %d, keepalive: %d/%d s, notsent lowat: %d,"
+               " quickack: %d, busy poll: %d us, user timeout: %d ms",
+               applied->sndbuf, applied->rcvbuf, applied->keepalive, applied->keepalive_interval,
+               applied->notsent_lowat, applied->quickack, applied->busy_poll, applied->user_timeout);
+}
+
+void tr_uv_sockopt_rearm(uv_tcp_t* socket, const tr_uv_sockopt_t* applied)
+{
+#ifdef TCP_QUICKACK
+    uv_os_fd_t fd;
+    int on = 1;
+
+    if (applied->quickack && !uv_fileno((uv_handle_t*)socket, &fd)) {
+        setsockopt((uv_os_sock_t)fd, IPPROTO_TCP, TCP_QUICKACK, (const char*)&on, sizeof(on));
+    }
+#else
+    (void)socket;
+    (void)applied;
+#endif
+}
+
+int tr_uv_sockopt_ktls_tx(uv_tcp_t* socket, const void* crypto_info)
+{
+#if defined(__linux__) && defined(TLS_TX)
+    const struct tls_crypto_info* info = (const struct tls_crypto_info*)crypto_info;
+    uv_os_fd_t fd;
+    size_t len;
+    int ret;
+
+    switch (info->cipher_type) {
+    case TLS_CIPHER_AES_GCM_128:
+        len = sizeof(struct tls12_crypto_info_aes_gcm_128);
+        break;
+#ifdef TLS_CIPHER_AES_GCM_256
+    case TLS_CIPHER_AES_GCM_256:
+        len = sizeof(struct tls12_crypto_info_aes_gcm_256);
+        break;
+#endif
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    case TLS_CIPHER_CHACHA20_POLY1305:
+        len = sizeof(struct tls12_crypto_info_chacha20_poly1305);
+        break;
+#endif
+    default:
+        return UV_ENOTSUP;
+    }
+
+    ret = uv_fileno((uv_handle_t*)socket, &fd);
+    if (ret) {
+        return ret;
+    }
+
+    /* the upper layer protocol stays on the socket, it is a new one per connection */
+    if (setsockopt(fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls"))
+        || setsockopt(fd, SOL_TLS, TLS_TX, crypto_info, (socklen_t)len)) {
+        return TR_UV_SOCK_ERROR();
+    }
+    return 0;
+#else
+    (void)socket;
+    (void)crypto_info;
+    return UV_ENOTSUP;
+#endif
+}
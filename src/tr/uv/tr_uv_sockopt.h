@@ -0,0 +1,58 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifndef TR_UV_SOCKOPT_H
+#define TR_UV_SOCKOPT_H
+
+#include <uv.h>
+
+#include <pitaya.h>
+
+/**
+ * Socket options of the tcp transports, taken from pc_client_config_t.
+ *
+ * Options a platform does not have are skipped, and an option the system
+ * refuses only logs a warning, the connection goes on with its default.
+ */
+
+#define TR_UV_SOCKOPT_DEFAULT_KEEPALIVE 60 /* seconds */
+
+/**
+ * The values the system applied, read back from the socket where it can be,
+ * 0 for the options left alone or not supported.
+ */
+typedef struct {
+    int sndbuf;
+    int rcvbuf;
+    int keepalive;
+    int keepalive_interval;
+    int notsent_lowat;
+    int quickack;
+    int busy_poll;
+    int user_timeout;
+} tr_uv_sockopt_t;
+
+/**
+ * Sets the options of `config` on the connected `socket`, only the buffer
+ * sizes if it is a unix domain socket.
+ */
+void tr_uv_sockopt_apply(uv_tcp_t* socket, const pc_client_config_t* config, tr_uv_sockopt_t* applied);
+
+/**
+ * Linux turns quick acks off again on its own, so they are set again after
+ * every read while `applied->quickack` is set.
+ */
+void tr_uv_sockopt_rearm(uv_tcp_t* socket, const tr_uv_sockopt_t* applied);
+
+/**
+ * Makes the kernel encrypt what is sent on `socket` from now on (kTLS,
+ * Linux), with the key material OpenSSL passes to BIO_set_ktls, which
+ * starts with a struct tls_crypto_info. Returns 0 or a uv error code,
+ * UV_ENOTSUP on other platforms or for ciphers the kernel does not know,
+ * UV_ENOENT if the tls module is not loaded.
+ */
+int tr_uv_sockopt_ktls_tx(uv_tcp_t* socket, const void* crypto_info);
+
+#endif /* TR_UV_SOCKOPT_H */
@@ -27,3 +27,8 @@ pc_transport_plugin_t* pc_tr_uv_tcp_trans_plugin()
     return (pc_transport_plugin_t* )&instance;
 }
 
+void tr_uv_tcp_clear_dns_cache(void)
+{
+    tr_uv_dns_clear();
+}
+
@@ -12,35 +12,43 @@
 #include <stdlib.h>
 #include <pc_assert.h>
 #include <time.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <poll.h>
+#endif
 
 #include <pc_lib.h>
 #include <pc_pitaya_i.h>
 
 #include "tr_uv_tcp_aux.h"
 #include "tr_uv_tcp_i.h"
+#include "tr_uv_rbuf.h"
 #include "pr_pkg.h"
 #include "pr_gzip.h"
 #include "pc_error.h"
 
 #define GET_TT(x) tr_uv_tcp_transport_t* tt = (tr_uv_tcp_transport_t* )(x->data); pc_assert(tt)
 
-static void tcp__reset_wi(pc_client_t* client, tr_uv_wi_t* wi)
+static void tcp__stream_finish(tr_uv_tcp_transport_t* tt);
+static void tcp__race_abort(tr_uv_tcp_transport_t* tt);
+static void tcp__unix_cancel(tr_uv_tcp_transport_t* tt);
+
+static void tcp__fail_wi(pc_client_t* client, tr_uv_wi_t* wi, pc_error_t* err)
 {
     if (TR_UV_WI_IS_RESP(wi->type)) {
-        pc_lib_log(PC_LOG_DEBUG, "tcp__reset_wi - reset request, req_id: %u", wi->req_id);
-        pc_error_t err = pc__error_reset();
+        pc_lib_log(PC_LOG_DEBUG, "tcp__fail_wi - fail request, req_id: %u, code: %d", wi->req_id, err->code);
         pc_buf_t empty_buf = {0};
-        pc_trans_resp(client, wi->req_id, &empty_buf, &err);
+        pc_trans_resp(client, wi->req_id, &empty_buf, err);
     } else if (TR_UV_WI_IS_NOTIFY(wi->type)) {
-        pc_lib_log(PC_LOG_DEBUG, "tcp__reset_wi - reset notify, seq_num: %u", wi->seq_num);
-        pc_error_t err = pc__error_reset();
-        pc_trans_sent(client, wi->seq_num, &err);
+        pc_lib_log(PC_LOG_DEBUG, "tcp__fail_wi - fail notify, seq_num: %u, code: %d", wi->seq_num, err->code);
+        pc_trans_sent(client, wi->seq_num, err);
     }
     /* drop internal write item */
 
-    pc_lib_free(wi->buf.base);
-    wi->buf.base = NULL;
-    wi->buf.len = 0;
+    tcp__wi_release_buf(wi);
 
     if (PC_IS_PRE_ALLOC(wi->type)) {
         PC_PRE_ALLOC_SET_IDLE(wi->type);
@@ -49,6 +57,49 @@ static void tcp__reset_wi(pc_client_t* client, tr_uv_wi_t* wi)
     }
 }
 
+void tcp__wi_release_buf(tr_uv_wi_t* wi)
+{
+    pc_lib_free(wi->buf.base);
+    wi->buf.base = NULL;
+    wi->buf.len = 0;
+
+    if (wi->prepared) {
+        pc_prepared_msg_release(wi->prepared);
+        wi->prepared = NULL;
+    }
+
+    wi->framed = 0;
+    wi->frame_len = 0;
+}
+
+void tcp__wi_flatten(tr_uv_wi_t* wi)
+{
+    const pc_buf_t* wire;
+    char* base;
+
+    if (!wi->prepared) {
+        return;
+    }
+
+    wire = &wi->prepared->wire;
+    base = (char* )pc_lib_malloc(wi->buf.len + (size_t)wire->len);
+    memcpy(base, wi->buf.base, wi->buf.len);
+    memcpy(base + wi->buf.len, wire->base, (size_t)wire->len);
+
+    pc_lib_free(wi->buf.base);
+    wi->buf.base = base;
+    wi->buf.len += (size_t)wire->len;
+
+    pc_prepared_msg_release(wi->prepared);
+    wi->prepared = NULL;
+}
+
+static void tcp__reset_wi(pc_client_t* client, tr_uv_wi_t* wi)
+{
+    pc_error_t err = pc__error_reset();
+    tcp__fail_wi(client, wi, &err);
+}
+
 void tcp__reset(tr_uv_tcp_transport_t* tt)
 {
     tr_uv_wi_t* wi;
@@ -57,6 +108,7 @@ void tcp__reset(tr_uv_tcp_transport_t* tt)
     pc_assert(tt);
 
     pc_pkg_parser_reset(&tt->pkg_parser);
+    tcp__stream_finish(tt);
 
     uv_timer_stop(&tt->hb_timer);
 
@@ -65,7 +117,21 @@ void tcp__reset(tr_uv_tcp_transport_t* tt)
     uv_timer_stop(&tt->reconn_delay_timer);
     uv_timer_stop(&tt->conn_timeout);
 
+    if (tt->dns_req) {
+        tr_uv_dns_cancel(tt->dns_req);
+        tt->dns_req = NULL;
+    }
+
+    if (tt->race_count) {
+        /* unlike a single connect, the attempts of a race do not report back */
+        tcp__race_abort(tt);
+        tt->is_connecting = 0;
+    }
+
+    tcp__unix_cancel(tt);
+
     tt->hb_rtt = -1;
+    tt->hb_sent_time = 0;
 
     pc_mutex_lock(&tt->serializer_mutex);
     pc_lib_free((char*)tt->serializer);
@@ -103,6 +169,8 @@ void tcp__reset(tr_uv_tcp_transport_t* tt)
         QUEUE_INIT(&tt->write_wait_queue);
     }
 
+    tcp__offload_drop(tt);
+
     while(!QUEUE_EMPTY(&tt->writing_queue)) {
         q = QUEUE_HEAD(&tt->writing_queue);
         QUEUE_REMOVE(q);
@@ -136,20 +204,69 @@ void tcp__reconn_delay_timer_cb(uv_timer_t* t)
     uv_async_send(&tt->conn_async);
 }
 
+void tcp__use_endpoint(tr_uv_tcp_transport_t* tt, int index)
+{
+    const tr_uv_endpoint_t* ep;
+
+    pc_mutex_lock(&tt->endpoints.mutex);
+    ep = &tt->endpoints.list[index];
+    pc_lib_free((char*)tt->host);
+    tt->host = pc_lib_strdup(ep->host);
+    tt->port = ep->port;
+    tt->endpoints.current = index;
+    pc_mutex_unlock(&tt->endpoints.mutex);
+}
+
+/*
+ * Picks the endpoint of the reconnect and returns its delay: at once when
+ * failing over to a healthy endpoint, after the backoff of the first one
+ * to recover when every endpoint is backed off.
+ */
+static uint64_t tcp__reconn_endpoint(tr_uv_tcp_transport_t* tt, int failed, uint64_t delay)
+{
+    uint64_t wait_ms;
+    int index;
+
+    index = tr_uv_endpoints_pick(&tt->endpoints, uv_now(&tt->uv_loop), &wait_ms);
+    if (index != tt->endpoints.current) {
+        pc_mutex_lock(&tt->endpoints.mutex);
+        pc_lib_log(PC_LOG_INFO, "tcp__reconn_endpoint - fail over from %s:%d to %s:%d",
+                   tt->host, tt->port, tt->endpoints.list[index].host, tt->endpoints.list[index].port);
+        pc_mutex_unlock(&tt->endpoints.mutex);
+        tt->endpoint_failovers++;
+        tcp__use_endpoint(tt, index);
+    }
+
+    if (wait_ms) {
+        return wait_ms;
+    }
+    return failed ? 0 : delay;
+}
+
 void tcp__reconn(tr_uv_tcp_transport_t* tt)
 {
     int timeout;
+    uint64_t delay;
     const pc_client_config_t* config;
     int i;
     int factor;
+    int failed;
     pc_assert(tt && tt->reset_fn);
 
+    /* the connection did not get through the handshake */
+    failed = tt->state == TR_UV_TCP_CONNECTING || tt->state == TR_UV_TCP_HANDSHAKEING;
+
     tt->reset_fn(tt);
 
     tt->state = TR_UV_TCP_CONNECTING;
 
     config = tt->config;
 
+    if (failed && tt->endpoints.count) {
+        tr_uv_endpoints_on_failure(&tt->endpoints, uv_now(&tt->uv_loop),
+                                   (uint64_t)config->reconn_delay * 1000, (uint64_t)config->reconn_delay_max * 1000);
+    }
+
     if (!config->enable_reconn) {
          pc_lib_log(PC_LOG_WARN, "tcp__reconn - trans want to reconn, but reconn is disabled");
          tt->reconn_times = 0;
@@ -210,10 +327,23 @@ void tcp__reconn(tr_uv_tcp_transport_t* tt)
     }
 
     timeout = (rand() % timeout) + timeout / 2;
+    delay = (uint64_t)timeout * 1000;
 
-    pc_lib_log(PC_LOG_DEBUG, "tcp__reconn - reconnect, delay: %d", timeout);
+    if (tt->endpoints.count) {
+        delay = tcp__reconn_endpoint(tt, failed, delay);
+    }
 
-    uv_timer_start(&tt->reconn_delay_timer, tcp__reconn_delay_timer_cb, timeout * 1000, 0);
+    /*
+     * the socket closed by the reset is only done closing at the end of this
+     * loop iteration, a timer due now could init it again before that.
+     */
+    if (!delay) {
+        delay = 1;
+    }
+
+    pc_lib_log(PC_LOG_DEBUG, "tcp__reconn - reconnect, delay: %d ms", (int)delay);
+
+    uv_timer_start(&tt->reconn_delay_timer, tcp__reconn_delay_timer_cb, delay, 0);
 }
 
 static void on_connection_done_cb(uv_connect_t *connect, int status)
@@ -228,93 +358,511 @@ static void on_connection_done_cb(uv_connect_t *connect, int status)
     }
 }
 
-void tcp__conn_async_cb(uv_async_t* t)
+void tcp__dns_opts(const tr_uv_tcp_transport_t* tt, tr_uv_dns_opts_t* opts)
 {
-    struct addrinfo hints;
-    struct addrinfo* ainfo;
-    struct addrinfo* rp;
-    struct sockaddr_in* addr4 = NULL;
-    struct sockaddr_in6* addr6 = NULL;
-    struct sockaddr* addr = NULL;
-    int ret;
+    int ttl = tt->config->dns_cache_ttl;
+    int negative_ttl = tt->config->dns_negative_ttl;
 
-    GET_TT(t);
+    ttl = ttl ? ttl : TR_UV_DNS_DEFAULT_TTL;
+    negative_ttl = negative_ttl ? negative_ttl : TR_UV_DNS_DEFAULT_NEGATIVE_TTL;
 
-    pc_assert(t == &tt->conn_async);
+    opts->ttl_ms = ttl > 0 ? (uint64_t)ttl * 1000 : 0;
+    opts->negative_ttl_ms = negative_ttl > 0 ? (uint64_t)negative_ttl * 1000 : 0;
+}
 
-    if (tt->is_connecting)
-        return;
+static void tcp__set_port(struct sockaddr_storage* addr, int port)
+{
+    if (addr->ss_family == AF_INET) {
+        ((struct sockaddr_in*)addr)->sin_port = htons(port);
+    } else {
+        ((struct sockaddr_in6*)addr)->sin6_port = htons(port);
+    }
+}
 
-    tt->state = TR_UV_TCP_CONNECTING;
+static int tcp__dup_socket(uv_os_sock_t sock, uv_os_sock_t* dup_sock)
+{
+#ifdef _WIN32
+    WSAPROTOCOL_INFOW info;
 
-    pc_assert(tt->host && tt->reconn_fn);
+    if (WSADuplicateSocketW(sock, GetCurrentProcessId(), &info)) {
+        return uv_translate_sys_error(WSAGetLastError());
+    }
+    *dup_sock = WSASocketW(FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO,
+                           &info, 0, WSA_FLAG_OVERLAPPED);
+    if (*dup_sock == INVALID_SOCKET) {
+        return uv_translate_sys_error(WSAGetLastError());
+    }
+#else
+    *dup_sock = dup(sock);
+    if (*dup_sock < 0) {
+        return uv_translate_sys_error(errno);
+    }
+#endif
+    return 0;
+}
 
-    memset(&hints, 0, sizeof(struct addrinfo));
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_flags = AI_ADDRCONFIG;
-    hints.ai_socktype = SOCK_STREAM;
+static void tcp__attempt_close_cb(uv_handle_t* handle)
+{
+    tr_uv_tcp_attempt_t* a = (tr_uv_tcp_attempt_t*)handle->data;
+    a->state = TR_UV_TCP_ATTEMPT_IDLE;
+}
 
-    uv_tcp_init(&tt->uv_loop, &tt->socket);
-    if (uv_tcp_nodelay(&tt->socket, true) != 0) {
-        pc_lib_log(PC_LOG_ERROR, "tcp__conn_async_cb - Failed to set tcp nodelay");
+static void tcp__attempt_close(tr_uv_tcp_attempt_t* a)
+{
+    if (a->state == TR_UV_TCP_ATTEMPT_CONNECTING) {
+        a->state = TR_UV_TCP_ATTEMPT_CLOSING;
+        uv_close((uv_handle_t*)&a->socket, tcp__attempt_close_cb);
     }
+}
 
-    tt->socket.data = tt;
+static void tcp__race_abort(tr_uv_tcp_transport_t* tt)
+{
+    int i;
 
-    ret = getaddrinfo(tt->host, NULL, &hints, &ainfo);
+    uv_timer_stop(&tt->race_timer);
+    for (i = 0; tt->attempts && i < TR_UV_DNS_MAX_ADDRS; ++i) {
+        tcp__attempt_close(&tt->attempts[i]);
+    }
+    tt->race_count = 0;
+    tt->race_next = 0;
+    tt->race_pending = 0;
+}
 
-    if (ret) {
-        pc_lib_log(PC_LOG_ERROR, "tcp__conn_async_cb - dns resolve error, state: %s", pc_client_state_str(tt->client->state));
-        pc_lib_log(PC_LOG_ERROR, "tcp__conn_async_cb - dns resolve error: %s, will reconn", tt->host);
-        pc_trans_fire_event(tt->client, PC_EV_CONNECT_ERROR, "DNS Resolve Error", NULL);
-        tt->reconn_fn(tt);
+/*
+ * Ends the race, handing the socket of the winner, if any, over to
+ * tt->socket, and reports the result like a single connect would.
+ */
+static void tcp__race_done(tr_uv_tcp_transport_t* tt, tr_uv_tcp_attempt_t* winner, int status)
+{
+    uv_os_fd_t fd;
+    uv_os_sock_t sock;
+
+    if (winner) {
+        status = uv_fileno((uv_handle_t*)&winner->socket, &fd);
+        if (!status) {
+            status = tcp__dup_socket((uv_os_sock_t)fd, &sock);
+        }
+        if (!status) {
+            status = uv_tcp_open(&tt->socket, sock);
+            if (status) {
+#ifdef _WIN32
+                closesocket(sock);
+#else
+                close(sock);
+#endif
+            }
+        }
+        if (status) {
+            pc_lib_log(PC_LOG_ERROR, "tcp__race_done - take over the connected socket error: %s", uv_strerror(status));
+        }
+    }
+
+    tcp__race_abort(tt);
+
+    if (tt->conn_done_cb) {
+        tt->conn_done_cb(&tt->conn_req, status);
+    }
+}
+
+static void tcp__race_next(tr_uv_tcp_transport_t* tt);
+
+static void tcp__attempt_done_cb(uv_connect_t* req, int status)
+{
+    tr_uv_tcp_attempt_t* a = (tr_uv_tcp_attempt_t*)req->data;
+    tr_uv_tcp_transport_t* tt = a->tt;
+
+    /* a loser closed by the race, or by the reset */
+    if (a->state != TR_UV_TCP_ATTEMPT_CONNECTING) {
         return ;
     }
 
-    for (rp = ainfo; rp; rp = rp->ai_next) {
-        if (rp->ai_family == AF_INET) {
-            addr4 = (struct sockaddr_in* )rp->ai_addr;
-            addr4->sin_port = htons(tt->port);
-            break;
+    tt->race_pending--;
 
-        } else if(rp->ai_family == AF_INET6){
-            addr6 = (struct sockaddr_in6* )rp->ai_addr;
-            addr6->sin6_port = htons(tt->port);
-            break;
+    if (!status) {
+        pc_lib_log(PC_LOG_DEBUG, "tcp__attempt_done_cb - attempt %d won the race", (int)(a - tt->attempts));
+        tcp__race_done(tt, a, 0);
+        return ;
+    }
 
-        } else {
+    pc_lib_log(PC_LOG_DEBUG, "tcp__attempt_done_cb - attempt %d failed: %s", (int)(a - tt->attempts), uv_strerror(status));
+    tt->race_error = status;
+    tcp__attempt_close(a);
+
+    /* do not wait for the delay to try the next address */
+    uv_timer_stop(&tt->race_timer);
+    tcp__race_next(tt);
+}
+
+static void tcp__race_timer_cb(uv_timer_t* t)
+{
+    GET_TT(t);
+
+    pc_assert(t == &tt->race_timer);
+    tcp__race_next(tt);
+}
+
+/*
+ * Starts the attempt to the next address, and arms the timer that starts
+ * the one after it if this one did not finish by then.
+ */
+static void tcp__race_next(tr_uv_tcp_transport_t* tt)
+{
+    tr_uv_tcp_attempt_t* a;
+    int delay;
+    int ret;
+    int i;
+
+    while (tt->race_next < tt->race_count) {
+        a = NULL;
+        for (i = 0; i < TR_UV_DNS_MAX_ADDRS; ++i) {
+            if (tt->attempts[i].state == TR_UV_TCP_ATTEMPT_IDLE) {
+                a = &tt->attempts[i];
+                break;
+            }
+        }
+        if (!a) {
+            /* every slot is still closing from the previous race, wait for one */
+            uv_timer_start(&tt->race_timer, tcp__race_timer_cb, 1, 0);
+            return ;
+        }
+
+        uv_tcp_init(&tt->uv_loop, &a->socket);
+        uv_tcp_nodelay(&a->socket, 1);
+        a->socket.data = a;
+        a->req.data = a;
+        a->state = TR_UV_TCP_ATTEMPT_CONNECTING;
+
+        ret = uv_tcp_connect(&a->req, &a->socket, (struct sockaddr*)&tt->race_addrs[tt->race_next++], tcp__attempt_done_cb);
+        if (ret) {
+            pc_lib_log(PC_LOG_DEBUG, "tcp__race_next - attempt %d error: %s", tt->race_next - 1, uv_strerror(ret));
+            tt->race_error = ret;
+            tcp__attempt_close(a);
             continue;
         }
+
+        tt->race_pending++;
+        tt->conn_attempts++;
+
+        if (tt->race_next < tt->race_count) {
+            delay = tt->config->conn_attempt_delay;
+            uv_timer_start(&tt->race_timer, tcp__race_timer_cb, delay ? delay : TR_UV_TCP_DEFAULT_ATTEMPT_DELAY, 0);
+        }
+        return ;
+    }
+
+    if (!tt->race_pending) {
+        pc_lib_log(PC_LOG_DEBUG, "tcp__race_next - every address failed");
+        tcp__race_done(tt, NULL, tt->race_error);
+    }
+}
+
+/*
+ * Orders the addresses as RFC 8305 section 4 does, alternating address
+ * families starting with the one the resolver preferred.
+ */
+static void tcp__race_start(tr_uv_tcp_transport_t* tt, const tr_uv_dns_result_t* res)
+{
+    int used[TR_UV_DNS_MAX_ADDRS] = {0};
+    int family = res->addrs[0].ss_family;
+    int n;
+    int i;
+
+    /* most clients connect to a single address and never race */
+    if (!tt->attempts) {
+        tt->attempts = (tr_uv_tcp_attempt_t*)pc_lib_malloc(sizeof(tr_uv_tcp_attempt_t) * TR_UV_DNS_MAX_ADDRS);
+        tt->race_addrs = (struct sockaddr_storage*)pc_lib_malloc(sizeof(struct sockaddr_storage) * TR_UV_DNS_MAX_ADDRS);
+        memset(tt->attempts, 0, sizeof(tr_uv_tcp_attempt_t) * TR_UV_DNS_MAX_ADDRS);
+        for (i = 0; i < TR_UV_DNS_MAX_ADDRS; ++i) {
+            tt->attempts[i].tt = tt;
+            tt->attempts[i].state = TR_UV_TCP_ATTEMPT_IDLE;
+        }
+    }
+
+    for (n = 0; n < res->count; ++n) {
+        for (i = 0; i < res->count; ++i) {
+            if (!used[i] && res->addrs[i].ss_family == family) {
+                break;
+            }
+        }
+        if (i == res->count) {
+            /* no address of that family left */
+            for (i = 0; i < res->count && used[i]; ++i) {
+            }
+        }
+        used[i] = 1;
+        tt->race_addrs[n] = res->addrs[i];
+        tcp__set_port(&tt->race_addrs[n], tt->port);
+        family = tt->race_addrs[n].ss_family == AF_INET ? AF_INET6 : AF_INET;
     }
 
-    if (!addr4 && !addr6) {
+    pc_lib_log(PC_LOG_DEBUG, "tcp__race_start - racing %d addresses of %s", res->count, tt->host);
+
+    tt->race_count = res->count;
+    tt->race_next = 0;
+    tt->race_pending = 0;
+    tt->race_error = 0;
+    tt->is_connecting = 1;
+
+    tcp__race_next(tt);
+}
+
+static void tcp__on_resolved(void* data, int status, const tr_uv_dns_result_t* res)
+{
+    struct sockaddr_storage addr;
+    int ret;
+    tr_uv_tcp_transport_t* tt = (tr_uv_tcp_transport_t*)data;
+
+    tt->dns_req = NULL;
+
+    if (status) {
+        pc_lib_log(PC_LOG_ERROR, "tcp__on_resolved - dns resolve error, state: %s", pc_client_state_str(tt->client->state));
+        pc_lib_log(PC_LOG_ERROR, "tcp__on_resolved - dns resolve error: %s, will reconn", tt->host);
         pc_trans_fire_event(tt->client, PC_EV_CONNECT_ERROR, "DNS Resolve Error", NULL);
-        pc_lib_log(PC_LOG_ERROR, "tcp__conn_async_cb - dns resolve error: %s, will reconn", tt->host);
-        freeaddrinfo(ainfo);
         tt->reconn_fn(tt);
-        return;
+        return ;
     }
 
-    addr = addr4 ? (struct sockaddr* )addr4 : (struct sockaddr* )addr6;
     tt->conn_req.data = tt;
 
-    ret = uv_tcp_connect(&tt->conn_req, &tt->socket, addr, on_connection_done_cb);
+    if (res->count > 1 && tt->config->conn_attempt_delay >= 0 && !tt->open_fn) {
+        tcp__race_start(tt, res);
+        return ;
+    }
 
-    freeaddrinfo(ainfo);
+    addr = res->addrs[0];
+    tcp__set_port(&addr, tt->port);
+
+    if (tt->open_fn) {
+        tt->is_connecting = 1;
+        tt->conn_attempts++;
+        ret = tt->open_fn(tt, (struct sockaddr*)&addr);
+        if (ret) {
+            tt->is_connecting = 0;
+            pc_trans_fire_event(tt->client, PC_EV_CONNECT_ERROR, "UV Conn Error", uv_strerror(ret));
+            pc_lib_log(PC_LOG_ERROR, "tcp__on_resolved - open error: %s, will reconn", uv_strerror(ret));
+            tt->reconn_fn(tt);
+        }
+        return ;
+    }
+
+    ret = uv_tcp_connect(&tt->conn_req, &tt->socket, (struct sockaddr*)&addr, on_connection_done_cb);
 
     if (ret) {
         pc_trans_fire_event(tt->client, PC_EV_CONNECT_ERROR, "UV Conn Error", uv_strerror(ret));
-        pc_lib_log(PC_LOG_ERROR, "tcp__conn_async_cb - uv tcp connect error: %s, will reconn", uv_strerror(ret));
+        pc_lib_log(PC_LOG_ERROR, "tcp__on_resolved - uv tcp connect error: %s, will reconn", uv_strerror(ret));
         tt->reconn_fn(tt);
         return ;
     }
 
     tt->is_connecting = 1;
+    tt->conn_attempts++;
+}
+
+/* the socket path of "unix:" hosts, see PC_HOST_UNIX_PREFIX, NULL for the others */
+static const char* tcp__unix_path(const char* host)
+{
+    size_t len = strlen(PC_HOST_UNIX_PREFIX);
+
+    if (strncmp(host, PC_HOST_UNIX_PREFIX, len) != 0) {
+        return NULL;
+    }
+    return host + len;
+}
+
+/*
+ * libuv only has unix domain sockets as pipes, so the socket is opened as
+ * tt->socket instead, which is a stream as well, and nothing past the
+ * connect tells it from tcp. The connect is polled on unix_poll until the
+ * socket is writable, a full backlog failing it with EAGAIN is tried again
+ * then, and it reports to conn_done_cb once the poll is closed, like a tcp
+ * connect does from its callback.
+ */
+#ifndef _WIN32
+static int tcp__unix_addr(const char* path, struct sockaddr_un* addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        return UV_ENAMETOOLONG;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/* 0 once connected, UV_EAGAIN while the connect is still on its way */
+static int tcp__unix_try_connect(tr_uv_tcp_transport_t* tt)
+{
+    struct sockaddr_un addr;
+    uv_os_fd_t fd;
+    int err = 0;
+    socklen_t len = sizeof(err);
+    int ret;
+
+    uv_fileno((uv_handle_t*)&tt->socket, &fd);
+
+    /* a connect that went on in the background reports here */
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err) {
+        return uv_translate_sys_error(err);
+    }
+
+    tcp__unix_addr(tcp__unix_path(tt->host), &addr);
+    do {
+        ret = connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+    } while (ret && errno == EINTR);
+
+    if (!ret || errno == EISCONN) {
+        return 0;
+    }
+    /* EAGAIN is the backlog of the listener being full */
+    if (errno == EAGAIN || errno == EINPROGRESS || errno == EALREADY) {
+        return UV_EAGAIN;
+    }
+    return uv_translate_sys_error(errno);
+}
+#endif
+
+static void tcp__unix_poll_close_cb(uv_handle_t* handle)
+{
+    tr_uv_tcp_transport_t* tt = (tr_uv_tcp_transport_t*)handle->data;
 
+    if (tt->conn_done_cb) {
+        tt->conn_done_cb(&tt->conn_req, tt->unix_status);
+    }
+}
+
+static void tcp__unix_poll_cb(uv_poll_t* poll, int status, int events)
+{
+    tr_uv_tcp_transport_t* tt = (tr_uv_tcp_transport_t*)poll->data;
+
+    (void)events;
+
+#ifndef _WIN32
+    if (!status) {
+        status = tcp__unix_try_connect(tt);
+    }
+#endif
+    if (status == UV_EAGAIN) {
+        return;
+    }
+
+    pc_lib_log(PC_LOG_DEBUG, "tcp__unix_poll_cb - connect to %s: %s", tt->host, status ? uv_strerror(status) : "ok");
+
+    /* the socket is left to tt->socket once the poll let go of it */
+    tt->unix_status = status;
+    uv_close((uv_handle_t*)poll, tcp__unix_poll_close_cb);
+}
+
+/* cancels the connect of a "unix:" host before its socket is closed */
+static void tcp__unix_cancel(tr_uv_tcp_transport_t* tt)
+{
+    if (uv_is_active((uv_handle_t*)&tt->unix_poll)) {
+        tt->unix_status = UV_ECANCELED;
+        uv_close((uv_handle_t*)&tt->unix_poll, tcp__unix_poll_close_cb);
+    }
+}
+
+static int tcp__unix_connect(tr_uv_tcp_transport_t* tt, const char* path)
+{
+#ifdef _WIN32
+    (void)tt; (void)path;
+    return UV_ENOTSUP;
+#else
+    struct sockaddr_un addr;
+    uv_os_fd_t fd;
+    int sock;
+    int ret;
+
+    ret = tcp__unix_addr(path, &addr);
+    if (ret) {
+        return ret;
+    }
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return uv_translate_sys_error(errno);
+    }
+
+    /* non blocking from here on */
+    ret = uv_tcp_open(&tt->socket, sock);
+    if (ret) {
+        close(sock);
+        return ret;
+    }
+
+    uv_fileno((uv_handle_t*)&tt->socket, &fd);
+    ret = uv_poll_init(&tt->uv_loop, &tt->unix_poll, fd);
+    if (!ret) {
+        tt->unix_poll.data = tt;
+        ret = uv_poll_start(&tt->unix_poll, UV_WRITABLE, tcp__unix_poll_cb);
+    }
+    return ret;
+#endif
+}
+
+void tcp__conn_async_cb(uv_async_t* t)
+{
+    tr_uv_dns_opts_t dns_opts;
+    const char* unix_path;
+    int ret;
+
+    GET_TT(t);
+
+    pc_assert(t == &tt->conn_async);
+
+    if (tt->is_connecting || tt->dns_req)
+        return;
+
+    tt->state = TR_UV_TCP_CONNECTING;
+    tt->conn_start_time = uv_hrtime();
+
+    pc_assert(tt->host && tt->reconn_fn);
+
+    /* "unix:" hosts are streams, subclasses opening sockets of their own resolve them like the others */
+    unix_path = tt->open_fn ? NULL : tcp__unix_path(tt->host);
+
+    uv_tcp_init(&tt->uv_loop, &tt->socket);
+    /* unix domain sockets have no Nagle, and libuv would fail to open them with it */
+    if (!unix_path && uv_tcp_nodelay(&tt->socket, true) != 0) {
+        pc_lib_log(PC_LOG_ERROR, "tcp__conn_async_cb - Failed to set tcp nodelay");
+    }
+
+    tt->socket.data = tt;
+
+    /* the connection timeout also covers resolving the host */
     if (tt->config->conn_timeout != PC_WITHOUT_TIMEOUT) {
         pc_lib_log(PC_LOG_DEBUG, "tcp__con_async_cb - start conn timeout timer");
         uv_timer_start(&tt->conn_timeout, tcp__conn_timeout_cb, tt->config->conn_timeout * 1000, 0);
     }
+
+    /* arms the timeout check of the requests sent before connecting */
+    uv_async_send(&tt->write_async);
+
+    if (unix_path) {
+        tt->conn_req.data = tt;
+        ret = tcp__unix_connect(tt, unix_path);
+        if (ret) {
+            pc_trans_fire_event(tt->client, PC_EV_CONNECT_ERROR, "UV Conn Error", uv_strerror(ret));
+            pc_lib_log(PC_LOG_ERROR, "tcp__conn_async_cb - unix connect error: %s, will reconn", uv_strerror(ret));
+            tt->reconn_fn(tt);
+            return;
+        }
+        tt->is_connecting = 1;
+        tt->conn_attempts++;
+        return;
+    }
+
+    tcp__dns_opts(tt, &dns_opts);
+    ret = tr_uv_dns_resolve(&tt->uv_loop, tt->host, &dns_opts, tcp__on_resolved, tt, &tt->dns_req);
+
+    if (ret == TR_UV_DNS_PENDING) {
+        tt->dns_lookups++;
+    } else if (ret == TR_UV_DNS_CACHED) {
+        tt->dns_cache_hits++;
+    } else if (ret < 0) {
+        pc_lib_log(PC_LOG_ERROR, "tcp__conn_async_cb - dns resolve error: %s, will reconn", tt->host);
+        pc_trans_fire_event(tt->client, PC_EV_CONNECT_ERROR, "DNS Resolve Error", uv_strerror(ret));
+        tt->reconn_fn(tt);
+    }
 }
 
 void tcp__conn_timeout_cb(uv_timer_t* t)
@@ -322,10 +870,26 @@ void tcp__conn_timeout_cb(uv_timer_t* t)
     GET_TT(t);
 
     pc_assert(&tt->conn_timeout == t);
-    pc_assert(tt->is_connecting);
     uv_timer_stop(t);
+
+    if (tt->dns_req) {
+        pc_lib_log(PC_LOG_INFO, "tcp__conn_timeout_cb - dns resolve timeout: %s, will reconn", tt->host);
+        tr_uv_dns_cancel(tt->dns_req);
+        tt->dns_req = NULL;
+        pc_trans_fire_event(tt->client, PC_EV_CONNECT_ERROR, "Connect Timeout", NULL);
+        tt->reconn_fn(tt);
+        return;
+    }
+
+    pc_assert(tt->is_connecting);
     pc_lib_log(PC_LOG_INFO, "tcp__conn_timeout_cb - conn timeout, cancel it");
 
+    if (tt->race_count) {
+        tcp__race_done(tt, NULL, UV_ECANCELED);
+        return;
+    }
+
+    tcp__unix_cancel(tt);
     if (!uv_is_closing((uv_handle_t*)&tt->socket)) {
         uv_close((uv_handle_t* )&tt->socket, NULL);
     }
@@ -362,8 +926,16 @@ void tcp__conn_done_cb(uv_connect_t* conn, int status)
     if (status == 0) {
         /* tcp connected. */
         tt->state = TR_UV_TCP_HANDSHAKEING;
+        tt->last_conn_setup_us = (uv_hrtime() - tt->conn_start_time) / 1000;
+        if (tt->endpoints.count) {
+            tr_uv_endpoints_on_tcp_connected(&tt->endpoints, (int)(tt->last_conn_setup_us / 1000));
+        }
 
-        ret = uv_read_start((uv_stream_t* ) &tt->socket, tcp__alloc_cb, tt->on_tcp_read_cb);
+        if (tt->read_start_fn) {
+            ret = tt->read_start_fn(tt);
+        } else {
+            ret = uv_read_start((uv_stream_t* ) &tt->socket, tt->alloc_cb, tt->on_tcp_read_cb);
+        }
 
         if (ret) {
             pc_lib_log(PC_LOG_ERROR, "tcp__conn_done_cb - start read from tcp error, reconn");
@@ -371,12 +943,17 @@ void tcp__conn_done_cb(uv_connect_t* conn, int status)
             return ;
         }
 
-        /* XXX: ignore return of uv_tcp_keepalive */
-        uv_tcp_keepalive(&tt->socket, 1, 60);
+        tr_uv_sockopt_apply(&tt->socket, tt->config, &tt->sockopt);
 
-        pc_lib_log(PC_LOG_INFO, "tcp__conn_done_cb - tcp connected, sending handshake");
+        pc_lib_log(PC_LOG_INFO, "tcp__conn_done_cb - tcp connected in %llu us, sending handshake",
+                   (unsigned long long)tt->last_conn_setup_us);
 
-        tcp__send_handshake(tt);
+        /* the handshake timer covers the upgrade of the connection too */
+        if (tt->upgrade_fn) {
+            tt->upgrade_fn(tt);
+        } else {
+            tcp__send_handshake(tt);
+        }
 
         if (tt->config->conn_timeout != PC_WITHOUT_TIMEOUT) {
             uv_timer_start(&tt->handshake_timer, tcp__handshake_timer_cb, hs_timeout, 0);
@@ -401,6 +978,7 @@ void tcp__write_async_cb(uv_async_t* a)
     int i;
     int ret;
     int need_check = 0;
+    size_t len = 0;
     QUEUE* q;
     tr_uv_wi_t* wi;
     uv_buf_t* bufs;
@@ -445,7 +1023,10 @@ void tcp__write_async_cb(uv_async_t* a)
             need_check = 1;
         }
 
-        buf_cnt++;
+        if (tt->frame_fn) {
+            tt->frame_fn(tt, wi);
+        }
+        buf_cnt += (wi->prepared ? 2 : 1) + (wi->frame_len ? 1 : 0);
     }
 
     if (buf_cnt == 0) {
@@ -478,7 +1059,15 @@ void tcp__write_async_cb(uv_async_t* a)
                     "seq_num: %u, req_id: %u", wi->seq_num, wi->req_id);
         }
 
+        if (wi->frame_len) {
+            bufs[i++] = uv_buf_init(wi->frame_hdr, wi->frame_len);
+        }
         bufs[i++] = wi->buf;
+        /* the wire image is shared with the other sends of the prepared message */
+        if (wi->prepared) {
+            bufs[i].base = (char* )wi->prepared->wire.base;
+            bufs[i++].len = (size_t)wi->prepared->wire.len;
+        }
 
         QUEUE_INSERT_TAIL(&tt->writing_queue, q);
     }
@@ -487,10 +1076,18 @@ void tcp__write_async_cb(uv_async_t* a)
 
     pc_mutex_unlock(&tt->wq_mutex);
 
+    for (i = 0; i < buf_cnt; ++i) {
+        len += bufs[i].len;
+    }
+
     tt->write_req.data = tt;
 
     pc_lib_log(PC_LOG_DEBUG, "tcp__write_async_cb - Writing to TCP socket");
-    ret = uv_write(&tt->write_req, (uv_stream_t* )&tt->socket, bufs, buf_cnt, tcp__write_done_cb);
+    if (tt->write_fn) {
+        ret = tt->write_fn(tt, bufs, buf_cnt);
+    } else {
+        ret = uv_write(&tt->write_req, (uv_stream_t* )&tt->socket, bufs, buf_cnt, tcp__write_done_cb);
+    }
 
     pc_lib_free(bufs);
 
@@ -505,9 +1102,7 @@ void tcp__write_async_cb(uv_async_t* a)
 
             wi = (tr_uv_wi_t* )QUEUE_DATA(q, tr_uv_wi_t, queue);
 
-            pc_lib_free(wi->buf.base);
-            wi->buf.base = NULL;
-            wi->buf.len = 0;
+            tcp__wi_release_buf(wi);
 
             if (TR_UV_WI_IS_NOTIFY(wi->type)) {
                 pc_error_t err = pc__error_uv(ret);
@@ -532,6 +1127,7 @@ void tcp__write_async_cb(uv_async_t* a)
     }
 
     tt->is_writing = 1;
+    tcp__on_socket_write(tt, len);
 
     /* enable check timeout timer */
     if (need_check && !uv_is_active((uv_handle_t* )&tt->check_timeout)) {
@@ -542,12 +1138,48 @@ void tcp__write_async_cb(uv_async_t* a)
 
 }
 
+void tcp__on_socket_write(tr_uv_tcp_transport_t* tt, size_t len)
+{
+    QUEUE* q;
+    tr_uv_wi_t* wi;
+    int app = 0;
+
+    tt->socket_writes++;
+    tt->socket_bytes += len;
+
+    if (!tt->connect_call_time) {
+        return ;
+    }
+
+    pc_mutex_lock(&tt->wq_mutex);
+    QUEUE_FOREACH(q, &tt->writing_queue) {
+        wi = (tr_uv_wi_t* )QUEUE_DATA(q, tr_uv_wi_t, queue);
+        if (!TR_UV_WI_IS_INTERNAL(wi->type)) {
+            app = 1;
+            break;
+        }
+    }
+    pc_mutex_unlock(&tt->wq_mutex);
+
+    if (app) {
+        tt->first_send_us = (uv_hrtime() - tt->connect_call_time) / 1000;
+        tt->connect_call_time = 0;
+        pc_lib_log(PC_LOG_INFO, "tcp__on_socket_write - first request on the wire %llu us after connect",
+                   (unsigned long long)tt->first_send_us);
+    }
+}
+
 void tcp__write_done_cb(uv_write_t* w, int status)
 {
     GET_TT(w);
 
-    pc_assert(tt->is_writing);
     pc_assert(w == &tt->write_req);
+    tcp__on_write_done(tt, status);
+}
+
+void tcp__on_write_done(tr_uv_tcp_transport_t* tt, int status)
+{
+    pc_assert(tt->is_writing);
 
     tt->is_writing = 0;
 
@@ -575,9 +1207,7 @@ void tcp__write_done_cb(uv_write_t* w, int status)
             continue;
         }
 
-        pc_lib_free(wi->buf.base);
-        wi->buf.base = NULL;
-        wi->buf.len = 0;
+        tcp__wi_release_buf(wi);
 
         if (TR_UV_WI_IS_NOTIFY(wi->type)) {
             if (status) {
@@ -638,9 +1268,7 @@ int tcp__check_queue_timeout(QUEUE* ql, pc_client_t* client, int cont)
 
                 /* if internal, just drop it. */
 
-                pc_lib_free(wi->buf.base);
-                wi->buf.base = NULL;
-                wi->buf.len = 0;
+                tcp__wi_release_buf(wi);
 
                 if (PC_IS_PRE_ALLOC(wi->type)) {
                     PC_PRE_ALLOC_SET_IDLE(wi->type);
@@ -710,6 +1338,7 @@ void tcp__cleanup_async_cb(uv_async_t* a)
     pc_assert(a == &tt->cleanup_async);
 
     tt->reset_fn(tt);
+    tr_uv_dns_cancel_all(&tt->uv_loop);
 
     if (tt->host) {
         pc_lib_free((char *)tt->host);
@@ -721,15 +1350,19 @@ void tcp__cleanup_async_cb(uv_async_t* a)
     // cleaned up.
     tt->conn_done_cb = NULL;
 
-    tcp__cleanup_pc_json(&tt->handshake_opts);
-    tcp__cleanup_pc_json(&tt->route_to_code);
-    tcp__cleanup_pc_json(&tt->code_to_route);
-
     // Stop the loop and walk all handles in the loop closing each one of them.
     // libuv will call for each handle the walk_cb function.
     uv_stop(&tt->uv_loop);
     uv_walk(&tt->uv_loop, walk_cb, NULL);
+    // With stop_flag set this returns at once, only clearing it. The run of
+    // tr_uv_tcp_thread_fn then goes on until the handles are closed and the
+    // offloaded jobs and chunk writes still on the thread pool are done,
+    // as they keep the loop alive, before the thread is joined.
     uv_run(&tt->uv_loop, UV_RUN_DEFAULT);
+
+    tcp__cleanup_pc_json(&tt->handshake_opts);
+    tcp__cleanup_pc_json(&tt->route_to_code);
+    tcp__cleanup_pc_json(&tt->code_to_route);
 }
 
 void tcp__disconnect_async_cb(uv_async_t* a)
@@ -786,23 +1419,33 @@ void tcp__send_heartbeat(tr_uv_tcp_transport_t* tt)
 
     pc_mutex_unlock(&tt->wq_mutex);
 
+    if (!tt->hb_sent_time) {
+        tt->hb_sent_time = uv_now(&tt->uv_loop);
+    }
+
     uv_async_send(&tt->write_async);
 }
 
 void tcp__on_heartbeat(tr_uv_tcp_transport_t* tt)
 {
     int rtt = 0;
-    int start = 0;
 
     pc_lib_log(PC_LOG_DEBUG, "tcp__on_heartbeat - [Heartbeat] received from server");
     pc_assert(tt->state == TR_UV_TCP_DONE);
 
-    // FIXME, TODO(lhahn): consider removing rtt code, since it is probably broken
     /*
-     * we hacking uv timer to get the heartbeat rtt, rtt in millisec
-     * int is enough to hold the value
+     * the rtt is the time from our heartbeat to the next one of the server,
+     * in millisec, int is enough to hold the value
      */
-    rtt = (int)(tt->uv_loop.time - start);
+    if (!tt->hb_sent_time) {
+        return;
+    }
+    rtt = (int)(uv_now(&tt->uv_loop) - tt->hb_sent_time);
+    tt->hb_sent_time = 0;
+
+    if (tt->endpoints.count) {
+        tr_uv_endpoints_on_rtt(&tt->endpoints, rtt);
+    }
 
     if (tt->hb_rtt == -1) {
         tt->hb_rtt = rtt;
@@ -830,65 +1473,554 @@ void tcp__heartbeat_timer_cb(uv_timer_t* t)
         return;
     }
 
-    tcp__send_heartbeat(tt);
+    tcp__send_heartbeat(tt);
+}
+
+void tcp__handshake_timer_cb(uv_timer_t* t)
+{
+    GET_TT(t);
+
+    pc_assert(t == &tt->handshake_timer);
+
+    pc_lib_log(PC_LOG_ERROR, "tcp__handshake_timer_cb - tcp handshake timeout, will reconn");
+    pc_trans_fire_event(tt->client, PC_EV_CONNECT_ERROR, "Connect Timeout", NULL);
+    tt->reconn_fn(tt);
+}
+
+void tcp__on_read_error(tr_uv_tcp_transport_t* tt, int err)
+{
+    pc_lib_log(PC_LOG_ERROR, "tcp__on_tcp_read_cb - read from tcp error: %s,"
+               "will reconn", uv_strerror(err));
+
+    if (tt->state == TR_UV_TCP_DONE) {
+        // If connection is completed, there was an unexpected disconnect
+        pc_trans_fire_event(tt->client, PC_EV_UNEXPECTED_DISCONNECT, "Read Error Or Close", uv_strerror(err));
+    } else {
+        // Otherwise, the client failed to connect.
+        pc_trans_fire_event(tt->client, PC_EV_CONNECT_FAILED, "Failed to complete pitaya connection", uv_strerror(err));
+    }
+
+    tt->reconn_fn(tt);
+}
+
+void tcp__on_tcp_read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf)
+{
+    GET_TT(stream);
+
+    if (nread < 0) {
+        if (buf->base) {
+            tr_uv_rbuf_put(buf->base);
+        }
+
+        tcp__on_read_error(tt, (int)nread);
+        return;
+    }
+
+    tr_uv_sockopt_rearm(&tt->socket, &tt->sockopt);
+    if (tt->feed_fn) {
+        tt->feed_fn(tt, buf->base, nread);
+    } else {
+        pc_pkg_parser_feed(&tt->pkg_parser, buf->base, nread);
+    }
+    tr_uv_rbuf_put(buf->base);
+}
+
+void tcp__alloc_cb(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf)
+{
+    (void)handle;
+
+    /* released by the read callback */
+    buf->base = tr_uv_rbuf_get();
+    buf->len = suggested_size < PC_TCP_READ_BUFFER_SIZE ? suggested_size : PC_TCP_READ_BUFFER_SIZE;
+}
+
+/*
+ * Decompresses the body of `msg` with `gzip`, turning it into an invalid
+ * message on error.
+ */
+static void tcp__inflate_msg(tr_uv_tcp_transport_t* tt, pr_gzip_engine_t* gzip, pc_msg_t* msg)
+{
+    if (pc_default_msg_inflate(gzip, &tt->compress_policy, msg)) {
+        pc_lib_free((char* )msg->route);
+        msg->route = NULL;
+        msg->buf.base = NULL;
+        msg->id = PC_INVALID_REQ_ID;
+    }
+}
+
+/*
+ * Returns the write item of the request waiting for the response `req_id`,
+ * or NULL if the request is gone.
+ */
+static tr_uv_wi_t* tcp__find_resp_wi(tr_uv_tcp_transport_t* tt, unsigned int req_id)
+{
+    QUEUE* q;
+    tr_uv_wi_t* wi;
+
+    QUEUE_FOREACH(q, &tt->resp_pending_queue) {
+        wi = (tr_uv_wi_t* )QUEUE_DATA(q, tr_uv_wi_t, queue);
+        pc_assert(TR_UV_WI_IS_RESP(wi->type));
+
+        if (wi->req_id == req_id) {
+            return wi;
+        }
+    }
+    return NULL;
+}
+
+static void tcp__release_resp_wi(tr_uv_tcp_transport_t* tt, tr_uv_wi_t* wi)
+{
+    QUEUE_REMOVE(&wi->queue);
+    QUEUE_INIT(&wi->queue);
+
+    tcp__wi_release_buf(wi);
+
+    if (PC_IS_PRE_ALLOC(wi->type)) {
+        pc_mutex_lock(&tt->wq_mutex);
+        PC_PRE_ALLOC_SET_IDLE(wi->type);
+        pc_mutex_unlock(&tt->wq_mutex);
+    } else {
+        pc_lib_free(wi);
+    }
+}
+
+/*
+ * Answers the streamed request `req_id` once its body was delivered, if it
+ * did not time out or was reset meanwhile.
+ */
+static void tcp__stream_answer(tr_uv_tcp_transport_t* tt, unsigned int req_id, int failed)
+{
+    tr_uv_wi_t* wi = tcp__find_resp_wi(tt, req_id);
+    pc_buf_t empty_buf = {0};
+
+    if (!wi) {
+        return;
+    }
+
+    if (failed) {
+        pc_error_t err = pc__error_local();
+        pc_trans_resp(tt->client, req_id, &empty_buf, &err);
+    } else {
+        pc_trans_resp(tt->client, req_id, &empty_buf, NULL);
+    }
+    tcp__release_resp_wi(tt, wi);
+}
+
+static tr_uv_stream_file_t* tcp__stream_file_new(tr_uv_tcp_transport_t* tt, unsigned int req_id, uv_file fd)
+{
+    tr_uv_stream_file_t* f = (tr_uv_stream_file_t* )pc_lib_malloc(sizeof(tr_uv_stream_file_t));
+
+    memset(f, 0, sizeof(tr_uv_stream_file_t));
+    f->tt = tt;
+    f->req_id = req_id;
+    f->fd = fd;
+    QUEUE_INIT(&f->chunks);
+    return f;
+}
+
+/* frees the chunks not written yet, but the one being written */
+static void tcp__stream_file_drop(tr_uv_stream_file_t* f)
+{
+    QUEUE* head;
+    QUEUE* q;
+
+    if (QUEUE_EMPTY(&f->chunks)) {
+        return;
+    }
+
+    head = QUEUE_HEAD(&f->chunks);
+    while ((q = QUEUE_NEXT(head)) != &f->chunks) {
+        QUEUE_REMOVE(q);
+        pc_lib_free(QUEUE_DATA(q, tr_uv_stream_chunk_t, queue));
+    }
+}
+
+#define TR_UV_STREAM_WAIT_MS 100
+
+/* on the thread pool, writes the head chunk */
+static void tcp__stream_file_work(uv_work_t* work)
+{
+    tr_uv_stream_file_t* f = (tr_uv_stream_file_t* )work->data;
+    tr_uv_stream_chunk_t* c = f->writing;
+    uv_buf_t buf;
+    uv_fs_t req;
+    int ret;
+
+    f->result = 0;
+    while (c->off < c->len) {
+        buf = uv_buf_init(c->data + c->off, (unsigned int)(c->len - c->off));
+        ret = uv_fs_write(&f->tt->uv_loop, &req, f->fd, &buf, 1, -1, NULL);
+        uv_fs_req_cleanup(&req);
+
+        if (ret == UV_EAGAIN && !f->failed) {
+#ifdef _WIN32
+            uv_sleep(TR_UV_STREAM_WAIT_MS);
+#else
+            struct pollfd pfd;
+            pfd.fd = f->fd;
+            pfd.events = POLLOUT;
+            poll(&pfd, 1, TR_UV_STREAM_WAIT_MS);
+#endif
+            continue;
+        }
+        if (ret <= 0) {
+            f->result = ret ? ret : UV_EIO;
+            return;
+        }
+        c->off += (size_t)ret;
+    }
+}
+
+static void tcp__stream_file_write(tr_uv_stream_file_t* f);
+
+static void tcp__stream_file_done(uv_work_t* work, int status)
+{
+    tr_uv_stream_file_t* f = (tr_uv_stream_file_t* )work->data;
+    tr_uv_stream_chunk_t* c = f->writing;
+
+    if (status == UV_ECANCELED) {
+        f->result = status;
+    }
+    if (f->result) {
+        if (!f->failed) {
+            pc_lib_log(PC_LOG_ERROR, "tcp__stream_file_done - write to fd %d failed: %s, req_id: %u",
+                       f->fd, uv_strerror(f->result), f->req_id);
+        }
+        f->failed = 1;
+    }
+
+    QUEUE_REMOVE(&c->queue);
+    pc_lib_free(c);
+    if (f->failed) {
+        tcp__stream_file_drop(f);
+    }
+
+    if (!QUEUE_EMPTY(&f->chunks)) {
+        tcp__stream_file_write(f);
+    } else if (f->ended) {
+        if (!f->orphan) {
+            tcp__stream_answer(f->tt, f->req_id, f->failed);
+        }
+        pc_lib_free(f);
+    }
+}
+
+static void tcp__stream_file_write(tr_uv_stream_file_t* f)
+{
+    f->writing = QUEUE_DATA(QUEUE_HEAD(&f->chunks), tr_uv_stream_chunk_t, queue);
+    f->work.data = f;
+    uv_queue_work(&f->tt->uv_loop, &f->work, tcp__stream_file_work, tcp__stream_file_done);
+}
+
+/*
+ * The body is all received, or given up on if `failed`. The request is
+ * answered once what was queued is written.
+ */
+static void tcp__stream_file_end(tr_uv_stream_file_t* f, int failed)
+{
+    f->ended = 1;
+    if (failed) {
+        f->failed = 1;
+        tcp__stream_file_drop(f);
+    }
+
+    if (QUEUE_EMPTY(&f->chunks)) {
+        if (!f->orphan) {
+            tcp__stream_answer(f->tt, f->req_id, f->failed);
+        }
+        pc_lib_free(f);
+    }
+}
+
+/*
+ * Hands a chunk of the streamed response to the chunk callback of the
+ * request and queues it to its file descriptor. Returns non zero on failure.
+ */
+static int tcp__stream_sink(void* data, const unsigned char* chunk, size_t len)
+{
+    tr_uv_tcp_transport_t* tt = (tr_uv_tcp_transport_t* )data;
+    tr_uv_resp_stream_t* s = &tt->resp_stream;
+    tr_uv_stream_file_t* f = s->file;
+    tr_uv_stream_chunk_t* c;
+    int idle;
+
+    s->out_bytes += len;
+
+    if (f && len > 0) {
+        if (f->failed) {
+            return -1;
+        }
+
+        c = (tr_uv_stream_chunk_t* )pc_lib_malloc(sizeof(tr_uv_stream_chunk_t) + len);
+        c->len = len;
+        c->off = 0;
+        memcpy(c->data, chunk, len);
+
+        idle = QUEUE_EMPTY(&f->chunks);
+        QUEUE_INSERT_TAIL(&f->chunks, &c->queue);
+        if (idle) {
+            tcp__stream_file_write(f);
+        }
+    }
+
+    return pc_trans_resp_chunk(tt->client, s->req_id, chunk, len) != PC_RC_OK;
+}
+
+/*
+ * Starts streaming the response whose first bytes are `data` if it is for
+ * a streamed request. Returns the size of the message header, or 0 when the
+ * package should be buffered as usual.
+ */
+static size_t tcp__stream_begin(tr_uv_tcp_transport_t* tt, const char* data, size_t len)
+{
+    tr_uv_tcp_transport_plugin_t* plugin = (tr_uv_tcp_transport_plugin_t* )tt->base.plugin((pc_transport_t*)tt);
+    tr_uv_resp_stream_t* s = &tt->resp_stream;
+    tr_uv_wi_t* wi;
+    uint32_t id;
+    int compressed;
+    size_t header_len;
+
+    if (plugin->pr_msg_decoder != pr_default_msg_decoder
+            || !QUEUE_EMPTY(&tt->offload_recv_queue)
+            || !pc_default_msg_peek_resp((const uint8_t* )data, len, &id, &compressed, &header_len)) {
+        return 0;
+    }
+
+    wi = tcp__find_resp_wi(tt, id);
+    if (!wi || !wi->stream) {
+        return 0;
+    }
+
+    /* other codecs can not decompress incrementally */
+    if (compressed && pr_gzip_engine_codec(&tt->gzip) != &pr_codec_zlib) {
+        return 0;
+    }
+
+    memset(s, 0, sizeof(tr_uv_resp_stream_t));
+    s->req_id = id;
+    s->compressed = compressed;
+    if (wi->stream_fd >= 0) {
+        s->file = tcp__stream_file_new(tt, id, wi->stream_fd);
+    }
+
+    if (compressed && pr_inflate_stream_init(&s->inflate, &tt->compress_policy.dicts)) {
+        s->compressed = 0;
+        s->failed = 1;
+    }
+
+    s->active = 1;
+    pc_lib_log(PC_LOG_INFO, "tcp__stream_begin - streaming response, req_id: %u", id);
+    return header_len;
+}
+
+static void tcp__stream_feed(tr_uv_tcp_transport_t* tt, const char* data, size_t len)
+{
+    tr_uv_resp_stream_t* s = &tt->resp_stream;
+
+    /* the request timed out or was reset meanwhile */
+    if (!s->failed && !tcp__find_resp_wi(tt, s->req_id)) {
+        s->failed = 1;
+    }
+
+    if (s->failed || len == 0) {
+        return;
+    }
+
+    if (s->compressed) {
+        uint64_t start = uv_hrtime();
+        s->in_bytes += len;
+        s->failed = pr_inflate_stream_feed(&s->inflate, (const unsigned char* )data, len, tcp__stream_sink, tt) != 0;
+        s->inflate_time_ns += uv_hrtime() - start;
+    } else {
+        s->failed = tcp__stream_sink(tt, (const unsigned char* )data, len);
+    }
+}
+
+static void tcp__stream_finish(tr_uv_tcp_transport_t* tt)
+{
+    tr_uv_resp_stream_t* s = &tt->resp_stream;
+
+    if (s->compressed) {
+        pr_inflate_stream_end(&s->inflate);
+    }
+    /* cut short by a reset, which fails the request, what is being written is let finish */
+    if (s->file) {
+        s->file->orphan = 1;
+        tcp__stream_file_end(s->file, 1);
+        s->file = NULL;
+    }
+    s->active = 0;
+    s->compressed = 0;
+}
+
+/*
+ * Answers the streamed request once its whole body was received.
+ */
+static void tcp__stream_end(tr_uv_tcp_transport_t* tt)
+{
+    tr_uv_resp_stream_t* s = &tt->resp_stream;
+
+    if (!s->failed && s->compressed && !pr_inflate_stream_done(&s->inflate)) {
+        pc_lib_log(PC_LOG_ERROR, "tcp__stream_end - truncated compressed body, req_id: %u", s->req_id);
+        s->failed = 1;
+    }
+
+    if (!s->failed && s->compressed) {
+        pr_compress_policy_record_inflate(&tt->compress_policy, s->in_bytes, s->out_bytes, s->inflate_time_ns);
+    }
+
+    if (s->file) {
+        tcp__stream_file_end(s->file, s->failed);
+        s->file = NULL;
+    } else {
+        tcp__stream_answer(tt, s->req_id, s->failed);
+    }
+
+    tcp__stream_finish(tt);
+}
+
+int tcp__on_data_chunk(const char* data, size_t len, size_t offset, size_t pkg_len, void* ex_data)
+{
+    tr_uv_tcp_transport_t* tt = (tr_uv_tcp_transport_t* )ex_data;
+    size_t header_len = 0;
+
+    if (offset == 0) {
+        header_len = tcp__stream_begin(tt, data, len);
+        if (!header_len) {
+            return 0;
+        }
+    }
+
+    pc_assert(tt->resp_stream.active);
+
+    /* a big body can take longer than the heartbeat timeout to arrive */
+    tt->last_server_packet_time = uv_now(&tt->uv_loop);
+
+    tcp__stream_feed(tt, data + header_len, len - header_len);
+
+    if (offset + len == pkg_len) {
+        tcp__stream_end(tt);
+    }
+    return 1;
 }
 
-void tcp__handshake_timer_cb(uv_timer_t* t)
+/*
+ * Delivers the body of a streamed request that could not be streamed as
+ * it arrived, in a single chunk.
+ */
+static void tcp__stream_whole(tr_uv_tcp_transport_t* tt, tr_uv_wi_t* wi, const pc_msg_t* msg)
 {
-    GET_TT(t);
+    tr_uv_resp_stream_t* s = &tt->resp_stream;
 
-    pc_assert(t == &tt->handshake_timer);
+    memset(s, 0, sizeof(tr_uv_resp_stream_t));
+    s->req_id = wi->req_id;
+    if (wi->stream_fd >= 0) {
+        s->file = tcp__stream_file_new(tt, wi->req_id, wi->stream_fd);
+    }
+    s->active = 1;
 
-    pc_lib_log(PC_LOG_ERROR, "tcp__handshake_timer_cb - tcp handshake timeout, will reconn");
-    pc_trans_fire_event(tt->client, PC_EV_CONNECT_ERROR, "Connect Timeout", NULL);
-    tt->reconn_fn(tt);
+    if (msg->buf.len > 0) {
+        s->failed = tcp__stream_sink(tt, msg->buf.base, msg->buf.len);
+    }
+    tcp__stream_end(tt);
 }
 
-void tcp__on_tcp_read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf)
+/*
+ * Moves the decoded body of `msg` to the caller memory of its request when
+ * it fits, which is needed when it could not be decoded there directly.
+ */
+static void tcp__copy_to_caller(tr_uv_tcp_transport_t* tt, pc_msg_t* msg)
 {
-    GET_TT(stream);
-
-    if (nread < 0) {
-        pc_lib_log(PC_LOG_ERROR, "tcp__on_tcp_read_cb - read from tcp error: %s,"
-                   "will reconn", uv_strerror(nread));
+    uint8_t* mem = pc_trans_resp_alloc(tt->client, msg->id, msg->buf.len);
 
-        if (tt->state == TR_UV_TCP_DONE) {
-            // If connection is completed, there was an unexpected disconnect
-            pc_trans_fire_event(tt->client, PC_EV_UNEXPECTED_DISCONNECT, "Read Error Or Close", uv_strerror(nread));
-        } else {
-            // Otherwise, the client failed to connect.
-            pc_trans_fire_event(tt->client, PC_EV_CONNECT_FAILED, "Failed to complete pitaya connection", uv_strerror(nread));
+    if (mem) {
+        memcpy(mem, msg->buf.base, msg->buf.len);
+        if (!msg->is_buf_borrowed) {
+            pc_buf_free(&msg->buf);
         }
-
-        tt->reconn_fn(tt);
-        return;
+        msg->buf.base = mem;
+        msg->is_buf_borrowed = 1;
     }
-
-    pc_pkg_parser_feed(&tt->pkg_parser, buf->base, nread);
 }
 
-void tcp__alloc_cb(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf)
+/*
+ * Decodes a successful response straight into the caller memory of its
+ * request, see pc_request_opts_t. Returns 0 when the message is not such a
+ * response or does not fit, leaving it to the usual decoding.
+ */
+static int tcp__decode_to_caller(tr_uv_tcp_transport_t* tt, const char* data, size_t len)
 {
-    size_t len;
-    GET_TT(handle);
+    const pr_codec_t* codec;
+    tr_uv_wi_t* wi;
+    pc_buf_t resp;
+    uint32_t id;
+    int compressed;
+    size_t header_len;
+    size_t cap = 0;
+    size_t size;
+    uint64_t start;
+    int ret;
+
+    if (!pc_default_msg_peek_resp((const uint8_t* )data, len, &id, &compressed, &header_len)) {
+        return 0;
+    }
+
+    wi = tcp__find_resp_wi(tt, id);
+    if (!wi || !wi->caller_buf) {
+        return 0;
+    }
+
+    data += header_len;
+    len -= header_len;
+
+    if (!compressed || len == 0) {
+        resp.base = pc_trans_resp_alloc(tt->client, id, len);
+        if (!resp.base) {
+            return 0;
+        }
+        memcpy(resp.base, data, len);
+        resp.len = len;
+    } else {
+        /* the size is unknown until decompressed, first try the caller buffer */
+        codec = pr_gzip_engine_codec(&tt->gzip);
+        resp.base = pc_trans_resp_buf(tt->client, id, &cap);
+        if (!codec->decompress_to || !resp.base) {
+            return 0;
+        }
+
+        start = uv_hrtime();
+        ret = codec->decompress_to(&tt->compress_policy.dicts, resp.base, cap, &size,
+                                   (const unsigned char* )data, len);
+        if (ret == PR_CODEC_SHORT_BUFFER) {
+            resp.base = pc_trans_resp_alloc(tt->client, id, size);
+            ret = resp.base
+                ? codec->decompress_to(&tt->compress_policy.dicts, resp.base, size, &size,
+                                       (const unsigned char* )data, len)
+                : PR_CODEC_SHORT_BUFFER;
+        }
+        if (ret != 0) {
+            return 0;
+        }
 
-    len = suggested_size < PC_TCP_READ_BUFFER_SIZE ? suggested_size : PC_TCP_READ_BUFFER_SIZE;
+        pr_compress_policy_record_inflate(&tt->compress_policy, len, size, uv_hrtime() - start);
+        resp.len = size;
+    }
 
-    buf->base = tt->tcp_read_buf;
-    buf->len = len;
+    pc_lib_log(PC_LOG_INFO, "tcp__decode_to_caller - recived data, req_id: %u", id);
+    pc_trans_resp(tt->client, id, &resp, NULL);
+    tcp__release_resp_wi(tt, wi);
+    return 1;
 }
 
-void tcp__on_data_recieved(tr_uv_tcp_transport_t* tt, const char* data, size_t len)
+/*
+ * Dispatches a decoded message and releases it. `compressed` tells the body
+ * is still compressed, which only happens with lazy decompression.
+ */
+static void tcp__on_msg_recieved(tr_uv_tcp_transport_t* tt, pc_msg_t msg, int compressed)
 {
-    QUEUE* q;
     tr_uv_wi_t* wi = NULL;
-    tr_uv_tcp_transport_plugin_t* plugin = (tr_uv_tcp_transport_plugin_t* )tt->base.plugin((pc_transport_t*)tt);
-
-    uv_buf_t buf;
-    buf.base = (char*)data;
-    buf.len = len;
-
-    pc_msg_t msg = plugin->pr_msg_decoder(tt, &buf);
+    pc_body_t body;
+    const pc_buf_t* payload = &msg.buf;
 
     if (msg.id == PC_INVALID_REQ_ID || !msg.buf.base) {
         pc_lib_log(PC_LOG_ERROR, "tcp__on_data_recieved - decode error, will reconn");
@@ -910,48 +2042,100 @@ void tcp__on_data_recieved(tr_uv_tcp_transport_t* tt, const char* data, size_t l
     pc_lib_log(PC_LOG_INFO, "tcp__on_data_recieved - recived data, req_id: %d", msg.id);
 
     if (msg.id != PC_NOTIFY_PUSH_REQ_ID) {
+        wi = tcp__find_resp_wi(tt, msg.id);
+    }
+
+    if (wi && wi->stream && !msg.error) {
+        if (compressed) {
+            tcp__inflate_msg(tt, &tt->gzip, &msg);
+            if (msg.id == PC_INVALID_REQ_ID) {
+                pc_trans_fire_event(tt->client, PC_EV_PROTO_ERROR, "Decode Error", NULL);
+                tt->reconn_fn(tt);
+                return;
+            }
+        }
+        tcp__stream_whole(tt, wi, &msg);
+    } else if (msg.id != PC_NOTIFY_PUSH_REQ_ID) {
         /* request */
         if (msg.error) {
             pc_error_t err = pc__error_server(&msg.buf);
             pc_trans_resp(tt->client, msg.id, &msg.buf, &err);
             pc__error_free(&err);
         } else {
-            pc_trans_resp(tt->client, msg.id, &msg.buf, NULL);
+            if (tt->config->lazy_decompression) {
+                pc_default_msg_lazy_body(&body, &msg, compressed, &tt->gzip, &tt->compress_policy);
+                payload = &body.raw;
+            } else if (wi && wi->caller_buf) {
+                tcp__copy_to_caller(tt, &msg);
+            }
+            pc_trans_resp(tt->client, msg.id, payload, NULL);
         }
 
-        /*
-         * As we will stop iterating if matched wi found,
-         * so it is safe to use `QUEUE_FOREACH` here.
-         */
-        QUEUE_FOREACH(q, &tt->resp_pending_queue) {
-            wi = (tr_uv_wi_t* )QUEUE_DATA(q, tr_uv_wi_t, queue);
-            pc_assert(TR_UV_WI_IS_RESP(wi->type));
+        if (wi) {
+            tcp__release_resp_wi(tt, wi);
+        }
+    } else {
+        if (tt->config->lazy_decompression) {
+            pc_default_msg_lazy_body(&body, &msg, compressed, &tt->gzip, &tt->compress_policy);
+            payload = &body.raw;
+        }
+        pc_trans_fire_push_event(tt->client, msg.route, payload);
+    }
 
-            if (wi->req_id != msg.id)
-                continue;
+    pc_lib_free((char *)msg.route);
+    if (!msg.is_buf_borrowed) {
+        pc_buf_free(&msg.buf);
+    }
+}
 
-            QUEUE_REMOVE(q);
-            QUEUE_INIT(q);
+void tcp__on_data_recieved(tr_uv_tcp_transport_t* tt, const char* data, size_t len)
+{
+    tr_uv_tcp_transport_plugin_t* plugin = (tr_uv_tcp_transport_plugin_t* )tt->base.plugin((pc_transport_t*)tt);
 
-            pc_lib_free(wi->buf.base);
-            wi->buf.base = NULL;
-            wi->buf.len = 0;
+    /*
+     * Bodies are left compressed for the application, except for errors,
+     * which are handed to the callbacks in a pc_error_t.
+     */
+    if (tt->config->lazy_decompression && plugin->pr_msg_decoder == pr_default_msg_decoder) {
+        pc_buf_t pb;
+        int compressed = 0;
 
-            if (PC_IS_PRE_ALLOC(wi->type)) {
-                pc_mutex_lock(&tt->wq_mutex);
-                PC_PRE_ALLOC_SET_IDLE(wi->type);
-                pc_mutex_unlock(&tt->wq_mutex);
-            } else {
-                pc_lib_free(wi);
-            }
-            break;
+        pb.base = (uint8_t* )data;
+        pb.len = len;
+
+        pc_msg_t msg = pc_default_msg_decode_header(tt->code_to_route, &pb, &compressed);
+        if (msg.id != PC_INVALID_REQ_ID && compressed && msg.error) {
+            tcp__inflate_msg(tt, &tt->gzip, &msg);
+            compressed = 0;
         }
-    } else {
-        pc_trans_fire_push_event(tt->client, msg.route, &msg.buf);
+
+        tcp__on_msg_recieved(tt, msg, compressed);
+        pr_gzip_engine_trim(&tt->gzip);
+        return;
     }
 
-    pc_lib_free((char *)msg.route);
-    pc_buf_free(&msg.buf);
+    /*
+     * Once a message is queued for the thread pool the following ones have
+     * to queue behind it, so they are not dispatched out of order.
+     */
+    if (tcp__offload_enabled(tt)
+            && (len >= (size_t)tt->config->compression_offload_min_size
+                || !QUEUE_EMPTY(&tt->offload_recv_queue))) {
+        tcp__offload_recv(tt, data, len);
+        return;
+    }
+
+    if (plugin->pr_msg_decoder == pr_default_msg_decoder && tcp__decode_to_caller(tt, data, len)) {
+        return;
+    }
+
+    uv_buf_t buf;
+    buf.base = (char*)data;
+    buf.len = len;
+
+    pc_msg_t msg = plugin->pr_msg_decoder(tt, &buf);
+    tcp__on_msg_recieved(tt, msg, 0);
+    pr_gzip_engine_trim(&tt->gzip);
 }
 
 void tcp__on_kick_recieved(tr_uv_tcp_transport_t* tt)
@@ -984,6 +2168,17 @@ void tcp__send_handshake(tr_uv_tcp_transport_t* tt)
     pc_JSON_AddItemToObject(sys, "clientBuildNumber", pc_JSON_CreateString(pc_lib_client_build_number_str));
     pc_JSON_AddItemToObject(sys, "clientVersion", pc_JSON_CreateString(pc_lib_client_version_str));
 
+    if (!pr_dict_store_empty(&tt->compress_policy.dicts)) {
+        pc_JSON_AddItemToObject(sys, "dictionaries", pr_dict_store_handshake_ids(&tt->compress_policy.dicts));
+    }
+
+    if (!tt->config->disable_compression) {
+        pc_JSON* codecs = pr_codec_handshake_names(tt->config->compression_codecs);
+        if (codecs) {
+            pc_JSON_AddItemToObject(sys, "codecs", codecs);
+        }
+    }
+
     pc_JSON_AddItemToObject(body, "sys", sys);
 
     if (tt->handshake_opts) {
@@ -1051,21 +2246,28 @@ void tcp__on_handshake_resp(tr_uv_tcp_transport_t* tt, const char* data, size_t
     if (is_compressed((unsigned char*)data, len)) {
         char* uncompressed_data = NULL;
         size_t uncompressed_len;
-        pr_decompress((unsigned char**)&uncompressed_data, &uncompressed_len, (unsigned char*) data, len);
+        int ret = pr_decompress((unsigned char**)&uncompressed_data, &uncompressed_len, (unsigned char*) data, len);
 
-        if (uncompressed_data) {
+        if (ret == Z_OK) {
+            // pc_JSON_Parse expects a null terminated string.
+            uncompressed_data = (char*)pc_lib_realloc(uncompressed_data, uncompressed_len + 1);
+            uncompressed_data[uncompressed_len] = '\0';
             pc_lib_log(PC_LOG_INFO, "data: %.*s", uncompressed_len, uncompressed_data);
-            res = pc_JSON_Parse(uncompressed_data);
+            res = pc_JSON_ParseArena(uncompressed_data, NULL, 0);
             pc_lib_free(uncompressed_data);
         } else {
+            pc_lib_free(uncompressed_data);
             pc_lib_log(PC_LOG_ERROR, "tcp__on_handshake_resp - failed to uncompress handshake data");
         }
     } else {
         pc_lib_log(PC_LOG_INFO, "data: %.*s", len, data);
-        res = pc_JSON_Parse(data);
+        res = pc_JSON_ParseArena(data, NULL, 0);
     }
 
-    pc_lib_log(PC_LOG_INFO, "tcp__on_handshake_resp - tcp get handshake resp");
+    /* conn_start_time + last_conn_setup_us is when tcp connected */
+    tt->last_handshake_us = (uv_hrtime() - tt->conn_start_time) / 1000 - tt->last_conn_setup_us;
+    pc_lib_log(PC_LOG_INFO, "tcp__on_handshake_resp - tcp get handshake resp, %llu us after tcp connected",
+               (unsigned long long)tt->last_handshake_us);
 
     if (tt->config->conn_timeout != PC_WITHOUT_TIMEOUT) {
         uv_timer_stop(&tt->handshake_timer);
@@ -1083,7 +2285,7 @@ void tcp__on_handshake_resp(tr_uv_tcp_transport_t* tt, const char* data, size_t
     if (!tmp || tmp->type != pc_JSON_Number || (code = tmp->valueint) != PC_HANDSHAKE_OK) {
         pc_lib_log(PC_LOG_ERROR, "tcp__on_handshake_resp - handshake fail, code: %d", code);
         pc_trans_fire_event(tt->client, PC_EV_CONNECT_FAILED, "Handshake Error", NULL);
-        pc_JSON_Delete(res);
+        pc_JSON_DeleteArena(res);
         tt->reset_fn(tt);
         return ;
     }
@@ -1093,7 +2295,7 @@ void tcp__on_handshake_resp(tr_uv_tcp_transport_t* tt, const char* data, size_t
     if (!sys) {
         pc_lib_log(PC_LOG_ERROR, "tcp__on_handshake_resp - handshake fail, no sys field");
         pc_trans_fire_event(tt->client, PC_EV_CONNECT_FAILED, "Handshake Error", NULL);
-        pc_JSON_Delete(res);
+        pc_JSON_DeleteArena(res);
         tt->reset_fn(tt);
         return ;
     }
@@ -1146,10 +2348,21 @@ void tcp__on_handshake_resp(tr_uv_tcp_transport_t* tt, const char* data, size_t
         /* pc_JSON* code2route = pc_JSON_DetachItemFromObject(sys, "codeToRoute"); */
         pc_assert(tt->route_to_code && tt->code_to_route);
     }
-    pc_JSON_Delete(res);
+
+    /* preset dictionaries the server also knows */
+    pr_dict_store_accept(&tt->compress_policy.dicts, pc_JSON_GetObjectItem(sys, "dictionaries"));
+
+    /* compression codec chosen by the server, zlib if none */
+    tmp = pc_JSON_GetObjectItem(sys, "codec");
+    pr_gzip_engine_set_codec(&tt->gzip, pr_codec_negotiate(tt->config->compression_codecs,
+                             tmp && tmp->type == pc_JSON_String ? tmp->valuestring : NULL));
+    pr_gzip_engine_set_codec(&tt->offload_gzip, pr_gzip_engine_codec(&tt->gzip));
+    pc_lib_log(PC_LOG_INFO, "tcp__on_handshake_resp - compression codec: %s", pr_gzip_engine_codec(&tt->gzip)->name);
+
+    pc_JSON_DeleteArena(res);
     res = NULL;
 
-    if (tt->config->local_storage_cb && need_sync) {
+    if (tt->config->local_storage_cb && (need_sync || tt->ls_dirty)) {
         pc_JSON* lc = pc_JSON_CreateObject();
         char* data;
         size_t len;
@@ -1162,6 +2375,15 @@ void tcp__on_handshake_resp(tr_uv_tcp_transport_t* tt, const char* data, size_t
             pc_JSON_AddItemReferenceToObject(lc, TR_UV_LCK_CODE_2_ROUTE, tt->code_to_route);
         }
 
+        if (tt->compress_policy.dicts.ls_json) {
+            pc_JSON_AddItemReferenceToObject(lc, PR_DICT_LCK, tt->compress_policy.dicts.ls_json);
+        }
+
+        if (tt->ls_save_fn) {
+            tt->ls_save_fn(tt, lc);
+        }
+        tt->ls_dirty = 0;
+
         data = pc_JSON_PrintUnformatted(lc);
         pc_JSON_Delete(lc);
 
@@ -1190,10 +2412,27 @@ void tcp__on_handshake_resp(tr_uv_tcp_transport_t* tt, const char* data, size_t
     }
 
     tt->state = TR_UV_TCP_DONE;
+    if (tt->endpoints.count) {
+        tr_uv_endpoints_on_handshake(&tt->endpoints);
+    }
     pc_lib_log(PC_LOG_INFO, "tcp__on_handshake_resp - handshake completely");
+
+    /*
+     * the requests queued while connecting follow the ack, then those sent
+     * by the PC_EV_CONNECTED handlers, all of them in a single write (or a
+     * single TLS flight) issued right away instead of on the next loop
+     * iteration.
+     */
+    pc_mutex_lock(&tt->wq_mutex);
+    if (!QUEUE_EMPTY(&tt->conn_pending_queue)) {
+        QUEUE_ADD(&tt->write_wait_queue, &tt->conn_pending_queue);
+        QUEUE_INIT(&tt->conn_pending_queue);
+    }
+    pc_mutex_unlock(&tt->wq_mutex);
+
     pc_lib_log(PC_LOG_INFO, "tcp__on_handshake_resp - client connected");
     pc_trans_fire_event(tt->client, PC_EV_CONNECTED, NULL, NULL);
-    uv_async_send(&tt->write_async);
+    tt->write_async_cb(&tt->write_async);
 }
 
 void tcp__send_handshake_ack(tr_uv_tcp_transport_t* tt)
@@ -1241,8 +2480,303 @@ void tcp__send_handshake_ack(tr_uv_tcp_transport_t* tt)
 
     pc_mutex_unlock(&tt->wq_mutex);
 
-    uv_async_send(&tt->write_async);
+    /* the caller writes it, together with the requests waiting for it */
 }
 
-#undef GET_TT
+int tcp__offload_enabled(tr_uv_tcp_transport_t* tt)
+{
+    tr_uv_tcp_transport_plugin_t* plugin = (tr_uv_tcp_transport_plugin_t* )tt->base.plugin((pc_transport_t*)tt);
+
+    /* the jobs call the steps of the default message codec directly */
+    return tt->config->compression_offload_min_size > 0
+        && !tt->config->disable_compression
+        && plugin->pr_msg_encoder == pr_default_msg_encoder
+        && plugin->pr_msg_decoder == pr_default_msg_decoder;
+}
+
+tr_uv_offload_job_t* tcp__offload_job_new(tr_uv_tcp_transport_t* tt, const pc_msg_t* msg, int state)
+{
+    tr_uv_offload_job_t* job = (tr_uv_offload_job_t* )pc_lib_malloc(sizeof(tr_uv_offload_job_t));
+    memset(job, 0, sizeof(tr_uv_offload_job_t));
+
+    QUEUE_INIT(&job->queue);
+    job->req.data = job;
+    job->tt = tt;
+    job->state = state;
+    job->generation = tt->offload_generation;
+
+    if (msg) {
+        job->msg = *msg;
+        job->msg.route = msg->route ? pc_lib_strdup(msg->route) : NULL;
+        job->msg.buf = pc_buf_copy(&msg->buf);
+        job->msg.is_buf_borrowed = 0;
+    }
+
+    return job;
+}
+
+static void tcp__offload_job_free(tr_uv_offload_job_t* job)
+{
+    pc_lib_free((char* )job->msg.route);
+    if (!job->msg.is_buf_borrowed) {
+        pc_buf_free(&job->msg.buf);
+    }
+    pc_lib_free(job);
+}
+
+static void tcp__offload_send_work(uv_work_t* req)
+{
+    tr_uv_offload_job_t* job = (tr_uv_offload_job_t* )req->data;
+    tr_uv_tcp_transport_t* tt = job->tt;
+    bool compressed = false;
+
+    pc_buf_t body = pc_default_msg_encode_body(&tt->offload_gzip, &tt->compress_policy, &job->msg, &compressed);
+
+    pc_buf_free(&job->msg.buf);
+    job->msg.buf = body;
+    job->compressed = compressed;
+
+    pr_compress_policy_record_offload(&tt->compress_policy);
+}
+
+static void tcp__offload_send_done(uv_work_t* req, int status)
+{
+    tr_uv_offload_job_t* job = (tr_uv_offload_job_t* )req->data;
+    tr_uv_tcp_transport_t* tt = job->tt;
+    uv_buf_t pkg_buf;
+
+    pkg_buf.base = NULL;
+    pkg_buf.len = 0;
+
+    /* cancelled with the loop closing, the body was never encoded */
+    if (status == UV_ECANCELED) {
+        job->error = 1;
+    }
+
+    /* the write item of a job from before a reset is reset by the pump */
+    if (job->generation == tt->offload_generation && !job->error) {
+        pc_buf_t msg_buf = pc_default_msg_encode_header(tt->route_to_code, &job->msg, job->msg.buf, job->compressed);
+        if (msg_buf.base) {
+            pkg_buf = pc_pkg_encode(PC_PKG_DATA, (const char* )msg_buf.base, msg_buf.len);
+            pc_lib_free(msg_buf.base);
+        }
+
+        if (!pkg_buf.base) {
+            pc_lib_log(PC_LOG_ERROR, "tcp__offload_send_done - encode msg failed, route: %s", job->msg.route);
+            job->error = 1;
+        }
+    }
+
+    pc_mutex_lock(&tt->wq_mutex);
+    job->wi->buf = pkg_buf;
+    job->state = TR_UV_OFFLOAD_DONE;
+    pc_mutex_unlock(&tt->wq_mutex);
+
+    tcp__offload_pump_send(tt);
+}
+
+void tcp__offload_pump_send(tr_uv_tcp_transport_t* tt)
+{
+    QUEUE* q;
+    tr_uv_offload_job_t* job;
+    int need_write = 0;
+
+    pc_mutex_lock(&tt->wq_mutex);
+    while (!QUEUE_EMPTY(&tt->offload_send_queue)) {
+        q = QUEUE_HEAD(&tt->offload_send_queue);
+        job = (tr_uv_offload_job_t* )QUEUE_DATA(q, tr_uv_offload_job_t, queue);
+
+        if (job->state == TR_UV_OFFLOAD_RUNNING) {
+            break;
+        }
+
+        if (job->state == TR_UV_OFFLOAD_PENDING) {
+            job->state = TR_UV_OFFLOAD_RUNNING;
+            uv_queue_work(&tt->uv_loop, &job->req, tcp__offload_send_work, tcp__offload_send_done);
+            break;
+        }
+
+        QUEUE_REMOVE(q);
+
+        if (job->generation != tt->offload_generation) {
+            tcp__reset_wi(tt->client, job->wi);
+        } else if (job->error) {
+            pc_error_t err = pc__error_local();
+            tcp__fail_wi(tt->client, job->wi, &err);
+        } else {
+            /* the same queue tr_uv_tcp_send would have picked */
+            QUEUE_INIT(&job->wi->queue);
+            if (tt->state == TR_UV_TCP_DONE) {
+                QUEUE_INSERT_TAIL(&tt->write_wait_queue, &job->wi->queue);
+            } else {
+                QUEUE_INSERT_TAIL(&tt->conn_pending_queue, &job->wi->queue);
+            }
+            need_write = 1;
+        }
+
+        tcp__offload_job_free(job);
+    }
+    pc_mutex_unlock(&tt->wq_mutex);
+
+    if (need_write && tt->state != TR_UV_TCP_NOT_CONN) {
+        uv_async_send(&tt->write_async);
+    }
+}
+
+void tcp__offload_async_cb(uv_async_t* a)
+{
+    GET_TT(a);
+
+    pc_assert(a == &tt->offload_async);
+    tcp__offload_pump_send(tt);
+}
+
+static void tcp__offload_recv_work(uv_work_t* req)
+{
+    tr_uv_offload_job_t* job = (tr_uv_offload_job_t* )req->data;
+    tr_uv_tcp_transport_t* tt = job->tt;
+
+    job->error = pc_default_msg_inflate(&tt->offload_gzip, &tt->compress_policy, &job->msg);
+    if (!job->error) {
+        pr_compress_policy_record_offload(&tt->compress_policy);
+    }
+}
+
+static void tcp__offload_recv_done(uv_work_t* req, int status)
+{
+    tr_uv_offload_job_t* job = (tr_uv_offload_job_t* )req->data;
+    tr_uv_tcp_transport_t* tt = job->tt;
+
+    /* cancelled with the loop closing, the message is dropped like after a reset */
+    if (job->generation != tt->offload_generation || status == UV_ECANCELED) {
+        QUEUE_REMOVE(&job->queue);
+        tcp__offload_job_free(job);
+    } else if (job->error) {
+        QUEUE_REMOVE(&job->queue);
+        tcp__offload_job_free(job);
+        pc_lib_log(PC_LOG_ERROR, "tcp__offload_recv_done - decode error, will reconn");
+        pc_trans_fire_event(tt->client, PC_EV_PROTO_ERROR, "Decode Error", NULL);
+        tt->reconn_fn(tt);
+        return;
+    } else {
+        job->state = TR_UV_OFFLOAD_DONE;
+    }
+
+    tcp__offload_pump_recv(tt);
+}
+
+void tcp__offload_pump_recv(tr_uv_tcp_transport_t* tt)
+{
+    QUEUE* q;
+    tr_uv_offload_job_t* job;
+    pc_msg_t msg;
+
+    while (!QUEUE_EMPTY(&tt->offload_recv_queue)) {
+        q = QUEUE_HEAD(&tt->offload_recv_queue);
+        job = (tr_uv_offload_job_t* )QUEUE_DATA(q, tr_uv_offload_job_t, queue);
+
+        if (job->state == TR_UV_OFFLOAD_RUNNING) {
+            return;
+        }
+
+        if (job->state == TR_UV_OFFLOAD_PENDING) {
+            /* no job is running, so the pooled buffer of the last one is free */
+            pr_gzip_engine_trim(&tt->offload_gzip);
+            job->state = TR_UV_OFFLOAD_RUNNING;
+            uv_queue_work(&tt->uv_loop, &job->req, tcp__offload_recv_work, tcp__offload_recv_done);
+            return;
+        }
+
+        QUEUE_REMOVE(q);
+        msg = job->msg;
+        pc_lib_free(job);
+
+        /* the message may reset the transport, which drops the jobs left in the queue */
+        tcp__on_msg_recieved(tt, msg, 0);
+    }
+
+    pr_gzip_engine_trim(&tt->offload_gzip);
+}
+
+void tcp__offload_recv(tr_uv_tcp_transport_t* tt, const char* data, size_t len)
+{
+    tr_uv_offload_job_t* job;
+    pc_buf_t buf;
+    int compressed = 0;
+    int offload;
+
+    buf.base = (uint8_t* )data;
+    buf.len = len;
+
+    pc_msg_t msg = pc_default_msg_decode_header(tt->code_to_route, &buf, &compressed);
+    if (msg.id == PC_INVALID_REQ_ID) {
+        tcp__on_msg_recieved(tt, msg, 0);
+        return;
+    }
+
+    offload = compressed && msg.buf.len >= tt->config->compression_offload_min_size;
+
+    if (compressed && !offload) {
+        tcp__inflate_msg(tt, &tt->gzip, &msg);
+        if (msg.id == PC_INVALID_REQ_ID) {
+            tcp__on_msg_recieved(tt, msg, 0);
+            return;
+        }
+    }
+
+    if (!offload && QUEUE_EMPTY(&tt->offload_recv_queue)) {
+        tcp__on_msg_recieved(tt, msg, 0);
+        pr_gzip_engine_trim(&tt->gzip);
+        return;
+    }
+
+    /* the body is borrowed from the read buffer or the engine, the job keeps a copy */
+    job = tcp__offload_job_new(tt, &msg, offload ? TR_UV_OFFLOAD_PENDING : TR_UV_OFFLOAD_DONE);
+    pc_lib_free((char* )msg.route);
+    pr_gzip_engine_trim(&tt->gzip);
+
+    QUEUE_INSERT_TAIL(&tt->offload_recv_queue, &job->queue);
+    tcp__offload_pump_recv(tt);
+}
+
+void tcp__offload_drop(tr_uv_tcp_transport_t* tt)
+{
+    QUEUE* q;
+    QUEUE* next;
+    tr_uv_offload_job_t* job;
+
+    /*
+     * Running jobs can not be taken back from the thread pool, they are
+     * left in their queues and discarded when they finish.
+     */
+    tt->offload_generation++;
+
+    pc_mutex_lock(&tt->wq_mutex);
+    q = QUEUE_HEAD(&tt->offload_send_queue);
+    while (q != &tt->offload_send_queue) {
+        next = QUEUE_NEXT(q);
+        job = (tr_uv_offload_job_t* )QUEUE_DATA(q, tr_uv_offload_job_t, queue);
+        if (job->state != TR_UV_OFFLOAD_RUNNING) {
+            QUEUE_REMOVE(q);
+            /* reset together with the other write items by tcp__reset */
+            QUEUE_INIT(&job->wi->queue);
+            QUEUE_INSERT_TAIL(&tt->writing_queue, &job->wi->queue);
+            tcp__offload_job_free(job);
+        }
+        q = next;
+    }
+    pc_mutex_unlock(&tt->wq_mutex);
+
+    q = QUEUE_HEAD(&tt->offload_recv_queue);
+    while (q != &tt->offload_recv_queue) {
+        next = QUEUE_NEXT(q);
+        job = (tr_uv_offload_job_t* )QUEUE_DATA(q, tr_uv_offload_job_t, queue);
+        if (job->state != TR_UV_OFFLOAD_RUNNING) {
+            QUEUE_REMOVE(q);
+            tcp__offload_job_free(job);
+        }
+        q = next;
+    }
+}
 
+#undef GET_TT
@@ -10,14 +10,33 @@
 
 void tcp__reset(tr_uv_tcp_transport_t* trans);
 void tcp__reconn(tr_uv_tcp_transport_t* trans);
+void tcp__use_endpoint(tr_uv_tcp_transport_t* tt, int index);
 
+void tcp__dns_opts(const tr_uv_tcp_transport_t* tt, tr_uv_dns_opts_t* opts);
 void tcp__conn_async_cb(uv_async_t* t);
 void tcp__conn_timeout_cb(uv_timer_t* t);
 void tcp__conn_done_cb(uv_connect_t* conn, int status);
 void tcp__reconn_delay_timer_cb(uv_timer_t* t);
 
+/**
+ * Frees the package of a write item and drops its prepared message.
+ * tcp__wi_flatten copies the wire image of a prepared message after the
+ * package header, for writers that need a single buffer per write item.
+ */
+void tcp__wi_release_buf(tr_uv_wi_t* wi);
+void tcp__wi_flatten(tr_uv_wi_t* wi);
+
 void tcp__write_async_cb(uv_async_t* a);
 void tcp__write_done_cb(uv_write_t* w, int status);
+/* completes the writing queue, `status` is 0 or a uv error code */
+void tcp__on_write_done(tr_uv_tcp_transport_t* tt, int status);
+
+/**
+ * Accounts a write of the writing queue handed to the socket, `len` bytes
+ * long, the first one carrying a request or notify since the connect call
+ * sets first_send_us.
+ */
+void tcp__on_socket_write(tr_uv_tcp_transport_t* tt, size_t len);
 
 void tcp__write_check_timeout_cb(uv_timer_t* timer);
 int tcp__check_queue_timeout(QUEUE* ql, pc_client_t* client, int cont);
@@ -35,9 +54,20 @@ void tcp__on_handshake_resp(tr_uv_tcp_transport_t* tt, const char* data, size_t
 void tcp__send_handshake_ack(tr_uv_tcp_transport_t* tt);
 
 void tcp__on_tcp_read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf);
+/* the connection failed or was closed by the server, `err` is a uv error code */
+void tcp__on_read_error(tr_uv_tcp_transport_t* tt, int err);
 void tcp__alloc_cb(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf);
 
 void tcp__on_data_recieved(tr_uv_tcp_transport_t* tt, const char* data, size_t len);
+int tcp__on_data_chunk(const char* data, size_t len, size_t offset, size_t pkg_len, void* ex_data);
 void tcp__on_kick_recieved(tr_uv_tcp_transport_t* tt);
 
+int tcp__offload_enabled(tr_uv_tcp_transport_t* tt);
+tr_uv_offload_job_t* tcp__offload_job_new(tr_uv_tcp_transport_t* tt, const pc_msg_t* msg, int state);
+void tcp__offload_async_cb(uv_async_t* a);
+void tcp__offload_pump_send(tr_uv_tcp_transport_t* tt);
+void tcp__offload_pump_recv(tr_uv_tcp_transport_t* tt);
+void tcp__offload_recv(tr_uv_tcp_transport_t* tt, const char* data, size_t len);
+void tcp__offload_drop(tr_uv_tcp_transport_t* tt);
+
 #endif /* TR_UV_TCP_AUX_H */
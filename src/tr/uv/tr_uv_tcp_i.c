@@ -20,6 +20,7 @@
 #include "tr_uv_tcp.h"
 #include "tr_uv_tcp_i.h"
 #include "tr_uv_tcp_aux.h"
+#include "tr_uv_rbuf.h"
 
 #define GET_TT tr_uv_tcp_transport_t* tt = (tr_uv_tcp_transport_t*)trans; pc_assert(tt)
 
@@ -31,7 +32,12 @@ pc_transport_t* tr_uv_tcp_create(pc_transport_plugin_t* plugin)
 
     (void)plugin; /* unused */
     tt->base.connect = tr_uv_tcp_connect;
+    tt->base.connect_endpoints = tr_uv_tcp_connect_endpoints;
+    tt->base.endpoint_health = tr_uv_tcp_endpoint_health;
     tt->base.send = tr_uv_tcp_send;
+    tt->base.send_with_opts = tr_uv_tcp_send_with_opts;
+    tt->base.send_prepared = tr_uv_tcp_send_prepared;
+    tt->base.stats = tr_uv_tcp_stats;
     tt->base.disconnect = tr_uv_tcp_disconnect;
     tt->base.cleanup = tr_uv_tcp_cleanup;
     tt->base.quality = tr_uv_tcp_quality;
@@ -47,6 +53,7 @@ pc_transport_t* tr_uv_tcp_create(pc_transport_plugin_t* plugin)
     tt->write_async_cb = tcp__write_async_cb;
     tt->cleanup_async_cb = tcp__cleanup_async_cb;
     tt->write_check_timeout_cb = tcp__write_check_timeout_cb;
+    tt->alloc_cb = tcp__alloc_cb;
     tt->on_tcp_read_cb = tcp__on_tcp_read_cb;
 
     return (pc_transport_t* )tt;
@@ -66,11 +73,15 @@ void tr_uv_tcp_plugin_on_register(pc_transport_plugin_t* plugin)
     h.malloc_fn = pc_lib_malloc;
     h.free_fn = pc_lib_free;
     pc_JSON_InitHooks(&h);
+    tr_uv_dns_init();
+    tr_uv_rbuf_init();
 }
 
 void tr_uv_tcp_plugin_on_deregister(pc_transport_plugin_t* plugin)
 {
     (void)plugin; /* unused */
+    tr_uv_dns_cleanup();
+    tr_uv_rbuf_cleanup();
 }
 
 static void tr_uv_tcp_thread_fn(void* arg)
@@ -127,6 +138,7 @@ int tr_uv_tcp_init(pc_transport_t* trans, pc_client_t* client)
 {
     int i;
     int ret;
+    int level;
     tr_uv_wi_t* wi;
     GET_TT;
 
@@ -184,6 +196,22 @@ int tr_uv_tcp_init(pc_transport_t* trans, pc_client_t* client)
     pc_assert(!ret);
     tt->write_async.data = tt;
 
+    level = tt->config->compression_level;
+    if (level < 0 || level > Z_BEST_COMPRESSION) {
+        pc_lib_log(PC_LOG_WARN, "tr_uv_tcp_init - invalid compression level %d, using the default", level);
+        level = 0;
+    }
+    pr_gzip_engine_init(&tt->gzip, level ? level : Z_DEFAULT_COMPRESSION);
+    pr_gzip_engine_init(&tt->offload_gzip, level ? level : Z_DEFAULT_COMPRESSION);
+    pr_compress_policy_init(&tt->compress_policy, tt->config);
+
+    tt->offload_async.data = tt;
+    ret = uv_async_init(&tt->uv_loop, &tt->offload_async, tcp__offload_async_cb);
+    pc_assert(!ret);
+    QUEUE_INIT(&tt->offload_send_queue);
+    QUEUE_INIT(&tt->offload_recv_queue);
+    tt->offload_generation = 0;
+
     QUEUE_INIT(&tt->conn_pending_queue);
     QUEUE_INIT(&tt->write_wait_queue);
     QUEUE_INIT(&tt->writing_queue);
@@ -198,6 +226,30 @@ int tr_uv_tcp_init(pc_transport_t* trans, pc_client_t* client)
     }
     tt->is_writing = 0;
     tt->is_connecting = 0;
+    tt->dns_req = NULL;
+    tt->dns_lookups = 0;
+    tt->dns_cache_hits = 0;
+
+    tt->attempts = NULL;
+    tt->race_addrs = NULL;
+    tt->race_count = 0;
+    tt->race_next = 0;
+    tt->race_pending = 0;
+    tt->race_error = 0;
+    ret = uv_timer_init(&tt->uv_loop, &tt->race_timer);
+    pc_assert(!ret);
+    tt->race_timer.data = tt;
+    tt->conn_start_time = 0;
+    tt->conn_attempts = 0;
+    tt->last_conn_setup_us = 0;
+    tt->connect_call_time = 0;
+    tt->first_send_us = 0;
+    tt->last_handshake_us = 0;
+    tt->socket_writes = 0;
+    tt->socket_bytes = 0;
+    memset(&tt->sockopt, 0, sizeof(tr_uv_sockopt_t));
+    tr_uv_endpoints_init(&tt->endpoints);
+    tt->endpoint_failovers = 0;
 
     ret = uv_timer_init(&tt->uv_loop, &tt->check_timeout);
     pc_assert(!ret);
@@ -217,9 +269,11 @@ int tr_uv_tcp_init(pc_transport_t* trans, pc_client_t* client)
 
     tt->hb_timer.data = tt;
     tt->hb_rtt = -1;
+    tt->hb_sent_time = 0;
     tt->last_server_packet_time = uv_now(&tt->uv_loop);
 
     pc_pkg_parser_init(&tt->pkg_parser, tr_tcp_on_pkg_handler, tt);
+    pc_pkg_parser_set_chunk_handler(&tt->pkg_parser, tcp__on_data_chunk);
 
     tt->route_to_code = NULL;
     tt->code_to_route = NULL;
@@ -237,8 +291,9 @@ int tr_uv_tcp_init(pc_transport_t* trans, pc_client_t* client)
             size_t len2;
 
             pc_assert(len > 0);
-            buf = (char* )pc_lib_malloc(len);
-            memset(buf, 0, len);
+            /* the stored json is not null terminated */
+            buf = (char* )pc_lib_malloc(len + 1);
+            memset(buf, 0, len + 1);
 
             ret = tt->config->local_storage_cb(PC_LOCAL_STORAGE_OP_READ, buf,
                     &len2, tt->config->ls_ex_data);
@@ -258,6 +313,12 @@ int tr_uv_tcp_init(pc_transport_t* trans, pc_client_t* client)
             tt->route_to_code = pc_JSON_DetachItemFromObject(lc, TR_UV_LCK_ROUTE_2_CODE);
             tt->code_to_route = pc_JSON_DetachItemFromObject(lc, TR_UV_LCK_CODE_2_ROUTE);
 
+            pr_dict_store_load(&tt->compress_policy.dicts, pc_JSON_DetachItemFromObject(lc, PR_DICT_LCK));
+
+            if (tt->ls_load_fn) {
+                tt->ls_load_fn(tt, lc);
+            }
+
             /* the local dict is complete */
             if (!tt->code_to_route || !tt->route_to_code) {
                 pc_JSON_Delete(tt->code_to_route);
@@ -271,6 +332,17 @@ int tr_uv_tcp_init(pc_transport_t* trans, pc_client_t* client)
     }
 
 next:
+    if (tt->config->dns_preresolve_hosts) {
+        tr_uv_dns_opts_t dns_opts;
+        const char* const* host;
+
+        /* the loop is not running yet, the lookups finish once it starts */
+        tcp__dns_opts(tt, &dns_opts);
+        for (host = tt->config->dns_preresolve_hosts; *host; ++host) {
+            tr_uv_dns_resolve(&tt->uv_loop, *host, &dns_opts, NULL, NULL, NULL);
+        }
+    }
+
     uv_thread_create(&tt->worker, tr_uv_tcp_thread_fn, &tt->uv_loop);
 
     return PC_RC_OK;
@@ -279,12 +351,9 @@ next:
 /**
  * uv_async_send always return 0
  */
-int tr_uv_tcp_connect(pc_transport_t* trans, const char* host, int port, const char* handshake_opts)
+static int tcp__set_handshake_opts(tr_uv_tcp_transport_t* tt, const char* handshake_opts)
 {
     pc_JSON* handshake;
-    GET_TT;
-
-    pc_assert(host);
 
     if (tt->handshake_opts) {
         pc_JSON_Delete(tt->handshake_opts);
@@ -299,6 +368,20 @@ int tr_uv_tcp_connect(pc_transport_t* trans, const char* host, int port, const c
         }
         tt->handshake_opts = handshake;
     }
+    return PC_RC_OK;
+}
+
+int tr_uv_tcp_connect(pc_transport_t* trans, const char* host, int port, const char* handshake_opts)
+{
+    int ret;
+    GET_TT;
+
+    pc_assert(host);
+
+    ret = tcp__set_handshake_opts(tt, handshake_opts);
+    if (ret != PC_RC_OK) {
+        return ret;
+    }
 
     if (tt->host) {
         pc_lib_free((char* )tt->host);
@@ -307,50 +390,75 @@ int tr_uv_tcp_connect(pc_transport_t* trans, const char* host, int port, const c
 
     tt->host = pc_lib_strdup(host);
     tt->port = port;
+    tr_uv_endpoints_clear(&tt->endpoints);
 
+    tt->connect_call_time = uv_hrtime();
     uv_async_send(&tt->conn_async);
     return PC_RC_OK;
 }
 
-int tr_uv_tcp_send(pc_transport_t* trans, const char* route, unsigned int seq_num, pc_buf_t buf, unsigned int req_id, int timeout)
+int tr_uv_tcp_connect_endpoints(pc_transport_t* trans, const pc_endpoint_t* endpoints, int count, const char* handshake_opts)
 {
-    pc_lib_log(PC_LOG_DEBUG, "tr_uv_tcp_send - ENTERED");
-
-    int i;
-    tr_uv_wi_t* wi;
+    uint64_t wait_ms;
+    int ret;
     GET_TT;
 
-    if (tt->state == TR_UV_TCP_NOT_CONN) {
-        return PC_RC_INVALID_STATE;
-    }
+    pc_assert(endpoints && count > 0);
 
-    pc_assert(trans && route && req_id != PC_INVALID_REQ_ID);
+    ret = tcp__set_handshake_opts(tt, handshake_opts);
+    if (ret != PC_RC_OK) {
+        return ret;
+    }
 
-    pc_msg_t m;
-    m.id = req_id;
-    m.buf = buf;
-    m.route = route;
+    /* every endpoint starts healthy */
+    tr_uv_endpoints_set(&tt->endpoints, endpoints, count);
+    tcp__use_endpoint(tt, tr_uv_endpoints_pick(&tt->endpoints, 0, &wait_ms));
 
-    uv_buf_t uv_buf = ((tr_uv_tcp_transport_plugin_t*)tr_uv_tcp_plugin((pc_transport_t*)tt))->pr_msg_encoder(tt, &m);
+    tt->connect_call_time = uv_hrtime();
+    uv_async_send(&tt->conn_async);
+    return PC_RC_OK;
+}
 
-    pc_lib_log(PC_LOG_DEBUG, "tr_uv_tcp_send - encoded msg length = %lu", uv_buf.len);
+int tr_uv_tcp_endpoint_health(pc_transport_t* trans, int index, pc_endpoint_health_t* health)
+{
+    GET_TT;
 
-    if (uv_buf.len == (unsigned int)-1) {
-        pc_assert(uv_buf.base == NULL && "uv_buf should be empty here");
-        pc_lib_log(PC_LOG_ERROR, "tr_uv_tcp_send - encode msg failed, route: %s", route);
-        return PC_RC_ERROR;
-    }
+    /* the loop time is uv_hrtime in milliseconds, uv_now is of the loop thread */
+    return tr_uv_endpoints_health(&tt->endpoints, index, uv_hrtime() / 1000000, health);
+}
 
-    uv_buf_t pkg_buf = pc_pkg_encode(PC_PKG_DATA, uv_buf.base, uv_buf.len);
+int tr_uv_tcp_send(pc_transport_t* trans, const char* route, unsigned int seq_num, pc_buf_t buf, unsigned int req_id, int timeout)
+{
+    return tr_uv_tcp_send_with_opts(trans, route, seq_num, buf, req_id, timeout, NULL);
+}
 
-    pc_lib_log(PC_LOG_DEBUG, "tr_uv_tcp_send - encoded pkg length = %lu", pkg_buf.len);
+static int tcp__compression_negotiated(tr_uv_tcp_transport_t* tt)
+{
+    return (tt->config->compression_codecs && strcmp(tt->config->compression_codecs, PR_CODEC_ZLIB) != 0)
+        || !pr_dict_store_empty(&tt->compress_policy.dicts);
+}
 
-    pc_lib_free(uv_buf.base);
+/*
+ * Requests and notifies sent right after pc_client_connect, before the loop
+ * starts connecting, or while waiting to reconnect wait in the conn pending
+ * queue like those sent while connecting.
+ */
+static int tcp__can_send(tr_uv_tcp_transport_t* tt)
+{
+    return tt->state != TR_UV_TCP_NOT_CONN || pc_client_state(tt->client) == PC_ST_CONNECTING;
+}
 
-    if (pkg_buf.len == (unsigned int)-1) {
-        pc_lib_log(PC_LOG_ERROR, "tr_uv_tcp_send - encode package failed");
-        return PC_RC_ERROR;
-    }
+/*
+ * Queues the package of a request or notify for writing. `job` is the
+ * pending offload job compressing its body, if any, and `prepared` the
+ * prepared message whose wire image follows the package header.
+ */
+static int tcp__queue_send(tr_uv_tcp_transport_t* tt, uv_buf_t pkg_buf, tr_uv_offload_job_t* job,
+                           pc_prepared_msg_t* prepared, unsigned int seq_num, unsigned int req_id,
+                           int timeout, const pc_request_opts_t* opts)
+{
+    int i;
+    tr_uv_wi_t* wi;
 
     wi = NULL;
     pc_mutex_lock(&tt->wq_mutex);
@@ -372,8 +480,17 @@ int tr_uv_tcp_send(pc_transport_t* trans, const char* route, unsigned int seq_nu
 
     QUEUE_INIT(&wi->queue);
 
-    /* if not done, push it to connecting queue. */
-    if (tt->state == TR_UV_TCP_DONE) {
+    /* messages can not overtake the ones being compressed on the thread pool */
+    if (!job && !QUEUE_EMPTY(&tt->offload_send_queue)) {
+        job = tcp__offload_job_new(tt, NULL, TR_UV_OFFLOAD_DONE);
+    }
+
+    if (job) {
+        job->wi = wi;
+        QUEUE_INSERT_TAIL(&tt->offload_send_queue, &job->queue);
+        pc_lib_log(PC_LOG_DEBUG, "tr_uv_tcp_send - put to offload queue, seq_num: %u, req_id: %u", seq_num, req_id);
+    } else if (tt->state == TR_UV_TCP_DONE) {
+        /* if not done, push it to connecting queue. */
         QUEUE_INSERT_TAIL(&tt->write_wait_queue, &wi->queue);
         pc_lib_log(PC_LOG_DEBUG, "tr_uv_tcp_send - put to write wait queue, seq_num: %u, req_id: %u", seq_num, req_id);
     } else {
@@ -388,21 +505,137 @@ int tr_uv_tcp_send(pc_transport_t* trans, const char* route, unsigned int seq_nu
     }
 
     wi->buf = pkg_buf;
+    wi->prepared = prepared;
     wi->seq_num = seq_num;
     wi->req_id = req_id;
     wi->timeout = timeout;
     wi->ts = time(NULL);
+    wi->stream = opts && (opts->chunk_cb || opts->chunk_fd >= 0);
+    wi->stream_fd = opts ? opts->chunk_fd : -1;
+    wi->caller_buf = opts && (opts->resp_buf || opts->resp_alloc);
 
     pc_lib_log(PC_LOG_DEBUG, "tr_uv_tcp_send - seq num: %u, req_id: %u, length: %lu", seq_num, req_id, wi->buf.len);
     pc_mutex_unlock(&tt->wq_mutex);
 
-    if (tt->state == TR_UV_TCP_CONNECTING || tt->state == TR_UV_TCP_HANDSHAKEING || tt->state == TR_UV_TCP_DONE) {
+    if (job) {
+        uv_async_send(&tt->offload_async);
+    } else if (tt->state == TR_UV_TCP_CONNECTING || tt->state == TR_UV_TCP_HANDSHAKEING || tt->state == TR_UV_TCP_DONE) {
         uv_async_send(&tt->write_async);
     }
 
     return PC_RC_OK;
 }
 
+int tr_uv_tcp_send_with_opts(pc_transport_t* trans, const char* route, unsigned int seq_num, pc_buf_t buf,
+                             unsigned int req_id, int timeout, const pc_request_opts_t* opts)
+{
+    pc_lib_log(PC_LOG_DEBUG, "tr_uv_tcp_send - ENTERED");
+
+    tr_uv_offload_job_t* job = NULL;
+    uv_buf_t pkg_buf;
+    GET_TT;
+
+    if (!tcp__can_send(tt)) {
+        return PC_RC_INVALID_STATE;
+    }
+
+    pc_assert(trans && route && req_id != PC_INVALID_REQ_ID);
+
+    pc_msg_t m;
+    m.id = req_id;
+    m.buf = buf;
+    m.route = route;
+    m.error = 0;
+    m.is_buf_borrowed = 0;
+    m.compression = opts ? opts->compression : PC_COMPRESSION_AUTO;
+
+    /*
+     * The codec and the dictionaries the server knows are only settled by the
+     * handshake, so bodies queued before it can only be compressed when plain
+     * zlib is the only option.
+     */
+    if (tt->state != TR_UV_TCP_DONE && tcp__compression_negotiated(tt)) {
+        m.compression = PC_COMPRESSION_NEVER;
+    }
+
+    /*
+     * Large bodies are compressed on the thread pool, the message is encoded
+     * when the job finishes, see tcp__offload_pump_send.
+     */
+    if (tcp__offload_enabled(tt) && buf.len >= tt->config->compression_offload_min_size) {
+        job = tcp__offload_job_new(tt, &m, TR_UV_OFFLOAD_PENDING);
+        pkg_buf.base = NULL;
+        pkg_buf.len = 0;
+    } else {
+        uv_buf_t uv_buf = ((tr_uv_tcp_transport_plugin_t*)tr_uv_tcp_plugin((pc_transport_t*)tt))->pr_msg_encoder(tt, &m);
+
+        pc_lib_log(PC_LOG_DEBUG, "tr_uv_tcp_send - encoded msg length = %lu", uv_buf.len);
+
+        if (uv_buf.len == (unsigned int)-1) {
+            pc_assert(uv_buf.base == NULL && "uv_buf should be empty here");
+            pc_lib_log(PC_LOG_ERROR, "tr_uv_tcp_send - encode msg failed, route: %s", route);
+            return PC_RC_ERROR;
+        }
+
+        pkg_buf = pc_pkg_encode(PC_PKG_DATA, uv_buf.base, uv_buf.len);
+
+        pc_lib_log(PC_LOG_DEBUG, "tr_uv_tcp_send - encoded pkg length = %lu", pkg_buf.len);
+
+        pc_lib_free(uv_buf.base);
+
+        if (pkg_buf.len == (unsigned int)-1) {
+            pc_lib_log(PC_LOG_ERROR, "tr_uv_tcp_send - encode package failed");
+            return PC_RC_ERROR;
+        }
+    }
+
+    return tcp__queue_send(tt, pkg_buf, job, NULL, seq_num, req_id, timeout, opts);
+}
+
+int tr_uv_tcp_send_prepared(pc_transport_t* trans, pc_prepared_msg_t* prepared, unsigned int seq_num,
+                            unsigned int req_id, int timeout)
+{
+    const pc_buf_t* wire;
+    uv_buf_t pkg_buf;
+    size_t head_len;
+    int compressed;
+    GET_TT;
+
+    if (!tcp__can_send(tt)) {
+        return PC_RC_INVALID_STATE;
+    }
+
+    pc_assert(prepared && req_id != PC_INVALID_REQ_ID);
+
+    wire = pc_prepared_msg_wire(prepared, &compressed);
+    if (!wire) {
+        return PC_RC_ERROR;
+    }
+
+    /* the image is compressed with plain zlib, see tr_uv_tcp_send_with_opts */
+    if (compressed && ((tt->config->disable_compression && prepared->opts.compression != PC_COMPRESSION_ALWAYS)
+                || pr_gzip_engine_codec(&tt->gzip) != &pr_codec_zlib
+                || (tt->state != TR_UV_TCP_DONE && tcp__compression_negotiated(tt)))) {
+        return tr_uv_tcp_send_with_opts(trans, prepared->route, seq_num, prepared->body,
+                                        req_id, timeout, &prepared->opts);
+    }
+
+    pkg_buf.base = (char* )pc_lib_malloc(PC_PKG_HEAD_BYTES + PC_PREPARED_MSG_HEAD_MAX_BYTES);
+    head_len = pc_prepared_msg_encode_head(req_id, compressed, (uint8_t* )pkg_buf.base + PC_PKG_HEAD_BYTES);
+
+    if (head_len + (size_t)wire->len > PC_PKG_MAX_BODY_BYTES - 1) {
+        pc_lib_log(PC_LOG_ERROR, "tr_uv_tcp_send_prepared - message too big, route: %s", prepared->route);
+        pc_lib_free(pkg_buf.base);
+        return PC_RC_ERROR;
+    }
+
+    pc_pkg_encode_head(PC_PKG_DATA, head_len + (size_t)wire->len, pkg_buf.base);
+    pkg_buf.len = PC_PKG_HEAD_BYTES + head_len;
+
+    pc__prepared_msg_retain(prepared);
+    return tcp__queue_send(tt, pkg_buf, NULL, prepared, seq_num, req_id, timeout, &prepared->opts);
+}
+
 int tr_uv_tcp_disconnect(pc_transport_t* trans)
 {
     GET_TT;
@@ -439,6 +672,10 @@ int tr_uv_tcp_cleanup(pc_transport_t* trans)
     }
 
     pc_mutex_destroy(&tt->wq_mutex);
+    pr_gzip_engine_cleanup(&tt->gzip);
+    pr_gzip_engine_cleanup(&tt->offload_gzip);
+    pr_compress_policy_cleanup(&tt->compress_policy);
+    tr_uv_endpoints_cleanup(&tt->endpoints);
 
     // After the thread exits, run pending close callbacks to avoid
     // memory leaks.
@@ -449,6 +686,12 @@ int tr_uv_tcp_cleanup(pc_transport_t* trans)
         return PC_RC_ERROR;
     }
 
+    /* the attempts are closed, their close callbacks ran with the loop */
+    pc_lib_free(tt->attempts);
+    pc_lib_free(tt->race_addrs);
+    tt->attempts = NULL;
+    tt->race_addrs = NULL;
+
     return PC_RC_OK;
 }
 
@@ -466,6 +709,31 @@ int tr_uv_tcp_quality(pc_transport_t* trans)
     return tt->hb_rtt;
 }
 
+int tr_uv_tcp_stats(pc_transport_t* trans, pc_client_stats_t* stats)
+{
+    GET_TT;
+
+    pr_compress_policy_stats(&tt->compress_policy, stats);
+    stats->dns_lookups = tt->dns_lookups;
+    stats->dns_cache_hits = tt->dns_cache_hits;
+    stats->conn_attempts = tt->conn_attempts;
+    stats->last_conn_setup_us = tt->last_conn_setup_us;
+    stats->endpoint_failovers = tt->endpoint_failovers;
+    stats->socket_writes = tt->socket_writes;
+    stats->socket_bytes = tt->socket_bytes;
+    stats->first_send_us = tt->first_send_us;
+    stats->last_handshake_us = tt->last_handshake_us;
+    stats->sock_sndbuf = tt->sockopt.sndbuf;
+    stats->sock_rcvbuf = tt->sockopt.rcvbuf;
+    stats->tcp_keepalive = tt->sockopt.keepalive;
+    stats->tcp_keepalive_interval = tt->sockopt.keepalive_interval;
+    stats->tcp_notsent_lowat = tt->sockopt.notsent_lowat;
+    stats->tcp_quickack = tt->sockopt.quickack;
+    stats->sock_busy_poll = tt->sockopt.busy_poll;
+    stats->tcp_user_timeout = tt->sockopt.user_timeout;
+    return PC_RC_OK;
+}
+
 const char *tr_uv_tcp_serializer(pc_transport_t *trans)
 {
     GET_TT;
@@ -17,6 +17,9 @@
 #include "pr_pkg.h"
 #include "pr_msg.h"
 #include "tr_uv_tcp.h"
+#include "tr_uv_dns.h"
+#include "tr_uv_endpoints.h"
+#include "tr_uv_sockopt.h"
 
 #define TR_UV_WI_TYPE_NONE 0x10
 #define TR_UV_WI_TYPE_NOTIFY 0x20
@@ -32,6 +35,9 @@
 #define TR_UV_WI_SET_RESP(type) do { (type) &= ~TR_UV_WI_TYPE_MASK; (type) |= TR_UV_WI_TYPE_RESP; } while(0)
 #define TR_UV_WI_SET_INTERNAL(type) do { (type) &= ~TR_UV_WI_TYPE_MASK; (type) |= TR_UV_WI_TYPE_INTERNAL; } while(0)
 
+/* the longest header frame_fn writes ahead of a write item, a masked websocket one */
+#define TR_UV_WI_FRAME_HDR_SIZE 14
+
 
 /* +1 for internal use */
 #define TR_UV_PRE_ALLOC_WI_SLOT_COUNT \
@@ -54,8 +60,121 @@ typedef struct {
     unsigned int req_id; /* for request, if internal use -1 */
     time_t ts;
     int timeout;
+
+    /* for request, the response body is streamed, see pc_request_opts_t */
+    int stream;
+    uv_file stream_fd;
+    /* for request, the response body goes to caller memory, see pc_trans_resp_buf */
+    int caller_buf;
+    /* prepared message whose wire image follows buf, see tr_uv_tcp_send_prepared */
+    pc_prepared_msg_t* prepared;
+
+    /*
+     * set once frame_fn went through the write item, frame_len bytes of
+     * frame_hdr are then written ahead of buf. Reset with the buffer.
+     */
+    int framed;
+    unsigned int frame_len;
+    char frame_hdr[TR_UV_WI_FRAME_HDR_SIZE];
 } tr_uv_wi_t;
 
+typedef struct {
+    QUEUE queue;
+    size_t len;
+    size_t off;
+    char data[1];
+} tr_uv_stream_chunk_t;
+
+/**
+ * Chunks of a streamed response written to its chunk_fd, one at a time on
+ * the thread pool so that they land in order, waiting for a non blocking
+ * fd to be writable. It outlives the stream until the last chunk is
+ * written, the request is answered then.
+ */
+typedef struct {
+    uv_work_t work;
+    tr_uv_tcp_transport_t* tt;
+    unsigned int req_id;
+    uv_file fd;
+    /* of tr_uv_stream_chunk_t, the head one is being written */
+    QUEUE chunks;
+    /* the head chunk, as handed to the thread pool */
+    tr_uv_stream_chunk_t* writing;
+    /* result of writing the head chunk, 0 or a libuv error */
+    int result;
+    /* also read by the thread pool, which stops waiting on the fd once set */
+    volatile int failed;
+    int ended;
+    /* the request was left to a reset, not answered once written */
+    int orphan;
+} tr_uv_stream_file_t;
+
+/**
+ * Response body being streamed by the package parser, see
+ * tcp__on_data_chunk. Only used by the uv loop thread.
+ */
+typedef struct {
+    int active;
+    unsigned int req_id;
+    /* NULL without a chunk_fd */
+    tr_uv_stream_file_t* file;
+    /* the request failed or is gone, the rest of the body is discarded */
+    int failed;
+
+    int compressed;
+    pr_inflate_stream_t inflate;
+    size_t in_bytes;
+    size_t out_bytes;
+    uint64_t inflate_time_ns;
+} tr_uv_resp_stream_t;
+
+#define TR_UV_OFFLOAD_PENDING 0
+#define TR_UV_OFFLOAD_RUNNING 1
+#define TR_UV_OFFLOAD_DONE 2
+
+/**
+ * A message body (de)compressed on the libuv thread pool.
+ *
+ * Jobs are kept in order in offload_send_queue/offload_recv_queue, a job only
+ * leaves its queue once it and every job before it are done, so offloading
+ * never reorders messages.
+ */
+typedef struct {
+    QUEUE queue;
+    uv_work_t req;
+    tr_uv_tcp_transport_t* tt;
+    int state;
+    /* recv jobs from before a reset are dropped */
+    unsigned int generation;
+
+    /* the route and the body are owned by the job */
+    pc_msg_t msg;
+    int compressed;
+    int error;
+
+    /* send jobs only */
+    tr_uv_wi_t* wi;
+} tr_uv_offload_job_t;
+
+/* RFC 8305 "Connection Attempt Delay", see pc_client_config_t.conn_attempt_delay */
+#define TR_UV_TCP_DEFAULT_ATTEMPT_DELAY 250
+
+#define TR_UV_TCP_ATTEMPT_IDLE 0
+#define TR_UV_TCP_ATTEMPT_CONNECTING 1
+#define TR_UV_TCP_ATTEMPT_CLOSING 2
+
+/**
+ * A connection attempt racing the others when the host resolved to several
+ * addresses, see tcp__race_next. The socket of the first one to connect is
+ * handed over to tt->socket and every attempt is closed.
+ */
+typedef struct {
+    tr_uv_tcp_transport_t* tt;
+    uv_tcp_t socket;
+    uv_connect_t req;
+    int state;
+} tr_uv_tcp_attempt_t;
+
 typedef enum {
     TR_UV_TCP_NOT_CONN,
     TR_UV_TCP_CONNECTING,
@@ -72,9 +191,45 @@ struct tr_uv_tcp_transport_s {
     void (*conn_done_cb)(uv_connect_t* conn, int status);
     void (*write_async_cb)(uv_async_t* a);
     void (*cleanup_async_cb)(uv_async_t* a);
+    void (*alloc_cb)(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf);
     void (*on_tcp_read_cb)(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf);
     void (*write_check_timeout_cb)(uv_timer_t* t);
 
+    /*
+     * socket I/O of subclasses not going through the libuv stream, NULL for
+     * tcp and tls. open_fn opens a socket of its own to the first address
+     * the host resolved to instead of connecting tt->socket, and calls
+     * conn_done_cb once connected, which it may do before returning.
+     * read_start_fn starts reading once connected, write_fn sends the
+     * buffers of the writing queue and calls tcp__on_write_done once they
+     * are written. They return 0 or a uv error code.
+     */
+    int (*open_fn)(tr_uv_tcp_transport_t* tt, const struct sockaddr* addr);
+    int (*read_start_fn)(tr_uv_tcp_transport_t* tt);
+    int (*write_fn)(tr_uv_tcp_transport_t* tt, const uv_buf_t* bufs, int buf_cnt);
+
+    /*
+     * protocol of subclasses between the connection and the packages, NULL
+     * for tcp and tls. upgrade_fn is called once connected instead of
+     * sending the handshake, which it sends itself when the connection is
+     * ready for it. feed_fn gets what is read instead of the package parser
+     * and frame_fn every write item before it is written.
+     */
+    void (*upgrade_fn)(tr_uv_tcp_transport_t* tt);
+    void (*feed_fn)(tr_uv_tcp_transport_t* tt, const char* data, size_t len);
+    void (*frame_fn)(tr_uv_tcp_transport_t* tt, tr_uv_wi_t* wi);
+
+    /*
+     * state of subclasses kept in the local storage next to the route
+     * dictionaries, NULL for tcp. ls_load_fn gets the object read by
+     * tr_uv_tcp_init and ls_save_fn adds its items to the one written after
+     * a handshake, which ls_dirty asks for even if the dictionaries are the
+     * same.
+     */
+    void (*ls_load_fn)(tr_uv_tcp_transport_t* tt, pc_JSON* lc);
+    void (*ls_save_fn)(tr_uv_tcp_transport_t* tt, pc_JSON* lc);
+    int ls_dirty;
+
     pc_client_t* client;
     const pc_client_config_t* config;
 
@@ -93,8 +248,42 @@ struct tr_uv_tcp_transport_s {
     uv_async_t conn_async;
     int reconn_times;
     int is_connecting; /* this flag is used for conn_req */
+    tr_uv_dns_req_t* dns_req; /* host name lookup preceding conn_req */
+    uv_poll_t unix_poll; /* connect of "unix:" hosts, see tcp__unix_connect */
+    int unix_status;
+    uint64_t dns_lookups;
+    uint64_t dns_cache_hits;
     int max_reconn_incr;
 
+    /*
+     * connection racing, race_count is 0 unless a race is running. The
+     * attempts and their addresses are only allocated by the first race.
+     */
+    tr_uv_tcp_attempt_t* attempts;
+    struct sockaddr_storage* race_addrs;
+    int race_count;
+    int race_next;
+    int race_pending;
+    int race_error;
+    uv_timer_t race_timer;
+    uint64_t conn_start_time;
+    uint64_t conn_attempts;
+    uint64_t last_conn_setup_us;
+
+    /* set by the connect calls, cleared once a request or notify is on the wire */
+    uint64_t connect_call_time;
+    uint64_t first_send_us;
+    uint64_t last_handshake_us;
+    uint64_t socket_writes;
+    uint64_t socket_bytes;
+
+    /* socket options applied to the current connection */
+    tr_uv_sockopt_t sockopt;
+
+    /* set by pc_client_connect_endpoints, host and port are the current one's */
+    tr_uv_endpoints_t endpoints;
+    uint64_t endpoint_failovers;
+
     uv_timer_t handshake_timer;
 
     const char* host;
@@ -126,10 +315,26 @@ struct tr_uv_tcp_transport_s {
 
     /* here, we use heartbeat round-trip time to evaluate the quality of connection. */
     int hb_rtt;
+    /* loop time our last heartbeat was sent at, 0 once the server's arrived */
+    uint64_t hb_sent_time;
 
     pc_pkg_parser_t pkg_parser;
+    tr_uv_resp_stream_t resp_stream;
+
+    /* zlib streams and buffers reused across messages */
+    pr_gzip_engine_t gzip;
+    pr_compress_policy_t compress_policy;
 
-    char tcp_read_buf[PC_TCP_READ_BUFFER_SIZE];
+    /**
+     * large bodies are (de)compressed on the thread pool with offload_gzip.
+     * offload_send_queue is guarded by wq_mutex, offload_recv_queue is only
+     * used by the uv loop thread.
+     */
+    pr_gzip_engine_t offload_gzip;
+    uv_async_t offload_async;
+    QUEUE offload_send_queue;
+    QUEUE offload_recv_queue;
+    unsigned int offload_generation;
 
     /**
      * holds ownership of these json
@@ -152,12 +357,19 @@ void tr_uv_tcp_plugin_on_deregister(pc_transport_plugin_t* plugin);
 
 int tr_uv_tcp_init(pc_transport_t* trans, pc_client_t* client);
 int tr_uv_tcp_connect(pc_transport_t* trans, const char* host, int port, const char* handshake_opts);
+int tr_uv_tcp_connect_endpoints(pc_transport_t* trans, const pc_endpoint_t* endpoints, int count, const char* handshake_opts);
+int tr_uv_tcp_endpoint_health(pc_transport_t* trans, int index, pc_endpoint_health_t* health);
 int tr_uv_tcp_send(pc_transport_t* trans, const char* route, unsigned int seq_num, pc_buf_t msg_buf, unsigned int req_id, int timeout);
+int tr_uv_tcp_send_with_opts(pc_transport_t* trans, const char* route, unsigned int seq_num, pc_buf_t msg_buf,
+                             unsigned int req_id, int timeout, const pc_request_opts_t* opts);
+int tr_uv_tcp_send_prepared(pc_transport_t* trans, pc_prepared_msg_t* prepared, unsigned int seq_num,
+                            unsigned int req_id, int timeout);
 int tr_uv_tcp_disconnect(pc_transport_t* trans);
 int tr_uv_tcp_cleanup(pc_transport_t* trans);
 const char *tr_uv_tcp_serializer(pc_transport_t *trans);
 void* tr_uv_tcp_internal_data(pc_transport_t* trans);
 int tr_uv_tcp_quality(pc_transport_t* trans);
+int tr_uv_tcp_stats(pc_transport_t* trans, pc_client_stats_t* stats);
 pc_transport_plugin_t* tr_uv_tcp_plugin(pc_transport_t* trans);
 
 #endif
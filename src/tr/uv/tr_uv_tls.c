@@ -27,7 +27,8 @@ static tr_uv_tls_transport_plugin_t instance =
         pr_default_msg_decoder  /* decoder */
     },
     NULL, /* ssl ctx */
-    1 /* enables the verification of the  */
+    1, /* enables the verification of the  */
+    {0} /* sessions, set up by on_register */
 };
 
 pc_transport_plugin_t* pc_tr_uv_tls_trans_plugin()
@@ -48,3 +49,11 @@ int tr_uv_tls_set_ca_file(const char* ca_file, const char* ca_path)
         return PC_RC_ERROR;
     }
 }
+
+void tr_uv_tls_clear_session_cache(void)
+{
+    /* the cache lives while the plugin is registered, as the ctx does */
+    if (instance.ctx) {
+        tr_uv_tls_sess_cache_clear(&instance.sessions);
+    }
+}
@@ -14,7 +14,10 @@
 #include <string.h>
 
 #include "tr_uv_tcp_aux.h"
+#include "tr_uv_tls.h"
 #include "tr_uv_tls_aux.h"
+#include "tr_uv_rbuf.h"
+#include "tr_uv_tls_bio.h"
 #include "pc_error.h"
 
 #define GET_TLS(x) tr_uv_tls_transport_t* tls; \
@@ -24,12 +27,58 @@
 
 #define GET_TT tr_uv_tcp_transport_t* tt = &tls->base; pc_assert(tt && tls)
 
+#define TLS_SESSIONS (&((tr_uv_tls_transport_plugin_t* )pc_tr_uv_tls_trans_plugin())->sessions)
+
+/* records SSL_write splits `len` bytes of application data in */
+#define TLS_RECORDS(len) (((len) + PC_TLS_RECORD_SIZE - 1) / PC_TLS_RECORD_SIZE)
+
 static void tls__read_from_bio(tr_uv_tls_transport_t* tls);
 static int tls__get_error(SSL* tls, int status);
 static void tls__write_to_tcp(tr_uv_tls_transport_t* tls);
 static void tls__cycle(tr_uv_tls_transport_t* tls);
 static void tls__emit_error_event(tr_uv_tls_transport_t* tls);
 static void tls__info_callback(const SSL* tls, int where, int ret);
+static int tls__on_handshake_done(tr_uv_tls_transport_t* tls);
+
+int tls__ssl_new(tr_uv_tls_transport_t* tls)
+{
+    tr_uv_tls_transport_plugin_t* plugin = (tr_uv_tls_transport_plugin_t* )pc_tr_uv_tls_trans_plugin();
+    GET_TT;
+
+    tls->tls = SSL_new(plugin->ctx);
+    if (!tls->tls) {
+        pc_lib_log(PC_LOG_ERROR, "tls__ssl_new - create ssl error: %s", ERR_error_string(ERR_get_error(), NULL));
+        return PC_RC_ERROR;
+    }
+
+    if (plugin->enable_verify) {
+        SSL_set_verify(tls->tls, SSL_VERIFY_PEER, NULL);
+    } else {
+        SSL_set_verify(tls->tls, SSL_VERIFY_NONE, NULL);
+    }
+
+    if (tt->config->tls_ktls) {
+#ifdef SSL_OP_ENABLE_KTLS
+        SSL_set_options(tls->tls, SSL_OP_ENABLE_KTLS);
+#else
+        pc_lib_log(PC_LOG_WARN, "tls__ssl_new - kernel tls needs OpenSSL 3, encrypting in userspace");
+#endif
+    }
+
+    SSL_set_connect_state(tls->tls);
+    SSL_set_app_data(tls->tls, tls);
+
+    tls->in = tr_uv_tls_bio_new(&tls->rbuf, NULL, NULL);
+    tls->out = tr_uv_tls_bio_new(&tls->wbuf, tls__ktls_start, tls);
+
+    /* oom, non-handling */
+    if (!tls->in || !tls->out)
+        abort();
+
+    SSL_set_bio(tls->tls, tls->in, tls->out);
+    tls->internal[1] = tls->tls;
+    return PC_RC_OK;
+}
 
 void tls__reset(tr_uv_tcp_transport_t* tt)
 {
@@ -41,6 +90,8 @@ void tls__reset(tr_uv_tcp_transport_t* tt)
     pc_lib_log(PC_LOG_DEBUG, "tls__reset - reset ssl");
 
     SSL_shutdown(tls->tls);
+    /* a shutdown in the middle of the handshake is an error nobody reads */
+    ERR_clear_error();
 
     /*
      * here tls__write_to_tcp will write close_notify alert
@@ -48,30 +99,45 @@ void tls__reset(tr_uv_tcp_transport_t* tt)
      */
     tls__write_to_tcp(tls);
     tls->is_handshake_completed = 0;
+    tls->ktls_tx = 0;
+
+    if (tls->early_data_used) {
+        /*
+         * SSL_clear leaves the early data state of the connection behind,
+         * SSL_write_early_data then refuses to write on the next one.
+         */
+        tls->early_data_used = 0;
+        SSL_free(tls->tls);
+        tr_uv_tls_bio_buf_reset(&tls->rbuf);
+        tr_uv_tls_bio_buf_reset(&tls->wbuf);
+        if (tls__ssl_new(tls) != PC_RC_OK) {
+            /* oom, non-handling */
+            abort();
+        }
+    } else {
+        if (!SSL_clear(tls->tls)) {
+            pc_lib_log(PC_LOG_WARN, "tls__reset - ssl clear error: %s",
+                    ERR_error_string(ERR_get_error(), NULL));
+        }
 
-    if (!SSL_clear(tls->tls)) {
-        pc_lib_log(PC_LOG_WARN, "tls__reset - ssl clear error: %s",
-                ERR_error_string(ERR_get_error(), NULL));
-    }
-
-    ret = BIO_reset(tls->in);
-    pc_assert(ret == 1);
+        ret = BIO_reset(tls->in);
+        pc_assert(ret == 1);
 
-    ret = BIO_reset(tls->out);
-    pc_assert(ret == 1);
+        ret = BIO_reset(tls->out);
+        pc_assert(ret == 1);
+    }
 
     /*
-     * write should retry remained, insert it to writing queue
-     * then tcp__reset will recycle it.
+     * write should retry remained, insert them to writing queue
+     * then tcp__reset will recycle them.
      */
-    if (tls->should_retry) {
-        pc_lib_log(PC_LOG_DEBUG, "tls__reset - move should retry wi to writing queue, seq_num: %u, req_id: %u",
-                tls->should_retry->seq_num, tls->should_retry->req_id);
-
-        QUEUE_INIT(&tls->should_retry->queue);
-        QUEUE_INSERT_TAIL(&tt->writing_queue, &tls->should_retry->queue);
+    while(!QUEUE_EMPTY(&tls->should_retry_queue)) {
+        q = QUEUE_HEAD(&tls->should_retry_queue);
+        QUEUE_REMOVE(q);
+        QUEUE_INIT(q);
 
-        tls->should_retry = NULL;
+        pc_lib_log(PC_LOG_DEBUG, "tls__reset - move should retry wi to writing queue");
+        QUEUE_INSERT_TAIL(&tt->writing_queue, q);
     }
 
     if (tls->retry_wb) {
@@ -80,6 +146,11 @@ void tls__reset(tr_uv_tcp_transport_t* tt)
         tls->retry_wb_len = 0;
     }
 
+    if (tls->early_wi) {
+        QUEUE_INSERT_TAIL(&tt->writing_queue, &tls->early_wi->queue);
+        tls->early_wi = NULL;
+    }
+
     /* tcp reset will recycle following write item */
     while(!QUEUE_EMPTY(&tls->when_tcp_is_writing_queue)) {
         q = QUEUE_HEAD(&tls->when_tcp_is_writing_queue);
@@ -136,8 +207,126 @@ out:
     return key_pinned;
 }
 
+/*
+ * sends the handshake package tcp__send_handshake queued with the
+ * ClientHello. Anything else may do harm when an attacker replays the early
+ * data, so application data waits for the handshake response as usual.
+ */
+static void tls__write_early_data(tr_uv_tls_transport_t* tls)
+{
+    QUEUE* q;
+    tr_uv_wi_t* wi = NULL;
+    size_t written;
+    GET_TT;
+
+    pc_mutex_lock(&tt->wq_mutex);
+    if (!QUEUE_EMPTY(&tt->write_wait_queue)) {
+        q = QUEUE_HEAD(&tt->write_wait_queue);
+        wi = (tr_uv_wi_t* )QUEUE_DATA(q, tr_uv_wi_t, queue);
+        if (TR_UV_WI_IS_INTERNAL(wi->type) && !wi->prepared && wi->buf.len
+                && wi->buf.base[0] == PC_PKG_HANDSHAKE) {
+            QUEUE_REMOVE(q);
+            QUEUE_INIT(q);
+        } else {
+            wi = NULL;
+        }
+    }
+    pc_mutex_unlock(&tt->wq_mutex);
+
+    if (!wi) {
+        return;
+    }
+
+    tls->early_data_used = 1;
+    if (!SSL_write_early_data(tls->tls, wi->buf.base, wi->buf.len, &written)) {
+        pc_lib_log(PC_LOG_WARN, "tls__write_early_data - early data not sent: %s",
+                   ERR_error_string(ERR_get_error(), NULL));
+        pc_mutex_lock(&tt->wq_mutex);
+        QUEUE_INSERT_HEAD(&tt->write_wait_queue, &wi->queue);
+        pc_mutex_unlock(&tt->wq_mutex);
+        return;
+    }
+
+    pc_lib_log(PC_LOG_INFO, "tls__write_early_data - handshake sent as early data");
+    tls->early_wi = wi;
+    tls->records += TLS_RECORDS(written);
+
+    /*
+     * no more early data, otherwise OpenSSL waits for more before it sends
+     * EndOfEarlyData and Finished, and the handshake would only end with
+     * the next SSL_write.
+     */
+    SSL_do_handshake(tls->tls);
+}
+
+/*
+ * whether the server took the early data is known once the tls handshake is
+ * done. If it did, the handshake package is released as sent, otherwise it
+ * is queued again, ahead of anything else.
+ */
+static void tls__on_early_data_done(tr_uv_tls_transport_t* tls)
+{
+    tr_uv_wi_t* wi = tls->early_wi;
+    GET_TT;
+
+    if (!wi) {
+        return;
+    }
+    tls->early_wi = NULL;
+
+    pc_mutex_lock(&tt->wq_mutex);
+    if (SSL_get_early_data_status(tls->tls) == SSL_EARLY_DATA_ACCEPTED) {
+        pc_lib_log(PC_LOG_INFO, "tls__on_early_data_done - early data accepted");
+        tls->early_data_accepted++;
+
+        tcp__wi_release_buf(wi);
+        if (PC_IS_PRE_ALLOC(wi->type)) {
+            PC_PRE_ALLOC_SET_IDLE(wi->type);
+        } else {
+            pc_lib_free(wi);
+        }
+    } else {
+        pc_lib_log(PC_LOG_INFO, "tls__on_early_data_done - early data rejected, sending the handshake again");
+        tls->early_data_rejected++;
+
+        QUEUE_INSERT_HEAD(&tt->write_wait_queue, &wi->queue);
+        uv_async_send(&tt->write_async);
+    }
+    pc_mutex_unlock(&tt->wq_mutex);
+}
+
+/*
+ * called by the SSL_write or SSL_read that finished the tls handshake,
+ * returns 0 if the connection was given up.
+ */
+static int tls__on_handshake_done(tr_uv_tls_transport_t* tls)
+{
+    GET_TT;
+
+    if (!tls__public_key_pinned(tls)) {
+        pc_lib_log(PC_LOG_ERROR, "Public key is not pinned.");
+        tr_uv_tls_sess_remove(TLS_SESSIONS, tt->host, tt->port);
+        pc_trans_fire_event(tt->client, PC_EV_CONNECT_FAILED, "Public key from server is not pinned.", NULL);
+        tt->reset_fn(tt);
+        return 0;
+    }
+
+    tls->is_handshake_completed = 1;
+    if (SSL_session_reused(tls->tls)) {
+        tls->resumed_handshakes++;
+    } else {
+        tls->full_handshakes++;
+    }
+    pc_lib_log(PC_LOG_INFO, "tls__on_handshake_done - tls handshake done, %s",
+               SSL_session_reused(tls->tls) ? "session resumed" : "full handshake");
+
+    tls__on_early_data_done(tls);
+    return 1;
+}
+
 void tls__conn_done_cb(uv_connect_t* conn, int status)
 {
+    SSL_SESSION* sess;
     GET_TLS(conn);
 
     tcp__conn_done_cb(conn, status);
@@ -154,9 +343,22 @@ void tls__conn_done_cb(uv_connect_t* conn, int status)
 
         SSL_set_info_callback(tls->tls, tls__info_callback);
 
+        /* resume the last session with this endpoint, if any, or forget the one of the last connection */
+        sess = tr_uv_tls_sess_get(TLS_SESSIONS, tt->host, tt->port);
+        SSL_set_session(tls->tls, sess);
+        if (sess && SSL_SESSION_get_protocol_version(sess) >= TLS1_3_VERSION) {
+            /* it left the cache, the local storage should not keep it either */
+            tt->ls_dirty = 1;
+        }
+
         /* SSL_read will write ClientHello to bio. */
         SSL_set_connect_state(tls->tls);
 
+        if (tt->config->tls_early_data && sess && SSL_SESSION_get_max_early_data(sess) > 0) {
+            tls__write_early_data(tls);
+        }
+        SSL_SESSION_free(sess);
+
         tls__read_from_bio(tls);
 
         /* write ClientHello out */
@@ -207,6 +409,9 @@ static void tls__emit_error_event(tr_uv_tls_transport_t* tls)
     GET_TT;
 
     if (!tls->is_handshake_completed) {
+        /* the session may be what the server refused, start over next time */
+        tr_uv_tls_sess_remove(TLS_SESSIONS, tt->host, tt->port);
+
         /* won't reconnect if tls handshake failed */
         pc_trans_fire_event(tt->client, PC_EV_CONNECT_FAILED, "TLS Handshake Error", NULL);
         tt->reset_fn(tt);
@@ -222,7 +427,13 @@ static void tls__write_to_bio(tr_uv_tls_transport_t* tls)
     int ret = 0;
     QUEUE* head;
     QUEUE* q;
+    QUEUE batch;
     tr_uv_wi_t* wi = NULL;
+    char* bb = NULL;
+    const char* data;
+    size_t len;
+    size_t room;
+    int count;
     int flag = 0;
 
     tr_uv_tcp_transport_t* tt = (tr_uv_tcp_transport_t* )tls;
@@ -270,23 +481,17 @@ static void tls__write_to_bio(tr_uv_tls_transport_t* tls)
             }
         } else {
 
-            if (!tls->is_handshake_completed) {
-                if (!tls__public_key_pinned(tls)) {
-                    pc_lib_log(PC_LOG_ERROR, "Public key is not pinned.");
-                    pc_trans_fire_event(tt->client, PC_EV_CONNECT_FAILED, "Public key from server is not pinned.", NULL);
-                    tt->reset_fn(tt);
-                    return;
-                }
-
-                tls->is_handshake_completed = 1;
+            if (!tls->is_handshake_completed && !tls__on_handshake_done(tls)) {
+                return;
             }
 
             /* retry succeeds */
-            if (tls->should_retry) {
-                QUEUE_INIT(&tls->should_retry->queue);
-                QUEUE_INSERT_TAIL(head, &tls->should_retry->queue);
-
-                tls->should_retry = NULL;
+            tls->records += TLS_RECORDS(tls->retry_wb_len);
+            while(!QUEUE_EMPTY(&tls->should_retry_queue)) {
+                q = QUEUE_HEAD(&tls->should_retry_queue);
+                QUEUE_REMOVE(q);
+                QUEUE_INIT(q);
+                QUEUE_INSERT_TAIL(head, q);
             }
             pc_lib_free(tls->retry_wb);
             tls->retry_wb = NULL;
@@ -299,41 +504,105 @@ static void tls__write_to_bio(tr_uv_tls_transport_t* tls)
     /* retry write buf has been written, try to write more data to bio. */
     if (!tls->retry_wb) {
         while(!QUEUE_EMPTY(&tt->write_wait_queue)) {
-            q = QUEUE_HEAD(&tt->write_wait_queue);
-            QUEUE_REMOVE(q);
-            QUEUE_INIT(q);
+            /*
+             * write items are encrypted together as long as they fit in a
+             * record, so a burst of small ones costs one record header, MAC
+             * and AEAD pass instead of one per item. A bigger item goes
+             * alone and SSL_write splits it in records.
+             */
+            QUEUE_INIT(&batch);
+            len = 0;
+            count = 0;
+            while(!QUEUE_EMPTY(&tt->write_wait_queue)) {
+                q = QUEUE_HEAD(&tt->write_wait_queue);
+                wi = (tr_uv_wi_t* )QUEUE_DATA(q, tr_uv_wi_t, queue);
+
+                /* SSL_write takes a single buffer per write item */
+                if (tt->frame_fn) {
+                    tt->frame_fn(tt, wi);
+                } else {
+                    tcp__wi_flatten(wi);
+                }
+                if (count && len + wi->buf.len > PC_TLS_RECORD_SIZE) {
+                    break;
+                }
 
-            wi = (tr_uv_wi_t* )QUEUE_DATA(q, tr_uv_wi_t, queue);
-            ret = SSL_write(tls->tls, wi->buf.base, wi->buf.len);
-            pc_assert(ret == -1 || ret == (int)(wi->buf.len));
+                QUEUE_REMOVE(q);
+                QUEUE_INIT(q);
+                QUEUE_INSERT_TAIL(&batch, q);
+                len += wi->buf.len;
+                count++;
+            }
+
+            if (tls->ktls_tx) {
+                /* the kernel makes the records, the items go out as they are */
+                QUEUE_FOREACH(q, &batch) {
+                    wi = (tr_uv_wi_t* )QUEUE_DATA(q, tr_uv_wi_t, queue);
+                    memcpy(tr_uv_tls_bio_buf_reserve(&tls->wbuf, wi->buf.len, &room), wi->buf.base, wi->buf.len);
+                    tls->wbuf.end += wi->buf.len;
+                }
+                tls->records += TLS_RECORDS(len);
+                QUEUE_ADD(head, &batch);
+                flag = 1;
+                continue;
+            }
+
+            if (count == 1) {
+                wi = (tr_uv_wi_t* )QUEUE_DATA(QUEUE_HEAD(&batch), tr_uv_wi_t, queue);
+                data = wi->buf.base;
+            } else {
+                if (!bb) {
+                    bb = tr_uv_rbuf_get();
+                }
+                len = 0;
+                QUEUE_FOREACH(q, &batch) {
+                    wi = (tr_uv_wi_t* )QUEUE_DATA(q, tr_uv_wi_t, queue);
+                    memcpy(bb + len, wi->buf.base, wi->buf.len);
+                    len += wi->buf.len;
+                }
+                data = bb;
+            }
+
+            ret = SSL_write(tls->tls, data, (int)len);
+            pc_assert(ret == -1 || ret == (int)len);
             if (ret == -1) {
-                tls->should_retry = wi;
+                QUEUE_ADD(&tls->should_retry_queue, &batch);
                 if (tls__get_error(tls->tls, ret)) {
                     pc_lib_log(PC_LOG_ERROR, "tls__write_to_bio - SSL_write error, will reconn");
 
+                    if (bb) {
+                        tr_uv_rbuf_put(bb);
+                    }
                     tls__emit_error_event(tls);
 
                     return ;
                 } else {
-                    tls->retry_wb = (char* )pc_lib_malloc(wi->buf.len);
-                    memcpy(tls->retry_wb, wi->buf.base, wi->buf.len);
-                    tls->retry_wb_len = tls->should_retry->buf.len;
+                    tls->retry_wb = (char* )pc_lib_malloc(len);
+                    memcpy(tls->retry_wb, data, len);
+                    tls->retry_wb_len = (int)len;
                     break;
                 }
             } else {
-                pc_assert(tls->is_handshake_completed);
-                if (!tls->is_handshake_completed) {
-                    tls->is_handshake_completed = 1;
-                }
-
-                pc_lib_log(PC_LOG_DEBUG, "tls__write_to_bio - move wi to writing queue or tcp write queue, seq_num: %u, req_id: %u", wi->seq_num, wi->req_id);
-                QUEUE_INIT(&wi->queue);
-                QUEUE_INSERT_TAIL(head, &wi->queue);
+                pc_lib_log(PC_LOG_DEBUG, "tls__write_to_bio - move %d wi to writing queue or tcp write queue", count);
+                tls->records += TLS_RECORDS(len);
+                QUEUE_ADD(head, &batch);
                 flag = 1;
+
+                /* the reset recycles the batch along with the queues */
+                if (!tls->is_handshake_completed && !tls__on_handshake_done(tls)) {
+                    if (bb) {
+                        tr_uv_rbuf_put(bb);
+                    }
+                    return ;
+                }
             }
         }
     }
 
+    if (bb) {
+        tr_uv_rbuf_put(bb);
+    }
+
     /* enable check timeout timer */
     if (!uv_is_active((uv_handle_t* )&tt->check_timeout)) {
         uv_timer_start(&tt->check_timeout, tt->write_check_timeout_cb,
@@ -346,21 +615,59 @@ static void tls__write_to_bio(tr_uv_tls_transport_t* tls)
 static void tls__read_from_bio(tr_uv_tls_transport_t* tls)
 {
     int read;
+    char* rb = NULL;
+    char* body;
+    size_t len;
     tr_uv_tcp_transport_t* tt = (tr_uv_tcp_transport_t* )tls;
 
     do {
-        read = SSL_read(tls->tls, tls->rb, PC_TLS_READ_BUF_SIZE);
-        if (read > 0) {
-            pc_assert(tls->is_handshake_completed);
-            if (!tls->is_handshake_completed) {
-                tls->is_handshake_completed = 1;
+        /*
+         * the body of a package being buffered is decrypted right where it
+         * goes, anything else is fed to the parser from a read buffer. So is
+         * everything when feed_fn has frames to take out first.
+         */
+        body = tt->feed_fn ? NULL : pc_pkg_parser_body_buf(&tt->pkg_parser, &len);
+        if (body) {
+            read = SSL_read(tls->tls, body, (int)(len < PC_TLS_READ_BUF_SIZE ? len : PC_TLS_READ_BUF_SIZE));
+        } else {
+            if (!rb) {
+                rb = tr_uv_rbuf_get();
+            }
+            read = SSL_read(tls->tls, rb, PC_TLS_READ_BUF_SIZE);
+        }
+
+        /*
+         * the handshake ends here when the server answered before anything
+         * was written, the handshake package sent as early data or still
+         * waiting for the write async.
+         */
+        if (!tls->is_handshake_completed && SSL_is_init_finished(tls->tls)) {
+            if (!tls__on_handshake_done(tls)) {
+                if (rb) {
+                    tr_uv_rbuf_put(rb);
+                }
+                return;
             }
+        }
 
-            pc_lib_log(PC_LOG_DEBUG, "Received TLS data from server, will parse package (first byte: %d, reead = %d)", tls->rb[0], read);
-            pc_pkg_parser_feed(&tt->pkg_parser, tls->rb, read);
+        if (read > 0) {
+            if (body) {
+                pc_pkg_parser_commit(&tt->pkg_parser, read);
+            } else {
+                pc_lib_log(PC_LOG_DEBUG, "Received TLS data from server, will parse package (first byte: %d, reead = %d)", rb[0], read);
+                if (tt->feed_fn) {
+                    tt->feed_fn(tt, rb, (size_t)read);
+                } else {
+                    pc_pkg_parser_feed(&tt->pkg_parser, rb, read);
+                }
+            }
         }
     } while (read > 0);
 
+    if (rb) {
+        tr_uv_rbuf_put(rb);
+    }
+
     if (tls__get_error(tls->tls, read)) {
         pc_lib_log(PC_LOG_ERROR, "tls__read_from_bio - SSL_read error, will reconn");
 
@@ -397,16 +704,16 @@ static void tls__write_to_tcp(tr_uv_tls_transport_t* tls)
 {
     int ret;
     QUEUE* q;
-    char* ptr;
     size_t len;
     uv_buf_t buf;
+    tr_uv_tls_bio_buf_t flight;
     tr_uv_wi_t* wi = NULL;
     tr_uv_tcp_transport_t* tt = (tr_uv_tcp_transport_t*)tls;
 
     if (tt->is_writing)
         return;
 
-    len = BIO_pending(tls->out);
+    len = tr_uv_tls_bio_buf_len(&tls->wbuf);
 
     if (len == 0) {
         pc_assert(QUEUE_EMPTY(&tls->when_tcp_is_writing_queue));
@@ -426,9 +733,15 @@ static void tls__write_to_tcp(tr_uv_tls_transport_t* tls)
         QUEUE_INSERT_TAIL(&tt->writing_queue, q);
     }
 
-    BIO_get_mem_data(tls->out, &ptr);
+    /*
+     * the ciphertext is sent from where SSL_write put it, the out BIO goes
+     * on with the buffer of the previous write, which is done.
+     */
+    flight = tls->wbuf_flight;
+    tls->wbuf_flight = tls->wbuf;
+    tls->wbuf = flight;
 
-    buf.base = ptr;
+    buf.base = tls->wbuf_flight.base + tls->wbuf_flight.start;
     buf.len = len;
 
     tt->write_req.data = tls;
@@ -443,9 +756,10 @@ static void tls__write_to_tcp(tr_uv_tls_transport_t* tls)
      */
     if (!ret) {
         tt->is_writing = 1;
+        tcp__on_socket_write(tt, len);
+    } else {
+        tr_uv_tls_bio_buf_reset(&tls->wbuf_flight);
     }
-
-    BIO_reset(tls->out);
 }
 
 void tls__write_done_cb(uv_write_t* w, int status)
@@ -455,6 +769,7 @@ void tls__write_done_cb(uv_write_t* w, int status)
     GET_TLS(w);
 
     tt->is_writing = 0;
+    tr_uv_tls_bio_buf_reset(&tls->wbuf_flight);
 
     if (status) {
         pc_lib_log(PC_LOG_ERROR, "tcp__write_done_cb - uv_write callback error: %s", uv_strerror(status));
@@ -479,9 +794,7 @@ void tls__write_done_cb(uv_write_t* w, int status)
             continue;
         };
 
-        pc_lib_free(wi->buf.base);
-        wi->buf.base = NULL;
-        wi->buf.len = 0;
+        tcp__wi_release_buf(wi);
 
         if (TR_UV_WI_IS_NOTIFY(wi->type)) {
             if (status) {
@@ -528,41 +841,15 @@ void tls__write_async_cb(uv_async_t* a)
 
 void tls__write_timeout_check_cb(uv_timer_t* t)
 {
-    tr_uv_wi_t* wi = NULL;
     int cont = 0;
-    time_t ct = time(0); /* TODO: */
     GET_TLS(t);
 
-    wi = tls->should_retry;
-    if (wi && wi->timeout != PC_WITHOUT_TIMEOUT && ct > wi->ts + wi->timeout) {
-        if (TR_UV_WI_IS_NOTIFY(wi->type)) {
-            pc_lib_log(PC_LOG_WARN, "tls__write_timeout_check_cb - notify timeout, seq num: %u", wi->seq_num);
-            pc_error_t err = pc__error_timeout();
-            pc_trans_sent(tt->client, wi->seq_num, &err);
-        } else if (TR_UV_WI_IS_RESP(wi->type)) {
-            pc_lib_log(PC_LOG_WARN, "tls__write_timeout_check_cb - request timeout, req id: %u", wi->req_id);
-            pc_error_t err = pc__error_timeout();
-            pc_buf_t empty_buf = {0};
-            pc_trans_resp(tt->client, wi->req_id, &empty_buf, &err);
-        }
-
-        /* if internal, just drop it. */
-
-        pc_lib_free(wi->buf.base);
-        wi->buf.base = NULL;
-        wi->buf.len = 0;
-
-        if (PC_IS_PRE_ALLOC(wi->type)) {
-            pc_mutex_lock(&tt->wq_mutex);
-            PC_PRE_ALLOC_SET_IDLE(wi->type);
-            pc_mutex_unlock(&tt->wq_mutex);
-        } else {
-            pc_lib_free(wi);
-        }
-        tls->should_retry = NULL;
-    }
-
+    /*
+     * the bytes of timed out write items waiting for a retry still go out
+     * with retry_wb, only their callbacks are fired now.
+     */
     pc_mutex_lock(&tt->wq_mutex);
+    cont = tcp__check_queue_timeout(&tls->should_retry_queue, tt->client, cont);
     cont = tcp__check_queue_timeout(&tls->when_tcp_is_writing_queue, tt->client, cont);
     pc_mutex_unlock(&tt->wq_mutex);
 
@@ -582,21 +869,168 @@ void tls__cleanup_async_cb(uv_async_t* a)
     if (tls->tls) {
         SSL_free(tls->tls);
         tls->tls = NULL;
-        /* BIO in and out will be freed by SSL_free */
+        /* BIO in and out will be freed by SSL_free, not their buffers */
         tls->in = NULL;
         tls->out = NULL;
     }
+
+    tr_uv_tls_bio_buf_free(&tls->rbuf);
+    tr_uv_tls_bio_buf_free(&tls->wbuf);
+    tr_uv_tls_bio_buf_free(&tls->wbuf_flight);
+}
+
+void tls__alloc_cb(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf)
+{
+    size_t room;
+    GET_TLS(handle);
+
+    (void)suggested_size;
+
+    /*
+     * the socket reads right behind the ciphertext SSL_read has not consumed,
+     * a partial record, which moves to the front once a record may not fit.
+     */
+    buf->base = tr_uv_tls_bio_buf_reserve(&tls->rbuf, PC_TLS_READ_BUF_SIZE, &room);
+    buf->len = room;
 }
 
 void tls__on_tcp_read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf)
 {
+    uv_buf_t none;
     GET_TLS(stream);
 
     if ( nread < 0) {
-        tcp__on_tcp_read_cb(stream, nread, buf);
+        /* buf is in the in BIO buffer, reset with the transport */
+        none = uv_buf_init(NULL, 0);
+        tcp__on_tcp_read_cb(stream, nread, &none);
         return ;
     }
 
-    BIO_write(tls->in, buf->base, nread);
+    pc_assert(nread == 0 || buf->base == tls->rbuf.base + tls->rbuf.end);
+
+    tr_uv_sockopt_rearm(&tt->socket, &tt->sockopt);
+    tls->rbuf.end += nread;
     tls__cycle(tls);
+
+    /* a connection with nothing to decrypt holds no read buffer */
+    if (tls->rbuf.base && tr_uv_tls_bio_buf_len(&tls->rbuf) == 0) {
+        tr_uv_tls_bio_buf_reset(&tls->rbuf);
+    }
+}
+
+int tls__ktls_start(void* arg, void* crypto_info, int is_tx)
+{
+    tr_uv_tls_transport_t* tls = (tr_uv_tls_transport_t* )arg;
+    uv_buf_t buf;
+    int ret;
+    GET_TT;
+
+    (void)is_tx;
+
+    /*
+     * the kernel encrypts whatever is sent from now on, so the records
+     * OpenSSL encrypted so far, its Finished at least, go to the socket
+     * first. If they can not all go right away, OpenSSL keeps encrypting.
+     */
+    if (uv_stream_get_write_queue_size((uv_stream_t* )&tt->socket) > 0) {
+        pc_lib_log(PC_LOG_INFO, "tls__ktls_start - a write is pending, encrypting in userspace");
+        return 0;
+    }
+
+    if (tr_uv_tls_bio_buf_len(&tls->wbuf)) {
+        buf = uv_buf_init(tls->wbuf.base + tls->wbuf.start, (unsigned int)tr_uv_tls_bio_buf_len(&tls->wbuf));
+        ret = uv_try_write((uv_stream_t* )&tt->socket, &buf, 1);
+        if (ret > 0) {
+            tls->wbuf.start += ret;
+            tcp__on_socket_write(tt, ret);
+        }
+        if (ret < 0 || tr_uv_tls_bio_buf_len(&tls->wbuf)) {
+            pc_lib_log(PC_LOG_INFO, "tls__ktls_start - the socket is busy, encrypting in userspace");
+            return 0;
+        }
+        tls->wbuf.start = tls->wbuf.end = 0;
+    }
+
+    ret = tr_uv_sockopt_ktls_tx(&tt->socket, crypto_info);
+    if (ret) {
+        pc_lib_log(PC_LOG_INFO, "tls__ktls_start - kernel tls not available, encrypting in userspace: %s",
+                   uv_strerror(ret));
+        return 0;
+    }
+
+    pc_lib_log(PC_LOG_INFO, "tls__ktls_start - the kernel encrypts the sends");
+    tls->ktls_tx = 1;
+    return 1;
+}
+
+int tls__new_session_cb(SSL* ssl, SSL_SESSION* sess)
+{
+    tr_uv_tls_transport_t* tls = (tr_uv_tls_transport_t* )SSL_get_app_data(ssl);
+    GET_TT;
+
+    if (!SSL_SESSION_is_resumable(sess)) {
+        return 0;
+    }
+
+    pc_lib_log(PC_LOG_DEBUG, "tls__new_session_cb - new session for %s:%d", tt->host, tt->port);
+    tr_uv_tls_sess_put(TLS_SESSIONS, tt->host, tt->port, sess);
+    tt->ls_dirty = 1;
+
+    /* the cache holds the reference now */
+    return 1;
+}
+
+void tls__ls_load(tr_uv_tcp_transport_t* tt, pc_JSON* lc)
+{
+    pc_JSON* sessions = pc_JSON_GetObjectItem(lc, TR_UV_TLS_SESS_LCK);
+    pc_JSON* item;
+    char* host;
+    char* port;
+
+    (void)tt; /* unused */
+
+    if (!sessions || sessions->type != pc_JSON_Object) {
+        return ;
+    }
+
+    /* keyed by host:port */
+    for (item = sessions->child; item; item = item->next) {
+        if (item->type != pc_JSON_String || !(port = strrchr(item->string, ':'))) {
+            continue;
+        }
+        host = (char*)pc_lib_strdup(item->string);
+        host[port - item->string] = '\0';
+        tr_uv_tls_sess_decode(TLS_SESSIONS, host, atoi(port + 1), item->valuestring);
+        pc_lib_free(host);
+    }
+}
+
+static void tls__ls_save_endpoint(pc_JSON* sessions, const char* host, int port)
+{
+    char key[512];
+    char* data = tr_uv_tls_sess_encode(TLS_SESSIONS, host, port);
+
+    if (data) {
+        snprintf(key, sizeof(key), "%s:%d", host, port);
+        pc_JSON_AddItemToObject(sessions, key, pc_JSON_CreateString(data));
+        pc_lib_free(data);
+    }
+}
+
+void tls__ls_save(tr_uv_tcp_transport_t* tt, pc_JSON* lc)
+{
+    pc_JSON* sessions = pc_JSON_CreateObject();
+    int i;
+
+    pc_mutex_lock(&tt->endpoints.mutex);
+    for (i = 0; i < tt->endpoints.count; ++i) {
+        tls__ls_save_endpoint(sessions, tt->endpoints.list[i].host, tt->endpoints.list[i].port);
+    }
+    pc_mutex_unlock(&tt->endpoints.mutex);
+
+    if (!i) {
+        tls__ls_save_endpoint(sessions, tt->host, tt->port);
+    }
+
+    pc_JSON_AddItemToObject(lc, TR_UV_TLS_SESS_LCK, sessions);
 }
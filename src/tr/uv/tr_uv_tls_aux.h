@@ -9,6 +9,9 @@
 #include "tr_uv_tcp_i.h"
 #include "tr_uv_tls_i.h"
 
+/* creates the SSL of the transport and its BIOs */
+int tls__ssl_new(tr_uv_tls_transport_t* tls);
+
 void tls__reset(tr_uv_tcp_transport_t* trans);
 
 void tls__conn_done_cb(uv_connect_t* conn, int status);
@@ -20,6 +23,16 @@ void tls__write_timeout_check_cb(uv_timer_t* timer);
 
 void tls__cleanup_async_cb(uv_async_t* a);
 
+void tls__alloc_cb(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf);
 void tls__on_tcp_read_cb(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf);
 
+/* keeps the sessions the server hands out in the cache of the plugin */
+int tls__new_session_cb(SSL* ssl, SSL_SESSION* sess);
+
+/* the tr_uv_tls_bio_ktls_cb of the out BIO */
+int tls__ktls_start(void* arg, void* crypto_info, int is_tx);
+
+void tls__ls_load(tr_uv_tcp_transport_t* tt, pc_JSON* lc);
+void tls__ls_save(tr_uv_tcp_transport_t* tt, pc_JSON* lc);
+
 #endif
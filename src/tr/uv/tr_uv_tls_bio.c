@@ -0,0 +1,236 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#include <string.h>
+
+#include <pc_assert.h>
+
+#include <pitaya.h>
+#include <pc_lib.h>
+
+#include "tr_uv_rbuf.h"
+#include "tr_uv_tls_bio.h"
+
+/* first allocation of a buffer that is not pooled */
+#define TR_UV_TLS_BIO_MIN_CAP 4096
+
+/*
+ * kTLS controls OpenSSL sends to the BIO it writes to. <openssl/bio.h> has
+ * BIO_CTRL_GET_KTLS_SEND from OpenSSL 3 on, and only lists the numbers of
+ * the others in a comment, so those are taken from it when it does not
+ * define them. Older versions have no kTLS and send none of these.
+ */
+#ifdef BIO_CTRL_GET_KTLS_SEND
+#define TR_UV_TLS_BIO_KTLS
+#ifndef BIO_CTRL_SET_KTLS
+#define BIO_CTRL_SET_KTLS 72
+#endif
+#ifndef BIO_CTRL_SET_KTLS_TX_SEND_CTRL_MSG
+#define BIO_CTRL_SET_KTLS_TX_SEND_CTRL_MSG 74
+#endif
+#ifndef BIO_CTRL_CLEAR_KTLS_TX_CTRL_MSG
+#define BIO_CTRL_CLEAR_KTLS_TX_CTRL_MSG 75
+#endif
+#endif
+
+typedef struct {
+    tr_uv_tls_bio_buf_t* buf;
+    tr_uv_tls_bio_ktls_cb ktls_cb;
+    void* ktls_arg;
+    int ktls_send;
+} tr_uv_tls_bio_ctx_t;
+
+#define BIO_BUF(bio) (((tr_uv_tls_bio_ctx_t*)BIO_get_data(bio))->buf)
+
+static BIO_METHOD* tr_uv_tls_bio__method = NULL;
+
+static int tr_uv_tls_bio__write(BIO* bio, const char* data, int len)
+{
+    tr_uv_tls_bio_buf_t* buf = BIO_BUF(bio);
+    size_t room;
+    char* p;
+
+    BIO_clear_retry_flags(bio);
+
+    p = tr_uv_tls_bio_buf_reserve(buf, (size_t)len, &room);
+    if (room < (size_t)len) {
+        BIO_set_retry_write(bio);
+        return -1;
+    }
+
+    memcpy(p, data, len);
+    buf->end += len;
+    return len;
+}
+
+static int tr_uv_tls_bio__read(BIO* bio, char* out, int len)
+{
+    tr_uv_tls_bio_buf_t* buf = BIO_BUF(bio);
+    size_t n = tr_uv_tls_bio_buf_len(buf);
+
+    BIO_clear_retry_flags(bio);
+
+    if (n == 0) {
+        BIO_set_retry_read(bio);
+        return -1;
+    }
+
+    if (n > (size_t)len) {
+        n = len;
+    }
+    memcpy(out, buf->base + buf->start, n);
+    buf->start += n;
+
+    if (buf->start == buf->end) {
+        buf->start = buf->end = 0;
+    }
+    return (int)n;
+}
+
+static long tr_uv_tls_bio__ctrl(BIO* bio, int cmd, long num, void* ptr)
+{
+    tr_uv_tls_bio_ctx_t* ctx = (tr_uv_tls_bio_ctx_t*)BIO_get_data(bio);
+
+    (void)num; /* unused without ktls */
+    (void)ptr; /* unused without ktls */
+
+    switch (cmd) {
+    case BIO_CTRL_RESET:
+        tr_uv_tls_bio_buf_reset(ctx->buf);
+        ctx->ktls_send = 0;
+        return 1;
+    case BIO_CTRL_PENDING:
+        return (long)tr_uv_tls_bio_buf_len(ctx->buf);
+    case BIO_CTRL_WPENDING:
+        return 0;
+    case BIO_CTRL_FLUSH:
+        return 1;
+#ifdef TR_UV_TLS_BIO_KTLS
+    case BIO_CTRL_SET_KTLS:
+        /* num tells the direction, only sends are offloaded */
+        if (!num || !ctx->ktls_cb || !ctx->ktls_cb(ctx->ktls_arg, ptr, 1)) {
+            return 0;
+        }
+        ctx->ktls_send = 1;
+        return 1;
+    case BIO_CTRL_GET_KTLS_SEND:
+        return ctx->ktls_send;
+    case BIO_CTRL_SET_KTLS_TX_SEND_CTRL_MSG:
+    case BIO_CTRL_CLEAR_KTLS_TX_CTRL_MSG:
+        /*
+         * records other than application data, alerts and key updates, need
+         * a control message on the send call, which uv_write can not pass.
+         * OpenSSL fails writing them, the connection is then reset.
+         */
+        return 0;
+#endif
+    default:
+        return 0;
+    }
+}
+
+static int tr_uv_tls_bio__destroy(BIO* bio)
+{
+    pc_lib_free(BIO_get_data(bio));
+    BIO_set_data(bio, NULL);
+    return 1;
+}
+
+void tr_uv_tls_bio_init(void)
+{
+    if (tr_uv_tls_bio__method) {
+        return;
+    }
+
+    tr_uv_tls_bio__method = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "pitaya uv buffer");
+    BIO_meth_set_write(tr_uv_tls_bio__method, tr_uv_tls_bio__write);
+    BIO_meth_set_read(tr_uv_tls_bio__method, tr_uv_tls_bio__read);
+    BIO_meth_set_ctrl(tr_uv_tls_bio__method, tr_uv_tls_bio__ctrl);
+    BIO_meth_set_destroy(tr_uv_tls_bio__method, tr_uv_tls_bio__destroy);
+}
+
+void tr_uv_tls_bio_cleanup(void)
+{
+    BIO_meth_free(tr_uv_tls_bio__method);
+    tr_uv_tls_bio__method = NULL;
+}
+
+BIO* tr_uv_tls_bio_new(tr_uv_tls_bio_buf_t* buf, tr_uv_tls_bio_ktls_cb ktls_cb, void* arg)
+{
+    BIO* bio;
+    tr_uv_tls_bio_ctx_t* ctx;
+
+    pc_assert(tr_uv_tls_bio__method);
+
+    bio = BIO_new(tr_uv_tls_bio__method);
+    if (bio) {
+        ctx = (tr_uv_tls_bio_ctx_t*)pc_lib_malloc(sizeof(tr_uv_tls_bio_ctx_t));
+        ctx->buf = buf;
+        ctx->ktls_cb = ktls_cb;
+        ctx->ktls_arg = arg;
+        ctx->ktls_send = 0;
+
+        BIO_set_data(bio, ctx);
+        BIO_set_init(bio, 1);
+    }
+    return bio;
+}
+
+char* tr_uv_tls_bio_buf_reserve(tr_uv_tls_bio_buf_t* buf, size_t len, size_t* room)
+{
+    size_t cap;
+
+    if (!buf->base) {
+        if (buf->pooled) {
+            buf->base = tr_uv_rbuf_get();
+            buf->cap = PC_TCP_READ_BUFFER_SIZE;
+        } else {
+            buf->cap = len > TR_UV_TLS_BIO_MIN_CAP ? len : TR_UV_TLS_BIO_MIN_CAP;
+            buf->base = (char*)pc_lib_malloc(buf->cap);
+        }
+        buf->start = buf->end = 0;
+    }
+
+    if (buf->cap - buf->end < len && buf->start > 0) {
+        memmove(buf->base, buf->base + buf->start, buf->end - buf->start);
+        buf->end -= buf->start;
+        buf->start = 0;
+    }
+
+    if (buf->cap - buf->end < len && !buf->pooled) {
+        cap = buf->cap * 2;
+        while (cap - buf->end < len) {
+            cap *= 2;
+        }
+        buf->base = (char*)pc_lib_realloc(buf->base, cap);
+        buf->cap = cap;
+    }
+
+    *room = buf->cap - buf->end;
+    return buf->base + buf->end;
+}
+
+void tr_uv_tls_bio_buf_reset(tr_uv_tls_bio_buf_t* buf)
+{
+    buf->start = buf->end = 0;
+
+    if (buf->pooled && buf->base) {
+        tr_uv_rbuf_put(buf->base);
+        buf->base = NULL;
+        buf->cap = 0;
+    }
+}
+
+void tr_uv_tls_bio_buf_free(tr_uv_tls_bio_buf_t* buf)
+{
+    if (buf->pooled) {
+        tr_uv_tls_bio_buf_reset(buf);
+    } else {
+        pc_lib_free(buf->base);
+    }
+    buf->base = NULL;
+    buf->cap = 0;
+    buf->start = buf->end = 0;
+}
@@ -0,0 +1,64 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifndef TR_UV_TLS_BIO_H
+#define TR_UV_TLS_BIO_H
+
+#include <stddef.h>
+
+#include <openssl/bio.h>
+
+/**
+ * BIOs between OpenSSL and the socket of a tls transport, backed by
+ * buffers the transport owns instead of memory BIOs.
+ *
+ * The socket reads ciphertext straight into the buffer of the input BIO,
+ * which SSL_read consumes from, and uv_write sends what SSL_write put in
+ * the buffer of the output BIO, so neither side copies the ciphertext in
+ * or out of a BIO. Consumed bytes are dropped from the front of a buffer
+ * by moving the rest back only when room is needed at its end, as both
+ * libuv and OpenSSL want contiguous memory.
+ */
+
+typedef struct {
+    char* base;
+    size_t cap;
+    size_t start; /* first byte not consumed yet */
+    size_t end;   /* end of the bytes written */
+    int pooled;   /* borrows a tr_uv_rbuf read buffer while it holds bytes */
+} tr_uv_tls_bio_buf_t;
+
+void tr_uv_tls_bio_init(void);
+void tr_uv_tls_bio_cleanup(void);
+
+/**
+ * Called when OpenSSL wants to hand the records of one direction to the
+ * kernel (kTLS) once the handshake is done, with the key material it passes
+ * to BIO_set_ktls. Returns 1 if the kernel took them, OpenSSL then writes
+ * plaintext to the BIO, or 0 to go on encrypting in userspace.
+ */
+typedef int (*tr_uv_tls_bio_ktls_cb)(void* arg, void* crypto_info, int is_tx);
+
+/**
+ * A BIO reading from or writing to `buf`, which must outlive it. Freeing
+ * the BIO leaves `buf` alone. `ktls_cb` may be NULL, kTLS is then refused.
+ * Resetting the BIO turns kTLS off again.
+ */
+BIO* tr_uv_tls_bio_new(tr_uv_tls_bio_buf_t* buf, tr_uv_tls_bio_ktls_cb ktls_cb, void* arg);
+
+#define tr_uv_tls_bio_buf_len(buf) ((buf)->end - (buf)->start)
+
+/**
+ * Makes room at the end of `buf` for `len` more bytes, returning it and
+ * setting `*room` to its size. A pooled buffer borrows a read buffer when it
+ * has none and never grows, so it may have less room than asked for.
+ */
+char* tr_uv_tls_bio_buf_reserve(tr_uv_tls_bio_buf_t* buf, size_t len, size_t* room);
+
+/* drops the bytes and gives a borrowed read buffer back to the pool */
+void tr_uv_tls_bio_buf_reset(tr_uv_tls_bio_buf_t* buf);
+void tr_uv_tls_bio_buf_free(tr_uv_tls_bio_buf_t* buf);
+
+#endif /* TR_UV_TLS_BIO_H */
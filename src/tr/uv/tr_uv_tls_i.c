@@ -21,7 +21,11 @@ pc_transport_t* tr_uv_tls_create(pc_transport_plugin_t* plugin)
 
     /* inherit from tr_uv_tcp */
     tls->base.base.connect = tr_uv_tcp_connect;
+    tls->base.base.connect_endpoints = tr_uv_tcp_connect_endpoints;
+    tls->base.base.endpoint_health = tr_uv_tcp_endpoint_health;
     tls->base.base.send = tr_uv_tcp_send;
+    tls->base.base.send_with_opts = tr_uv_tcp_send_with_opts;
+    tls->base.base.send_prepared = tr_uv_tcp_send_prepared;
     tls->base.base.disconnect = tr_uv_tcp_disconnect;
     tls->base.base.cleanup = tr_uv_tcp_cleanup;
     tls->base.base.quality = tr_uv_tcp_quality;
@@ -32,13 +36,17 @@ pc_transport_t* tr_uv_tls_create(pc_transport_plugin_t* plugin)
     tls->base.base.init = tr_uv_tls_init;
     tls->base.base.internal_data = tr_uv_tls_internal_data;
     tls->base.base.plugin = tr_uv_tls_plugin;
+    tls->base.base.stats = tr_uv_tls_stats;
 
     tls->base.reset_fn = tls__reset;
     tls->base.conn_done_cb = tls__conn_done_cb;
     tls->base.write_async_cb = tls__write_async_cb;
     tls->base.cleanup_async_cb = tls__cleanup_async_cb;
+    tls->base.alloc_cb = tls__alloc_cb;
     tls->base.on_tcp_read_cb = tls__on_tcp_read_cb;
     tls->base.write_check_timeout_cb = tls__write_timeout_check_cb;
+    tls->base.ls_load_fn = tls__ls_load;
+    tls->base.ls_save_fn = tls__ls_save;
 
     return (pc_transport_t*)tls;
 }
@@ -54,13 +62,23 @@ void tr_uv_tls_plugin_on_register(pc_transport_plugin_t* plugin)
     tr_uv_tcp_plugin_on_register(plugin);
 
     ERR_load_BIO_strings();
+    tr_uv_tls_bio_init();
 
     pl = (tr_uv_tls_transport_plugin_t* )plugin;
     pl->ctx = SSL_CTX_new(TLS_client_method());
     if (!pl->ctx) {
         pc_lib_log(PC_LOG_ERROR, "tr_uv_tls_plugin_on_register - tls error: %s",
                 ERR_error_string(ERR_get_error(), NULL));
+    } else {
+        /* idle connections give their record buffers back */
+        SSL_CTX_set_mode(pl->ctx, SSL_MODE_RELEASE_BUFFERS);
+
+        /* sessions are kept per endpoint by tls__new_session_cb */
+        SSL_CTX_set_session_cache_mode(pl->ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(pl->ctx, tls__new_session_cb);
     }
+
+    tr_uv_tls_sess_cache_init(&pl->sessions);
 }
 
 void tr_uv_tls_plugin_on_deregister(pc_transport_plugin_t* plugin)
@@ -68,11 +86,14 @@ void tr_uv_tls_plugin_on_deregister(pc_transport_plugin_t* plugin)
     int i;
     tr_uv_tls_transport_plugin_t* pl = (tr_uv_tls_transport_plugin_t* )plugin;
 
+    tr_uv_tls_sess_cache_cleanup(&pl->sessions);
+
     if (pl->ctx) {
         SSL_CTX_free(pl->ctx);
         pl->ctx = NULL;
     }
 
+    tr_uv_tls_bio_cleanup();
     tr_uv_tcp_plugin_on_deregister(plugin);
 }
 
@@ -102,42 +123,26 @@ int tr_uv_tls_init(pc_transport_t* trans, pc_client_t* client)
         return PC_RC_ERROR;
     }
 
-    tls->tls = SSL_new(plugin->ctx);
-    if (!tls->tls) {
-        ret = ERR_get_error();
-        pc_lib_log(PC_LOG_ERROR, "tr_uv_tls_init - create ssl error: %s", ERR_error_string(ret, NULL));
+    /* ciphertext read from the socket borrows a read buffer while it waits */
+    tls->rbuf.pooled = 1;
+
+    tls->internal[0] = &tt->uv_loop;
+    if (tls__ssl_new(tls) != PC_RC_OK) {
         tt->reset_fn(tt);
         return PC_RC_ERROR;
     }
 
-    if (plugin->enable_verify) {
-        SSL_set_verify(tls->tls, SSL_VERIFY_PEER, NULL);
-    } else {
-        SSL_set_verify(tls->tls, SSL_VERIFY_NONE, NULL);
-    }
-
-    SSL_set_connect_state(tls->tls);
-
-    tls->in = BIO_new(BIO_s_mem());
-    tls->out = BIO_new(BIO_s_mem());
-
+    tls->ktls_tx = 0;
     tls->is_handshake_completed = 0;
 
-    /* oom, non-handling */
-    if (!tls->in || !tls->out)
-        abort();
-
-    SSL_set_bio(tls->tls, tls->in, tls->out);
-
     tls->retry_wb_len = 0;
     tls->retry_wb = NULL;
+    tls->early_wi = NULL;
+    tls->early_data_used = 0;
 
-    tls->should_retry = NULL;
+    QUEUE_INIT(&tls->should_retry_queue);
     QUEUE_INIT(&tls->when_tcp_is_writing_queue);
 
-    tls->internal[0] = &tt->uv_loop;
-    tls->internal[1] = tls->tls;
-
     return PC_RC_OK;
 }
 
@@ -151,3 +156,17 @@ pc_transport_plugin_t* tr_uv_tls_plugin(pc_transport_t* trans)
 {
     return pc_tr_uv_tls_trans_plugin();
 }
+
+int tr_uv_tls_stats(pc_transport_t* trans, pc_client_stats_t* stats)
+{
+    tr_uv_tls_transport_t* tls = (tr_uv_tls_transport_t*)trans;
+
+    tr_uv_tcp_stats(trans, stats);
+    stats->tls_full_handshakes = tls->full_handshakes;
+    stats->tls_resumed_handshakes = tls->resumed_handshakes;
+    stats->tls_records = tls->records;
+    stats->tls_ktls_tx = tls->ktls_tx;
+    stats->tls_early_data_accepted = tls->early_data_accepted;
+    stats->tls_early_data_rejected = tls->early_data_rejected;
+    return PC_RC_OK;
+}
@@ -11,8 +11,14 @@
 #include <openssl/err.h>
 
 #include "tr_uv_tcp_i.h"
+#include "tr_uv_tls_sess.h"
+#include "tr_uv_tls_bio.h"
 
-#define PC_TLS_READ_BUF_SIZE 1024
+/* plaintext of a full TLS record */
+#define PC_TLS_RECORD_SIZE 16384
+
+/* the most SSL_read returns at once */
+#define PC_TLS_READ_BUF_SIZE PC_TLS_RECORD_SIZE
 
 typedef struct {
     tr_uv_tcp_transport_t base;
@@ -21,16 +27,40 @@ typedef struct {
     BIO* in;
     BIO* out;
 
-    int is_handshake_completed;
+    /*
+     * buffers of the in and out BIOs. wbuf_flight is the ciphertext uv_write
+     * is sending, while SSL_write goes on filling wbuf.
+     */
+    tr_uv_tls_bio_buf_t rbuf;
+    tr_uv_tls_bio_buf_t wbuf;
+    tr_uv_tls_bio_buf_t wbuf_flight;
 
-    char rb[PC_TLS_READ_BUF_SIZE];
+    int is_handshake_completed;
 
+    /*
+     * write items are encrypted in batches of up to a record. When SSL_write
+     * has to be retried, the batch goes to should_retry_queue and retry_wb
+     * keeps its bytes, as the retry must pass the same ones.
+     */
     char* retry_wb;
     int retry_wb_len;
 
-    tr_uv_wi_t* should_retry;
+    QUEUE should_retry_queue;
     QUEUE when_tcp_is_writing_queue;
 
+    uint64_t full_handshakes;
+    uint64_t resumed_handshakes;
+    uint64_t records;
+
+    /* the kernel encrypts what is sent, see tls__ktls_start */
+    int ktls_tx;
+
+    /* the handshake package sent as early data, until the server took it or not */
+    tr_uv_wi_t* early_wi;
+    int early_data_used; /* early data was tried on this connection */
+    uint64_t early_data_accepted;
+    uint64_t early_data_rejected;
+
     void* internal[2];
 } tr_uv_tls_transport_t;
 
@@ -39,6 +69,8 @@ typedef struct {
 
     SSL_CTX* ctx;
     int enable_verify;
+
+    tr_uv_tls_sess_cache_t sessions;
 } tr_uv_tls_transport_plugin_t;
 
 pc_transport_t* tr_uv_tls_create(pc_transport_plugin_t* plugin);
@@ -47,6 +79,7 @@ void tr_uv_tls_plugin_on_register(pc_transport_plugin_t* plugin);
 void tr_uv_tls_plugin_on_deregister(pc_transport_plugin_t* plugin);
 
 int tr_uv_tls_init(pc_transport_t* trans, pc_client_t* client);
+int tr_uv_tls_stats(pc_transport_t* trans, pc_client_stats_t* stats);
 
 void* tr_uv_tls_internal_data(pc_transport_t* trans);
 pc_transport_plugin_t* tr_uv_tls_plugin(pc_transport_t* trans);
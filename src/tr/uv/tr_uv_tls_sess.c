@@ -0,0 +1,216 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include <openssl/evp.h>
+
+#include <pitaya.h>
+#include <pc_lib.h>
+
+#include "tr_uv_tls_sess.h"
+
+/*
+ * Returns the latest session of host and port, or the oldest one if
+ * `oldest`, and sets `*count` to how many there are if not NULL.
+ */
+static tr_uv_tls_sess_t* tr_uv_tls_sess__find(tr_uv_tls_sess_cache_t* cache, const char* host, int port,
+                                              int oldest, int* count)
+{
+    tr_uv_tls_sess_t* found = NULL;
+    tr_uv_tls_sess_t* s;
+    int n = 0;
+    int i;
+
+    for (i = 0; i < TR_UV_TLS_SESS_MAX; ++i) {
+        s = &cache->list[i];
+        if (!host || !s->host || s->port != port || strcmp(s->host, host)) {
+            continue;
+        }
+        if (!found || (oldest ? s->used < found->used : s->used > found->used)) {
+            found = s;
+        }
+        n++;
+    }
+
+    if (count) {
+        *count = n;
+    }
+    return found;
+}
+
+static void tr_uv_tls_sess__free(tr_uv_tls_sess_t* s)
+{
+    pc_lib_free(s->host);
+    SSL_SESSION_free(s->sess);
+    memset(s, 0, sizeof(tr_uv_tls_sess_t));
+}
+
+static int tr_uv_tls_sess__resumable(SSL_SESSION* sess)
+{
+    return SSL_SESSION_is_resumable(sess)
+        && SSL_SESSION_get_time(sess) + SSL_SESSION_get_timeout(sess) > (long)time(NULL);
+}
+
+/* must be called with the mutex held */
+static void tr_uv_tls_sess__put(tr_uv_tls_sess_cache_t* cache, const char* host, int port, SSL_SESSION* sess)
+{
+    tr_uv_tls_sess_t* s;
+    int count;
+    int i;
+
+    s = tr_uv_tls_sess__find(cache, host, port, 1, &count);
+    if (count < TR_UV_TLS_SESS_PER_ENDPOINT) {
+        /* a free slot, or the least recently used one */
+        s = &cache->list[0];
+        for (i = 0; i < TR_UV_TLS_SESS_MAX && s->host; ++i) {
+            if (!cache->list[i].host || cache->list[i].used < s->used) {
+                s = &cache->list[i];
+            }
+        }
+    }
+
+    if (s->host) {
+        pc_lib_log(PC_LOG_DEBUG, "tr_uv_tls_sess_put - evict a session of %s:%d", s->host, s->port);
+        tr_uv_tls_sess__free(s);
+    }
+
+    s->host = (char*)pc_lib_strdup(host);
+    s->port = port;
+    s->sess = sess;
+    s->used = ++cache->clock;
+}
+
+void tr_uv_tls_sess_cache_init(tr_uv_tls_sess_cache_t* cache)
+{
+    memset(cache->list, 0, sizeof(cache->list));
+    cache->clock = 0;
+    pc_mutex_init(&cache->mutex);
+}
+
+void tr_uv_tls_sess_cache_cleanup(tr_uv_tls_sess_cache_t* cache)
+{
+    tr_uv_tls_sess_cache_clear(cache);
+    pc_mutex_destroy(&cache->mutex);
+}
+
+void tr_uv_tls_sess_cache_clear(tr_uv_tls_sess_cache_t* cache)
+{
+    int i;
+
+    pc_mutex_lock(&cache->mutex);
+    for (i = 0; i < TR_UV_TLS_SESS_MAX; ++i) {
+        if (cache->list[i].host) {
+            tr_uv_tls_sess__free(&cache->list[i]);
+        }
+    }
+    pc_mutex_unlock(&cache->mutex);
+}
+
+SSL_SESSION* tr_uv_tls_sess_get(tr_uv_tls_sess_cache_t* cache, const char* host, int port)
+{
+    tr_uv_tls_sess_t* s;
+    SSL_SESSION* sess = NULL;
+
+    pc_mutex_lock(&cache->mutex);
+    while ((s = tr_uv_tls_sess__find(cache, host, port, 0, NULL)) && !tr_uv_tls_sess__resumable(s->sess)) {
+        pc_lib_log(PC_LOG_DEBUG, "tr_uv_tls_sess_get - a session of %s:%d expired", host, port);
+        tr_uv_tls_sess__free(s);
+    }
+
+    if (s && SSL_SESSION_get_protocol_version(s->sess) >= TLS1_3_VERSION) {
+        /* single use, the reference of the cache goes to the caller */
+        sess = s->sess;
+        s->sess = NULL;
+        tr_uv_tls_sess__free(s);
+    } else if (s) {
+        sess = s->sess;
+        SSL_SESSION_up_ref(sess);
+        s->used = ++cache->clock;
+    }
+    pc_mutex_unlock(&cache->mutex);
+
+    return sess;
+}
+
+void tr_uv_tls_sess_put(tr_uv_tls_sess_cache_t* cache, const char* host, int port, SSL_SESSION* sess)
+{
+    pc_mutex_lock(&cache->mutex);
+    tr_uv_tls_sess__put(cache, host, port, sess);
+    pc_mutex_unlock(&cache->mutex);
+}
+
+void tr_uv_tls_sess_remove(tr_uv_tls_sess_cache_t* cache, const char* host, int port)
+{
+    tr_uv_tls_sess_t* s;
+
+    pc_mutex_lock(&cache->mutex);
+    while ((s = tr_uv_tls_sess__find(cache, host, port, 0, NULL))) {
+        tr_uv_tls_sess__free(s);
+    }
+    pc_mutex_unlock(&cache->mutex);
+}
+
+char* tr_uv_tls_sess_encode(tr_uv_tls_sess_cache_t* cache, const char* host, int port)
+{
+    tr_uv_tls_sess_t* s;
+    unsigned char* der = NULL;
+    unsigned char* p;
+    char* data = NULL;
+    int len = 0;
+
+    pc_mutex_lock(&cache->mutex);
+    s = tr_uv_tls_sess__find(cache, host, port, 0, NULL);
+    if (s) {
+        len = i2d_SSL_SESSION(s->sess, NULL);
+        if (len > 0) {
+            der = (unsigned char*)pc_lib_malloc(len);
+            p = der;
+            i2d_SSL_SESSION(s->sess, &p);
+        }
+    }
+    pc_mutex_unlock(&cache->mutex);
+
+    if (der) {
+        data = (char*)pc_lib_malloc(4 * ((len + 2) / 3) + 1);
+        EVP_EncodeBlock((unsigned char*)data, der, len);
+        pc_lib_free(der);
+    }
+    return data;
+}
+
+void tr_uv_tls_sess_decode(tr_uv_tls_sess_cache_t* cache, const char* host, int port, const char* data)
+{
+    size_t data_len = strlen(data);
+    unsigned char* der;
+    const unsigned char* p;
+    SSL_SESSION* sess = NULL;
+    int len;
+
+    der = (unsigned char*)pc_lib_malloc(3 * (data_len / 4) + 1);
+    /* the padding decodes to trailing zeros, which the DER length leaves out */
+    len = EVP_DecodeBlock(der, (const unsigned char*)data, (int)data_len);
+    if (len > 0) {
+        p = der;
+        sess = d2i_SSL_SESSION(NULL, &p, len);
+    }
+    pc_lib_free(der);
+
+    if (!sess || !tr_uv_tls_sess__resumable(sess)) {
+        pc_lib_log(PC_LOG_DEBUG, "tr_uv_tls_sess_decode - stored session of %s:%d is %s", host, port,
+                   sess ? "expired" : "not valid");
+        SSL_SESSION_free(sess);
+        return ;
+    }
+
+    pc_mutex_lock(&cache->mutex);
+    if (tr_uv_tls_sess__find(cache, host, port, 0, NULL)) {
+        SSL_SESSION_free(sess);
+    } else {
+        tr_uv_tls_sess__put(cache, host, port, sess);
+    }
+    pc_mutex_unlock(&cache->mutex);
+}
@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifndef TR_UV_TLS_SESS_H
+#define TR_UV_TLS_SESS_H
+
+#include <stdint.h>
+
+#include <openssl/ssl.h>
+
+#include <pc_mutex.h>
+
+/**
+ * TLS sessions, tickets or session ids, kept per endpoint so that
+ * reconnects resume them instead of doing a full handshake.
+ *
+ * One cache is shared by every client of the tls plugin, so a client
+ * connecting to an endpoint another one already talked to resumes too.
+ * TLS 1.3 tickets are used once, as RFC 8446 recommends and OpenSSL
+ * enforces, so the latest TR_UV_TLS_SESS_PER_ENDPOINT ones of an endpoint
+ * are kept (servers usually hand out two) and a lookup takes one out. TLS
+ * 1.2 sessions stay until they expire. The least recently used session is
+ * evicted when the cache is full. Guarded by its own mutex, clients store
+ * and look sessions up from their uv loop threads.
+ */
+
+#define TR_UV_TLS_SESS_MAX 32
+#define TR_UV_TLS_SESS_PER_ENDPOINT 2
+
+/* local storage key of the sessions, next to the route dictionaries */
+#define TR_UV_TLS_SESS_LCK "tlsSessions"
+
+typedef struct {
+    char* host;
+    int port;
+    SSL_SESSION* sess;
+    uint64_t used; /* cache clock of the last store or lookup */
+} tr_uv_tls_sess_t;
+
+typedef struct {
+    pc_mutex_t mutex;
+    tr_uv_tls_sess_t list[TR_UV_TLS_SESS_MAX];
+    uint64_t clock;
+} tr_uv_tls_sess_cache_t;
+
+void tr_uv_tls_sess_cache_init(tr_uv_tls_sess_cache_t* cache);
+void tr_uv_tls_sess_cache_cleanup(tr_uv_tls_sess_cache_t* cache);
+void tr_uv_tls_sess_cache_clear(tr_uv_tls_sess_cache_t* cache);
+
+/**
+ * Returns a new reference to the latest session of host and port, or NULL
+ * if there is none that can still be resumed. A TLS 1.3 session is removed
+ * from the cache.
+ */
+SSL_SESSION* tr_uv_tls_sess_get(tr_uv_tls_sess_cache_t* cache, const char* host, int port);
+
+/**
+ * Adds `sess` to the sessions of host and port, taking over the reference
+ * of the caller.
+ */
+void tr_uv_tls_sess_put(tr_uv_tls_sess_cache_t* cache, const char* host, int port, SSL_SESSION* sess);
+
+/* forgets every session of host and port */
+void tr_uv_tls_sess_remove(tr_uv_tls_sess_cache_t* cache, const char* host, int port);
+
+/**
+ * The latest session of host and port as base64 DER, to be freed by the
+ * caller, or NULL if there is none.
+ */
+char* tr_uv_tls_sess_encode(tr_uv_tls_sess_cache_t* cache, const char* host, int port);
+
+/**
+ * Stores a session encoded by tr_uv_tls_sess_encode, unless the cache
+ * already has one for host and port, which is fresher.
+ */
+void tr_uv_tls_sess_decode(tr_uv_tls_sess_cache_t* cache, const char* host, int port, const char* data);
+
+#endif /* TR_UV_TLS_SESS_H */
@@ -0,0 +1,31 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#include "tr_uv_uring.h"
+
+#ifdef TR_UV_URING_SUPPORTED
+
+#include "pr_msg.h"
+#include "tr_uv_uring_i.h"
+
+static tr_uv_tcp_transport_plugin_t instance =
+{
+    {
+        tr_uv_uring_create,
+        tr_uv_uring_release,
+        tr_uv_tcp_plugin_on_register,
+        tr_uv_tcp_plugin_on_deregister,
+        PC_TR_NAME_UV_URING
+    },
+    pr_default_msg_encoder, /* pr_msg_encoder */
+    pr_default_msg_decoder  /* pr_msg_decoder */
+};
+
+pc_transport_plugin_t* pc_tr_uv_uring_trans_plugin()
+{
+    return (pc_transport_plugin_t* )&instance;
+}
+
+#endif /* TR_UV_URING_SUPPORTED */
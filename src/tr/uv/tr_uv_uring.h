@@ -0,0 +1,26 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifndef TR_UV_URING_H
+#define TR_UV_URING_H
+
+#include <pitaya_trans.h>
+
+/*
+ * multishot receives and provided buffer rings came with Linux 6.0, older
+ * kernels fail at run time and the transport goes on with libuv.
+ */
+#if defined(__linux__) && !defined(__ANDROID__)
+#include <linux/io_uring.h>
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_SETUP_SINGLE_ISSUER)
+#define TR_UV_URING_SUPPORTED 1
+#endif
+#endif
+
+#ifdef TR_UV_URING_SUPPORTED
+pc_transport_plugin_t* pc_tr_uv_uring_trans_plugin();
+#endif
+
+#endif /* TR_UV_URING_H */
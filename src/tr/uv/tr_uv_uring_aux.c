@@ -0,0 +1,425 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#include "tr_uv_uring_aux.h"
+
+#ifdef TR_UV_URING_SUPPORTED
+
+#include <errno.h>
+#include <string.h>
+
+#include <pc_assert.h>
+#include <pc_lib.h>
+
+#include "tr_uv_tcp_aux.h"
+
+#define URING_USER_DATA(ut, op) (((uint64_t)(ut)->generation << 8) | (op))
+#define URING_OP(user_data) ((int)((user_data) & 0xff))
+#define URING_GENERATION(user_data) ((unsigned int)((user_data) >> 8))
+
+/*
+ * Submits the `ops` entries got since the last submit. On error none of
+ * them was taken, see tr_uv_uring_ring_submit, and those the kernel did not
+ * take yet go with the next submit.
+ */
+static int uring__submit(tr_uv_uring_transport_t* ut, unsigned int ops)
+{
+    int ret = tr_uv_uring_ring_submit(&ut->ring, 0);
+
+    if (ret < 0) {
+        return ret;
+    }
+    ut->inflight += ops;
+    return 0;
+}
+
+static void uring__free_orphans(tr_uv_uring_transport_t* ut)
+{
+    int i;
+
+    for (i = 0; i < ut->orphan_count; ++i) {
+        pc_lib_free(ut->orphans[i].base);
+        if (ut->orphans[i].prepared) {
+            pc_prepared_msg_release(ut->orphans[i].prepared);
+        }
+    }
+    pc_lib_free(ut->orphans);
+    ut->orphans = NULL;
+    ut->orphan_count = 0;
+}
+
+static void uring__add_orphan(tr_uv_uring_transport_t* ut, char* base, pc_prepared_msg_t* prepared)
+{
+    ut->orphans = (tr_uv_uring_orphan_t*)pc_lib_realloc(ut->orphans,
+                                                        sizeof(tr_uv_uring_orphan_t) * (ut->orphan_count + 1));
+    ut->orphans[ut->orphan_count].base = base;
+    ut->orphans[ut->orphan_count].prepared = prepared;
+    ut->orphan_count++;
+}
+
+/*
+ * The reset fails the write items being sent, but the kernel may still be
+ * reading their buffers, so they are kept until the sends complete.
+ */
+static void uring__orphan_writes(tr_uv_uring_transport_t* ut)
+{
+    tr_uv_tcp_transport_t* tt = &ut->base;
+    tr_uv_wi_t* wi;
+    QUEUE* q;
+
+    pc_mutex_lock(&tt->wq_mutex);
+    QUEUE_FOREACH(q, &tt->writing_queue) {
+        wi = (tr_uv_wi_t* )QUEUE_DATA(q, tr_uv_wi_t, queue);
+        uring__add_orphan(ut, wi->buf.base, wi->prepared);
+        wi->buf.base = NULL;
+        wi->buf.len = 0;
+        wi->prepared = NULL;
+    }
+    pc_mutex_unlock(&tt->wq_mutex);
+
+    if (ut->iov) {
+        uring__add_orphan(ut, (char*)ut->iov, NULL);
+        ut->iov = NULL;
+    }
+}
+
+static int uring__arm_recv(tr_uv_uring_transport_t* ut)
+{
+    struct io_uring_sqe* sqe = tr_uv_uring_ring_sqe(&ut->ring);
+
+    if (!sqe) {
+        return UV_ENOBUFS;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = ut->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = TR_UV_URING_BUF_GROUP;
+    sqe->user_data = URING_USER_DATA(ut, TR_UV_URING_OP_RECV);
+
+    return uring__submit(ut, 1);
+}
+
+static void uring__on_recv(tr_uv_uring_transport_t* ut, const struct io_uring_cqe* cqe, int current)
+{
+    tr_uv_tcp_transport_t* tt = &ut->base;
+    char* buf;
+    int ret;
+
+    if (!current) {
+        tr_uv_uring_ring_buf_put(&ut->ring, cqe);
+        return;
+    }
+
+    if (cqe->res > 0) {
+        buf = tr_uv_uring_ring_buf(&ut->ring, cqe);
+        pc_assert(buf);
+
+        tr_uv_sockopt_rearm(&tt->socket, &tt->sockopt);
+        pc_pkg_parser_feed(&tt->pkg_parser, buf, (size_t)cqe->res);
+        tr_uv_uring_ring_buf_put(&ut->ring, cqe);
+
+        /* a package handler may have reset the connection */
+        if (cqe->flags & IORING_CQE_F_MORE || !ut->active) {
+            return;
+        }
+    } else {
+        tr_uv_uring_ring_buf_put(&ut->ring, cqe);
+    }
+
+    /* every buffer was in use or the receive stopped on its own, it is armed again */
+    if (cqe->res > 0 || cqe->res == -ENOBUFS) {
+        ret = uring__arm_recv(ut);
+        if (!ret) {
+            return;
+        }
+        pc_lib_log(PC_LOG_ERROR, "uring__on_recv - arm receive error: %s", uv_strerror(ret));
+        tcp__on_read_error(tt, ret);
+        return;
+    }
+
+    if (cqe->res == -EINVAL) {
+        /* no multishot receives before Linux 6.0, the next connections use libuv */
+        pc_lib_log(PC_LOG_WARN, "uring__on_recv - multishot receive not supported, using libuv");
+        ut->ring_state = TR_UV_URING_RING_UNAVAILABLE;
+    }
+
+    tcp__on_read_error(tt, cqe->res == 0 ? UV_EOF : cqe->res);
+}
+
+static void uring__on_send(tr_uv_uring_transport_t* ut, const struct io_uring_cqe* cqe, int current)
+{
+    pc_assert(ut->inflight_sends > 0);
+    ut->inflight_sends--;
+
+    if (current) {
+        if (cqe->res < 0 && !ut->send_error) {
+            ut->send_error = cqe->res;
+        }
+
+        pc_assert(ut->sends > 0);
+        if (--ut->sends == 0) {
+            pc_lib_free(ut->iov);
+            ut->iov = NULL;
+            tcp__on_write_done(&ut->base, ut->send_error);
+        }
+    }
+
+    if (!ut->inflight_sends) {
+        uring__free_orphans(ut);
+    }
+}
+
+static void uring__reap(tr_uv_uring_transport_t* ut)
+{
+    struct io_uring_cqe* cqe;
+    struct io_uring_cqe c;
+    int current;
+
+    while ((cqe = tr_uv_uring_ring_peek(&ut->ring))) {
+        c = *cqe;
+        tr_uv_uring_ring_seen(&ut->ring);
+
+        if (!(c.flags & IORING_CQE_F_MORE)) {
+            pc_assert(ut->inflight > 0);
+            ut->inflight--;
+        }
+
+        current = ut->active && URING_GENERATION(c.user_data) == ut->generation;
+
+        switch (URING_OP(c.user_data)) {
+        case TR_UV_URING_OP_RECV:
+            uring__on_recv(ut, &c, current);
+            break;
+        case TR_UV_URING_OP_SEND:
+            uring__on_send(ut, &c, current);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static void uring__ring_poll_cb(uv_poll_t* handle, int status, int events)
+{
+    tr_uv_uring_transport_t* ut = (tr_uv_uring_transport_t*)handle->data;
+
+    (void)events;
+    if (status) {
+        pc_lib_log(PC_LOG_ERROR, "uring__ring_poll_cb - poll error: %s", uv_strerror(status));
+    }
+    uring__reap(ut);
+}
+
+static void uring__ring_open(tr_uv_uring_transport_t* ut)
+{
+    tr_uv_tcp_transport_t* tt = &ut->base;
+    int ret;
+
+    ret = tr_uv_uring_ring_init(&ut->ring);
+    if (!ret) {
+        ret = uv_poll_init(&tt->uv_loop, &ut->ring_poll, ut->ring.fd);
+        if (!ret) {
+            ut->ring_poll.data = ut;
+            ret = uv_poll_start(&ut->ring_poll, UV_READABLE, uring__ring_poll_cb);
+            if (ret) {
+                uv_close((uv_handle_t*)&ut->ring_poll, NULL);
+            }
+        }
+        if (ret) {
+            tr_uv_uring_ring_close(&ut->ring);
+        }
+    }
+
+    if (ret) {
+        /* old kernels, seccomp filters and io_uring_disabled */
+        pc_lib_log(PC_LOG_WARN, "uring__ring_open - io_uring not available: %s, using libuv", uv_strerror(ret));
+        ut->ring_state = TR_UV_URING_RING_UNAVAILABLE;
+        return;
+    }
+
+    pc_lib_log(PC_LOG_INFO, "uring__ring_open - io_uring ready, %d buffers of %d bytes",
+               TR_UV_URING_BUF_COUNT, TR_UV_URING_BUF_SIZE);
+    ut->ring_state = TR_UV_URING_RING_READY;
+}
+
+int uring__read_start(tr_uv_tcp_transport_t* tt)
+{
+    tr_uv_uring_transport_t* ut = (tr_uv_uring_transport_t*)tt;
+    int ret;
+
+    if (ut->ring_state == TR_UV_URING_RING_NONE) {
+        uring__ring_open(ut);
+    }
+
+    if (ut->ring_state != TR_UV_URING_RING_READY) {
+        return uv_read_start((uv_stream_t* )&tt->socket, tt->alloc_cb, tt->on_tcp_read_cb);
+    }
+
+    ret = uv_fileno((uv_handle_t*)&tt->socket, &ut->fd);
+    if (ret) {
+        return ret;
+    }
+
+    ut->generation++;
+    ut->sends = 0;
+    ut->send_error = 0;
+    ut->active = 1;
+
+    ret = uring__arm_recv(ut);
+    if (ret) {
+        ut->active = 0;
+    }
+    return ret;
+}
+
+int uring__write(tr_uv_tcp_transport_t* tt, const uv_buf_t* bufs, int buf_cnt)
+{
+    tr_uv_uring_transport_t* ut = (tr_uv_uring_transport_t*)tt;
+    struct io_uring_sqe* sqe;
+    int sends;
+    int ret;
+    int i;
+
+    if (!ut->active) {
+        return uv_write(&tt->write_req, (uv_stream_t* )&tt->socket, bufs, buf_cnt, tcp__write_done_cb);
+    }
+
+    pc_assert(!ut->sends && !ut->iov);
+
+    /* the receive may need an entry to be armed again */
+    if (buf_cnt <= TR_UV_URING_MAX_LINK && (unsigned)buf_cnt < tr_uv_uring_ring_space(&ut->ring)) {
+        /*
+         * linked sends run one after the other, and MSG_WAITALL has the
+         * kernel finish a partial one before the next, so the bytes keep
+         * their order. MSG_MORE holds them back until the last one.
+         */
+        for (i = 0; i < buf_cnt; ++i) {
+            sqe = tr_uv_uring_ring_sqe(&ut->ring);
+            sqe->opcode = IORING_OP_SEND;
+            sqe->fd = ut->fd;
+            sqe->addr = (uint64_t)(uintptr_t)bufs[i].base;
+            sqe->len = (uint32_t)bufs[i].len;
+            sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+            if (i + 1 < buf_cnt) {
+                sqe->msg_flags |= MSG_MORE;
+                sqe->flags = IOSQE_IO_LINK;
+            }
+            sqe->user_data = URING_USER_DATA(ut, TR_UV_URING_OP_SEND);
+        }
+        sends = buf_cnt;
+    } else {
+        sqe = tr_uv_uring_ring_sqe(&ut->ring);
+        if (!sqe) {
+            return UV_ENOBUFS;
+        }
+
+        ut->iov = (struct iovec*)pc_lib_malloc(sizeof(struct iovec) * buf_cnt);
+        for (i = 0; i < buf_cnt; ++i) {
+            ut->iov[i].iov_base = bufs[i].base;
+            ut->iov[i].iov_len = bufs[i].len;
+        }
+        memset(&ut->msg, 0, sizeof(ut->msg));
+        ut->msg.msg_iov = ut->iov;
+        ut->msg.msg_iovlen = (size_t)buf_cnt;
+
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = ut->fd;
+        sqe->addr = (uint64_t)(uintptr_t)&ut->msg;
+        sqe->len = 1;
+        sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+        sqe->user_data = URING_USER_DATA(ut, TR_UV_URING_OP_SEND);
+        sends = 1;
+    }
+
+    ret = uring__submit(ut, (unsigned int)sends);
+    if (ret) {
+        pc_lib_free(ut->iov);
+        ut->iov = NULL;
+        return ret;
+    }
+
+    ut->sends = sends;
+    ut->send_error = 0;
+    ut->inflight_sends += (unsigned int)sends;
+    return 0;
+}
+
+static void uring__cancel(tr_uv_uring_transport_t* ut, int fd, unsigned int flags)
+{
+    struct io_uring_sqe* sqe = tr_uv_uring_ring_sqe(&ut->ring);
+    int ret;
+
+    if (!sqe) {
+        pc_lib_log(PC_LOG_ERROR, "uring__cancel - submission queue full");
+        return;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd;
+    sqe->cancel_flags = flags;
+    sqe->user_data = URING_USER_DATA(ut, TR_UV_URING_OP_CANCEL);
+
+    ret = uring__submit(ut, 1);
+    if (ret) {
+        pc_lib_log(PC_LOG_ERROR, "uring__cancel - submit error: %s", uv_strerror(ret));
+    }
+}
+
+void uring__reset(tr_uv_tcp_transport_t* tt)
+{
+    tr_uv_uring_transport_t* ut = (tr_uv_uring_transport_t*)tt;
+
+    if (ut->active) {
+        /* before the socket is closed, as the operations hold on to it */
+        uring__cancel(ut, ut->fd, IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL);
+
+        if (ut->sends) {
+            uring__orphan_writes(ut);
+            ut->sends = 0;
+            tt->is_writing = 0;
+        }
+
+        ut->active = 0;
+        ut->generation++;
+    }
+
+    tcp__reset(tt);
+}
+
+void uring__cleanup_async_cb(uv_async_t* a)
+{
+    tr_uv_uring_transport_t* ut = (tr_uv_uring_transport_t*)a->data;
+    int ret;
+
+    /* resets and closes every handle, the ring poll included */
+    tcp__cleanup_async_cb(a);
+
+    if (ut->ring_state != TR_UV_URING_RING_READY) {
+        return;
+    }
+
+    /* the kernel must be done with the buffers before they are freed */
+    if (ut->inflight) {
+        uring__cancel(ut, 0, IORING_ASYNC_CANCEL_ANY);
+    }
+    while (ut->inflight) {
+        ret = tr_uv_uring_ring_submit(&ut->ring, 1);
+        if (ret < 0) {
+            pc_lib_log(PC_LOG_ERROR, "uring__cleanup_async_cb - wait error: %s", uv_strerror(ret));
+            break;
+        }
+        uring__reap(ut);
+    }
+
+    tr_uv_uring_ring_close(&ut->ring);
+    ut->ring_state = TR_UV_URING_RING_NONE;
+    uring__free_orphans(ut);
+    pc_lib_free(ut->iov);
+    ut->iov = NULL;
+}
+
+#endif /* TR_UV_URING_SUPPORTED */
@@ -0,0 +1,24 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifndef TR_UV_URING_AUX_H
+#define TR_UV_URING_AUX_H
+
+#include "tr_uv_uring_i.h"
+
+#ifdef TR_UV_URING_SUPPORTED
+
+/* writes longer than this are sent with a single sendmsg instead of linked sends */
+#define TR_UV_URING_MAX_LINK (TR_UV_URING_ENTRIES / 2)
+
+void uring__reset(tr_uv_tcp_transport_t* tt);
+void uring__cleanup_async_cb(uv_async_t* a);
+
+int uring__read_start(tr_uv_tcp_transport_t* tt);
+int uring__write(tr_uv_tcp_transport_t* tt, const uv_buf_t* bufs, int buf_cnt);
+
+#endif /* TR_UV_URING_SUPPORTED */
+
+#endif /* TR_UV_URING_AUX_H */
@@ -0,0 +1,104 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#include "tr_uv_uring_i.h"
+
+#ifdef TR_UV_URING_SUPPORTED
+
+#include <string.h>
+
+#include <pc_assert.h>
+#include <pc_lib.h>
+
+#include "tr_uv_tcp_aux.h"
+#include "tr_uv_uring_aux.h"
+
+pc_transport_t* tr_uv_uring_create(pc_transport_plugin_t* plugin)
+{
+    size_t len = sizeof(tr_uv_uring_transport_t);
+    tr_uv_uring_transport_t* ut = (tr_uv_uring_transport_t* )pc_lib_malloc(len);
+    memset(ut, 0, len);
+
+    (void)plugin; /* unused */
+
+    /* inherit from tr_uv_tcp */
+    ut->base.base.connect = tr_uv_tcp_connect;
+    ut->base.base.connect_endpoints = tr_uv_tcp_connect_endpoints;
+    ut->base.base.endpoint_health = tr_uv_tcp_endpoint_health;
+    ut->base.base.send = tr_uv_tcp_send;
+    ut->base.base.send_with_opts = tr_uv_tcp_send_with_opts;
+    ut->base.base.send_prepared = tr_uv_tcp_send_prepared;
+    ut->base.base.disconnect = tr_uv_tcp_disconnect;
+    ut->base.base.cleanup = tr_uv_tcp_cleanup;
+    ut->base.base.quality = tr_uv_tcp_quality;
+    ut->base.base.serializer = tr_uv_tcp_serializer;
+    ut->base.base.internal_data = tr_uv_tcp_internal_data;
+    ut->base.reconn_fn = tcp__reconn;
+    ut->base.conn_done_cb = tcp__conn_done_cb;
+    ut->base.write_async_cb = tcp__write_async_cb;
+    ut->base.write_check_timeout_cb = tcp__write_check_timeout_cb;
+    ut->base.alloc_cb = tcp__alloc_cb;
+    ut->base.on_tcp_read_cb = tcp__on_tcp_read_cb;
+
+    /* reimplemetating method */
+    ut->base.base.init = tr_uv_uring_init;
+    ut->base.base.plugin = tr_uv_uring_plugin;
+    ut->base.base.stats = tr_uv_uring_stats;
+
+    ut->base.reset_fn = uring__reset;
+    ut->base.cleanup_async_cb = uring__cleanup_async_cb;
+    ut->base.read_start_fn = uring__read_start;
+    ut->base.write_fn = uring__write;
+
+    return (pc_transport_t*)ut;
+}
+
+void tr_uv_uring_release(pc_transport_plugin_t* plugin, pc_transport_t* trans)
+{
+    (void)plugin; /* unused */
+
+    pc_lib_free(trans);
+}
+
+int tr_uv_uring_init(pc_transport_t* trans, pc_client_t* client)
+{
+    tr_uv_uring_transport_t* ut = (tr_uv_uring_transport_t* )trans;
+
+    pc_assert(ut);
+
+    /* the ring is set up by the first connection, on the loop thread */
+    ut->ring_state = TR_UV_URING_RING_NONE;
+    ut->active = 0;
+    ut->fd = -1;
+    ut->generation = 0;
+    ut->inflight = 0;
+    ut->inflight_sends = 0;
+    ut->sends = 0;
+    ut->send_error = 0;
+    ut->iov = NULL;
+    ut->orphans = NULL;
+    ut->orphan_count = 0;
+
+    return tr_uv_tcp_init(trans, client);
+}
+
+int tr_uv_uring_stats(pc_transport_t* trans, pc_client_stats_t* stats)
+{
+    tr_uv_uring_transport_t* ut = (tr_uv_uring_transport_t* )trans;
+
+    tr_uv_tcp_stats(trans, stats);
+    stats->uring_active = ut->active;
+    stats->uring_enters = ut->ring.enters;
+    return PC_RC_OK;
+}
+
+pc_transport_plugin_t* tr_uv_uring_plugin(pc_transport_t* trans)
+{
+    (void)trans; /* unused */
+
+    return pc_tr_uv_uring_trans_plugin();
+}
+
+#endif /* TR_UV_URING_SUPPORTED */
@@ -0,0 +1,85 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifndef TR_UV_URING_I_H
+#define TR_UV_URING_I_H
+
+#include "tr_uv_tcp_i.h"
+#include "tr_uv_uring.h"
+
+#ifdef TR_UV_URING_SUPPORTED
+
+#include <sys/socket.h>
+
+#include "tr_uv_uring_ring.h"
+
+/*
+ * low byte of the user data of an operation, the rest is the generation of
+ * the connection it belongs to
+ */
+#define TR_UV_URING_OP_RECV 1
+#define TR_UV_URING_OP_SEND 2
+#define TR_UV_URING_OP_CANCEL 3
+
+#define TR_UV_URING_RING_NONE 0
+#define TR_UV_URING_RING_READY 1
+#define TR_UV_URING_RING_UNAVAILABLE 2
+
+/* buffers of a write a reset gave up on while the kernel still sends them */
+typedef struct {
+    char* base;
+    pc_prepared_msg_t* prepared;
+} tr_uv_uring_orphan_t;
+
+/**
+ * The tcp transport reading and writing through an io_uring instead of the
+ * libuv stream; connecting, timers and the package and message codecs are
+ * the tcp ones.
+ *
+ * A connection receives with one multishot receive into the provided
+ * buffers of the ring, and each write of the writing queue goes out as a
+ * chain of linked sends, which keeps them in order. The ring is set up by
+ * the first connection and polled by the uv loop. When the kernel does
+ * not have io_uring, or it is not allowed, connections use libuv.
+ */
+typedef struct {
+    tr_uv_tcp_transport_t base;
+
+    tr_uv_uring_ring_t ring;
+    uv_poll_t ring_poll;
+    int ring_state;
+
+    /* the current connection goes through the ring */
+    int active;
+    uv_os_fd_t fd;
+    unsigned int generation;
+
+    /* operations the kernel has not completed yet, of any connection */
+    unsigned int inflight;
+    unsigned int inflight_sends;
+
+    /* sends of the current write left, and the first error */
+    int sends;
+    int send_error;
+
+    /* the iovecs of a write too long to link, sent with one sendmsg */
+    struct msghdr msg;
+    struct iovec* iov;
+
+    tr_uv_uring_orphan_t* orphans;
+    int orphan_count;
+} tr_uv_uring_transport_t;
+
+pc_transport_t* tr_uv_uring_create(pc_transport_plugin_t* plugin);
+void tr_uv_uring_release(pc_transport_plugin_t* plugin, pc_transport_t* trans);
+
+int tr_uv_uring_init(pc_transport_t* trans, pc_client_t* client);
+int tr_uv_uring_stats(pc_transport_t* trans, pc_client_stats_t* stats);
+
+pc_transport_plugin_t* tr_uv_uring_plugin(pc_transport_t* trans);
+
+#endif /* TR_UV_URING_SUPPORTED */
+
+#endif /* TR_UV_URING_I_H */
@@ -0,0 +1,279 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#include "tr_uv_uring_ring.h"
+
+#ifdef TR_UV_URING_SUPPORTED
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <pc_lib.h>
+
+#define TR_UV_URING_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define TR_UV_URING_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static int tr_uv_uring__enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    int ret = (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+    return ret < 0 ? -errno : ret;
+}
+
+static int tr_uv_uring__setup(tr_uv_uring_ring_t* ring, unsigned flags)
+{
+    struct io_uring_params p;
+    int fd;
+
+    memset(&p, 0, sizeof(p));
+    p.flags = flags;
+    fd = (int)syscall(__NR_io_uring_setup, TR_UV_URING_ENTRIES, &p);
+    if (fd < 0) {
+        return -errno;
+    }
+    ring->fd = fd;
+
+    ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_len > ring->sq_len) {
+            ring->sq_len = ring->cq_len;
+        }
+        ring->cq_len = 0;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        ring->sq_ptr = NULL;
+        return -errno;
+    }
+
+    if (ring->cq_len) {
+        ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            ring->cq_ptr = NULL;
+            return -errno;
+        }
+    } else {
+        ring->cq_ptr = ring->sq_ptr;
+    }
+
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                            fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        return -errno;
+    }
+
+    ring->sq_head = (unsigned*)((char*)ring->sq_ptr + p.sq_off.head);
+    ring->sq_tail = (unsigned*)((char*)ring->sq_ptr + p.sq_off.tail);
+    ring->sq_mask = *(unsigned*)((char*)ring->sq_ptr + p.sq_off.ring_mask);
+    ring->sq_entries = p.sq_entries;
+    ring->sq_local_tail = *ring->sq_tail;
+
+    ring->cq_head = (unsigned*)((char*)ring->cq_ptr + p.cq_off.head);
+    ring->cq_tail = (unsigned*)((char*)ring->cq_ptr + p.cq_off.tail);
+    ring->cq_mask = *(unsigned*)((char*)ring->cq_ptr + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)((char*)ring->cq_ptr + p.cq_off.cqes);
+
+    /* entries are always taken in order */
+    {
+        unsigned* array = (unsigned*)((char*)ring->sq_ptr + p.sq_off.array);
+        unsigned i;
+        for (i = 0; i < p.sq_entries; ++i) {
+            array[i] = i;
+        }
+    }
+    return 0;
+}
+
+static int tr_uv_uring__setup_bufs(tr_uv_uring_ring_t* ring)
+{
+    struct io_uring_buf_reg reg;
+    struct io_uring_buf* buf;
+    unsigned short i;
+
+    ring->br_len = TR_UV_URING_BUF_COUNT * sizeof(struct io_uring_buf);
+    ring->br = (struct io_uring_buf_ring*)mmap(NULL, ring->br_len, PROT_READ | PROT_WRITE,
+                                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->br == MAP_FAILED) {
+        ring->br = NULL;
+        return -errno;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring->br;
+    reg.ring_entries = TR_UV_URING_BUF_COUNT;
+    reg.bgid = TR_UV_URING_BUF_GROUP;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        return -errno;
+    }
+
+    ring->bufs = (char*)pc_lib_malloc(TR_UV_URING_BUF_COUNT * TR_UV_URING_BUF_SIZE);
+    for (i = 0; i < TR_UV_URING_BUF_COUNT; ++i) {
+        buf = &ring->br->bufs[i];
+        buf->addr = (uint64_t)(uintptr_t)(ring->bufs + (size_t)i * TR_UV_URING_BUF_SIZE);
+        buf->len = TR_UV_URING_BUF_SIZE;
+        buf->bid = i;
+    }
+    TR_UV_URING_STORE(&ring->br->tail, (unsigned short)TR_UV_URING_BUF_COUNT);
+    return 0;
+}
+
+int tr_uv_uring_ring_init(tr_uv_uring_ring_t* ring)
+{
+    int ret;
+
+    memset(ring, 0, sizeof(tr_uv_uring_ring_t));
+    ring->fd = -1;
+
+    /* the flags only spare work to the kernel, older ones refuse them */
+    ret = tr_uv_uring__setup(ring, IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN);
+    if (ret == -EINVAL) {
+        tr_uv_uring_ring_close(ring);
+        ret = tr_uv_uring__setup(ring, 0);
+    }
+    if (!ret) {
+        ret = tr_uv_uring__setup_bufs(ring);
+    }
+    if (ret) {
+        tr_uv_uring_ring_close(ring);
+    }
+    return ret;
+}
+
+void tr_uv_uring_ring_close(tr_uv_uring_ring_t* ring)
+{
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqes_len);
+    }
+    if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_len);
+    }
+    if (ring->sq_ptr) {
+        munmap(ring->sq_ptr, ring->sq_len);
+    }
+    /* the kernel lets go of the buffers with the ring */
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+    if (ring->br) {
+        munmap(ring->br, ring->br_len);
+    }
+    pc_lib_free(ring->bufs);
+
+    memset(ring, 0, sizeof(tr_uv_uring_ring_t));
+    ring->fd = -1;
+}
+
+unsigned tr_uv_uring_ring_space(const tr_uv_uring_ring_t* ring)
+{
+    return ring->sq_entries - (ring->sq_local_tail - TR_UV_URING_LOAD(ring->sq_head));
+}
+
+struct io_uring_sqe* tr_uv_uring_ring_sqe(tr_uv_uring_ring_t* ring)
+{
+    struct io_uring_sqe* sqe;
+
+    if (!tr_uv_uring_ring_space(ring)) {
+        return NULL;
+    }
+
+    sqe = &ring->sqes[ring->sq_local_tail & ring->sq_mask];
+    ring->sq_local_tail++;
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    return sqe;
+}
+
+int tr_uv_uring_ring_submit(tr_uv_uring_ring_t* ring, unsigned wait)
+{
+    unsigned tail = *ring->sq_tail;
+    unsigned n;
+    int submitted = 0;
+    int ret;
+
+    TR_UV_URING_STORE(ring->sq_tail, ring->sq_local_tail);
+
+    for (;;) {
+        /* what a short enter left published goes again with the new ones */
+        n = ring->sq_local_tail - TR_UV_URING_LOAD(ring->sq_head);
+
+        do {
+            ring->enters++;
+            ret = tr_uv_uring__enter(ring->fd, n, wait, wait ? IORING_ENTER_GETEVENTS : 0);
+        } while (ret == -EINTR);
+
+        if (ret <= 0 || (unsigned)ret >= n) {
+            break;
+        }
+        /* short, the rest is tried again without waiting twice */
+        submitted += ret;
+        wait = 0;
+    }
+
+    if (ret < 0) {
+        if (!submitted) {
+            /* the kernel took none, they point at memory the caller frees */
+            TR_UV_URING_STORE(ring->sq_tail, tail);
+            ring->sq_local_tail = tail;
+            return ret;
+        }
+        ret = 0;
+    }
+
+    if ((unsigned)ret < n) {
+        /* left published, the next submit counts them from sq_head */
+        pc_lib_log(PC_LOG_WARN, "tr_uv_uring_ring_submit - %u entries left for the next submit",
+                   n - (unsigned)ret);
+    }
+    return submitted + ret;
+}
+
+struct io_uring_cqe* tr_uv_uring_ring_peek(tr_uv_uring_ring_t* ring)
+{
+    unsigned head = *ring->cq_head;
+
+    if (head == TR_UV_URING_LOAD(ring->cq_tail)) {
+        return NULL;
+    }
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+void tr_uv_uring_ring_seen(tr_uv_uring_ring_t* ring)
+{
+    TR_UV_URING_STORE(ring->cq_head, *ring->cq_head + 1);
+}
+
+char* tr_uv_uring_ring_buf(tr_uv_uring_ring_t* ring, const struct io_uring_cqe* cqe)
+{
+    if (!(cqe->flags & IORING_CQE_F_BUFFER)) {
+        return NULL;
+    }
+    return ring->bufs + (size_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT) * TR_UV_URING_BUF_SIZE;
+}
+
+void tr_uv_uring_ring_buf_put(tr_uv_uring_ring_t* ring, const struct io_uring_cqe* cqe)
+{
+    struct io_uring_buf* buf;
+    unsigned short tail;
+    unsigned short bid;
+
+    if (!(cqe->flags & IORING_CQE_F_BUFFER)) {
+        return;
+    }
+
+    bid = (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+    tail = ring->br->tail;
+    buf = &ring->br->bufs[tail & (TR_UV_URING_BUF_COUNT - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(ring->bufs + (size_t)bid * TR_UV_URING_BUF_SIZE);
+    buf->len = TR_UV_URING_BUF_SIZE;
+    buf->bid = bid;
+    TR_UV_URING_STORE(&ring->br->tail, (unsigned short)(tail + 1));
+}
+
+#endif /* TR_UV_URING_SUPPORTED */
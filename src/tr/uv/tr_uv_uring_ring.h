@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifndef TR_UV_URING_RING_H
+#define TR_UV_URING_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tr_uv_uring.h"
+
+#ifdef TR_UV_URING_SUPPORTED
+
+/**
+ * An io_uring of a uring transport, set up with the raw system calls as
+ * the library does not depend on liburing.
+ *
+ * Only the loop thread of the transport submits and reaps, so the ring is
+ * not guarded. Receives pick their buffer from a ring of
+ * TR_UV_URING_BUF_COUNT buffers registered with the kernel (a provided
+ * buffer ring), which the kernel fills directly; a buffer is handed back
+ * with tr_uv_uring_ring_buf_put once its bytes are consumed.
+ */
+
+#define TR_UV_URING_ENTRIES 64
+#define TR_UV_URING_BUF_COUNT 8
+#define TR_UV_URING_BUF_SIZE 8192 /* all together as much as one read buffer */
+#define TR_UV_URING_BUF_GROUP 0
+
+typedef struct {
+    int fd;
+
+    /* submission queue, sq_local_tail counts the entries not submitted yet too */
+    void* sq_ptr;
+    size_t sq_len;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_local_tail;
+    struct io_uring_sqe* sqes;
+    size_t sqes_len;
+
+    /* completion queue, shares sq_ptr with IORING_FEAT_SINGLE_MMAP */
+    void* cq_ptr;
+    size_t cq_len;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+
+    /* provided buffers */
+    struct io_uring_buf_ring* br;
+    size_t br_len;
+    char* bufs;
+
+    uint64_t enters;
+} tr_uv_uring_ring_t;
+
+/* returns 0 or a negative errno, the ring is left closed on error */
+int tr_uv_uring_ring_init(tr_uv_uring_ring_t* ring);
+void tr_uv_uring_ring_close(tr_uv_uring_ring_t* ring);
+
+/* free submission entries */
+unsigned tr_uv_uring_ring_space(const tr_uv_uring_ring_t* ring);
+
+/* a zeroed submission entry, or NULL if the queue is full */
+struct io_uring_sqe* tr_uv_uring_ring_sqe(tr_uv_uring_ring_t* ring);
+
+/**
+ * Submits the entries got since the last call, and those an earlier call
+ * could not, waiting for `wait` completions. A short submit is tried again
+ * while the kernel takes some, what is still left goes with the next call. Returns the number
+ * submitted or a negative errno, the new entries are then dropped.
+ */
+int tr_uv_uring_ring_submit(tr_uv_uring_ring_t* ring, unsigned wait);
+
+/* the oldest completion not seen yet, or NULL */
+struct io_uring_cqe* tr_uv_uring_ring_peek(tr_uv_uring_ring_t* ring);
+void tr_uv_uring_ring_seen(tr_uv_uring_ring_t* ring);
+
+/* the provided buffer a receive completion points to, and giving it back */
+char* tr_uv_uring_ring_buf(tr_uv_uring_ring_t* ring, const struct io_uring_cqe* cqe);
+void tr_uv_uring_ring_buf_put(tr_uv_uring_ring_t* ring, const struct io_uring_cqe* cqe);
+
+#endif /* TR_UV_URING_SUPPORTED */
+
+#endif /* TR_UV_URING_RING_H */
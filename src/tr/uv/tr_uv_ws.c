@@ -0,0 +1,45 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#include "tr_uv_ws.h"
+
+#include "pr_msg.h"
+#include "tr_uv_ws_i.h"
+
+static tr_uv_tcp_transport_plugin_t instance =
+{
+    {
+        tr_uv_ws_create,
+        tr_uv_ws_release,
+        tr_uv_tcp_plugin_on_register,
+        tr_uv_tcp_plugin_on_deregister,
+        PC_TR_NAME_UV_WS
+    },
+    pr_default_msg_encoder, /* pr_msg_encoder */
+    pr_default_msg_decoder  /* pr_msg_decoder */
+};
+
+static tr_uv_tcp_transport_plugin_t secure_instance =
+{
+    {
+        tr_uv_ws_create,
+        tr_uv_ws_release,
+        tr_uv_tcp_plugin_on_register,
+        tr_uv_tcp_plugin_on_deregister,
+        PC_TR_NAME_UV_WSS
+    },
+    pr_default_msg_encoder, /* pr_msg_encoder */
+    pr_default_msg_decoder  /* pr_msg_decoder */
+};
+
+pc_transport_plugin_t* pc_tr_uv_ws_trans_plugin()
+{
+    return (pc_transport_plugin_t* )&instance;
+}
+
+pc_transport_plugin_t* pc_tr_uv_wss_trans_plugin()
+{
+    return (pc_transport_plugin_t* )&secure_instance;
+}
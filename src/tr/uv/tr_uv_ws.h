@@ -0,0 +1,16 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifndef TR_UV_WS_H
+#define TR_UV_WS_H
+
+#include <pitaya_trans.h>
+
+pc_transport_plugin_t* pc_tr_uv_ws_trans_plugin();
+
+/* needs the tls plugin registered, its context and sessions are shared */
+pc_transport_plugin_t* pc_tr_uv_wss_trans_plugin();
+
+#endif /* TR_UV_WS_H */
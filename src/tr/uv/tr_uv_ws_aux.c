@@ -0,0 +1,607 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+
+#include <pc_assert.h>
+#include <pc_lib.h>
+#include <pc_pitaya_i.h>
+
+#include "tr_uv_tcp_aux.h"
+#include "tr_uv_tls_aux.h"
+#include "tr_uv_ws_aux.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TR_UV_WS_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TR_UV_WS_NEON 1
+#endif
+
+#define GET_WS tr_uv_ws_transport_t* wt = (tr_uv_ws_transport_t* )tt; pc_assert(wt)
+
+#define TR_UV_WS_OP_CONT 0x0
+#define TR_UV_WS_OP_BINARY 0x2
+#define TR_UV_WS_OP_CLOSE 0x8
+#define TR_UV_WS_OP_PING 0x9
+#define TR_UV_WS_OP_PONG 0xa
+
+#define TR_UV_WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+/* close code of a close frame without one */
+#define TR_UV_WS_NO_STATUS 1005
+
+static void ws__frame_reset(tr_uv_ws_transport_t* wt)
+{
+    wt->hdr_len = 0;
+    wt->hdr_need = 2;
+    wt->opcode = TR_UV_WS_OP_CONT;
+    wt->remaining = 0;
+    wt->ctrl_len = 0;
+}
+
+void ws__reset(tr_uv_tcp_transport_t* tt)
+{
+    GET_WS;
+
+    wt->state = TR_UV_WS_NOT_CONN;
+    pc_lib_free(wt->resp);
+    wt->resp = NULL;
+    wt->resp_len = 0;
+    wt->in_message = 0;
+    ws__frame_reset(wt);
+
+    if (wt->secure) {
+        tls__reset(tt);
+    } else {
+        tcp__reset(tt);
+    }
+}
+
+/*
+ * the masking keys only have to be unpredictable to the pages a browser
+ * runs, xorshift seeded from the OpenSSL generator for each connection
+ * spares a call into it for every frame.
+ */
+static void ws__mask_key(tr_uv_ws_transport_t* wt, unsigned char key[4])
+{
+    uint64_t x = wt->rng;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    wt->rng = x;
+
+    x *= 0x2545F4914F6CDD1DULL;
+    key[0] = (unsigned char)(x >> 32);
+    key[1] = (unsigned char)(x >> 40);
+    key[2] = (unsigned char)(x >> 48);
+    key[3] = (unsigned char)(x >> 56);
+}
+
+void ws__mask(char* dst, const char* src, size_t len, const unsigned char key[4])
+{
+    size_t i = 0;
+    uint32_t k32;
+    uint64_t k64;
+    uint64_t w;
+
+    /* the key repeats every 4 bytes, so it does in any wider word */
+    memcpy(&k32, key, 4);
+
+#if defined(TR_UV_WS_SSE2)
+    {
+        __m128i k = _mm_set1_epi32((int)k32);
+        for (; i + 16 <= len; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i* )(src + i));
+            _mm_storeu_si128((__m128i* )(dst + i), _mm_xor_si128(v, k));
+        }
+    }
+#elif defined(TR_UV_WS_NEON)
+    {
+        uint8x16_t k = vreinterpretq_u8_u32(vdupq_n_u32(k32));
+        for (; i + 16 <= len; i += 16) {
+            vst1q_u8((uint8_t* )(dst + i), veorq_u8(vld1q_u8((const uint8_t* )(src + i)), k));
+        }
+    }
+#endif
+
+    k64 = ((uint64_t)k32 << 32) | k32;
+    for (; i + 8 <= len; i += 8) {
+        memcpy(&w, src + i, 8);
+        w ^= k64;
+        memcpy(dst + i, &w, 8);
+    }
+
+    for (; i < len; ++i) {
+        dst[i] = (char)(src[i] ^ key[i & 3]);
+    }
+}
+
+/* writes the header of a masked frame of `len` bytes, returns its length */
+static unsigned int ws__frame_hdr(char* hdr, int opcode, size_t len, const unsigned char key[4])
+{
+    unsigned int n = 0;
+    int i;
+
+    hdr[n++] = (char)(0x80 | opcode);
+    if (len < 126) {
+        hdr[n++] = (char)(0x80 | len);
+    } else if (len <= 0xffff) {
+        hdr[n++] = (char)(0x80 | 126);
+        hdr[n++] = (char)(len >> 8);
+        hdr[n++] = (char)len;
+    } else {
+        hdr[n++] = (char)(0x80 | 127);
+        for (i = 7; i >= 0; --i) {
+            hdr[n++] = (char)((uint64_t)len >> (8 * i));
+        }
+    }
+
+    memcpy(hdr + n, key, 4);
+    return n + 4;
+}
+
+/* queues bytes going out as they are, the upgrade request or a control frame */
+static void ws__queue_raw(tr_uv_tcp_transport_t* tt, uv_buf_t buf)
+{
+    tr_uv_wi_t* wi = NULL;
+    int i;
+
+    pc_mutex_lock(&tt->wq_mutex);
+    for (i = 0; i < TR_UV_PRE_ALLOC_WI_SLOT_COUNT; ++i) {
+        if (PC_PRE_ALLOC_IS_IDLE(tt->pre_wis[i].type)) {
+            wi = &tt->pre_wis[i];
+            PC_PRE_ALLOC_SET_BUSY(wi->type);
+            break;
+        }
+    }
+
+    if (!wi) {
+        wi = (tr_uv_wi_t* )pc_lib_malloc(sizeof(tr_uv_wi_t));
+        memset(wi, 0, sizeof(tr_uv_wi_t));
+        wi->type = PC_DYN_ALLOC;
+    }
+
+    QUEUE_INIT(&wi->queue);
+    TR_UV_WI_SET_INTERNAL(wi->type);
+
+    wi->buf = buf;
+    wi->seq_num = -1; /* internal data */
+    wi->req_id = -1; /* internal data */
+    wi->timeout = PC_WITHOUT_TIMEOUT; /* internal timeout */
+    wi->ts = time(NULL);
+    wi->framed = 1;
+
+    QUEUE_INSERT_TAIL(&tt->write_wait_queue, &wi->queue);
+    pc_mutex_unlock(&tt->wq_mutex);
+
+    uv_async_send(&tt->write_async);
+}
+
+static void ws__send_ctrl(tr_uv_ws_transport_t* wt, int opcode, const char* payload, size_t len)
+{
+    unsigned char key[4];
+    unsigned int hdr_len;
+    uv_buf_t buf;
+
+    pc_assert(len <= TR_UV_WS_CTRL_MAX);
+
+    buf.base = (char* )pc_lib_malloc(TR_UV_WI_FRAME_HDR_SIZE + len);
+    ws__mask_key(wt, key);
+    hdr_len = ws__frame_hdr(buf.base, opcode, len, key);
+    ws__mask(buf.base + hdr_len, payload, len, key);
+    buf.len = hdr_len + len;
+
+    wt->frames_sent++;
+    ws__queue_raw(&wt->base.base, buf);
+}
+
+void ws__frame(tr_uv_tcp_transport_t* tt, tr_uv_wi_t* wi)
+{
+    unsigned char key[4];
+    char hdr[TR_UV_WI_FRAME_HDR_SIZE];
+    unsigned int hdr_len;
+    char* base;
+    GET_WS;
+
+    if (wi->framed) {
+        return;
+    }
+    wi->framed = 1;
+
+    /* the wire image of a prepared message is shared by its sends, so it is masked on a copy */
+    tcp__wi_flatten(wi);
+
+    ws__mask_key(wt, key);
+    hdr_len = ws__frame_hdr(hdr, TR_UV_WS_OP_BINARY, wi->buf.len, key);
+
+    if (wt->secure) {
+        /*
+         * SSL_write takes a single buffer per write item, the package is
+         * masked as it is copied behind the header.
+         */
+        base = (char* )pc_lib_malloc(hdr_len + wi->buf.len);
+        memcpy(base, hdr, hdr_len);
+        ws__mask(base + hdr_len, wi->buf.base, wi->buf.len, key);
+
+        pc_lib_free(wi->buf.base);
+        wi->buf.base = base;
+        wi->buf.len += hdr_len;
+    } else {
+        ws__mask(wi->buf.base, wi->buf.base, wi->buf.len, key);
+        memcpy(wi->frame_hdr, hdr, hdr_len);
+        wi->frame_len = hdr_len;
+    }
+
+    wt->frames_sent++;
+}
+
+void ws__accept_key(const char* key, char* out)
+{
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    char buf[64];
+    size_t len = strlen(key);
+
+    pc_assert(len + sizeof(TR_UV_WS_GUID) <= sizeof(buf));
+
+    memcpy(buf, key, len);
+    memcpy(buf + len, TR_UV_WS_GUID, sizeof(TR_UV_WS_GUID) - 1);
+    SHA1((const unsigned char* )buf, len + sizeof(TR_UV_WS_GUID) - 1, digest);
+    EVP_EncodeBlock((unsigned char* )out, digest, SHA_DIGEST_LENGTH);
+}
+
+void ws__upgrade(tr_uv_tcp_transport_t* tt)
+{
+    unsigned char nonce[16];
+    const char* host = tt->host;
+    const char* lb = "";
+    const char* rb = "";
+    size_t len;
+    uv_buf_t buf;
+    GET_WS;
+
+    if (RAND_bytes(nonce, sizeof(nonce)) != 1 || RAND_bytes((unsigned char* )&wt->rng, sizeof(wt->rng)) != 1) {
+        pc_lib_log(PC_LOG_WARN, "ws__upgrade - no random bytes, keys are made from the clock");
+        wt->rng = uv_hrtime();
+        memcpy(nonce, &wt->rng, sizeof(wt->rng));
+        memcpy(nonce + sizeof(wt->rng), &wt->rng, sizeof(wt->rng));
+    }
+    /* xorshift never leaves 0 */
+    wt->rng |= 1;
+    EVP_EncodeBlock((unsigned char* )wt->key, nonce, sizeof(nonce));
+
+    if (!strncmp(host, PC_HOST_UNIX_PREFIX, sizeof(PC_HOST_UNIX_PREFIX) - 1)) {
+        host = "localhost";
+    } else if (strchr(host, ':')) {
+        /* ipv6 literal */
+        lb = "[";
+        rb = "]";
+    }
+
+    len = strlen(host) + 256;
+    buf.base = (char* )pc_lib_malloc(len);
+    buf.len = (size_t)snprintf(buf.base, len,
+                               "GET / HTTP/1.1\r\n"
+                               "Host: %s%s%s:%d\r\n"
+                               "Upgrade: websocket\r\n"
+                               "Connection: Upgrade\r\n"
+                               "Sec-WebSocket-Key: %s\r\n"
+                               "Sec-WebSocket-Version: 13\r\n"
+                               "\r\n",
+                               lb, host, rb, tt->port, wt->key);
+    pc_assert(buf.len < len);
+
+    pc_lib_log(PC_LOG_INFO, "ws__upgrade - upgrading the connection to websocket");
+
+    wt->state = TR_UV_WS_UPGRADING;
+    ws__queue_raw(tt, buf);
+}
+
+/* gives up on the connection, `reason` goes with the event */
+static void ws__fail(tr_uv_ws_transport_t* wt, const char* reason)
+{
+    tr_uv_tcp_transport_t* tt = &wt->base.base;
+
+    pc_lib_log(PC_LOG_ERROR, "ws__fail - %s, will reconn", reason);
+
+    if (tt->state == TR_UV_TCP_DONE) {
+        pc_trans_fire_event(tt->client, PC_EV_UNEXPECTED_DISCONNECT, "WebSocket Protocol Error", reason);
+    } else {
+        pc_trans_fire_event(tt->client, PC_EV_CONNECT_FAILED, "Failed to complete pitaya connection", reason);
+    }
+
+    tt->reconn_fn(tt);
+}
+
+static int ws__ieq(const char* s, size_t len, const char* lit)
+{
+    size_t i;
+
+    if (len != strlen(lit)) {
+        return 0;
+    }
+    for (i = 0; i < len; ++i) {
+        if (tolower((unsigned char)s[i]) != tolower((unsigned char)lit[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * checks the upgrade response, status line and headers each ended by
+ * "\r\n". Returns NULL if the server switched to websocket, what is wrong
+ * otherwise.
+ */
+static const char* ws__check_upgrade(tr_uv_ws_transport_t* wt, const char* resp)
+{
+    char accept[32];
+    const char* line;
+    const char* eol;
+    const char* colon;
+    const char* value;
+    const char* end;
+    int upgraded = 0;
+    int accepted = 0;
+
+    eol = strstr(resp, "\r\n");
+    if (strncmp(resp, "HTTP/1.1 101", 12)) {
+        pc_lib_log(PC_LOG_ERROR, "ws__check_upgrade - server answered %.*s", (int)(eol - resp), resp);
+        return "upgrade refused";
+    }
+
+    ws__accept_key(wt->key, accept);
+
+    for (line = eol + 2; (eol = strstr(line, "\r\n")); line = eol + 2) {
+        colon = (const char* )memchr(line, ':', (size_t)(eol - line));
+        if (!colon) {
+            continue;
+        }
+
+        value = colon + 1;
+        while (value < eol && (*value == ' ' || *value == '\t')) {
+            value++;
+        }
+        end = eol;
+        while (end > value && (end[-1] == ' ' || end[-1] == '\t')) {
+            end--;
+        }
+
+        if (ws__ieq(line, (size_t)(colon - line), "Upgrade")) {
+            upgraded = ws__ieq(value, (size_t)(end - value), "websocket");
+        } else if (ws__ieq(line, (size_t)(colon - line), "Sec-WebSocket-Accept")) {
+            accepted = (size_t)(end - value) == strlen(accept) && !memcmp(value, accept, strlen(accept));
+        }
+    }
+
+    if (!upgraded) {
+        return "not upgraded to websocket";
+    }
+    if (!accepted) {
+        return "bad Sec-WebSocket-Accept";
+    }
+    return NULL;
+}
+
+/* reads the upgrade response, returns the bytes it took */
+static size_t ws__on_upgrade_data(tr_uv_ws_transport_t* wt, const char* data, size_t len)
+{
+    size_t old = wt->resp_len;
+    size_t n;
+    char* end;
+    const char* err;
+    tr_uv_tcp_transport_t* tt = &wt->base.base;
+
+    if (!wt->resp) {
+        wt->resp = (char* )pc_lib_malloc(TR_UV_WS_UPGRADE_RESP_MAX + 1);
+    }
+
+    n = TR_UV_WS_UPGRADE_RESP_MAX - wt->resp_len;
+    n = len < n ? len : n;
+    memcpy(wt->resp + wt->resp_len, data, n);
+    wt->resp_len += n;
+    wt->resp[wt->resp_len] = '\0';
+
+    /* the end may have been split with the previous read */
+    end = strstr(wt->resp + (old > 3 ? old - 3 : 0), "\r\n\r\n");
+    if (!end) {
+        if (wt->resp_len == TR_UV_WS_UPGRADE_RESP_MAX) {
+            ws__fail(wt, "upgrade response too long");
+        }
+        return n;
+    }
+
+    /* frames may follow right behind the response */
+    n = (size_t)(end + 4 - wt->resp) - old;
+    end[2] = '\0';
+
+    err = ws__check_upgrade(wt, wt->resp);
+    if (err) {
+        ws__fail(wt, err);
+        return n;
+    }
+
+    pc_lib_free(wt->resp);
+    wt->resp = NULL;
+    wt->resp_len = 0;
+
+    wt->state = TR_UV_WS_OPEN;
+    ws__frame_reset(wt);
+
+    pc_lib_log(PC_LOG_INFO, "ws__on_upgrade_data - connection upgraded, sending handshake");
+    tcp__send_handshake(tt);
+    return n;
+}
+
+/* checks the header of a frame read, returns 0 if the connection was given up */
+static int ws__on_frame_hdr(tr_uv_ws_transport_t* wt)
+{
+    const unsigned char* h = wt->hdr;
+    int fin = h[0] & 0x80;
+    int opcode = h[0] & 0x0f;
+    uint64_t len = h[1] & 0x7f;
+    int i;
+
+    if (h[0] & 0x70) {
+        ws__fail(wt, "reserved bits set without an extension");
+        return 0;
+    }
+    if (h[1] & 0x80) {
+        ws__fail(wt, "masked frame from the server");
+        return 0;
+    }
+
+    if (len == 126) {
+        len = ((uint64_t)h[2] << 8) | h[3];
+    } else if (len == 127) {
+        len = 0;
+        for (i = 2; i < 10; ++i) {
+            len = (len << 8) | h[i];
+        }
+    }
+
+    switch (opcode) {
+    case TR_UV_WS_OP_CONT:
+        if (!wt->in_message) {
+            ws__fail(wt, "continuation frame out of a message");
+            return 0;
+        }
+        wt->in_message = !fin;
+        break;
+    case TR_UV_WS_OP_BINARY:
+        if (wt->in_message) {
+            ws__fail(wt, "data frame in the middle of a message");
+            return 0;
+        }
+        wt->in_message = !fin;
+        break;
+    case TR_UV_WS_OP_CLOSE:
+    case TR_UV_WS_OP_PING:
+    case TR_UV_WS_OP_PONG:
+        if (!fin || len > TR_UV_WS_CTRL_MAX) {
+            ws__fail(wt, "fragmented or long control frame");
+            return 0;
+        }
+        break;
+    default:
+        /* pitaya only sends binary messages */
+        pc_lib_log(PC_LOG_ERROR, "ws__on_frame_hdr - unexpected opcode %d", opcode);
+        ws__fail(wt, "unexpected opcode");
+        return 0;
+    }
+
+    wt->opcode = opcode;
+    wt->remaining = len;
+    wt->ctrl_len = 0;
+    wt->frames_recv++;
+    return 1;
+}
+
+static void ws__on_frame_done(tr_uv_ws_transport_t* wt)
+{
+    int opcode = wt->opcode;
+    int code;
+    tr_uv_tcp_transport_t* tt = &wt->base.base;
+
+    wt->hdr_len = 0;
+    wt->hdr_need = 2;
+
+    switch (opcode) {
+    case TR_UV_WS_OP_PING:
+        wt->pings++;
+        ws__send_ctrl(wt, TR_UV_WS_OP_PONG, wt->ctrl, wt->ctrl_len);
+        break;
+    case TR_UV_WS_OP_PONG:
+        pc_lib_log(PC_LOG_DEBUG, "ws__on_frame_done - unsolicited pong");
+        break;
+    case TR_UV_WS_OP_CLOSE:
+        code = wt->ctrl_len >= 2
+            ? (((unsigned char)wt->ctrl[0] << 8) | (unsigned char)wt->ctrl[1])
+            : TR_UV_WS_NO_STATUS;
+        pc_lib_log(PC_LOG_INFO, "ws__on_frame_done - closed by the server, code %d", code);
+        tcp__on_read_error(tt, UV_EOF);
+        break;
+    default:
+        break;
+    }
+}
+
+/* reads frames, returns the bytes it took */
+static size_t ws__on_frame_data(tr_uv_ws_transport_t* wt, const char* data, size_t len)
+{
+    size_t n;
+    size_t ext;
+    tr_uv_tcp_transport_t* tt = &wt->base.base;
+
+    if (wt->hdr_len < wt->hdr_need) {
+        n = wt->hdr_need - wt->hdr_len;
+        n = len < n ? len : n;
+        memcpy(wt->hdr + wt->hdr_len, data, n);
+        wt->hdr_len += n;
+
+        /* the first 2 bytes tell how long the header is */
+        if (wt->hdr_len == 2) {
+            ext = (wt->hdr[1] & 0x7f) == 126 ? 2 : (wt->hdr[1] & 0x7f) == 127 ? 8 : 0;
+            wt->hdr_need = 2 + ext + ((wt->hdr[1] & 0x80) ? 4 : 0);
+        }
+        if (wt->hdr_len < wt->hdr_need) {
+            return n;
+        }
+
+        if (ws__on_frame_hdr(wt) && !wt->remaining) {
+            ws__on_frame_done(wt);
+        }
+        return n;
+    }
+
+    n = len < wt->remaining ? len : (size_t)wt->remaining;
+    if (wt->opcode & 0x08) {
+        memcpy(wt->ctrl + wt->ctrl_len, data, n);
+        wt->ctrl_len += n;
+    } else {
+        /* fragmented or not, packages are a stream to the parser */
+        pc_pkg_parser_feed(&tt->pkg_parser, data, n);
+
+        /* the packages may have ended the connection */
+        if (wt->state != TR_UV_WS_OPEN) {
+            return n;
+        }
+    }
+
+    wt->remaining -= n;
+    if (!wt->remaining) {
+        ws__on_frame_done(wt);
+    }
+    return n;
+}
+
+void ws__feed(tr_uv_tcp_transport_t* tt, const char* data, size_t len)
+{
+    size_t n;
+    GET_WS;
+
+    while (len > 0) {
+        if (wt->state == TR_UV_WS_UPGRADING) {
+            n = ws__on_upgrade_data(wt, data, len);
+        } else if (wt->state == TR_UV_WS_OPEN) {
+            n = ws__on_frame_data(wt, data, len);
+        } else {
+            /* the connection was given up, the rest is dropped */
+            return;
+        }
+
+        data += n;
+        len -= n;
+    }
+}
@@ -0,0 +1,29 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifndef TR_UV_WS_AUX_H
+#define TR_UV_WS_AUX_H
+
+#include "tr_uv_ws_i.h"
+
+void ws__reset(tr_uv_tcp_transport_t* tt);
+
+void ws__upgrade(tr_uv_tcp_transport_t* tt);
+void ws__feed(tr_uv_tcp_transport_t* tt, const char* data, size_t len);
+void ws__frame(tr_uv_tcp_transport_t* tt, tr_uv_wi_t* wi);
+
+/*
+ * xors `len` bytes of `src` with the masking key, 4 bytes repeated, into
+ * `dst`, which may be `src`.
+ */
+void ws__mask(char* dst, const char* src, size_t len, const unsigned char key[4]);
+
+/**
+ * Sec-WebSocket-Accept the server answers a Sec-WebSocket-Key with, `out`
+ * takes 29 bytes.
+ */
+void ws__accept_key(const char* key, char* out);
+
+#endif /* TR_UV_WS_AUX_H */
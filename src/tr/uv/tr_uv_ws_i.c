@@ -0,0 +1,115 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#include <string.h>
+
+#include <pc_assert.h>
+#include <pc_lib.h>
+
+#include "tr_uv_tcp_aux.h"
+#include "tr_uv_tls_aux.h"
+#include "tr_uv_ws.h"
+#include "tr_uv_ws_i.h"
+#include "tr_uv_ws_aux.h"
+
+pc_transport_t* tr_uv_ws_create(pc_transport_plugin_t* plugin)
+{
+    size_t len = sizeof(tr_uv_ws_transport_t);
+    tr_uv_ws_transport_t* wt = (tr_uv_ws_transport_t* )pc_lib_malloc(len);
+    tr_uv_tcp_transport_t* tt = &wt->base.base;
+    memset(wt, 0, len);
+
+    wt->secure = plugin->transport_name == PC_TR_NAME_UV_WSS;
+
+    /* inherit from tr_uv_tcp, and from tr_uv_tls for wss */
+    tt->base.connect = tr_uv_tcp_connect;
+    tt->base.connect_endpoints = tr_uv_tcp_connect_endpoints;
+    tt->base.endpoint_health = tr_uv_tcp_endpoint_health;
+    tt->base.send = tr_uv_tcp_send;
+    tt->base.send_with_opts = tr_uv_tcp_send_with_opts;
+    tt->base.send_prepared = tr_uv_tcp_send_prepared;
+    tt->base.disconnect = tr_uv_tcp_disconnect;
+    tt->base.cleanup = tr_uv_tcp_cleanup;
+    tt->base.quality = tr_uv_tcp_quality;
+    tt->base.serializer = tr_uv_tcp_serializer;
+    tt->reconn_fn = tcp__reconn;
+
+    if (wt->secure) {
+        tt->base.internal_data = tr_uv_tls_internal_data;
+        tt->conn_done_cb = tls__conn_done_cb;
+        tt->write_async_cb = tls__write_async_cb;
+        tt->cleanup_async_cb = tls__cleanup_async_cb;
+        tt->alloc_cb = tls__alloc_cb;
+        tt->on_tcp_read_cb = tls__on_tcp_read_cb;
+        tt->write_check_timeout_cb = tls__write_timeout_check_cb;
+        tt->ls_load_fn = tls__ls_load;
+        tt->ls_save_fn = tls__ls_save;
+    } else {
+        tt->base.internal_data = tr_uv_tcp_internal_data;
+        tt->conn_done_cb = tcp__conn_done_cb;
+        tt->write_async_cb = tcp__write_async_cb;
+        tt->cleanup_async_cb = tcp__cleanup_async_cb;
+        tt->alloc_cb = tcp__alloc_cb;
+        tt->on_tcp_read_cb = tcp__on_tcp_read_cb;
+        tt->write_check_timeout_cb = tcp__write_check_timeout_cb;
+    }
+
+    /* reimplemetating method */
+    tt->base.init = tr_uv_ws_init;
+    tt->base.plugin = tr_uv_ws_plugin;
+    tt->base.stats = tr_uv_ws_stats;
+
+    tt->reset_fn = ws__reset;
+    tt->upgrade_fn = ws__upgrade;
+    tt->feed_fn = ws__feed;
+    tt->frame_fn = ws__frame;
+
+    return (pc_transport_t*)wt;
+}
+
+void tr_uv_ws_release(pc_transport_plugin_t* plugin, pc_transport_t* trans)
+{
+    (void)plugin; /* unused */
+
+    pc_lib_free(trans);
+}
+
+int tr_uv_ws_init(pc_transport_t* trans, pc_client_t* client)
+{
+    tr_uv_ws_transport_t* wt = (tr_uv_ws_transport_t* )trans;
+
+    pc_assert(wt);
+
+    wt->state = TR_UV_WS_NOT_CONN;
+    wt->resp = NULL;
+    wt->resp_len = 0;
+
+    if (wt->secure) {
+        return tr_uv_tls_init(trans, client);
+    }
+    return tr_uv_tcp_init(trans, client);
+}
+
+int tr_uv_ws_stats(pc_transport_t* trans, pc_client_stats_t* stats)
+{
+    tr_uv_ws_transport_t* wt = (tr_uv_ws_transport_t* )trans;
+
+    if (wt->secure) {
+        tr_uv_tls_stats(trans, stats);
+    } else {
+        tr_uv_tcp_stats(trans, stats);
+    }
+    stats->ws_frames_sent = wt->frames_sent;
+    stats->ws_frames_recv = wt->frames_recv;
+    stats->ws_pings = wt->pings;
+    return PC_RC_OK;
+}
+
+pc_transport_plugin_t* tr_uv_ws_plugin(pc_transport_t* trans)
+{
+    tr_uv_ws_transport_t* wt = (tr_uv_ws_transport_t* )trans;
+
+    return wt->secure ? pc_tr_uv_wss_trans_plugin() : pc_tr_uv_ws_trans_plugin();
+}
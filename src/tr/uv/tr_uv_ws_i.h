@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) 2014,2015 NetEase, Inc. and other Pomelo contributors
+ * MIT Licensed.
+ */
+
+#ifndef TR_UV_WS_I_H
+#define TR_UV_WS_I_H
+
+#include "tr_uv_tcp_i.h"
+#include "tr_uv_tls_i.h"
+
+#define TR_UV_WS_NOT_CONN 0
+#define TR_UV_WS_UPGRADING 1
+#define TR_UV_WS_OPEN 2
+
+/* the most of the upgrade response kept while looking for its end */
+#define TR_UV_WS_UPGRADE_RESP_MAX 4096
+
+/* payload of a control frame */
+#define TR_UV_WS_CTRL_MAX 125
+
+/**
+ * The websocket transport, RFC 6455, for the websocket acceptor of pitaya.
+ *
+ * It is the tcp transport, or the tls one for wss, with a connection
+ * upgraded by a GET request before the handshake. Each write item goes in
+ * a binary frame of its own, masked in place, and the payload of the data
+ * frames read, fragmented or not, is fed to the package parser as it comes.
+ * Pings are answered and a close frame ends the connection like a close of
+ * the socket would.
+ */
+typedef struct {
+    tr_uv_tls_transport_t base;
+
+    int secure;
+    int state;
+
+    /* Sec-WebSocket-Key of the upgrade, base64 of 16 bytes */
+    char key[25];
+    char* resp;
+    size_t resp_len;
+
+    /* masking keys, seeded for each connection */
+    uint64_t rng;
+
+    /* frame being read */
+    unsigned char hdr[TR_UV_WI_FRAME_HDR_SIZE];
+    size_t hdr_len;
+    size_t hdr_need;
+    int opcode;
+    uint64_t remaining;
+    /* a fragmented data message waits for its continuation frames */
+    int in_message;
+    char ctrl[TR_UV_WS_CTRL_MAX];
+    size_t ctrl_len;
+
+    uint64_t frames_sent;
+    uint64_t frames_recv;
+    uint64_t pings;
+} tr_uv_ws_transport_t;
+
+pc_transport_t* tr_uv_ws_create(pc_transport_plugin_t* plugin);
+void tr_uv_ws_release(pc_transport_plugin_t* plugin, pc_transport_t* trans);
+
+int tr_uv_ws_init(pc_transport_t* trans, pc_client_t* client);
+int tr_uv_ws_stats(pc_transport_t* trans, pc_client_stats_t* stats);
+pc_transport_plugin_t* tr_uv_ws_plugin(pc_transport_t* trans);
+
+#endif /* TR_UV_WS_I_H */
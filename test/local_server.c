@@ -0,0 +1,590 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <uv.h>
+#include <zlib.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "pr_pkg.h"
+#include "local_server.h"
+
+// Message flags, see pr_msg.c.
+#define LOCAL_MSG_REQUEST 0
+#define LOCAL_MSG_RESPONSE 2
+#define LOCAL_MSG_PUSH 3
+#define LOCAL_MSG_GZIP 0x10
+
+struct local_server_s {
+    uv_loop_t loop;
+    uv_thread_t thread;
+    uv_sem_t ready;
+    uv_tcp_t listener;
+    // Same server on a unix domain socket, accepted into conn as well,
+    // like the client opens them as tcp handles.
+    uv_pipe_t unix_listener;
+    char unix_path[64];
+    uv_tcp_t conn;
+    int has_conn;
+    // A connection came while the last one was still open, accepted once
+    // that one is closed.
+    uv_stream_t *accept_pending;
+    uv_async_t stop_async;
+    int port;
+    int hb_interval;
+
+    pc_pkg_parser_t parser;
+    char read_buf[64 * 1024];
+
+    // With a latency, what is read waits in delayed for conn_latency_ms
+    // before it is handled, as if it had taken that long to arrive.
+    // latency_ms is taken by the next connection.
+    int latency_ms;
+    int conn_latency_ms;
+    uv_timer_t latency_timer;
+    char *delayed;
+    size_t delayed_len;
+    size_t delayed_cap;
+
+    // Server side of TLS over memory BIOs, NULL for plain TCP.
+    SSL_CTX *tls_ctx;
+    SSL *tls;
+    BIO *tls_in;
+    BIO *tls_out;
+    // Set once the early data of the client, if any, has all been read.
+    int early_done;
+    int reject_early_data;
+
+    // Package pushed back to back once the handshake is done.
+    uv_buf_t push_pkg;
+    int pushing;
+
+    uv_mutex_t mutex;
+    uint64_t hb_times[LOCAL_SERVER_MAX_HEARTBEATS];
+    size_t hb_count;
+    size_t handshakes;
+};
+
+typedef struct {
+    uv_write_t req;
+    local_server_t *server;
+    // Freed once written, NULL for the push package.
+    char *owned;
+    // Carries the push package, the next one follows once it is written.
+    int is_push;
+} local_write_t;
+
+static void push_next(local_server_t *s);
+
+static void
+write_done_cb(uv_write_t *req, int status)
+{
+    local_write_t *w = (local_write_t*)req;
+    local_server_t *s = w->server;
+    int was_push = w->is_push;
+
+    free(w->owned);
+    free(w);
+
+    if (was_push && status == 0) {
+        push_next(s);
+    }
+}
+
+static void
+write_buf(local_server_t *s, uv_buf_t buf, int owned, int is_push)
+{
+    local_write_t *w = (local_write_t*)calloc(1, sizeof(local_write_t));
+    w->server = s;
+    w->owned = owned ? buf.base : NULL;
+    w->is_push = is_push;
+    uv_write(&w->req, (uv_stream_t*)&s->conn, &buf, 1, write_done_cb);
+}
+
+// Sends whatever TLS produced, records or handshake messages.
+static void
+flush_tls(local_server_t *s, int is_push)
+{
+    uv_buf_t buf;
+    buf.len = (size_t)BIO_pending(s->tls_out);
+    if (buf.len == 0) {
+        return;
+    }
+    buf.base = (char*)malloc(buf.len);
+    BIO_read(s->tls_out, buf.base, (int)buf.len);
+    write_buf(s, buf, 1, is_push);
+}
+
+static void
+send_pkg(local_server_t *s, uv_buf_t pkg, int owned)
+{
+    if (!s->has_conn || uv_is_closing((uv_handle_t*)&s->conn)) {
+        if (owned) {
+            free(pkg.base);
+        }
+        return;
+    }
+
+    if (!s->tls) {
+        write_buf(s, pkg, owned, !owned);
+        return;
+    }
+
+    if (s->early_done) {
+        SSL_write(s->tls, pkg.base, (int)pkg.len);
+    } else {
+        // Answers to early data go before the client finished the handshake.
+        size_t written;
+        SSL_write_early_data(s->tls, pkg.base, pkg.len, &written);
+    }
+    if (owned) {
+        free(pkg.base);
+    }
+    flush_tls(s, !owned);
+}
+
+static void
+push_next(local_server_t *s)
+{
+    if (s->pushing) {
+        send_pkg(s, s->push_pkg, 0);
+    }
+}
+
+// pc_pkg_encode allocates with pc_lib_malloc, copy into a malloc'ed buffer so
+// send_pkg can release every buffer the same way.
+static uv_buf_t
+encode_pkg(pc_pkg_type type, const char *data, size_t len)
+{
+    uv_buf_t pkg;
+    pkg.len = PC_PKG_HEAD_BYTES + len;
+    pkg.base = (char*)malloc(pkg.len);
+    pkg.base[0] = (char)type;
+    pkg.base[1] = (char)((len >> 16) & 0xff);
+    pkg.base[2] = (char)((len >> 8) & 0xff);
+    pkg.base[3] = (char)(len & 0xff);
+    if (len) {
+        memcpy(pkg.base + PC_PKG_HEAD_BYTES, data, len);
+    }
+    return pkg;
+}
+
+static void
+on_request(local_server_t *s, const char *data, size_t len)
+{
+    // flag, varint id, route length, route and body; only the id is needed.
+    char resp[16];
+    size_t n = 0;
+    size_t i;
+
+    resp[n++] = (char)(LOCAL_MSG_RESPONSE << 1);
+    for (i = 1; i < len && n < sizeof(resp) - 2; ++i) {
+        resp[n++] = data[i];
+        if (!((unsigned char)data[i] & 0x80)) {
+            break;
+        }
+    }
+    resp[n++] = '{';
+    resp[n++] = '}';
+
+    send_pkg(s, encode_pkg(PC_PKG_DATA, resp, n), 1);
+}
+
+static void
+on_pkg(pc_pkg_type type, const char *data, size_t len, void *ex_data)
+{
+    local_server_t *s = (local_server_t*)ex_data;
+    char handshake[128];
+    int n;
+
+    switch (type) {
+    case PC_PKG_HANDSHAKE:
+        uv_mutex_lock(&s->mutex);
+        s->handshakes++;
+        uv_mutex_unlock(&s->mutex);
+        n = snprintf(handshake, sizeof(handshake),
+                     "{\"code\":200,\"sys\":{\"heartbeat\":%d,\"serializer\":\"json\"}}", s->hb_interval);
+        send_pkg(s, encode_pkg(PC_PKG_HANDSHAKE, handshake, (size_t)n), 1);
+        break;
+    case PC_PKG_HANDSHAKE_ACK:
+        if (s->push_pkg.base && !s->pushing) {
+            s->pushing = 1;
+            push_next(s);
+        }
+        break;
+    case PC_PKG_HEARBEAT:
+        uv_mutex_lock(&s->mutex);
+        if (s->hb_count < LOCAL_SERVER_MAX_HEARTBEATS) {
+            s->hb_times[s->hb_count++] = uv_hrtime();
+        }
+        uv_mutex_unlock(&s->mutex);
+        send_pkg(s, encode_pkg(PC_PKG_HEARBEAT, NULL, 0), 1);
+        break;
+    case PC_PKG_DATA:
+        if (len > 0 && ((data[0] >> 1) & 0x07) == LOCAL_MSG_REQUEST) {
+            on_request(s, data, len);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void
+alloc_cb(uv_handle_t *handle, size_t suggested_size, uv_buf_t *buf)
+{
+    local_server_t *s = (local_server_t*)handle->data;
+    buf->base = s->read_buf;
+    buf->len = sizeof(s->read_buf);
+}
+
+static void connection_cb(uv_stream_t *listener, int status);
+
+static void
+conn_close_cb(uv_handle_t *handle)
+{
+    local_server_t *s = (local_server_t*)handle->data;
+
+    // Freed without a shutdown, OpenSSL drops the session of the last
+    // ticket from its cache and the client could not resume it.
+    if (s->tls) {
+        SSL_set_shutdown(s->tls, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    }
+    SSL_free(s->tls);
+    s->tls = NULL;
+    pc_pkg_parser_reset(&s->parser);
+    s->delayed_len = 0;
+    s->has_conn = 0;
+
+    if (s->accept_pending) {
+        uv_stream_t *listener = s->accept_pending;
+        s->accept_pending = NULL;
+        connection_cb(listener, 0);
+    }
+}
+
+static void
+handle_data(local_server_t *s, const char *data, size_t len)
+{
+    if (!s->tls) {
+        pc_pkg_parser_feed(&s->parser, data, len);
+        return;
+    }
+
+    // SSL_read runs the handshake first, into the same buffer as it is
+    // done with what was read from it.
+    BIO_write(s->tls_in, data, (int)len);
+
+    // SSL_read_early_data answers the ClientHello and reads the early data
+    // until the client ends it, or right away if it sent none or it was
+    // rejected.
+    while (!s->early_done) {
+        size_t len;
+        int ret = SSL_read_early_data(s->tls, s->read_buf, sizeof(s->read_buf), &len);
+        if (ret == SSL_READ_EARLY_DATA_ERROR) {
+            flush_tls(s, 0);
+            return;
+        }
+        if (ret == SSL_READ_EARLY_DATA_FINISH) {
+            s->early_done = 1;
+        }
+        if (len > 0) {
+            pc_pkg_parser_feed(&s->parser, s->read_buf, len);
+        }
+    }
+
+    int n;
+    while ((n = SSL_read(s->tls, s->read_buf, sizeof(s->read_buf))) > 0) {
+        pc_pkg_parser_feed(&s->parser, s->read_buf, (size_t)n);
+    }
+    flush_tls(s, 0);
+}
+
+static void
+latency_timer_cb(uv_timer_t *t)
+{
+    local_server_t *s = (local_server_t*)t->data;
+    char *data = s->delayed;
+    size_t len = s->delayed_len;
+
+    if (!s->has_conn || uv_is_closing((uv_handle_t*)&s->conn)) {
+        return;
+    }
+
+    // handle_data may read more before it returns
+    s->delayed = NULL;
+    s->delayed_len = s->delayed_cap = 0;
+    handle_data(s, data, len);
+    free(data);
+}
+
+static void
+read_cb(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf)
+{
+    local_server_t *s = (local_server_t*)stream->data;
+
+    if (nread < 0) {
+        s->pushing = 0;
+        uv_close((uv_handle_t*)&s->conn, conn_close_cb);
+        return;
+    }
+
+    if (!s->conn_latency_ms) {
+        handle_data(s, buf->base, (size_t)nread);
+        return;
+    }
+
+    if (s->delayed_len + (size_t)nread > s->delayed_cap) {
+        s->delayed_cap = s->delayed_len + (size_t)nread;
+        s->delayed = (char*)realloc(s->delayed, s->delayed_cap);
+    }
+    memcpy(s->delayed + s->delayed_len, buf->base, (size_t)nread);
+    s->delayed_len += (size_t)nread;
+
+    if (!uv_is_active((uv_handle_t*)&s->latency_timer)) {
+        uv_timer_start(&s->latency_timer, latency_timer_cb, (uint64_t)s->conn_latency_ms, 0);
+    }
+}
+
+// Unlike a max early data of 0, tickets issued still allow early data, so
+// every resumed connection sends some.
+static int
+reject_early_data_cb(SSL *ssl, void *arg)
+{
+    return 0;
+}
+
+static void
+connection_cb(uv_stream_t *listener, int status)
+{
+    local_server_t *s = (local_server_t*)listener->data;
+
+    if (status < 0) {
+        return;
+    }
+    if (s->has_conn) {
+        s->accept_pending = listener;
+        return;
+    }
+
+    uv_tcp_init(&s->loop, &s->conn);
+    s->conn.data = s;
+    if (uv_accept(listener, (uv_stream_t*)&s->conn) == 0) {
+        s->has_conn = 1;
+        if (listener == (uv_stream_t*)&s->listener) {
+            uv_tcp_nodelay(&s->conn, 1);
+        }
+
+        uv_mutex_lock(&s->mutex);
+        s->conn_latency_ms = s->latency_ms;
+        int reject_early_data = s->reject_early_data;
+        uv_mutex_unlock(&s->mutex);
+
+        if (s->tls_ctx) {
+            s->tls = SSL_new(s->tls_ctx);
+            s->tls_in = BIO_new(BIO_s_mem());
+            s->tls_out = BIO_new(BIO_s_mem());
+            SSL_set_bio(s->tls, s->tls_in, s->tls_out);
+            SSL_set_accept_state(s->tls);
+            if (reject_early_data) {
+                SSL_set_allow_early_data_cb(s->tls, reject_early_data_cb, NULL);
+            }
+            s->early_done = 0;
+        }
+        uv_read_start((uv_stream_t*)&s->conn, alloc_cb, read_cb);
+    } else {
+        uv_close((uv_handle_t*)&s->conn, NULL);
+    }
+}
+
+static void
+close_walk_cb(uv_handle_t *handle, void *arg)
+{
+    if (!uv_is_closing(handle)) {
+        uv_close(handle, NULL);
+    }
+}
+
+static void
+stop_cb(uv_async_t *a)
+{
+    local_server_t *s = (local_server_t*)a->data;
+    s->pushing = 0;
+    uv_walk(&s->loop, close_walk_cb, NULL);
+}
+
+static void
+thread_fn(void *arg)
+{
+    local_server_t *s = (local_server_t*)arg;
+    struct sockaddr_in addr;
+    struct sockaddr_storage bound;
+    int namelen = sizeof(bound);
+
+    uv_ip4_addr("127.0.0.1", 0, &addr);
+    uv_tcp_bind(&s->listener, (const struct sockaddr*)&addr, 0);
+    uv_listen((uv_stream_t*)&s->listener, 1, connection_cb);
+    uv_tcp_getsockname(&s->listener, (struct sockaddr*)&bound, &namelen);
+    s->port = ntohs(((struct sockaddr_in*)&bound)->sin_port);
+
+#ifndef _WIN32
+    uv_pipe_init(&s->loop, &s->unix_listener, 0);
+    s->unix_listener.data = s;
+    snprintf(s->unix_path, sizeof(s->unix_path), "/tmp/pitaya-local-%d-%d.sock", (int)uv_os_getpid(), s->port);
+    unlink(s->unix_path);
+    if (uv_pipe_bind(&s->unix_listener, s->unix_path) == 0) {
+        uv_listen((uv_stream_t*)&s->unix_listener, 1, connection_cb);
+    } else {
+        s->unix_path[0] = '\0';
+    }
+#endif
+
+    uv_sem_post(&s->ready);
+    uv_run(&s->loop, UV_RUN_DEFAULT);
+}
+
+local_server_t *
+local_server_start(int hb_interval, const char *push_route,
+                   const char *push_body, size_t push_len, int compress_push)
+{
+    return local_server_start_ex(hb_interval, push_route, push_body, push_len, compress_push, 0);
+}
+
+local_server_t *
+local_server_start_ex(int hb_interval, const char *push_route,
+                      const char *push_body, size_t push_len, int compress_push, int tls)
+{
+    local_server_t *s = (local_server_t*)calloc(1, sizeof(local_server_t));
+    s->hb_interval = hb_interval;
+
+    if (tls) {
+        s->tls_ctx = SSL_CTX_new(TLS_server_method());
+        if (SSL_CTX_use_certificate_chain_file(s->tls_ctx, LOCAL_SERVER_FIXTURES_DIR "/server/pitaya.crt") != 1 ||
+            SSL_CTX_use_PrivateKey_file(s->tls_ctx, LOCAL_SERVER_FIXTURES_DIR "/server/pitaya.key", SSL_FILETYPE_PEM) != 1) {
+            fprintf(stderr, "local server: loading the certificate failed: %s\n",
+                    ERR_error_string(ERR_get_error(), NULL));
+            abort();
+        }
+        // Resumed connections may send early data, see local_server_reject_early_data.
+        SSL_CTX_set_max_early_data(s->tls_ctx, 16384);
+    }
+
+    if (push_route) {
+        // flag, route length, route and body
+        size_t route_len = strlen(push_route);
+        uLongf body_len = compress_push ? compressBound((uLong)push_len) : (uLongf)push_len;
+        char *msg = (char*)malloc(2 + route_len + body_len);
+
+        msg[0] = (char)((LOCAL_MSG_PUSH << 1) | (compress_push ? LOCAL_MSG_GZIP : 0));
+        msg[1] = (char)route_len;
+        memcpy(msg + 2, push_route, route_len);
+        if (compress_push) {
+            int ret = compress2((Bytef*)msg + 2 + route_len, &body_len, (const Bytef*)push_body,
+                                (uLong)push_len, Z_DEFAULT_COMPRESSION);
+            assert(ret == Z_OK);
+            (void)ret;
+        } else {
+            memcpy(msg + 2 + route_len, push_body, push_len);
+        }
+
+        assert(2 + route_len + body_len < PC_PKG_MAX_BODY_BYTES);
+        s->push_pkg = encode_pkg(PC_PKG_DATA, msg, 2 + route_len + body_len);
+        free(msg);
+    }
+
+    uv_mutex_init(&s->mutex);
+    uv_sem_init(&s->ready, 0);
+    uv_loop_init(&s->loop);
+    pc_pkg_parser_init(&s->parser, on_pkg, s);
+
+    uv_tcp_init(&s->loop, &s->listener);
+    s->listener.data = s;
+    uv_async_init(&s->loop, &s->stop_async, stop_cb);
+    s->stop_async.data = s;
+    uv_timer_init(&s->loop, &s->latency_timer);
+    s->latency_timer.data = s;
+
+    uv_thread_create(&s->thread, thread_fn, s);
+    uv_sem_wait(&s->ready);
+
+    return s;
+}
+
+void
+local_server_stop(local_server_t *s)
+{
+    uv_async_send(&s->stop_async);
+    uv_thread_join(&s->thread);
+
+    uv_loop_close(&s->loop);
+#ifndef _WIN32
+    if (s->unix_path[0]) {
+        unlink(s->unix_path);
+    }
+#endif
+    pc_pkg_parser_reset(&s->parser);
+    uv_sem_destroy(&s->ready);
+    uv_mutex_destroy(&s->mutex);
+    SSL_free(s->tls);
+    SSL_CTX_free(s->tls_ctx);
+    free(s->push_pkg.base);
+    free(s->delayed);
+    free(s);
+}
+
+int
+local_server_port(local_server_t *s)
+{
+    return s->port;
+}
+
+const char *
+local_server_unix_path(local_server_t *s)
+{
+    return s->unix_path[0] ? s->unix_path : NULL;
+}
+
+void
+local_server_set_latency(local_server_t *s, int latency_ms)
+{
+    uv_mutex_lock(&s->mutex);
+    s->latency_ms = latency_ms;
+    uv_mutex_unlock(&s->mutex);
+}
+
+void
+local_server_reject_early_data(local_server_t *s, int reject)
+{
+    uv_mutex_lock(&s->mutex);
+    s->reject_early_data = reject;
+    uv_mutex_unlock(&s->mutex);
+}
+
+size_t
+local_server_heartbeats(local_server_t *s, uint64_t *times, size_t cap)
+{
+    size_t n;
+
+    uv_mutex_lock(&s->mutex);
+    n = s->hb_count < cap ? s->hb_count : cap;
+    memcpy(times, s->hb_times, n * sizeof(uint64_t));
+    uv_mutex_unlock(&s->mutex);
+
+    return n;
+}
+
+size_t
+local_server_handshakes(local_server_t *s)
+{
+    size_t n;
+
+    uv_mutex_lock(&s->mutex);
+    n = s->handshakes;
+    uv_mutex_unlock(&s->mutex);
+
+    return n;
+}
@@ -0,0 +1,48 @@
+/*
+ * Minimal in process Pitaya server used by the benchmarks and the tests
+ * that need a connected client the mock servers can not provide. It runs its own libuv loop on a thread and accepts a
+ * single connection on an ephemeral port, or on a unix domain socket.
+ */
+
+#ifndef LOCAL_SERVER_H
+#define LOCAL_SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOCAL_SERVER_MAX_HEARTBEATS 256
+
+typedef struct local_server_s local_server_t;
+
+// Starts the server, announcing `hb_interval` seconds as heartbeat interval.
+// If `push_route` is not NULL, once the handshake is done `push_body` is
+// pushed to the client back to back until the server stops, compressed
+// with zlib if `compress_push` is set.
+local_server_t *local_server_start(int hb_interval, const char *push_route,
+                                   const char *push_body, size_t push_len, int compress_push);
+// Same as local_server_start, speaking TLS with the test server certificate
+// of the fixtures if `tls` is set. Connections are accepted one after the
+// other, and TLS 1.3 ones resuming a session may send early data.
+local_server_t *local_server_start_ex(int hb_interval, const char *push_route,
+                                      const char *push_body, size_t push_len, int compress_push, int tls);
+void local_server_stop(local_server_t *server);
+
+int local_server_port(local_server_t *server);
+// Path of the unix domain socket the server also listens on, NULL on Windows.
+const char *local_server_unix_path(local_server_t *server);
+
+// Delays what the server reads by `latency_ms`, so that each flight of the
+// client costs about a round trip of that length.
+void local_server_set_latency(local_server_t *server, int latency_ms);
+
+// Makes the next TLS connections reject the early data clients send.
+void local_server_reject_early_data(local_server_t *server, int reject);
+
+// Copies the uv_hrtime() of each heartbeat received from the client to
+// `times` and returns how many were copied.
+size_t local_server_heartbeats(local_server_t *server, uint64_t *times, size_t cap);
+
+// Number of handshake packages received over all connections.
+size_t local_server_handshakes(local_server_t *server);
+
+#endif // LOCAL_SERVER_H
@@ -20,6 +20,8 @@ extern const MunitSuite notify_suite;
 extern const MunitSuite stress_suite;
 extern const MunitSuite protobuf_suite;
 extern const MunitSuite push_suite;
+extern const MunitSuite json_suite;
+extern const MunitSuite endpoints_suite;
 static const int SUITES_END = __LINE__;
 
 const MunitSuite null_suite = {
@@ -52,6 +54,8 @@ make_suites()
     suites_array[i++] = stress_suite;
     suites_array[i++] = protobuf_suite;
     suites_array[i++] = push_suite;
+    suites_array[i++] = json_suite;
+    suites_array[i++] = endpoints_suite;
     // IMPORTANT: always has to end with a null suite
     suites_array[i++] = null_suite;
     return suites_array;
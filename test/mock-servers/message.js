@@ -57,7 +57,8 @@ function routable(t) {
 	  return t === Type.Request || t === Type.Notify || t === Type.Push;
 }
 
-function encode(msg) {
+// `compress` deflates the body when it makes it smaller.
+function encode(msg, compress) {
 	  if (invalidType(msg.type)) {
 		    return [null, Errors.WrongMessageType];
 	  }
@@ -115,19 +116,16 @@ function encode(msg) {
         }
 	  }
 
-    const dataCompression = false;
-	  if (dataCompression) {
-        const compressedData = zlib.deflateSync(msg.data);
+    let dataBuf = Buffer.from(msg.data);
+	  if (compress) {
+        const compressedData = zlib.deflateSync(dataBuf);
 
-		    if (compressedData.length < msg.data) {
-			      msg.data = compressedData;
+		    if (compressedData.length < dataBuf.length) {
+			      dataBuf = compressedData;
 			      flagBuf[0] |= Mask.Gzip;
 		    }
 	  }
 
-    const dataBuf = Buffer.alloc(msg.data.length);
-    dataBuf.write(msg.data.toString(), 0);
-
     const finalBuf = Buffer.concat([
         flagBuf,
         msgIdBuf ? msgIdBuf : Buffer.alloc(0),
@@ -140,7 +138,58 @@ function encode(msg) {
 
 
 // See ref: https://github.com/topfreegames/pitaya/blob/master/docs/communication_protocol.md
-function decode(buf) {
+// Decodes an LZ4 block prefixed by its uncompressed size (little endian).
+function lz4Decompress(data) {
+    const size = data.readUInt32LE(0);
+    const out = Buffer.alloc(size);
+    let ip = 4, op = 0;
+
+    const readLength = (len) => {
+        if (len === 15) {
+            let b;
+            do {
+                b = data[ip++];
+                len += b;
+            } while (b === 255);
+        }
+        return len;
+    };
+
+    while (ip < data.length) {
+        const token = data[ip++];
+        const litLen = readLength(token >> 4);
+        data.copy(out, op, ip, ip + litLen);
+        ip += litLen;
+        op += litLen;
+        if (ip >= data.length) {
+            break;
+        }
+
+        const offset = data.readUInt16LE(ip);
+        ip += 2;
+        const matchLen = readLength(token & 15) + 4;
+        for (let i = 0; i < matchLen; i++, op++) {
+            out[op] = out[op - offset];
+        }
+    }
+
+    if (op !== size) {
+        throw new Error(`LZ4 block decoded to ${op} bytes, expected ${size}`);
+    }
+    return out;
+}
+
+// Returns the id of the preset dictionary of a zlib stream, or null.
+function dictionaryId(data) {
+    if (data.length < 6 || (data[1] & 0x20) === 0) {
+        return null;
+    }
+    return data.readUInt32BE(2);
+}
+
+// `dictionaries` maps the adler32 id of a preset dictionary to its contents.
+// `codec` is the compression codec negotiated in the handshake, zlib if not set.
+function decode(buf, dictionaries, codec) {
     if (buf.length < MSG_HEAD_LENGTH) {
         console.log('ERROR: buffer smaller than the message header');
         return [null, Errors.InvalidMessage];
@@ -196,7 +245,19 @@ function decode(buf) {
 
     if ((flag&Mask.Gzip) === Mask.Gzip) {
         msg.gzipped = true;
-        msg.data = zlib.inflateSync(msg.data);
+        const dictId = codec === 'lz4' ? null : dictionaryId(msg.data);
+        if (codec === 'lz4') {
+            msg.data = lz4Decompress(msg.data);
+        } else if (dictId !== null) {
+            const dictionary = dictionaries ? dictionaries[dictId] : undefined;
+            if (!dictionary) {
+                return [null, new Error(`Unknown dictionary ${dictId}`)];
+            }
+            msg.usedDictionary = true;
+            msg.data = zlib.inflateSync(msg.data, {dictionary: dictionary});
+        } else {
+            msg.data = zlib.inflateSync(msg.data);
+        }
     }
 
     msg.data = msg.data.toString();
@@ -9,37 +9,93 @@ const TCP_PORT = 4100;
 const TLS_PORT = TCP_PORT+1;
 const HEARTBEAT_INTERVAL = 6;
 
+// Preset dictionary known by the server, indexed by its adler32 id.
+const dictionary = Buffer.from(fs.readFileSync('../../fixtures/compression/dictionary.b64', 'utf8').trim(), 'base64');
+const dictionaries = {[adler32(dictionary)]: dictionary};
+
+function adler32(buf) {
+    let a = 1, b = 0;
+    for (let i = 0; i < buf.length; i++) {
+        a = (a + buf[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return ((b << 16) | a) >>> 0;
+}
+
+// Codecs the server can decompress, in order of preference.
+const CODECS = ['lz4', 'zlib'];
+
+// Big message of about `size` bytes, the same made by fill_random_json in
+// test_compression.c.
+function bigMessage(size) {
+    let out = '{"items":[';
+    let seed = 42;
+    while (out.length < size - 64) {
+        seed = (Math.imul(seed, 1103515245) + 12345) >>> 0;
+        out += `{"name":"sword","id":${seed}},`;
+    }
+    return out.slice(0, -1) + ']}';
+}
+
 let heartbeatInterval;
 let clientDisconnected = false;
 
 function processPacket(packet, clientSocket) {
+    const session = clientSocket.session;
     console.log('processing packet');
 
     switch (packet.type) {
     case pkt.PacketType.Handshake:
         console.log('Handshake length: ' + packet.data.length);
         console.log(packet.data.toString('utf8'));
-        pkt.sendHandshakeResponse(clientSocket);
+        const sys = JSON.parse(packet.data.toString('utf8')).sys;
+        const respSys = {};
+        if (sys.dictionaries) {
+            respSys.dictionaries = sys.dictionaries.filter(id => dictionaries[id] !== undefined);
+        }
+        if (sys.codecs) {
+            session.codec = sys.codecs.find(c => CODECS.includes(c));
+            if (session.codec) {
+                respSys.codec = session.codec;
+            }
+        }
+        pkt.sendHandshakeResponse(clientSocket, Object.keys(respSys).length > 0 ? respSys : undefined);
         break;
 
     case pkt.PacketType.HandshakeAck:
         break;
 
     case pkt.PacketType.Data:
-        const [msg, decodeError] = message.decode(packet.data);
+        const [msg, decodeError] = message.decode(packet.data, dictionaries, session.codec);
         if (decodeError) {
             throw decodeError;
         }
         console.log(msg);
 
+        // Echoes the body back, compressed when it is worth it.
+        const echo = msg.route.startsWith('echo.');
+
         const respData = {
             isCompressed: msg.gzipped,
         };
+        if (msg.usedDictionary) {
+            respData.usedDictionary = true;
+        }
+        if (msg.gzipped && session.codec && session.codec !== 'zlib') {
+            respData.codec = session.codec;
+        }
 
         console.log(respData);
 
-        const respMsg = message.createResponseMessage(msg.id, JSON.stringify(respData));
-        const [encodedRespMsg, encodeError] = message.encode(respMsg);
+        // Answers with a big message of the requested size, compressed for big.compressed.
+        const big = msg.route.startsWith('big.');
+        let respBody = echo ? msg.data : JSON.stringify(respData);
+        if (big) {
+            respBody = bigMessage(JSON.parse(msg.data.toString('utf8')).size);
+        }
+
+        const respMsg = message.createResponseMessage(msg.id, respBody);
+        const [encodedRespMsg, encodeError] = message.encode(respMsg, echo || msg.route === 'big.compressed');
         if (encodeError) {
             throw encodeError;
         }
@@ -75,6 +131,7 @@ function processBuffer(buffer, socket) {
 
 const tcpServer = net.createServer((socket) => {
     console.log('======= New TCP Connection ========');
+    socket.session = {};
 
     socket.on('data', (buffer) => {
         console.log(`type `, buffer[0]);
@@ -101,6 +158,7 @@ const tlsOptions = {
 
 const tlsServer = tls.createServer(tlsOptions, (socket) => {
     console.log('======= New TLS Connection ========');
+    socket.session = {};
     console.log(socket.authorized ? 'Authorized' : 'Unauthorized');
 
     socket.on('data', (buffer) => {
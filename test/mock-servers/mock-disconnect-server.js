@@ -6,6 +6,8 @@ const pkt = require('./packet.js');
 const HOST = '127.0.0.1';
 const TCP_PORT = 4000;
 const TLS_PORT = TCP_PORT+1;
+// The tcp server also listens there, see PC_HOST_UNIX_PREFIX.
+const UNIX_PATH = '/tmp/pitaya-mock-disconnect.sock';
 const HEARTBEAT_INTERVAL = 2;
 
 let heartbeatInterval;
@@ -49,7 +51,7 @@ function processBuffer(buffer, socket) {
     }
 }
 
-const tcpServer = net.createServer((socket) => {
+function onTcpConnection(socket) {
     console.log('======= New TCP Connection ========');
 
     socket.on('data', (buffer) => {
@@ -67,7 +69,10 @@ const tcpServer = net.createServer((socket) => {
         clearTimeout(handshakeTimeout);
         console.log('Client disconnected with error :(');
     });
-});
+}
+
+const tcpServer = net.createServer(onTcpConnection);
+const unixServer = net.createServer(onTcpConnection);
 
 const tlsOptions = {
     key: fs.readFileSync('../../fixtures/server/pitaya.key'),
@@ -104,4 +109,19 @@ tlsServer.listen(TLS_PORT, HOST, () => {
     console.log(`TLS server on ${HOST}:${TLS_PORT}`);
 });
 
+if (process.platform !== 'win32') {
+    // A socket file left by a previous run would make listen fail, but one
+    // a server still accepts on is left to it.
+    const probe = net.connect(UNIX_PATH, () => {
+        console.log(`TCP server already on ${UNIX_PATH}`);
+        probe.destroy();
+    });
+    probe.on('error', () => {
+        fs.rmSync(UNIX_PATH, { force: true });
+        unixServer.listen(UNIX_PATH, () => {
+            console.log(`TCP server on ${UNIX_PATH}`);
+        });
+    });
+}
+
 pkt.encodeHanshakeAndHeartbeatResponse(HEARTBEAT_INTERVAL);
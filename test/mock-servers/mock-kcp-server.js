@@ -0,0 +1,440 @@
+const dgram = require('dgram');
+const net = require('net');
+const pkt = require('./packet.js');
+const message = require('./message.js');
+
+const HOST = '127.0.0.1';
+const KCP_PORT = 4700;
+const LOSSY_KCP_PORT = KCP_PORT+1;
+const LOSSY_TCP_PORT = KCP_PORT+2;
+const HEARTBEAT_INTERVAL = 6;
+
+// The link the lossy ports are behind, each way.
+const LOSS = 0.1;
+const DELAY_MS = 20;
+const JITTER_MS = 5;
+// A lost tcp write waits for the least retransmission timeout of Linux, as
+// writes of a few packets do not get fast retransmits.
+const TCP_MIN_RTO_MS = 200;
+
+// KCP segments, see tr_uv_kcp_arq.h.
+const OVERHEAD = 24;
+const MTU = 1400;
+const MSS = MTU - OVERHEAD;
+const Cmd = Object.freeze({
+    Push: 81,
+    Ack: 82,
+    WindowAsk: 83,
+    WindowTell: 84,
+});
+const WND = 128;
+// The fast mode of KCP.
+const INTERVAL_MS = 10;
+const MIN_RTO_MS = 30;
+const FAST_RESEND = 2;
+const DEAD_LINK = 20;
+const SESSION_IDLE_MS = 30 * 1000;
+
+// Seeded, so runs lose about the same datagrams.
+function mulberry32(seed) {
+    return function() {
+        seed = (seed + 0x6D2B79F5) >>> 0;
+        let t = seed;
+        t = Math.imul(t ^ (t >>> 15), t | 1);
+        t ^= t + Math.imul(t ^ (t >>> 7), t | 61);
+        return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+    };
+}
+
+const random = mulberry32(42);
+
+function linkDelay() {
+    return DELAY_MS + Math.floor((random() * 2 - 1) * JITTER_MS);
+}
+
+function now32() {
+    return Date.now() >>> 0;
+}
+
+function diff(later, earlier) {
+    return (later - earlier) | 0;
+}
+
+// Pitaya packages over a stream, `write` sends bytes to the client.
+class PitayaStream {
+    constructor(write) {
+        this.write = write;
+        this.buffer = Buffer.alloc(0);
+    }
+
+    feed(data) {
+        this.buffer = Buffer.concat([this.buffer, data]);
+
+        while (this.buffer.length >= pkt.HEADER_LENGTH) {
+            const size = this.buffer.readIntBE(1, 3);
+            if (this.buffer.length < pkt.HEADER_LENGTH + size) {
+                return;
+            }
+            const raw = this.buffer.slice(0, pkt.HEADER_LENGTH + size);
+            this.buffer = this.buffer.slice(pkt.HEADER_LENGTH + size);
+            new pkt.RawPackets(raw).decode().forEach(p => this.processPacket(p));
+        }
+    }
+
+    processPacket(packet) {
+        switch (packet.type) {
+        case pkt.PacketType.Handshake:
+            console.log(packet.data.toString('utf8'));
+            pkt.sendHandshakeResponse(this);
+            break;
+
+        case pkt.PacketType.HandshakeAck:
+            break;
+
+        case pkt.PacketType.Heartbeat:
+            pkt.sendHeartbeat(this);
+            break;
+
+        case pkt.PacketType.Data:
+            const [msg, decodeError] = message.decode(packet.data, {}, undefined);
+            if (decodeError) {
+                throw decodeError;
+            }
+            console.log(msg);
+            // Every request is echoed, notifies are not answered.
+            if (msg.type === 0) {
+                const [encoded, encodeError] = message.encode(message.createResponseMessage(msg.id, msg.data), false);
+                if (encodeError) {
+                    throw encodeError;
+                }
+                this.write(pkt.encode(pkt.PacketType.Data, encoded));
+            }
+            break;
+        }
+    }
+}
+
+function encodeSegment(conv, cmd, wnd, ts, sn, una, data) {
+    const seg = Buffer.alloc(OVERHEAD + (data ? data.length : 0));
+    seg.writeUInt32LE(conv, 0);
+    seg.writeUInt8(cmd, 4);
+    seg.writeUInt8(0, 5);
+    seg.writeUInt16LE(wnd, 6);
+    seg.writeUInt32LE(ts >>> 0, 8);
+    seg.writeUInt32LE(sn >>> 0, 12);
+    seg.writeUInt32LE(una >>> 0, 16);
+    seg.writeUInt32LE(data ? data.length : 0, 20);
+    if (data) {
+        data.copy(seg, OVERHEAD);
+    }
+    return seg;
+}
+
+// A conversation of a client, the server side of the KCP ARQ in stream
+// mode and its fast mode. `send` sends a datagram to the client.
+class KcpSession {
+    constructor(conv, send) {
+        this.conv = conv;
+        this.send = send;
+        this.stream = new PitayaStream((data) => this.write(data));
+
+        this.sndUna = 0;
+        this.sndNxt = 0;
+        this.rcvNxt = 0;
+        this.rmtWnd = WND;
+        this.sndQueue = [];
+        this.sndBuf = new Map();
+        this.rcvBuf = new Map();
+        this.acks = [];
+        this.tellWindow = false;
+
+        this.srtt = 0;
+        this.rttval = 0;
+        this.rto = 200;
+
+        this.timer = null;
+        this.lastInput = Date.now();
+        this.dead = false;
+    }
+
+    write(data) {
+        let offset = 0;
+        const last = this.sndQueue[this.sndQueue.length - 1];
+        if (last && last.length < MSS) {
+            const n = Math.min(MSS - last.length, data.length);
+            this.sndQueue[this.sndQueue.length - 1] = Buffer.concat([last, data.slice(0, n)]);
+            offset = n;
+        }
+        while (offset < data.length) {
+            const n = Math.min(MSS, data.length - offset);
+            this.sndQueue.push(data.slice(offset, offset + n));
+            offset += n;
+        }
+        this.schedule(0);
+    }
+
+    updateRtt(rtt) {
+        if (this.srtt === 0) {
+            this.srtt = rtt;
+            this.rttval = rtt / 2;
+        } else {
+            this.rttval = (3 * this.rttval + Math.abs(rtt - this.srtt)) / 4;
+            this.srtt = Math.max(1, (7 * this.srtt + rtt) / 8);
+        }
+        this.rto = Math.min(60000, Math.max(MIN_RTO_MS, this.srtt + Math.max(INTERVAL_MS, 4 * this.rttval)));
+    }
+
+    input(data) {
+        this.lastInput = Date.now();
+        let maxAck = -1;
+
+        while (data.length >= OVERHEAD) {
+            const conv = data.readUInt32LE(0);
+            const cmd = data.readUInt8(4);
+            const wnd = data.readUInt16LE(6);
+            const ts = data.readUInt32LE(8);
+            const sn = data.readUInt32LE(12);
+            const una = data.readUInt32LE(16);
+            const len = data.readUInt32LE(20);
+            if (conv !== this.conv || len > data.length - OVERHEAD) {
+                console.log('Malformed datagram');
+                return;
+            }
+            const payload = data.slice(OVERHEAD, OVERHEAD + len);
+            data = data.slice(OVERHEAD + len);
+
+            this.rmtWnd = wnd;
+            for (const s of this.sndBuf.keys()) {
+                if (diff(s, una) < 0) {
+                    this.sndBuf.delete(s);
+                }
+            }
+
+            switch (cmd) {
+            case Cmd.Ack:
+                // The una of the segment may have taken it out already.
+                if (diff(now32(), ts) >= 0) {
+                    this.updateRtt(diff(now32(), ts));
+                }
+                this.sndBuf.delete(sn);
+                if (maxAck < 0 || diff(sn, maxAck) > 0) {
+                    maxAck = sn;
+                }
+                break;
+            case Cmd.Push:
+                if (diff(sn, this.rcvNxt + WND) < 0) {
+                    this.acks.push([sn, ts]);
+                    if (diff(sn, this.rcvNxt) >= 0 && !this.rcvBuf.has(sn)) {
+                        this.rcvBuf.set(sn, Buffer.from(payload));
+                    }
+                }
+                break;
+            case Cmd.WindowAsk:
+                this.tellWindow = true;
+                break;
+            }
+        }
+
+        this.sndUna = this.sndBuf.size ? Math.min(...this.sndBuf.keys()) : this.sndNxt;
+
+        if (maxAck >= 0) {
+            for (const [s, seg] of this.sndBuf) {
+                if (diff(s, maxAck) < 0) {
+                    seg.fastack++;
+                }
+            }
+        }
+
+        while (this.rcvBuf.has(this.rcvNxt)) {
+            const payload = this.rcvBuf.get(this.rcvNxt);
+            this.rcvBuf.delete(this.rcvNxt);
+            this.rcvNxt = (this.rcvNxt + 1) >>> 0;
+            this.stream.feed(payload);
+        }
+
+        this.schedule(0);
+    }
+
+    schedule(delay) {
+        if (this.timer) {
+            clearTimeout(this.timer);
+        }
+        this.timer = setTimeout(() => {
+            this.timer = null;
+            this.flush();
+        }, delay);
+    }
+
+    flush() {
+        const current = now32();
+        const segs = [];
+        const wnd = WND;
+
+        this.acks.forEach(([sn, ts]) => segs.push(encodeSegment(this.conv, Cmd.Ack, wnd, ts, sn, this.rcvNxt)));
+        this.acks = [];
+        if (this.tellWindow) {
+            segs.push(encodeSegment(this.conv, Cmd.WindowTell, wnd, 0, 0, this.rcvNxt));
+            this.tellWindow = false;
+        }
+
+        const cwnd = Math.min(WND, this.rmtWnd);
+        while (this.sndQueue.length && diff(this.sndNxt, this.sndUna + cwnd) < 0) {
+            this.sndBuf.set(this.sndNxt, {data: this.sndQueue.shift(), xmit: 0, resendts: 0, rto: this.rto, fastack: 0});
+            this.sndNxt = (this.sndNxt + 1) >>> 0;
+        }
+
+        for (const [sn, seg] of this.sndBuf) {
+            let send = false;
+            if (seg.xmit === 0) {
+                send = true;
+                seg.rto = this.rto;
+            } else if (diff(current, seg.resendts) >= 0) {
+                send = true;
+                seg.rto += seg.rto / 2;
+            } else if (seg.fastack >= FAST_RESEND) {
+                send = true;
+                seg.fastack = 0;
+            }
+            if (send) {
+                seg.xmit++;
+                seg.resendts = (current + Math.round(seg.rto)) >>> 0;
+                segs.push(encodeSegment(this.conv, Cmd.Push, wnd, current, sn, this.rcvNxt, seg.data));
+                if (seg.xmit >= DEAD_LINK) {
+                    this.dead = true;
+                }
+            }
+        }
+
+        // Segments go together in datagrams of up to MTU bytes.
+        let datagram = [];
+        let size = 0;
+        for (const seg of segs) {
+            if (size + seg.length > MTU) {
+                this.send(Buffer.concat(datagram));
+                datagram = [];
+                size = 0;
+            }
+            datagram.push(seg);
+            size += seg.length;
+        }
+        if (size) {
+            this.send(Buffer.concat(datagram));
+        }
+
+        if (this.sndBuf.size && !this.dead) {
+            this.schedule(INTERVAL_MS);
+        }
+    }
+
+    close() {
+        if (this.timer) {
+            clearTimeout(this.timer);
+            this.timer = null;
+        }
+    }
+}
+
+// `lossy` has the datagrams go through the simulated link both ways.
+function kcpServer(port, lossy) {
+    const socket = dgram.createSocket('udp4');
+    const sessions = new Map();
+
+    function through(fn) {
+        if (!lossy) {
+            fn();
+            return;
+        }
+        if (random() < LOSS) {
+            return;
+        }
+        setTimeout(fn, linkDelay());
+    }
+
+    socket.on('message', (data, rinfo) => through(() => {
+        if (data.length < OVERHEAD) {
+            return;
+        }
+        const key = `${rinfo.address}:${rinfo.port}`;
+        const conv = data.readUInt32LE(0);
+        let session = sessions.get(key);
+
+        // A reconnect of the client starts a new conversation.
+        if (!session || session.conv !== conv) {
+            if (session) {
+                session.close();
+            }
+            console.log(`======= New KCP conversation ${conv} from ${key} ========`);
+            session = new KcpSession(conv, (datagram) => through(() => socket.send(datagram, rinfo.port, rinfo.address)));
+            sessions.set(key, session);
+        }
+        session.input(data);
+    }));
+
+    setInterval(() => {
+        for (const [key, session] of sessions) {
+            if (Date.now() - session.lastInput > SESSION_IDLE_MS) {
+                session.close();
+                sessions.delete(key);
+            }
+        }
+    }, SESSION_IDLE_MS).unref();
+
+    socket.bind(port, HOST, () => {
+        console.log(`KCP server on ${HOST}:${port}${lossy ? ', lossy' : ''}`);
+    });
+}
+
+// Delivers what goes through it in order, each write after the link delay
+// and a lost one after the retransmission timeout too, holding back those
+// behind it like tcp does.
+class OrderedLink {
+    constructor(deliver) {
+        this.deliver = deliver;
+        this.queue = [];
+        this.last = 0;
+        this.timer = null;
+    }
+
+    push(data) {
+        let at = Date.now() + linkDelay();
+        if (random() < LOSS) {
+            at += TCP_MIN_RTO_MS;
+        }
+        this.last = Math.max(this.last, at);
+        this.queue.push({at: this.last, data});
+        this.arm();
+    }
+
+    arm() {
+        if (this.timer || !this.queue.length) {
+            return;
+        }
+        this.timer = setTimeout(() => {
+            this.timer = null;
+            while (this.queue.length && this.queue[0].at <= Date.now()) {
+                this.deliver(this.queue.shift().data);
+            }
+            this.arm();
+        }, Math.max(0, this.queue[0].at - Date.now()));
+    }
+}
+
+const lossyTcpServer = net.createServer((socket) => {
+    console.log('======= New lossy TCP connection ========');
+    const out = new OrderedLink((data) => socket.writable && socket.write(data));
+    const stream = new PitayaStream((data) => out.push(data));
+    const inbound = new OrderedLink((data) => stream.feed(data));
+
+    socket.setNoDelay(true);
+    socket.on('data', (data) => inbound.push(data));
+    socket.on('error', () => console.log('Client disconnected with error :('));
+});
+
+kcpServer(KCP_PORT, false);
+kcpServer(LOSSY_KCP_PORT, true);
+
+lossyTcpServer.listen(LOSSY_TCP_PORT, HOST, () => {
+    console.log(`Lossy TCP server on ${HOST}:${LOSSY_TCP_PORT}`);
+});
+
+pkt.encodeHanshakeAndHeartbeatResponse(HEARTBEAT_INTERVAL);
@@ -0,0 +1,272 @@
+const http = require('http');
+const https = require('https');
+const crypto = require('crypto');
+const fs = require('fs');
+const pkt = require('./packet.js');
+const message = require('./message.js');
+
+const HOST = '127.0.0.1';
+const WS_PORT = 4600;
+const WSS_PORT = WS_PORT+1;
+const REFUSE_PORT = WS_PORT+2;
+const HEARTBEAT_INTERVAL = 6;
+
+const GUID = '258EAFA5-E914-47DA-95CA-C5AB0DC85B11';
+
+const Opcode = Object.freeze({
+    Continuation: 0x0,
+    Text: 0x1,
+    Binary: 0x2,
+    Close: 0x8,
+    Ping: 0x9,
+    Pong: 0xa,
+});
+
+// Server frames are never masked.
+function frame(opcode, payload, fin = true) {
+    let header;
+    if (payload.length < 126) {
+        header = Buffer.alloc(2);
+        header[1] = payload.length;
+    } else if (payload.length <= 0xffff) {
+        header = Buffer.alloc(4);
+        header[1] = 126;
+        header.writeUInt16BE(payload.length, 2);
+    } else {
+        header = Buffer.alloc(10);
+        header[1] = 127;
+        header.writeBigUInt64BE(BigInt(payload.length), 2);
+    }
+    header[0] = (fin ? 0x80 : 0) | opcode;
+    return Buffer.concat([header, payload]);
+}
+
+// A websocket connection carrying pitaya packets, one per binary message
+// like the websocket acceptor of pitaya expects them.
+class Connection {
+    constructor(socket) {
+        this.socket = socket;
+        this.buffer = Buffer.alloc(0);
+        this.message = null;
+        this.pongWaiters = [];
+    }
+
+    // packet.js writes whole packets, each one goes in a binary message.
+    write(packet) {
+        this.socket.write(frame(Opcode.Binary, packet));
+    }
+
+    close(code) {
+        const payload = Buffer.alloc(2);
+        payload.writeUInt16BE(code, 0);
+        this.socket.write(frame(Opcode.Close, payload));
+        this.socket.end();
+    }
+
+    onData(data) {
+        this.buffer = Buffer.concat([this.buffer, data]);
+
+        while (this.buffer.length >= 2) {
+            const b0 = this.buffer[0];
+            const b1 = this.buffer[1];
+            let len = b1 & 0x7f;
+            let offset = 2;
+
+            if (len === 126) {
+                if (this.buffer.length < 4) return;
+                len = this.buffer.readUInt16BE(2);
+                offset = 4;
+            } else if (len === 127) {
+                if (this.buffer.length < 10) return;
+                len = Number(this.buffer.readBigUInt64BE(2));
+                offset = 10;
+            }
+
+            if (!(b1 & 0x80)) {
+                console.log('Unmasked frame from the client');
+                this.close(1002);
+                return;
+            }
+            if (this.buffer.length < offset + 4 + len) return;
+
+            const mask = this.buffer.slice(offset, offset + 4);
+            const payload = Buffer.from(this.buffer.slice(offset + 4, offset + 4 + len));
+            for (let i = 0; i < payload.length; i++) {
+                payload[i] ^= mask[i & 3];
+            }
+            this.buffer = this.buffer.slice(offset + 4 + len);
+
+            this.onFrame(b0 & 0x80, b0 & 0x0f, payload);
+        }
+    }
+
+    onFrame(fin, opcode, payload) {
+        switch (opcode) {
+        case Opcode.Binary:
+        case Opcode.Continuation:
+            this.message = this.message ? Buffer.concat([this.message, payload]) : payload;
+            if (fin) {
+                const msg = this.message;
+                this.message = null;
+                this.onMessage(msg);
+            }
+            break;
+        case Opcode.Ping:
+            this.socket.write(frame(Opcode.Pong, payload));
+            break;
+        case Opcode.Pong:
+            const waiter = this.pongWaiters.shift();
+            if (waiter) waiter(payload);
+            break;
+        case Opcode.Close:
+            console.log('Client closed the connection');
+            this.socket.end();
+            break;
+        default:
+            console.log(`Unexpected opcode ${opcode}`);
+            this.close(1003);
+        }
+    }
+
+    onMessage(msg) {
+        const size = msg.length >= pkt.HEADER_LENGTH ? msg.readIntBE(1, 3) : -1;
+        if (size !== msg.length - pkt.HEADER_LENGTH) {
+            console.log(`Message of ${msg.length} bytes is not a single packet`);
+            this.close(1002);
+            return;
+        }
+
+        new pkt.RawPackets(msg).decode().forEach(p => this.processPacket(p));
+    }
+
+    processPacket(packet) {
+        switch (packet.type) {
+        case pkt.PacketType.Handshake:
+            console.log(packet.data.toString('utf8'));
+            pkt.sendHandshakeResponse(this);
+            break;
+
+        case pkt.PacketType.HandshakeAck:
+            break;
+
+        case pkt.PacketType.Heartbeat:
+            pkt.sendHeartbeat(this);
+            break;
+
+        case pkt.PacketType.Data:
+            const [msg, decodeError] = message.decode(packet.data, {}, undefined);
+            if (decodeError) {
+                throw decodeError;
+            }
+            console.log(msg);
+            this.processRequest(msg);
+            break;
+        }
+    }
+
+    respond(msg, body) {
+        const [encoded, encodeError] = message.encode(message.createResponseMessage(msg.id, body), false);
+        if (encodeError) {
+            throw encodeError;
+        }
+        return pkt.encode(pkt.PacketType.Data, encoded);
+    }
+
+    processRequest(msg) {
+        // The client answers a ping with the same payload.
+        if (msg.route === 'ws.ping') {
+            const payload = Buffer.from('pitaya');
+            this.pongWaiters.push((pong) => {
+                this.write(this.respond(msg, JSON.stringify({pong: pong.toString('utf8')})));
+            });
+            this.socket.write(frame(Opcode.Ping, payload));
+            return;
+        }
+
+        // Closes the connection with a close frame.
+        if (msg.route === 'ws.close') {
+            this.close(1001);
+            return;
+        }
+
+        const respPacket = this.respond(msg, msg.data);
+
+        // Echoes the body split in 3 frames, a ping in between.
+        if (msg.route === 'echo.fragmented') {
+            const third = Math.ceil(respPacket.length / 3);
+            this.socket.write(Buffer.concat([
+                frame(Opcode.Binary, respPacket.slice(0, third), false),
+                frame(Opcode.Ping, Buffer.from('mid')),
+                frame(Opcode.Continuation, respPacket.slice(third, 2 * third), false),
+                frame(Opcode.Continuation, respPacket.slice(2 * third), true),
+            ]));
+            return;
+        }
+
+        this.write(respPacket);
+    }
+}
+
+function onUpgrade(req, socket, head) {
+    console.log('======= New WebSocket Connection ========');
+
+    const key = req.headers['sec-websocket-key'];
+    if ((req.headers['upgrade'] || '').toLowerCase() !== 'websocket' ||
+        req.headers['sec-websocket-version'] !== '13' || !key) {
+        socket.end('HTTP/1.1 400 Bad Request\r\n\r\n');
+        return;
+    }
+
+    const accept = crypto.createHash('sha1').update(key + GUID).digest('base64');
+    socket.write('HTTP/1.1 101 Switching Protocols\r\n' +
+                 'Upgrade: websocket\r\n' +
+                 'Connection: Upgrade\r\n' +
+                 `Sec-WebSocket-Accept: ${accept}\r\n\r\n`);
+
+    const conn = new Connection(socket);
+    socket.on('data', (data) => conn.onData(data));
+    if (head && head.length) {
+        conn.onData(head);
+    }
+    socket.on('error', () => console.log('Client disconnected with error :('));
+}
+
+const wsServer = http.createServer((req, res) => {
+    res.writeHead(426);
+    res.end();
+});
+wsServer.on('upgrade', onUpgrade);
+
+const tlsOptions = {
+    key: fs.readFileSync('../../fixtures/server/pitaya.key'),
+    cert: fs.readFileSync('../../fixtures/server/pitaya.crt'),
+};
+
+const wssServer = https.createServer(tlsOptions, (req, res) => {
+    res.writeHead(426);
+    res.end();
+});
+wssServer.on('upgrade', onUpgrade);
+
+// Answers upgrades like a server without a websocket acceptor would.
+const refuseServer = http.createServer((req, res) => {
+    res.writeHead(404);
+    res.end();
+});
+refuseServer.on('upgrade', (req, socket) => {
+    socket.end('HTTP/1.1 403 Forbidden\r\nContent-Length: 0\r\n\r\n');
+});
+
+wsServer.listen(WS_PORT, HOST, () => {
+    console.log(`WS server on ${HOST}:${WS_PORT}`);
+});
+
+wssServer.listen(WSS_PORT, HOST, () => {
+    console.log(`WSS server on ${HOST}:${WSS_PORT}`);
+});
+
+refuseServer.listen(REFUSE_PORT, HOST, () => {
+    console.log(`Refusing server on ${HOST}:${REFUSE_PORT}`);
+});
+
+pkt.encodeHanshakeAndHeartbeatResponse(HEARTBEAT_INTERVAL);
@@ -129,8 +129,15 @@ class RawPackets {
 
 }
 
-function sendHandshakeResponse(socket) {
-    socket.write(handshakeResponseData);
+// `sys` holds extra fields merged into the sys object of the default response.
+function sendHandshakeResponse(socket, sys) {
+    if (!sys) {
+        socket.write(handshakeResponseData);
+        return;
+    }
+    const hData = JSON.parse(handshakeResponseData.slice(HEADER_LENGTH).toString());
+    Object.assign(hData.sys, sys);
+    socket.write(encode(PacketType.Handshake, Buffer.from(JSON.stringify(hData))));
 }
 
 function sendHeartbeat(socket) {
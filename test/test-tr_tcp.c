@@ -14,6 +14,14 @@
 
 #include "test_common.h"
 #include "flag.h"
+#include "tr_uv_dns.h"
+#include "tr_uv_uring.h"
+
+#ifndef _WIN32
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
 static pc_client_t* g_client = NULL;
 
@@ -342,6 +350,769 @@ test_connection_with_options_fails_with_invalid_data(const MunitParameter params
     return MUNIT_OK;
 }
 
+static void
+pipelined_event_cb(pc_client_t* client, int ev_type, void* ex_data, const char* arg1, const char* arg2)
+{
+    Unused(client); Unused(arg1); Unused(arg2);
+    if (ev_type == PC_EV_CONNECTED) {
+        flag_set((flag_t*)ex_data);
+    }
+}
+
+static void
+pipelined_notify_error_cb(const pc_notify_t* noti, const pc_error_t *error)
+{
+    Unused(noti); Unused(error);
+    munit_error("notify sent while connecting failed");
+}
+
+// Notifies sent while connecting go out together with the handshake ack.
+static MunitResult
+test_pipelined_connect(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    int ports[] = {
+        g_disconnect_mock_server.tcp_port,
+        g_disconnect_mock_server.tls_port,
+#ifdef TR_UV_URING_SUPPORTED
+        g_disconnect_mock_server.tcp_port,
+#endif
+    };
+    int transports[] = {
+        PC_TR_NAME_UV_TCP,
+        PC_TR_NAME_UV_TLS,
+#ifdef TR_UV_URING_SUPPORTED
+        PC_TR_NAME_UV_URING,
+#endif
+    };
+
+    assert_int(tr_uv_tls_set_ca_file(CRT, NULL), ==, PC_RC_OK);
+
+    for (size_t i = 0; i < ArrayCount(ports); i++) {
+        flag_t flag = flag_make();
+        pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+        config.transport_name = transports[i];
+        config.enable_reconn = false;
+
+        pc_client_init_result_t res = pc_client_init(NULL, &config);
+        g_client = res.client;
+        assert_int(res.rc, ==, PC_RC_OK);
+        pc_client_add_ev_handler(g_client, pipelined_event_cb, &flag, NULL);
+
+        assert_int(pc_client_connect(g_client, LOCALHOST, ports[i], NULL), ==, PC_RC_OK);
+        for (int n = 0; n < 3; n++) {
+            assert_int(pc_string_notify_with_timeout(g_client, NOTI_ROUTE, NOTI_MSG, NULL, NOTI_TIMEOUT,
+                                                     pipelined_notify_error_cb), ==, PC_RC_OK);
+        }
+        assert_int(flag_wait(&flag, 10), ==, FLAG_SET);
+        SLEEP_SECONDS(1);
+
+        pc_client_stats_t stats;
+        assert_int(pc_client_stats(g_client, &stats), ==, PC_RC_OK);
+        assert_uint64(stats.first_send_us, >, 0);
+        munit_logf(MUNIT_LOG_INFO, "connect to first notify on the wire: %llu us, %llu socket writes",
+                   (unsigned long long)stats.first_send_us, (unsigned long long)stats.socket_writes);
+
+        // The handshake, then the ack and the notifies. TLS writes its
+        // ClientHello first and the handshake along with its Finished.
+        assert_uint64(stats.socket_writes, ==, transports[i] == PC_TR_NAME_UV_TLS ? 3 : 2);
+        // The ack and the notifies are encrypted together in one record.
+        assert_uint64(stats.tls_records, ==, transports[i] == PC_TR_NAME_UV_TLS ? 2 : 0);
+
+        assert_int(pc_client_disconnect(g_client), ==, PC_RC_OK);
+        assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+        flag_cleanup(&flag);
+    }
+
+    return MUNIT_OK;
+}
+
+// The socket options are applied to the connection and reported back.
+static MunitResult
+test_socket_options(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    flag_t flag = flag_make();
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+    config.enable_reconn = false;
+    config.sock_sndbuf = 64 * 1024;
+    config.sock_rcvbuf = 128 * 1024;
+    config.tcp_keepalive = 30;
+    config.tcp_keepalive_interval = 5;
+    config.tcp_notsent_lowat = 16 * 1024;
+    config.tcp_quickack = 1;
+    config.tcp_user_timeout = 10000;
+
+    pc_client_init_result_t res = pc_client_init(NULL, &config);
+    g_client = res.client;
+    assert_int(res.rc, ==, PC_RC_OK);
+    pc_client_add_ev_handler(g_client, pipelined_event_cb, &flag, NULL);
+
+    assert_int(pc_client_connect(g_client, LOCALHOST, g_disconnect_mock_server.tcp_port, NULL), ==, PC_RC_OK);
+    assert_int(flag_wait(&flag, 10), ==, FLAG_SET);
+
+    pc_client_stats_t stats;
+    assert_int(pc_client_stats(g_client, &stats), ==, PC_RC_OK);
+    // The system may round the buffer sizes up, Linux doubles them.
+    assert_uint64(stats.sock_sndbuf, >=, (uint64_t)config.sock_sndbuf);
+    assert_uint64(stats.sock_rcvbuf, >=, (uint64_t)config.sock_rcvbuf);
+    assert_uint64(stats.tcp_keepalive, ==, 30);
+#ifdef __linux__
+    assert_uint64(stats.tcp_keepalive_interval, ==, 5);
+    assert_uint64(stats.tcp_notsent_lowat, ==, 16 * 1024);
+    assert_uint64(stats.tcp_quickack, ==, 1);
+    assert_uint64(stats.tcp_user_timeout, ==, 10000);
+#endif
+    assert_uint64(stats.sock_busy_poll, ==, 0);
+
+    assert_int(pc_client_disconnect(g_client), ==, PC_RC_OK);
+    assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+    flag_cleanup(&flag);
+    return MUNIT_OK;
+}
+
+#ifndef _WIN32
+
+#define EYEBALLS_HOST "eyeballs.test"
+
+typedef struct {
+    flag_t flag;
+    int ev_type;
+} eyeballs_ev_t;
+
+static void
+eyeballs_event_cb(pc_client_t* client, int ev_type, void* ex_data, const char* arg1, const char* arg2)
+{
+    Unused(client); Unused(arg1); Unused(arg2);
+    eyeballs_ev_t *ev = (eyeballs_ev_t*)ex_data;
+    ev->ev_type = ev_type;
+    flag_set(&ev->flag);
+}
+
+// Listens on [::1]:port with a full accept queue, so that further connects
+// to it hang like connects to a blackholed address do. Returns the listen
+// socket, or -1 if IPv6 is not available.
+static int
+blackhole_listen(int port, int *filler)
+{
+    struct sockaddr_in6 addr;
+    int on = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_loopback;
+    addr.sin6_port = htons(port);
+
+    int fd = socket(AF_INET6, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on));
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) || listen(fd, 0)) {
+        close(fd);
+        return -1;
+    }
+
+    *filler = socket(AF_INET6, SOCK_STREAM, 0);
+    if (connect(*filler, (struct sockaddr*)&addr, sizeof(addr))) {
+        close(*filler);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// The host resolves to a blackholed IPv6 address and to the IPv4 address of
+// the server, racing them connects within the attempt delay while trying the
+// first address alone only ends with the connect timeout.
+static MunitResult
+test_happy_eyeballs(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    int ports[] = {g_disconnect_mock_server.tcp_port, g_disconnect_mock_server.tls_port};
+    int transports[] = {PC_TR_NAME_UV_TCP, PC_TR_NAME_UV_TLS};
+
+    assert_int(tr_uv_tls_set_ca_file(CRT, NULL), ==, PC_RC_OK);
+
+    for (size_t i = 0; i < ArrayCount(ports); i++) {
+        int filler;
+        int blackhole = blackhole_listen(ports[i], &filler);
+        if (blackhole < 0) {
+            return MUNIT_SKIP;
+        }
+
+        tr_uv_dns_result_t addrs;
+        memset(&addrs, 0, sizeof(addrs));
+        assert_int(uv_ip6_addr("::1", 0, (struct sockaddr_in6*)&addrs.addrs[0]), ==, 0);
+        assert_int(uv_ip4_addr(LOCALHOST, 0, (struct sockaddr_in*)&addrs.addrs[1]), ==, 0);
+        addrs.count = 2;
+        tr_uv_dns_put(EYEBALLS_HOST, &addrs, 60000);
+
+        for (int race = 1; race >= 0; race--) {
+            eyeballs_ev_t ev = {flag_make(), -1};
+            pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+            config.transport_name = transports[i];
+            config.enable_reconn = false;
+            config.conn_timeout = 2;
+            config.conn_attempt_delay = race ? 100 : -1;
+
+            pc_client_init_result_t res = pc_client_init(NULL, &config);
+            g_client = res.client;
+            assert_int(res.rc, ==, PC_RC_OK);
+            pc_client_add_ev_handler(g_client, eyeballs_event_cb, &ev, NULL);
+
+            assert_int(pc_client_connect(g_client, EYEBALLS_HOST, ports[i], NULL), ==, PC_RC_OK);
+            assert_int(flag_wait(&ev.flag, 10), ==, FLAG_SET);
+
+            pc_client_stats_t stats;
+            assert_int(pc_client_stats(g_client, &stats), ==, PC_RC_OK);
+
+            if (race) {
+                assert_int(ev.ev_type, ==, PC_EV_CONNECTED);
+                assert_uint64(stats.conn_attempts, ==, 2);
+                // The second attempt waits for the delay, give or take the
+                // millisecond resolution of the loop timers.
+                assert_uint64(stats.last_conn_setup_us, >=, 99000);
+                assert_uint64(stats.last_conn_setup_us, <, 1000000);
+                munit_logf(MUNIT_LOG_INFO, "raced connection setup: %llu us",
+                           (unsigned long long)stats.last_conn_setup_us);
+
+                assert_int(pc_client_disconnect(g_client), ==, PC_RC_OK);
+                assert_int(flag_wait(&ev.flag, 10), ==, FLAG_SET);
+            } else {
+                assert_int(ev.ev_type, ==, PC_EV_CONNECT_ERROR);
+                assert_uint64(stats.conn_attempts, ==, 1);
+            }
+
+            assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+            flag_cleanup(&ev.flag);
+        }
+
+        close(filler);
+        close(blackhole);
+    }
+
+    tr_uv_tcp_clear_dns_cache();
+    return MUNIT_OK;
+}
+
+#endif
+
+#ifndef _WIN32
+
+static void
+unix_event_cb(pc_client_t* client, int ev_type, void* ex_data, const char* arg1, const char* arg2)
+{
+    Unused(client); Unused(arg2);
+    flag_t *flag = (flag_t*)ex_data;
+    if (ev_type == PC_EV_CONNECTED) {
+        flag_set(flag);
+    } else if (ev_type == PC_EV_CONNECT_ERROR) {
+        assert_string_equal(arg1, "Connect Error");
+        flag_set(flag);
+    }
+}
+
+// "unix:" hosts connect through a unix domain socket, the rest of the
+// connection is the same as over tcp.
+static MunitResult
+test_unix_socket(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    int transports[] = {
+        PC_TR_NAME_UV_TCP,
+#ifdef TR_UV_URING_SUPPORTED
+        PC_TR_NAME_UV_URING,
+#endif
+    };
+
+    for (size_t i = 0; i < ArrayCount(transports); i++) {
+        flag_t flag = flag_make();
+        pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+        config.transport_name = transports[i];
+        config.enable_reconn = false;
+        config.sock_rcvbuf = 128 * 1024;
+        config.tcp_quickack = 1;
+
+        pc_client_init_result_t res = pc_client_init(NULL, &config);
+        g_client = res.client;
+        assert_int(res.rc, ==, PC_RC_OK);
+        pc_client_add_ev_handler(g_client, unix_event_cb, &flag, NULL);
+
+        assert_int(pc_client_connect(g_client, MOCK_DISCONNECT_UNIX_HOST, 0, NULL), ==, PC_RC_OK);
+        for (int n = 0; n < 3; n++) {
+            assert_int(pc_string_notify_with_timeout(g_client, NOTI_ROUTE, NOTI_MSG, NULL, NOTI_TIMEOUT,
+                                                     pipelined_notify_error_cb), ==, PC_RC_OK);
+        }
+        assert_int(flag_wait(&flag, 10), ==, FLAG_SET);
+        assert_int(pc_client_state(g_client), ==, PC_ST_CONNECTED);
+        SLEEP_SECONDS(1);
+
+        pc_client_stats_t stats;
+        assert_int(pc_client_stats(g_client, &stats), ==, PC_RC_OK);
+        assert_uint64(stats.conn_attempts, ==, 1);
+        assert_uint64(stats.dns_lookups, ==, 0);
+        assert_uint64(stats.socket_writes, ==, 2);
+        // The buffer sizes apply, the tcp options do not.
+        assert_uint64(stats.sock_rcvbuf, >=, 128 * 1024);
+        assert_uint64(stats.tcp_quickack, ==, 0);
+
+        assert_int(pc_client_disconnect(g_client), ==, PC_RC_OK);
+        assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+        flag_cleanup(&flag);
+    }
+
+    // Nothing listens on that path.
+    flag_t flag = flag_make();
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+    config.enable_reconn = false;
+
+    pc_client_init_result_t res = pc_client_init(NULL, &config);
+    g_client = res.client;
+    assert_int(res.rc, ==, PC_RC_OK);
+    pc_client_add_ev_handler(g_client, unix_event_cb, &flag, NULL);
+
+    assert_int(pc_client_connect(g_client, PC_HOST_UNIX_PREFIX "/tmp/pitaya-nothing-here.sock", 0, NULL), ==, PC_RC_OK);
+    assert_int(flag_wait(&flag, 10), ==, FLAG_SET);
+    assert_int(pc_client_state(g_client), !=, PC_ST_CONNECTED);
+
+    assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+    flag_cleanup(&flag);
+    return MUNIT_OK;
+}
+
+#endif
+
+#ifdef TR_UV_URING_SUPPORTED
+
+typedef struct {
+    flag_t flag;
+    const char *expected_resp;
+} uring_req_t;
+
+static void
+uring_request_cb(const pc_request_t* req, const pc_buf_t *resp)
+{
+    uring_req_t *r = (uring_req_t*)pc_request_ex_data(req);
+    assert_int(resp->len, ==, strlen(r->expected_resp));
+    assert_memory_equal(resp->len, resp->base, r->expected_resp);
+    flag_set(&r->flag);
+}
+
+static void
+uring_request_error_cb(const pc_request_t* req, const pc_error_t *error)
+{
+    Unused(req); Unused(error);
+    munit_error("request through io_uring failed");
+}
+
+static void
+uring_echo(const char *body)
+{
+    uring_req_t r = {flag_make(), body};
+    assert_int(pc_string_request_with_timeout(g_client, "echo.uring", body, &r, REQ_TIMEOUT,
+                                              uring_request_cb, uring_request_error_cb), ==, PC_RC_OK);
+    assert_int(flag_wait(&r.flag, 10), ==, FLAG_SET);
+    flag_cleanup(&r.flag);
+}
+
+// The io_uring transport echoes bodies of every size, writes bursts that do
+// not fit a chain of linked sends and survives a reconnection.
+static MunitResult
+test_uring(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    flag_t flag = flag_make();
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+    config.transport_name = PC_TR_NAME_UV_URING;
+    config.enable_reconn = false;
+    config.disable_compression = true;
+
+    pc_client_init_result_t res = pc_client_init(NULL, &config);
+    g_client = res.client;
+    assert_int(res.rc, ==, PC_RC_OK);
+    pc_client_add_ev_handler(g_client, pipelined_event_cb, &flag, NULL);
+
+    // Spans several of the provided buffers, under the 64k the mock server takes.
+    size_t big_len = 48 * 1024;
+    char *big = (char*)malloc(big_len + 1);
+    assert_not_null(big);
+    big[0] = '"';
+    for (size_t i = 1; i < big_len - 1; i++) {
+        big[i] = 'a' + (char)(i % 26);
+    }
+    big[big_len - 1] = '"';
+    big[big_len] = '\0';
+
+    for (int round = 0; round < 2; round++) {
+        assert_int(pc_client_connect(g_client, LOCALHOST, g_compression_mock_server.tcp_port, NULL), ==, PC_RC_OK);
+        assert_int(flag_wait(&flag, 10), ==, FLAG_SET);
+
+        uring_echo("{}");
+        uring_echo(big);
+
+        // More buffers than a chain of linked sends takes.
+        uring_req_t burst[40];
+        for (size_t i = 0; i < ArrayCount(burst); i++) {
+            burst[i].flag = flag_make();
+            burst[i].expected_resp = "{\"burst\":true}";
+            assert_int(pc_string_request_with_timeout(g_client, "echo.burst", burst[i].expected_resp, &burst[i],
+                                                      REQ_TIMEOUT, uring_request_cb, uring_request_error_cb), ==, PC_RC_OK);
+        }
+        for (size_t i = 0; i < ArrayCount(burst); i++) {
+            assert_int(flag_wait(&burst[i].flag, 10), ==, FLAG_SET);
+            flag_cleanup(&burst[i].flag);
+        }
+
+        pc_client_stats_t stats;
+        assert_int(pc_client_stats(g_client, &stats), ==, PC_RC_OK);
+        if (stats.uring_active) {
+            assert_uint64(stats.uring_enters, >, 0);
+        } else {
+            munit_log(MUNIT_LOG_INFO, "io_uring unavailable, the transport fell back to libuv");
+        }
+
+        assert_int(pc_client_disconnect(g_client), ==, PC_RC_OK);
+        SLEEP_SECONDS(1);
+    }
+
+    assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+    free(big);
+    flag_cleanup(&flag);
+    return MUNIT_OK;
+}
+
+#endif
+
+typedef struct {
+    flag_t flag;
+    int last_ev;
+} ws_events_t;
+
+static void
+ws_event_cb(pc_client_t* client, int ev_type, void* ex_data, const char* arg1, const char* arg2)
+{
+    Unused(client); Unused(arg1); Unused(arg2);
+    ws_events_t *evs = (ws_events_t*)ex_data;
+
+    if (ev_type == PC_EV_CONNECTED || ev_type == PC_EV_UNEXPECTED_DISCONNECT ||
+        ev_type == PC_EV_CONNECT_FAILED || ev_type == PC_EV_CONNECT_ERROR) {
+        evs->last_ev = ev_type;
+        flag_set(&evs->flag);
+    }
+}
+
+typedef struct {
+    flag_t flag;
+    const char *expected_resp;
+} ws_req_t;
+
+static void
+ws_request_cb(const pc_request_t* req, const pc_buf_t *resp)
+{
+    ws_req_t *r = (ws_req_t*)pc_request_ex_data(req);
+    assert_int(resp->len, ==, strlen(r->expected_resp));
+    assert_memory_equal(resp->len, resp->base, r->expected_resp);
+    flag_set(&r->flag);
+}
+
+static void
+ws_request_error_cb(const pc_request_t* req, const pc_error_t *error)
+{
+    Unused(req); Unused(error);
+    munit_error("request through websocket failed");
+}
+
+static void
+ws_closed_error_cb(const pc_request_t* req, const pc_error_t *error)
+{
+    Unused(req); Unused(error);
+}
+
+static void
+ws_echo(const char *route, const char *body, const char *expected_resp)
+{
+    ws_req_t r = {flag_make(), expected_resp ? expected_resp : body};
+    assert_int(pc_string_request_with_timeout(g_client, route, body, &r, REQ_TIMEOUT,
+                                              ws_request_cb, ws_request_error_cb), ==, PC_RC_OK);
+    assert_int(flag_wait(&r.flag, 10), ==, FLAG_SET);
+    flag_cleanup(&r.flag);
+}
+
+// Requests go through the websocket mock server, plain and over tls: bodies
+// of every frame length, responses fragmented around a ping, pings of the
+// server and its close frame.
+static MunitResult
+test_websocket(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    struct {
+        int transport;
+        int port;
+    } cases[] = {
+        {PC_TR_NAME_UV_WS, MOCK_WEBSOCKET_PORT},
+        {PC_TR_NAME_UV_WSS, MOCK_WEBSOCKET_TLS_PORT},
+    };
+
+    assert_int(tr_uv_tls_set_ca_file(CRT, NULL), ==, PC_RC_OK);
+
+    // Odd sizes, so masking has a tail after the vectors.
+    char medium[300 + 3 + 1];
+    size_t big_len = 48 * 1024 + 3;
+    char *big = malloc(big_len + 1);
+    for (size_t i = 0; i < big_len; i++) {
+        big[i] = 'a' + (i % 26);
+    }
+    big[0] = '"';
+    big[big_len - 1] = '"';
+    big[big_len] = '\0';
+    memcpy(medium, big, sizeof(medium) - 2);
+    medium[sizeof(medium) - 2] = '"';
+    medium[sizeof(medium) - 1] = '\0';
+
+    for (size_t i = 0; i < ArrayCount(cases); i++) {
+        ws_events_t evs = {flag_make(), 0};
+        pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+        config.transport_name = cases[i].transport;
+        config.enable_reconn = false;
+        config.disable_compression = true;
+
+        pc_client_init_result_t res = pc_client_init(NULL, &config);
+        g_client = res.client;
+        assert_int(res.rc, ==, PC_RC_OK);
+        pc_client_add_ev_handler(g_client, ws_event_cb, &evs, NULL);
+
+        assert_int(pc_client_connect(g_client, LOCALHOST, cases[i].port, NULL), ==, PC_RC_OK);
+        assert_int(flag_wait(&evs.flag, 10), ==, FLAG_SET);
+        assert_int(evs.last_ev, ==, PC_EV_CONNECTED);
+
+        // 7 and 16 bit payload lengths, the mock server takes no more.
+        ws_echo("echo.ws", "{\"small\":true}", NULL);
+        ws_echo("echo.ws", medium, NULL);
+        ws_echo("echo.ws", big, NULL);
+        ws_echo("echo.fragmented", big, NULL);
+        ws_echo("ws.ping", "{}", "{\"pong\":\"pitaya\"}");
+
+        pc_client_stats_t stats;
+        assert_int(pc_client_stats(g_client, &stats), ==, PC_RC_OK);
+        // The handshake, its ack, the requests and the pongs, heartbeats aside.
+        assert_uint64(stats.ws_frames_sent, >=, 2 + 5 + 2);
+        // The handshake, the responses, one in 3 frames, and the pings.
+        assert_uint64(stats.ws_frames_recv, >=, 1 + 4 + 3 + 2);
+        assert_uint64(stats.ws_pings, ==, 2);
+
+        // The close frame ends the connection.
+        assert_int(pc_string_request_with_timeout(g_client, "ws.close", "{}", NULL, REQ_TIMEOUT,
+                                                  ws_request_cb, ws_closed_error_cb), ==, PC_RC_OK);
+        assert_int(flag_wait(&evs.flag, 10), ==, FLAG_SET);
+        assert_int(evs.last_ev, ==, PC_EV_UNEXPECTED_DISCONNECT);
+
+        assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+        flag_cleanup(&evs.flag);
+    }
+
+    // A server refusing the upgrade.
+    ws_events_t evs = {flag_make(), 0};
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+    config.transport_name = PC_TR_NAME_UV_WS;
+    config.enable_reconn = false;
+
+    pc_client_init_result_t res = pc_client_init(NULL, &config);
+    g_client = res.client;
+    assert_int(res.rc, ==, PC_RC_OK);
+    pc_client_add_ev_handler(g_client, ws_event_cb, &evs, NULL);
+
+    assert_int(pc_client_connect(g_client, LOCALHOST, MOCK_WEBSOCKET_REFUSE_PORT, NULL), ==, PC_RC_OK);
+    assert_int(flag_wait(&evs.flag, 10), ==, FLAG_SET);
+    assert_int(evs.last_ev, ==, PC_EV_CONNECT_FAILED);
+    assert_int(pc_client_state(g_client), !=, PC_ST_CONNECTED);
+
+    assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+    flag_cleanup(&evs.flag);
+    free(big);
+    return MUNIT_OK;
+}
+
+typedef struct {
+    flag_t flag;
+    int last_ev;
+} kcp_events_t;
+
+static void
+kcp_event_cb(pc_client_t* client, int ev_type, void* ex_data, const char* arg1, const char* arg2)
+{
+    Unused(client); Unused(arg1); Unused(arg2);
+    kcp_events_t *evs = (kcp_events_t*)ex_data;
+
+    if (ev_type == PC_EV_CONNECTED || ev_type == PC_EV_DISCONNECT ||
+        ev_type == PC_EV_UNEXPECTED_DISCONNECT || ev_type == PC_EV_CONNECT_FAILED) {
+        evs->last_ev = ev_type;
+        flag_set(&evs->flag);
+    }
+}
+
+static pc_client_t *
+kcp_client(const pc_client_config_t *config, kcp_events_t *evs)
+{
+    pc_client_init_result_t res = pc_client_init(NULL, config);
+    assert_int(res.rc, ==, PC_RC_OK);
+    pc_client_add_ev_handler(res.client, kcp_event_cb, evs, NULL);
+    return res.client;
+}
+
+// Requests go through the kcp mock server, bodies of one segment and of more
+// than a send window of them, over two connections, and a connection to a
+// port nobody listens on fails.
+static MunitResult
+test_kcp(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    size_t big_len = 48 * 1024 + 3;
+    char *big = malloc(big_len + 1);
+    for (size_t i = 0; i < big_len; i++) {
+        big[i] = 'a' + (i % 26);
+    }
+    big[0] = '"';
+    big[big_len - 1] = '"';
+    big[big_len] = '\0';
+
+    kcp_events_t evs = {flag_make(), 0};
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+    config.transport_name = PC_TR_NAME_UV_KCP;
+    config.enable_reconn = false;
+    config.disable_compression = true;
+
+    g_client = kcp_client(&config, &evs);
+
+    uint64_t segs_sent = 0;
+    for (int i = 0; i < 2; i++) {
+        assert_int(pc_client_connect(g_client, LOCALHOST, MOCK_KCP_PORT, NULL), ==, PC_RC_OK);
+        assert_int(flag_wait(&evs.flag, 10), ==, FLAG_SET);
+        assert_int(evs.last_ev, ==, PC_EV_CONNECTED);
+
+        // The websocket helpers take any transport.
+        ws_echo("echo.kcp", "{\"small\":true}", NULL);
+        ws_echo("echo.kcp", big, NULL);
+
+        pc_client_stats_t stats;
+        assert_int(pc_client_stats(g_client, &stats), ==, PC_RC_OK);
+        // The handshake, its ack and the big body over 36 segments, counted
+        // across connections.
+        assert_uint64(stats.kcp_segs_sent, >=, segs_sent + 2 + 1 + 36);
+        assert_uint64(stats.kcp_dropped, ==, 0);
+        segs_sent = stats.kcp_segs_sent;
+
+        assert_int(pc_client_disconnect(g_client), ==, PC_RC_OK);
+        assert_int(flag_wait(&evs.flag, 10), ==, FLAG_SET);
+        assert_int(evs.last_ev, ==, PC_EV_DISCONNECT);
+    }
+
+    assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+
+    // The icmp error of the closed port fails the handshake.
+    g_client = kcp_client(&config, &evs);
+    assert_int(pc_client_connect(g_client, LOCALHOST, MOCK_KCP_CLOSED_PORT, NULL), ==, PC_RC_OK);
+    assert_int(flag_wait(&evs.flag, 10), ==, FLAG_SET);
+    assert_int(evs.last_ev, ==, PC_EV_CONNECT_FAILED);
+    assert_int(pc_client_state(g_client), !=, PC_ST_CONNECTED);
+
+    assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+    flag_cleanup(&evs.flag);
+    free(big);
+    return MUNIT_OK;
+}
+
+#define KCP_LOSSY_REQUESTS 50
+
+typedef struct {
+    flag_t flag;
+    pc_client_t *client;
+    int count;
+    int failed;
+} kcp_run_t;
+
+static void kcp_run_request(kcp_run_t *run);
+
+static void
+kcp_run_request_cb(const pc_request_t* req, const pc_buf_t *resp)
+{
+    Unused(resp);
+    kcp_run_t *run = (kcp_run_t*)pc_request_ex_data(req);
+
+    if (++run->count == KCP_LOSSY_REQUESTS) {
+        flag_set(&run->flag);
+    } else {
+        kcp_run_request(run);
+    }
+}
+
+static void
+kcp_run_request_error_cb(const pc_request_t* req, const pc_error_t *error)
+{
+    Unused(error);
+    kcp_run_t *run = (kcp_run_t*)pc_request_ex_data(req);
+
+    run->failed = 1;
+    flag_set(&run->flag);
+}
+
+// One request at a time, the next one is sent by the callback of the last.
+static void
+kcp_run_request(kcp_run_t *run)
+{
+    if (pc_string_request_with_timeout(run->client, "echo.lossy", "{\"tick\":true}", run, REQ_TIMEOUT,
+                                       kcp_run_request_cb, kcp_run_request_error_cb) != PC_RC_OK) {
+        run->failed = 1;
+        flag_set(&run->flag);
+    }
+}
+
+// Requests over kcp in its fast mode behind a link losing 10% of the
+// datagrams each way all complete, with lost segments sent again. How its
+// latency compares with tcp is measured by /bench/lossy.
+static MunitResult
+test_kcp_lossy(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    kcp_events_t evs = {flag_make(), 0};
+    kcp_run_t run = {flag_make(), NULL, 0, 0};
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+    config.transport_name = PC_TR_NAME_UV_KCP;
+    config.enable_reconn = false;
+    config.disable_compression = true;
+    config.kcp_nodelay = 1;
+    config.kcp_interval = 10;
+    config.kcp_fast_resend = 2;
+    config.kcp_no_cwnd = 1;
+
+    g_client = kcp_client(&config, &evs);
+    run.client = g_client;
+
+    assert_int(pc_client_connect(g_client, LOCALHOST, MOCK_KCP_LOSSY_PORT, NULL), ==, PC_RC_OK);
+    assert_int(flag_wait(&evs.flag, 10), ==, FLAG_SET);
+    assert_int(evs.last_ev, ==, PC_EV_CONNECTED);
+
+    kcp_run_request(&run);
+    assert_int(flag_wait(&run.flag, 60), ==, FLAG_SET);
+    assert_false(run.failed);
+    assert_int(run.count, ==, KCP_LOSSY_REQUESTS);
+
+    pc_client_stats_t stats;
+    assert_int(pc_client_stats(g_client, &stats), ==, PC_RC_OK);
+    assert_uint64(stats.kcp_retransmits + stats.kcp_fast_resends, >, 0);
+
+    assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+    flag_cleanup(&run.flag);
+    flag_cleanup(&evs.flag);
+    return MUNIT_OK;
+}
+
 static MunitTest tests[] = {
     {"/invalid_disconnect", test_invalid_disconnect, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
     {"/event_cb", test_event_callback, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
@@ -352,6 +1123,18 @@ static MunitTest tests[] = {
     {"/connection_with_options", test_connection_with_options, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
     {"/connection_with_options_fails_with_invalid_data",
      test_connection_with_options_fails_with_invalid_data, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/pipelined_connect", test_pipelined_connect, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/socket_options", test_socket_options, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+#ifndef _WIN32
+    {"/happy_eyeballs", test_happy_eyeballs, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/unix_socket", test_unix_socket, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+#endif
+#ifdef TR_UV_URING_SUPPORTED
+    {"/uring", test_uring, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+#endif
+    {"/websocket", test_websocket, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/kcp", test_kcp, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/kcp_lossy", test_kcp_lossy, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
     {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
 };
 
@@ -14,6 +14,7 @@
 #include "test_common.h"
 #include "pc_assert.h"
 #include "flag.h"
+#include "local_server.h"
 
 static pc_client_t *g_client = NULL;
 
@@ -369,6 +370,228 @@ test_unexpected_disconnect(const MunitParameter params[], void *data)
     return MUNIT_OK;
 }
 
+typedef struct {
+    char data[16384];
+    size_t len;
+} session_storage_t;
+
+static int
+session_storage_cb(pc_local_storage_op_t op, char *data, size_t *len, void *ex_data)
+{
+    session_storage_t *ls = (session_storage_t*)ex_data;
+    if (op == PC_LOCAL_STORAGE_OP_WRITE) {
+        assert_size(*len, <, sizeof(ls->data));
+        memcpy(ls->data, data, *len);
+        ls->data[*len] = '\0';
+        ls->len = *len;
+        return 0;
+    }
+
+    if (!ls->len) {
+        return -1;
+    }
+    *len = ls->len;
+    if (data) {
+        memcpy(data, ls->data, ls->len);
+    }
+    return 0;
+}
+
+static void
+session_event_cb(pc_client_t* client, int ev_type, void* ex_data, const char* arg1, const char* arg2)
+{
+    Unused(client); Unused(arg1); Unused(arg2);
+    flag_t *flag = (flag_t*)ex_data;
+
+    if (ev_type == PC_EV_CONNECTED || ev_type == PC_EV_DISCONNECT) {
+        flag_set(flag);
+    }
+}
+
+// Connects `times` times in a row and checks how many handshakes resumed a session.
+static void
+connect_resuming_ex(session_storage_t *ls, int times, uint64_t full, uint64_t resumed, int early_data)
+{
+    flag_t flag = flag_make();
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+    config.transport_name = PC_TR_NAME_UV_TLS;
+    config.tls_early_data = early_data;
+    config.local_storage_cb = ls ? session_storage_cb : NULL;
+    config.ls_ex_data = ls;
+
+    pc_client_init_result_t res = pc_client_init(NULL, &config);
+    g_client = res.client;
+    assert_int(res.rc, ==, PC_RC_OK);
+    pc_client_add_ev_handler(g_client, session_event_cb, &flag, NULL);
+
+    for (int i = 0; i < times; ++i) {
+        assert_int(pc_client_connect(g_client, LOCALHOST, g_compression_mock_server.tls_port, NULL), ==, PC_RC_OK);
+        assert_int(flag_wait(&flag, 10), ==, FLAG_SET);
+        assert_int(pc_client_disconnect(g_client), ==, PC_RC_OK);
+        assert_int(flag_wait(&flag, 10), ==, FLAG_SET);
+    }
+
+    pc_client_stats_t stats;
+    assert_int(pc_client_stats(g_client, &stats), ==, PC_RC_OK);
+    munit_logf(MUNIT_LOG_INFO, "%llu full and %llu resumed tls handshakes",
+               (unsigned long long)stats.tls_full_handshakes, (unsigned long long)stats.tls_resumed_handshakes);
+    assert_uint64(stats.tls_full_handshakes, ==, full);
+    assert_uint64(stats.tls_resumed_handshakes, ==, resumed);
+    assert_uint64(stats.last_handshake_us, >, 0);
+    // node does not do 0-RTT, the tickets of the mock server never allow
+    // early data, see test_early_data
+    assert_uint64(stats.tls_early_data_accepted + stats.tls_early_data_rejected, ==, 0);
+
+    assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+    flag_cleanup(&flag);
+}
+
+static void
+connect_resuming(session_storage_t *ls, int times, uint64_t full, uint64_t resumed)
+{
+    connect_resuming_ex(ls, times, full, resumed, 0);
+}
+
+static MunitResult
+test_session_resumption(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    session_storage_t ls = {0};
+
+    assert_int(tr_uv_tls_set_ca_file(CRT, NULL), ==, PC_RC_OK);
+    tr_uv_tls_clear_session_cache();
+
+    // Reconnects resume a session handed out on the first connection.
+    connect_resuming(&ls, 2, 1, 1);
+    assert_not_null(strstr(ls.data, "\"tlsSessions\""));
+
+    // So does another client of the plugin, with the other one.
+    connect_resuming(NULL, 1, 0, 1);
+
+    // And a new client with the session kept in its local storage.
+    tr_uv_tls_clear_session_cache();
+    connect_resuming(&ls, 1, 0, 1);
+
+    // Without one it does a full handshake.
+    tr_uv_tls_clear_session_cache();
+    connect_resuming(NULL, 1, 1, 0);
+
+    // Early data is only sent when the session allows it, resuming is the same otherwise.
+    tr_uv_tls_clear_session_cache();
+    connect_resuming_ex(NULL, 3, 1, 2, 1);
+
+    return MUNIT_OK;
+}
+
+// Reconnects `times` times to `server` with early data on, checking each
+// handshake package reached it once, early or sent again once rejected.
+static void
+connect_early_data(local_server_t *server, int times, int reject)
+{
+    flag_t flag = flag_make();
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+    config.transport_name = PC_TR_NAME_UV_TLS;
+    config.enable_reconn = 0;
+    config.tls_early_data = 1;
+
+    pc_client_init_result_t res = pc_client_init(NULL, &config);
+    g_client = res.client;
+    assert_int(res.rc, ==, PC_RC_OK);
+    pc_client_add_ev_handler(g_client, session_event_cb, &flag, NULL);
+
+    // the first connection does a full handshake and gets the tickets
+    local_server_reject_early_data(server, reject);
+    size_t handshakes = local_server_handshakes(server);
+    for (int i = 0; i < times + 1; ++i) {
+        assert_int(pc_client_connect(g_client, LOCALHOST, local_server_port(server), NULL), ==, PC_RC_OK);
+        assert_int(flag_wait(&flag, 10), ==, FLAG_SET);
+        assert_int(pc_client_disconnect(g_client), ==, PC_RC_OK);
+        assert_int(flag_wait(&flag, 10), ==, FLAG_SET);
+    }
+
+    pc_client_stats_t stats;
+    assert_int(pc_client_stats(g_client, &stats), ==, PC_RC_OK);
+    assert_uint64(stats.tls_full_handshakes, ==, 1);
+    assert_uint64(stats.tls_resumed_handshakes, ==, times);
+    assert_uint64(stats.tls_early_data_accepted, ==, reject ? 0 : times);
+    assert_uint64(stats.tls_early_data_rejected, ==, reject ? times : 0);
+    assert_size(local_server_handshakes(server) - handshakes, ==, (size_t)times + 1);
+
+    assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+    flag_cleanup(&flag);
+}
+
+static MunitResult
+test_early_data(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    // The in process server allows early data in its tickets.
+    local_server_t *server = local_server_start_ex(60, NULL, NULL, 0, 0, 1);
+    assert_int(tr_uv_tls_set_ca_file(CRT, NULL), ==, PC_RC_OK);
+
+    // The handshake package goes as early data and is answered right away.
+    tr_uv_tls_clear_session_cache();
+    connect_early_data(server, 2, 0);
+
+    // Rejected, it goes again once the handshake is done.
+    tr_uv_tls_clear_session_cache();
+    connect_early_data(server, 2, 1);
+
+    local_server_stop(server);
+    return MUNIT_OK;
+}
+
+static void
+ktls_request_cb(const pc_request_t* req, const pc_buf_t *resp)
+{
+    Unused(resp);
+    flag_set((flag_t*)pc_request_ex_data(req));
+}
+
+static MunitResult
+test_ktls(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    flag_t flag_evs = flag_make();
+    flag_t flag_req = flag_make();
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+    config.transport_name = PC_TR_NAME_UV_TLS;
+    config.tls_ktls = 1;
+
+    assert_int(tr_uv_tls_set_ca_file(CRT, NULL), ==, PC_RC_OK);
+
+    pc_client_init_result_t res = pc_client_init(NULL, &config);
+    g_client = res.client;
+    assert_int(res.rc, ==, PC_RC_OK);
+    pc_client_add_ev_handler(g_client, session_event_cb, &flag_evs, NULL);
+
+    assert_int(pc_client_connect(g_client, LOCALHOST, g_compression_mock_server.tls_port, NULL), ==, PC_RC_OK);
+    assert_int(flag_wait(&flag_evs, 10), ==, FLAG_SET);
+
+    // Requests go through whether the kernel took the sends or OpenSSL kept them.
+    for (int i = 0; i < 3; ++i) {
+        assert_int(pc_string_request_with_timeout(g_client, "irrelevant.route", "{}", &flag_req, REQ_TIMEOUT,
+                                                  ktls_request_cb, NULL), ==, PC_RC_OK);
+        assert_int(flag_wait(&flag_req, 10), ==, FLAG_SET);
+    }
+
+    pc_client_stats_t stats;
+    assert_int(pc_client_stats(g_client, &stats), ==, PC_RC_OK);
+    munit_logf(MUNIT_LOG_INFO, "kernel tls sends: %llu", (unsigned long long)stats.tls_ktls_tx);
+    assert_uint64(stats.tls_ktls_tx, <=, 1);
+
+    assert_int(pc_client_disconnect(g_client), ==, PC_RC_OK);
+    assert_int(flag_wait(&flag_evs, 10), ==, FLAG_SET);
+    assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+
+    flag_cleanup(&flag_req);
+    flag_cleanup(&flag_evs);
+    return MUNIT_OK;
+}
+
 static MunitTest tests[] = {
     {"/no_client_certificate", test_no_client_certificate, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
     {"/wrong_client_certificate", test_wrong_client_certificate, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
@@ -378,6 +601,9 @@ static MunitTest tests[] = {
     {"/add_pinned_key_errors", test_add_key_pinned_errors, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
     {"/cleanup_before_connection_done", test_cleanup_before_connection_done, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
     {"/unexpected_disconnect", test_unexpected_disconnect, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/session_resumption", test_session_resumption, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/early_data", test_early_data, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/ktls", test_ktls, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
     {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
 };
 
@@ -55,6 +55,18 @@ static test_server_t g_kick_mock_server = {4200, 4201};
 static test_server_t g_timeout_mock_server = {4300, 4301};
 static test_server_t g_destroy_socket_mock_server = {4400, 4401};
 static test_server_t g_kill_client_mock_server = {4500, 4501};
+// The websocket mock server, plain and over tls, and the port where it
+// refuses upgrades.
+#define MOCK_WEBSOCKET_PORT 4600
+#define MOCK_WEBSOCKET_TLS_PORT 4601
+#define MOCK_WEBSOCKET_REFUSE_PORT 4602
+// The kcp mock server and its port behind a lossy link, nothing listens on
+// the closed one.
+#define MOCK_KCP_PORT 4700
+#define MOCK_KCP_LOSSY_PORT 4701
+#define MOCK_KCP_CLOSED_PORT 4703
+// The disconnect mock server also listens on a unix domain socket.
+#define MOCK_DISCONNECT_UNIX_HOST PC_HOST_UNIX_PREFIX "/tmp/pitaya-mock-disconnect.sock"
 // Pitaya servers
 static test_server_t g_test_server = {3251, 3252};
 static test_server_t g_test_protobuf_server = {3351, 3352};
@@ -1,10 +1,18 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <pitaya.h>
+#include <uv.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "test_common.h"
 #include "flag.h"
+#include "pr_lz4.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#endif
 
 static pc_client_t *g_client = NULL;
 
@@ -36,6 +44,8 @@ request_cb_disabled(const pc_request_t* req, const pc_buf_t *resp)
     flag_set(flag);
 }
 
+#define PREPARED_CHECK_BODY "{\"Data\":{\"name\":\"PEPE\",\"age\":\"veryyyyyyyyyyy old myyyyyyyyyyyyyyyyyyy boiiiiiiiiiiiiiiiiiiiiiiiiiiiiii\"}}"
+
 static char *RESPONSES_ENABLED[] = {
     "{\"isCompressed\":true}",
     "{\"isCompressed\":false}",
@@ -141,9 +151,867 @@ test_enabled_compression(const MunitParameter params[], void *data)
     return MUNIT_OK;
 }
 
+typedef struct {
+    flag_t flag;
+    const char *expected_resp;
+} policy_req_t;
+
+static void
+request_cb_policy(const pc_request_t* req, const pc_buf_t *resp)
+{
+    policy_req_t *r = (policy_req_t*)pc_request_ex_data(req);
+    assert_int(resp->len, ==, strlen(r->expected_resp));
+    assert_memory_equal(resp->len, resp->base, r->expected_resp);
+    flag_set(&r->flag);
+}
+
+MunitResult
+test_compression_policy(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    flag_t flag_evs = flag_make();
+    policy_req_t r;
+    r.flag = flag_make();
+
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+    config.compression_level = 9;
+
+    pc_client_init_result_t res = pc_client_init(NULL, &config);
+    g_client = res.client;
+    assert_int(res.rc, ==, PC_RC_OK);
+
+    pc_client_add_ev_handler(g_client, event_cb, &flag_evs, NULL);
+
+    assert_int(pc_client_connect(g_client, LOCALHOST, g_compression_mock_server.tcp_port, NULL), ==, PC_RC_OK);
+    assert_int(flag_wait(&flag_evs, 60), ==, FLAG_SET);
+
+    char big_json[1024];
+    size_t off = 0;
+    off += snprintf(big_json + off, sizeof(big_json) - off, "{\"items\":[");
+    while (off < sizeof(big_json) - 64) {
+        off += snprintf(big_json + off, sizeof(big_json) - off, "{\"name\":\"sword\",\"level\":10},");
+    }
+    snprintf(big_json + off - 1, sizeof(big_json) - off + 1, "]}");
+
+    pc_request_opts_t never = PC_REQUEST_OPTS_DEFAULT;
+    pc_request_opts_t always = PC_REQUEST_OPTS_DEFAULT;
+    never.compression = PC_COMPRESSION_NEVER;
+    always.compression = PC_COMPRESSION_ALWAYS;
+
+    // Compressible bodies above the minimum size are compressed.
+    r.expected_resp = RESPONSES_ENABLED[0];
+    assert_int(pc_string_request_with_timeout(g_client, "policy.big", big_json, &r, REQ_TIMEOUT, request_cb_policy, NULL), ==, PC_RC_OK);
+    assert_int(flag_wait(&r.flag, 60), ==, FLAG_SET);
+
+    // The per request option overrides the policy.
+    r.expected_resp = RESPONSES_ENABLED[1];
+    assert_int(pc_string_request_with_opts(g_client, "policy.big", big_json, &r, REQ_TIMEOUT, &never, request_cb_policy, NULL), ==, PC_RC_OK);
+    assert_int(flag_wait(&r.flag, 60), ==, FLAG_SET);
+
+    // Small bodies are not worth compressing, unless asked to.
+    const char *small_json = "{\"Data\":{\"name\":\"PEPE\"}}";
+    assert_int(pc_string_request_with_timeout(g_client, "policy.small", small_json, &r, REQ_TIMEOUT, request_cb_policy, NULL), ==, PC_RC_OK);
+    assert_int(flag_wait(&r.flag, 60), ==, FLAG_SET);
+
+    const char *repeated_json = "{\"Data\":\"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\"}";
+    r.expected_resp = RESPONSES_ENABLED[0];
+    assert_int(pc_string_request_with_opts(g_client, "policy.small", repeated_json, &r, REQ_TIMEOUT, &always, request_cb_policy, NULL), ==, PC_RC_OK);
+    assert_int(flag_wait(&r.flag, 60), ==, FLAG_SET);
+
+    // A route whose bodies do not compress stops being compressed after a few samples.
+    uint8_t random_data[512];
+    for (size_t i = 0; i < sizeof(random_data); ++i) {
+        random_data[i] = (uint8_t)munit_rand_uint32();
+    }
+
+    r.expected_resp = RESPONSES_ENABLED[1];
+    for (int i = 0; i < 6; ++i) {
+        assert_int(pc_binary_request_with_timeout(g_client, "policy.random", random_data, sizeof(random_data), &r, REQ_TIMEOUT, request_cb_policy, NULL), ==, PC_RC_OK);
+        assert_int(flag_wait(&r.flag, 60), ==, FLAG_SET);
+    }
+
+    pc_client_stats_t stats;
+    assert_int(pc_client_stats(g_client, &stats), ==, PC_RC_OK);
+    assert_uint64(stats.compress_msgs, ==, 2);
+    assert_uint64(stats.compress_rejected, ==, 4);
+    assert_uint64(stats.compress_skipped, ==, 4);
+    assert_uint64(stats.compress_bytes_saved, >, 0);
+
+    assert_int(pc_client_disconnect(g_client), ==, PC_RC_OK);
+    assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+
+    flag_cleanup(&r.flag);
+    flag_cleanup(&flag_evs);
+
+    return MUNIT_OK;
+}
+
+#define DICTIONARY_FIXTURE "fixtures/compression/dictionary.b64"
+
+static int
+dictionary_local_storage_cb(pc_local_storage_op_t op, char *data, size_t *len, void *ex_data)
+{
+    const char *ls = (const char*)ex_data;
+    if (op == PC_LOCAL_STORAGE_OP_WRITE) {
+        return 0;
+    }
+
+    *len = strlen(ls);
+    if (data) {
+        memcpy(data, ls, *len);
+    }
+    return 0;
+}
+
+MunitResult
+test_compression_dictionary(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    char b64[1024] = {0};
+    FILE *f = fopen(DICTIONARY_FIXTURE, "r");
+    assert_not_null(f);
+    size_t b64_len = fread(b64, 1, sizeof(b64) - 1, f);
+    fclose(f);
+    while (b64_len > 0 && (b64[b64_len - 1] == '\n' || b64[b64_len - 1] == '\r')) {
+        b64[--b64_len] = '\0';
+    }
+
+    char ls[2048];
+    snprintf(ls, sizeof(ls), "{\"compressionDicts\":{\"global\":\"%s\"}}", b64);
+
+    flag_t flag_evs = flag_make();
+    policy_req_t r;
+    r.flag = flag_make();
+
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+    config.local_storage_cb = dictionary_local_storage_cb;
+    config.ls_ex_data = ls;
+
+    pc_client_init_result_t res = pc_client_init(NULL, &config);
+    g_client = res.client;
+    assert_int(res.rc, ==, PC_RC_OK);
+
+    pc_client_add_ev_handler(g_client, event_cb, &flag_evs, NULL);
+
+    assert_int(pc_client_connect(g_client, LOCALHOST, g_compression_mock_server.tcp_port, NULL), ==, PC_RC_OK);
+    assert_int(flag_wait(&flag_evs, 60), ==, FLAG_SET);
+
+    // A body resembling the dictionary, which the server knows and accepts in the handshake.
+    const char *player_json =
+        "{\"player\":{\"id\":42,\"name\":\"PEPE\",\"level\":7,\"gold\":1200,\"guild\":\"knights\"},"
+        "\"items\":[{\"id\":3,\"type\":\"sword\",\"quantity\":1},{\"id\":9,\"type\":\"potion\",\"quantity\":5}],"
+        "\"timestamp\":1700000000}";
+
+    r.expected_resp = "{\"isCompressed\":true,\"usedDictionary\":true}";
+    assert_int(pc_string_request_with_timeout(g_client, "dict.player", player_json, &r, REQ_TIMEOUT, request_cb_policy, NULL), ==, PC_RC_OK);
+    assert_int(flag_wait(&r.flag, 60), ==, FLAG_SET);
+
+    pc_client_stats_t stats;
+    assert_int(pc_client_stats(g_client, &stats), ==, PC_RC_OK);
+    assert_uint64(stats.compress_msgs, ==, 1);
+    assert_uint64(stats.compress_dict_msgs, ==, 1);
+
+    assert_int(pc_client_disconnect(g_client), ==, PC_RC_OK);
+    assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+
+    flag_cleanup(&r.flag);
+    flag_cleanup(&flag_evs);
+
+    return MUNIT_OK;
+}
+
+MunitResult
+test_compression_codec(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    flag_t flag_evs = flag_make();
+    policy_req_t r;
+    r.flag = flag_make();
+
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+    config.compression_codecs = "lz4,zlib";
+
+    pc_client_init_result_t res = pc_client_init(NULL, &config);
+    g_client = res.client;
+    assert_int(res.rc, ==, PC_RC_OK);
+
+    pc_client_add_ev_handler(g_client, event_cb, &flag_evs, NULL);
+
+    assert_int(pc_client_connect(g_client, LOCALHOST, g_compression_mock_server.tcp_port, NULL), ==, PC_RC_OK);
+    assert_int(flag_wait(&flag_evs, 60), ==, FLAG_SET);
+
+    char big_json[4096];
+    size_t off = 0;
+    off += snprintf(big_json + off, sizeof(big_json) - off, "{\"items\":[");
+    for (int i = 0; off < sizeof(big_json) - 64; ++i) {
+        off += snprintf(big_json + off, sizeof(big_json) - off, "{\"name\":\"sword\",\"level\":%d},", i);
+    }
+    snprintf(big_json + off - 1, sizeof(big_json) - off + 1, "]}");
+
+    // The server picks LZ4, the first codec it supports from the ones offered.
+    r.expected_resp = "{\"isCompressed\":true,\"codec\":\"lz4\"}";
+    assert_int(pc_string_request_with_timeout(g_client, "codec.big", big_json, &r, REQ_TIMEOUT, request_cb_policy, NULL), ==, PC_RC_OK);
+    assert_int(flag_wait(&r.flag, 60), ==, FLAG_SET);
+
+    pc_client_stats_t stats;
+    assert_int(pc_client_stats(g_client, &stats), ==, PC_RC_OK);
+    assert_uint64(stats.compress_msgs, ==, 1);
+    assert_uint64(stats.compress_bytes_saved, >, 0);
+
+    assert_int(pc_client_disconnect(g_client), ==, PC_RC_OK);
+    assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+
+    flag_cleanup(&r.flag);
+    flag_cleanup(&flag_evs);
+
+    return MUNIT_OK;
+}
+
+static void
+fill_random_json(char *buf, size_t size)
+{
+    size_t off = 0;
+    unsigned int seed = 42;
+    off += snprintf(buf + off, size - off, "{\"items\":[");
+    while (off < size - 64) {
+        seed = seed * 1103515245 + 12345;
+        off += snprintf(buf + off, size - off, "{\"name\":\"sword\",\"id\":%u},", seed);
+    }
+    snprintf(buf + off - 1, size - off + 1, "]}");
+}
+
+typedef struct {
+    flag_t flag;
+    const char *expected_resp;
+    int *order;
+    int position;
+} offload_req_t;
+
+static void
+request_cb_offload(const pc_request_t* req, const pc_buf_t *resp)
+{
+    offload_req_t *r = (offload_req_t*)pc_request_ex_data(req);
+    assert_int(resp->len, ==, strlen(r->expected_resp));
+    assert_memory_equal(resp->len, resp->base, r->expected_resp);
+    assert_int(*r->order, ==, r->position);
+    (*r->order)++;
+    flag_set(&r->flag);
+}
+
+MunitResult
+test_compression_offload(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    flag_t flag_evs = flag_make();
+    int order = 0;
+    offload_req_t big = {flag_make(), NULL, &order, 0};
+    offload_req_t small = {flag_make(), NULL, &order, 1};
+
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+    config.compression_offload_min_size = 1024;
+
+    pc_client_init_result_t res = pc_client_init(NULL, &config);
+    g_client = res.client;
+    assert_int(res.rc, ==, PC_RC_OK);
+
+    pc_client_add_ev_handler(g_client, event_cb, &flag_evs, NULL);
+
+    assert_int(pc_client_connect(g_client, LOCALHOST, g_compression_mock_server.tcp_port, NULL), ==, PC_RC_OK);
+    assert_int(flag_wait(&flag_evs, 60), ==, FLAG_SET);
+
+    // Random ids keep the body big once compressed, so the echoed response is also offloaded.
+    static char big_json[8192];
+    fill_random_json(big_json, sizeof(big_json));
+
+    // The small request is encoded right away but has to wait for the big one.
+    big.expected_resp = big_json;
+    small.expected_resp = "{}";
+    assert_int(pc_string_request_with_timeout(g_client, "echo.big", big_json, &big, REQ_TIMEOUT, request_cb_offload, NULL), ==, PC_RC_OK);
+    assert_int(pc_string_request_with_timeout(g_client, "echo.small", "{}", &small, REQ_TIMEOUT, request_cb_offload, NULL), ==, PC_RC_OK);
+    assert_int(flag_wait(&big.flag, 60), ==, FLAG_SET);
+    assert_int(flag_wait(&small.flag, 60), ==, FLAG_SET);
+
+    pc_client_stats_t stats;
+    assert_int(pc_client_stats(g_client, &stats), ==, PC_RC_OK);
+    assert_uint64(stats.compress_msgs, ==, 1);
+    assert_uint64(stats.decompress_msgs, ==, 1);
+    assert_uint64(stats.offload_msgs, ==, 2);
+
+    assert_int(pc_client_disconnect(g_client), ==, PC_RC_OK);
+    assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+
+    flag_cleanup(&big.flag);
+    flag_cleanup(&small.flag);
+    flag_cleanup(&flag_evs);
+
+    return MUNIT_OK;
+}
+
+static void
+request_cb_lazy(const pc_request_t* req, const pc_buf_t *resp)
+{
+    policy_req_t *r = (policy_req_t*)pc_request_ex_data(req);
+    const pc_body_t *body = pc_body_from_payload(resp);
+    size_t expected_len = strlen(r->expected_resp);
+    size_t len = 0;
+
+    // The payload is the body as received.
+    assert_true(pc_body_is_compressed(body));
+    assert_ptr_equal(pc_body_raw(body), resp);
+    assert_int(resp->len, <, expected_len);
+
+    // A buffer too small only tells the size.
+    assert_int(pc_body_read(body, NULL, 0, &len), ==, PC_RC_INVALID_ARG);
+    assert_size(len, ==, expected_len);
+
+    uint8_t *buf = (uint8_t*)malloc(len);
+    assert_int(pc_body_read(body, buf, len, &len), ==, PC_RC_OK);
+    assert_size(len, ==, expected_len);
+    assert_memory_equal(len, buf, r->expected_resp);
+    free(buf);
+
+    flag_set(&r->flag);
+}
+
+// With polling enabled events are only delivered by pc_client_poll.
+static int
+wait_flag_polling(pc_client_t *client, flag_t *flag, bool polling)
+{
+    for (int tries = 0; tries < 60; ++tries) {
+        if (polling) {
+            pc_client_poll(client);
+        }
+        if (flag_wait(flag, 1) == FLAG_SET) {
+            return FLAG_SET;
+        }
+    }
+    return FLAG_TIMEOUT;
+}
+
+MunitResult
+test_compression_lazy(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    static char big_json[4096];
+    fill_random_json(big_json, sizeof(big_json));
+
+    const bool polling[] = {false, true};
+
+    for (size_t i = 0; i < ArrayCount(polling); i++) {
+        policy_req_t r;
+        r.flag = flag_make();
+        r.expected_resp = big_json;
+
+        pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+        config.lazy_decompression = true;
+        config.enable_polling = polling[i];
+
+        pc_client_init_result_t res = pc_client_init(NULL, &config);
+        g_client = res.client;
+        assert_int(res.rc, ==, PC_RC_OK);
+
+        flag_t flag_evs = flag_make();
+        pc_client_add_ev_handler(g_client, event_cb, &flag_evs, NULL);
+
+        assert_int(pc_client_connect(g_client, LOCALHOST, g_compression_mock_server.tcp_port, NULL), ==, PC_RC_OK);
+        assert_int(wait_flag_polling(g_client, &flag_evs, polling[i]), ==, FLAG_SET);
+
+        assert_int(pc_string_request_with_timeout(g_client, "echo.lazy", big_json, &r, REQ_TIMEOUT, request_cb_lazy, NULL), ==, PC_RC_OK);
+        assert_int(wait_flag_polling(g_client, &r.flag, polling[i]), ==, FLAG_SET);
+
+        // Nothing was decompressed by the client itself.
+        pc_client_stats_t stats;
+        assert_int(pc_client_stats(g_client, &stats), ==, PC_RC_OK);
+        assert_uint64(stats.decompress_msgs, ==, 0);
+
+        assert_int(pc_client_disconnect(g_client), ==, PC_RC_OK);
+        assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+
+        flag_cleanup(&r.flag);
+        flag_cleanup(&flag_evs);
+    }
+
+    return MUNIT_OK;
+}
+
+typedef struct {
+    flag_t flag;
+    const char *expected;
+    uint8_t *buf;
+    // Arena handed out by caller_buf_alloc.
+    uint8_t *arena;
+    size_t arena_cap;
+    int fits;
+    const uint8_t *resp_base;
+} caller_buf_req_t;
+
+static void *
+caller_buf_alloc(const pc_request_t* req, size_t size)
+{
+    caller_buf_req_t *r = (caller_buf_req_t*)pc_request_ex_data(req);
+    return size <= r->arena_cap ? r->arena : NULL;
+}
+
+static void
+caller_buf_cb(const pc_request_t* req, const pc_buf_t *resp)
+{
+    caller_buf_req_t *r = (caller_buf_req_t*)pc_request_ex_data(req);
+    assert_int(resp->len, ==, strlen(r->expected));
+    assert_memory_equal(resp->len, resp->base, r->expected);
+    r->fits = pc_request_resp_fits(req);
+    r->resp_base = resp->base;
+    flag_set(&r->flag);
+}
+
+static void
+caller_buf_request(const char *body, caller_buf_req_t *r, const pc_request_opts_t *opts, bool polling)
+{
+    r->flag = flag_make();
+    r->expected = body;
+    r->fits = -1;
+    r->resp_base = NULL;
+
+    assert_int(pc_string_request_with_opts(g_client, "echo.caller", body, r, REQ_TIMEOUT, opts,
+                                           caller_buf_cb, NULL), ==, PC_RC_OK);
+    assert_int(wait_flag_polling(g_client, &r->flag, polling), ==, FLAG_SET);
+    flag_cleanup(&r->flag);
+}
+
+MunitResult
+test_compression_caller_buf(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    static char big_json[4096];
+    fill_random_json(big_json, sizeof(big_json));
+    const char *small_json = "{\"a\":1}";
+
+    static uint8_t buf[sizeof(big_json)];
+    static uint8_t arena[sizeof(big_json)];
+    const bool polling[] = {false, true};
+
+    for (size_t i = 0; i < ArrayCount(polling); i++) {
+        pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+        config.enable_polling = polling[i];
+
+        pc_client_init_result_t res = pc_client_init(NULL, &config);
+        g_client = res.client;
+        assert_int(res.rc, ==, PC_RC_OK);
+
+        flag_t flag_evs = flag_make();
+        pc_client_add_ev_handler(g_client, event_cb, &flag_evs, NULL);
+        assert_int(pc_client_connect(g_client, LOCALHOST, g_compression_mock_server.tcp_port, NULL), ==, PC_RC_OK);
+        assert_int(wait_flag_polling(g_client, &flag_evs, polling[i]), ==, FLAG_SET);
+
+        caller_buf_req_t r;
+        r.buf = buf;
+        r.arena = arena;
+        r.arena_cap = sizeof(arena);
+
+        pc_request_opts_t opts = PC_REQUEST_OPTS_DEFAULT;
+        opts.resp_buf = buf;
+        opts.resp_buf_cap = sizeof(buf);
+
+        // Compressed and plain bodies land in the caller buffer.
+        caller_buf_request(big_json, &r, &opts, polling[i]);
+        assert_int(r.fits, ==, 1);
+        assert_ptr_equal(r.resp_base, buf);
+
+        caller_buf_request(small_json, &r, &opts, polling[i]);
+        assert_int(r.fits, ==, 1);
+        assert_ptr_equal(r.resp_base, buf);
+
+        // Too small, the library buffer is used instead.
+        opts.resp_buf_cap = 16;
+        caller_buf_request(big_json, &r, &opts, polling[i]);
+        assert_int(r.fits, ==, 0);
+        assert_ptr_not_equal(r.resp_base, buf);
+
+        // Too small but with an allocator to fall back to.
+        opts.resp_alloc = caller_buf_alloc;
+        caller_buf_request(big_json, &r, &opts, polling[i]);
+        assert_int(r.fits, ==, 1);
+        assert_ptr_equal(r.resp_base, arena);
+
+        // Only an allocator.
+        opts.resp_buf = NULL;
+        caller_buf_request(big_json, &r, &opts, polling[i]);
+        assert_int(r.fits, ==, 1);
+        assert_ptr_equal(r.resp_base, arena);
+
+        assert_int(pc_client_disconnect(g_client), ==, PC_RC_OK);
+        assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+        flag_cleanup(&flag_evs);
+    }
+
+    return MUNIT_OK;
+}
+
+#define STREAM_BODY_SIZE (4 * 1024 * 1024)
+
+typedef struct {
+    flag_t flag;
+    const char *expected;
+    size_t received;
+    size_t max_chunk;
+    int error_code;
+    bool abort;
+} stream_req_t;
+
+static int
+stream_chunk_cb(const pc_request_t* req, const uint8_t *chunk, size_t len)
+{
+    stream_req_t *r = (stream_req_t*)pc_request_ex_data(req);
+
+    if (r->abort) {
+        return 1;
+    }
+
+    assert_size(r->received + len, <=, strlen(r->expected));
+    assert_memory_equal(len, chunk, r->expected + r->received);
+    r->received += len;
+    r->max_chunk = len > r->max_chunk ? len : r->max_chunk;
+    return 0;
+}
+
+static void
+stream_success_cb(const pc_request_t* req, const pc_buf_t *resp)
+{
+    stream_req_t *r = (stream_req_t*)pc_request_ex_data(req);
+    // The body was already handed in chunks.
+    assert_int(resp->len, ==, 0);
+    flag_set(&r->flag);
+}
+
+static void
+stream_error_cb(const pc_request_t* req, const pc_error_t *error)
+{
+    stream_req_t *r = (stream_req_t*)pc_request_ex_data(req);
+    r->error_code = error->code;
+    flag_set(&r->flag);
+}
+
+static void
+stream_request(const char *route, stream_req_t *r, const pc_request_opts_t *opts)
+{
+    char size_json[64];
+    snprintf(size_json, sizeof(size_json), "{\"size\":%d}", STREAM_BODY_SIZE);
+
+    r->flag = flag_make();
+    r->received = 0;
+    r->max_chunk = 0;
+    r->error_code = PC_RC_OK;
+
+    assert_int(pc_string_request_with_opts(g_client, route, size_json, r, REQ_TIMEOUT, opts,
+                                           stream_success_cb, stream_error_cb), ==, PC_RC_OK);
+    assert_int(flag_wait(&r->flag, 60), ==, FLAG_SET);
+    flag_cleanup(&r->flag);
+}
+
+#ifndef _WIN32
+typedef struct {
+    int fd;
+    char *buf;
+    size_t cap;
+    size_t read;
+} slow_reader_t;
+
+// Lets the pipe fill up before reading it to the end.
+static void
+slow_reader_fn(void *arg)
+{
+    slow_reader_t *r = (slow_reader_t*)arg;
+    SLEEP_SECONDS(1);
+    for (;;) {
+        ssize_t n = read(r->fd, r->buf + r->read, r->cap - r->read);
+        if (n <= 0) {
+            break;
+        }
+        r->read += (size_t)n;
+    }
+}
+#endif
+
+MunitResult
+test_compression_stream(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    char *expected = (char*)malloc(STREAM_BODY_SIZE);
+    fill_random_json(expected, STREAM_BODY_SIZE);
+
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+    pc_client_init_result_t res = pc_client_init(NULL, &config);
+    g_client = res.client;
+    assert_int(res.rc, ==, PC_RC_OK);
+
+    flag_t flag_evs = flag_make();
+    pc_client_add_ev_handler(g_client, event_cb, &flag_evs, NULL);
+    assert_int(pc_client_connect(g_client, LOCALHOST, g_compression_mock_server.tcp_port, NULL), ==, PC_RC_OK);
+    assert_int(flag_wait(&flag_evs, 60), ==, FLAG_SET);
+
+    pc_request_opts_t opts = PC_REQUEST_OPTS_DEFAULT;
+    opts.chunk_cb = stream_chunk_cb;
+
+    stream_req_t r;
+    r.expected = expected;
+    r.abort = false;
+
+    // Compressed bodies are inflated chunk by chunk.
+    stream_request("big.compressed", &r, &opts);
+    assert_int(r.error_code, ==, PC_RC_OK);
+    assert_size(r.received, ==, strlen(expected));
+    assert_size(r.max_chunk, <=, 16 * 1024);
+
+    // Plain bodies are handed as they are read.
+    stream_request("big.plain", &r, &opts);
+    assert_int(r.error_code, ==, PC_RC_OK);
+    assert_size(r.received, ==, strlen(expected));
+    assert_size(r.max_chunk, <=, PC_TCP_READ_BUFFER_SIZE);
+
+    // Aborting discards the rest of the body, the connection is still usable.
+    r.abort = true;
+    stream_request("big.compressed", &r, &opts);
+    assert_int(r.error_code, ==, PC_RC_ERROR);
+    r.abort = false;
+
+    // Written to a file descriptor.
+    FILE *file = tmpfile();
+    assert_not_null(file);
+    opts.chunk_cb = NULL;
+    opts.chunk_fd = fileno(file);
+    stream_request("big.compressed", &r, &opts);
+    assert_int(r.error_code, ==, PC_RC_OK);
+
+    size_t len = strlen(expected);
+    char *written = (char*)malloc(len + 1);
+    rewind(file);
+    assert_size(fread(written, 1, len + 1, file), ==, len);
+    assert_memory_equal(len, written, expected);
+    free(written);
+    fclose(file);
+
+#ifndef _WIN32
+    // Also to file descriptor 0, -1 is the one meaning none.
+    file = tmpfile();
+    assert_not_null(file);
+    int saved_stdin = dup(0);
+    assert_int(dup2(fileno(file), 0), ==, 0);
+    opts.chunk_fd = 0;
+    stream_request("big.compressed", &r, &opts);
+    assert_int(dup2(saved_stdin, 0), ==, 0);
+    close(saved_stdin);
+    assert_int(r.error_code, ==, PC_RC_OK);
+
+    written = (char*)malloc(len + 1);
+    rewind(file);
+    assert_size(fread(written, 1, len + 1, file), ==, len);
+    assert_memory_equal(len, written, expected);
+    free(written);
+    fclose(file);
+
+    // And to a non blocking pipe read slower than the body arrives.
+    int fds[2];
+    assert_int(pipe(fds), ==, 0);
+    assert_int(fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK), ==, 0);
+    slow_reader_t reader = {fds[0], (char*)malloc(len), len, 0};
+    uv_thread_t reader_thread;
+    assert_int(uv_thread_create(&reader_thread, slow_reader_fn, &reader), ==, 0);
+    opts.chunk_fd = fds[1];
+    stream_request("big.compressed", &r, &opts);
+    assert_int(r.error_code, ==, PC_RC_OK);
+    close(fds[1]);
+    uv_thread_join(&reader_thread);
+    close(fds[0]);
+    assert_size(reader.read, ==, len);
+    assert_memory_equal(len, reader.buf, expected);
+    free(reader.buf);
+#endif
+
+    assert_int(pc_client_disconnect(g_client), ==, PC_RC_OK);
+    assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+
+    flag_cleanup(&flag_evs);
+    free(expected);
+
+    return MUNIT_OK;
+}
+
+typedef struct {
+    flag_t flag;
+    const char *expected_resp;
+    const char *expected_msg;
+} prepared_req_t;
+
+static void
+request_cb_prepared(const pc_request_t* req, const pc_buf_t *resp)
+{
+    prepared_req_t *r = (prepared_req_t*)pc_request_ex_data(req);
+    assert_int(resp->len, ==, strlen(r->expected_resp));
+    assert_memory_equal(resp->len, resp->base, r->expected_resp);
+    assert_string_equal(pc_request_msg(req), r->expected_msg);
+    flag_set(&r->flag);
+}
+
+MunitResult
+test_compression_prepared(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    const int ports[] = {g_compression_mock_server.tcp_port, g_compression_mock_server.tls_port,
+                         g_compression_mock_server.tcp_port};
+    const int transports[] = {PC_TR_NAME_UV_TCP, PC_TR_NAME_UV_TLS, PC_TR_NAME_UV_TCP};
+    const int disabled[] = {0, 0, 1};
+
+    assert_int(tr_uv_tls_set_ca_file(CRT, NULL), ==, PC_RC_OK);
+
+    static char big_json[8192];
+    fill_random_json(big_json, sizeof(big_json));
+
+    // Encoded once and shared by the three clients.
+    pc_prepared_msg_t *echo = pc_prepared_msg_new("echo.prepared", (const uint8_t*)big_json, strlen(big_json), NULL);
+    assert_not_null(echo);
+
+    for (size_t i = 0; i < ArrayCount(ports); i++) {
+        flag_t flag_evs = flag_make();
+        prepared_req_t r;
+        r.flag = flag_make();
+
+        pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+        config.transport_name = transports[i];
+        config.disable_compression = disabled[i];
+
+        pc_client_init_result_t res = pc_client_init(NULL, &config);
+        g_client = res.client;
+        assert_int(res.rc, ==, PC_RC_OK);
+
+        pc_client_add_ev_handler(g_client, event_cb, &flag_evs, NULL);
+
+        assert_int(pc_client_connect(g_client, LOCALHOST, ports[i], NULL), ==, PC_RC_OK);
+        assert_int(flag_wait(&flag_evs, 60), ==, FLAG_SET);
+
+        // Back to back sends write the shared image several times.
+        r.expected_resp = big_json;
+        r.expected_msg = big_json;
+        for (int n = 0; n < 3; ++n) {
+            assert_int(pc_prepared_request_with_timeout(g_client, echo, &r, REQ_TIMEOUT, request_cb_prepared, NULL), ==, PC_RC_OK);
+        }
+        for (int tries = 0; tries < 60 && flag_get_num_called(&r.flag) < 3; ++tries) {
+            flag_wait(&r.flag, 1);
+        }
+        assert_int(flag_get_num_called(&r.flag), ==, 3);
+        flag_reset(&r.flag);
+
+        // Sent as a regular message when compression is disabled, pending sends keep it alive.
+        pc_prepared_msg_t *check = pc_prepared_msg_new("irrelevant.route", (const uint8_t*)PREPARED_CHECK_BODY,
+                                                       strlen(PREPARED_CHECK_BODY), NULL);
+        r.expected_resp = disabled[i] ? RESPONSES_DISABLED[0] : RESPONSES_ENABLED[0];
+        r.expected_msg = PREPARED_CHECK_BODY;
+        assert_int(pc_prepared_request_with_timeout(g_client, check, &r, REQ_TIMEOUT, request_cb_prepared, NULL), ==, PC_RC_OK);
+        pc_prepared_msg_release(check);
+        assert_int(flag_wait(&r.flag, 60), ==, FLAG_SET);
+
+        assert_int(pc_client_disconnect(g_client), ==, PC_RC_OK);
+        assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+
+        flag_cleanup(&r.flag);
+        flag_cleanup(&flag_evs);
+    }
+
+    pc_prepared_msg_release(echo);
+
+    return MUNIT_OK;
+}
+
+// Blocks the reference LZ4 1.9.4 command line tool produced from
+// LZ4_REFERENCE_INPUT with 300 'a' in place of the %s, in its fast and its
+// high compression modes, taken out of the frames it wraps them in.
+#define LZ4_REFERENCE_INPUT \
+    "{\"route\":\"connector.getsessiondata\",\"body\":{\"uid\":\"42\",\"data\":\"%s\"}," \
+    "\"tags\":[\"pitaya\",\"pitaya\",\"pitaya\"],\"text\":\"the quick brown fox jumps over " \
+    "the lazy dog, the quick brown fox\"}"
+
+static const uint8_t LZ4_REFERENCE_FAST[] = {
+    0xf1, 0x29, 0x7b, 0x22, 0x72, 0x6f, 0x75, 0x74, 0x65, 0x22, 0x3a, 0x22,
+    0x63, 0x6f, 0x6e, 0x6e, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x2e, 0x67, 0x65,
+    0x74, 0x73, 0x65, 0x73, 0x73, 0x69, 0x6f, 0x6e, 0x64, 0x61, 0x74, 0x61,
+    0x22, 0x2c, 0x22, 0x62, 0x6f, 0x64, 0x79, 0x22, 0x3a, 0x7b, 0x22, 0x75,
+    0x69, 0x64, 0x22, 0x3a, 0x22, 0x34, 0x32, 0x22, 0x2c, 0x22, 0x1a, 0x00,
+    0x3f, 0x3a, 0x22, 0x61, 0x01, 0x00, 0xff, 0x19, 0xf0, 0x02, 0x22, 0x7d,
+    0x2c, 0x22, 0x74, 0x61, 0x67, 0x73, 0x22, 0x3a, 0x5b, 0x22, 0x70, 0x69,
+    0x74, 0x61, 0x79, 0x5b, 0x01, 0x0c, 0x09, 0x00, 0xf0, 0x1a, 0x5d, 0x2c,
+    0x22, 0x74, 0x65, 0x78, 0x74, 0x22, 0x3a, 0x22, 0x74, 0x68, 0x65, 0x20,
+    0x71, 0x75, 0x69, 0x63, 0x6b, 0x20, 0x62, 0x72, 0x6f, 0x77, 0x6e, 0x20,
+    0x66, 0x6f, 0x78, 0x20, 0x6a, 0x75, 0x6d, 0x70, 0x73, 0x20, 0x6f, 0x76,
+    0x65, 0x72, 0x20, 0x1f, 0x00, 0x91, 0x6c, 0x61, 0x7a, 0x79, 0x20, 0x64,
+    0x6f, 0x67, 0x2c, 0x0e, 0x00, 0x08, 0x2d, 0x00, 0x50, 0x66, 0x6f, 0x78,
+    0x22, 0x7d,
+};
+
+static const uint8_t LZ4_REFERENCE_HC[] = {
+    0xf1, 0x29, 0x7b, 0x22, 0x72, 0x6f, 0x75, 0x74, 0x65, 0x22, 0x3a, 0x22,
+    0x63, 0x6f, 0x6e, 0x6e, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x2e, 0x67, 0x65,
+    0x74, 0x73, 0x65, 0x73, 0x73, 0x69, 0x6f, 0x6e, 0x64, 0x61, 0x74, 0x61,
+    0x22, 0x2c, 0x22, 0x62, 0x6f, 0x64, 0x79, 0x22, 0x3a, 0x7b, 0x22, 0x75,
+    0x69, 0x64, 0x22, 0x3a, 0x22, 0x34, 0x32, 0x22, 0x2c, 0x22, 0x1a, 0x00,
+    0x3f, 0x3a, 0x22, 0x61, 0x01, 0x00, 0xff, 0x19, 0xf0, 0x02, 0x22, 0x7d,
+    0x2c, 0x22, 0x74, 0x61, 0x67, 0x73, 0x22, 0x3a, 0x5b, 0x22, 0x70, 0x69,
+    0x74, 0x61, 0x79, 0x5b, 0x01, 0x0c, 0x09, 0x00, 0xf0, 0x1a, 0x5d, 0x2c,
+    0x22, 0x74, 0x65, 0x78, 0x74, 0x22, 0x3a, 0x22, 0x74, 0x68, 0x65, 0x20,
+    0x71, 0x75, 0x69, 0x63, 0x6b, 0x20, 0x62, 0x72, 0x6f, 0x77, 0x6e, 0x20,
+    0x66, 0x6f, 0x78, 0x20, 0x6a, 0x75, 0x6d, 0x70, 0x73, 0x20, 0x6f, 0x76,
+    0x65, 0x72, 0x20, 0x1f, 0x00, 0xac, 0x6c, 0x61, 0x7a, 0x79, 0x20, 0x64,
+    0x6f, 0x67, 0x2c, 0x20, 0x2d, 0x00, 0x50, 0x66, 0x6f, 0x78, 0x22, 0x7d,
+};
+
+static void
+check_lz4_reference(const uint8_t *block, size_t size, const char *expected, size_t expected_len)
+{
+    uint8_t out[1024];
+
+    assert_int64(pr_lz4_decompress_block(block, size, out, sizeof(out)), ==, (int64_t)expected_len);
+    assert_memory_equal(expected_len, out, expected);
+
+    // cut short or without room for its output the block is refused
+    assert_int64(pr_lz4_decompress_block(block, size - 1, out, sizeof(out)), ==, -1);
+    assert_int64(pr_lz4_decompress_block(block, size, out, expected_len - 1), ==, -1);
+}
+
+static MunitResult
+test_compression_lz4_reference(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    char run[301];
+    char expected[1024];
+    memset(run, 'a', 300);
+    run[300] = '\0';
+    int len = snprintf(expected, sizeof(expected), LZ4_REFERENCE_INPUT, run);
+    assert_int(len, ==, 476);
+
+    check_lz4_reference(LZ4_REFERENCE_FAST, sizeof(LZ4_REFERENCE_FAST), expected, (size_t)len);
+    check_lz4_reference(LZ4_REFERENCE_HC, sizeof(LZ4_REFERENCE_HC), expected, (size_t)len);
+
+    return MUNIT_OK;
+}
+
 static MunitTest tests[] = {
     {"/enabled", test_enabled_compression, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
     {"/disabled", test_disabled_compression, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/policy", test_compression_policy, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/dictionary", test_compression_dictionary, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/codec", test_compression_codec, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/lz4_reference", test_compression_lz4_reference, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/offload", test_compression_offload, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/lazy", test_compression_lazy, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/stream", test_compression_stream, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/caller_buf", test_compression_caller_buf, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/prepared", test_compression_prepared, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
     {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
 };
 
@@ -0,0 +1,150 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <pitaya.h>
+
+#include "test_common.h"
+#include "flag.h"
+
+// Nothing listens on these ports, connects to them are refused.
+#define REFUSING_PORT_A 4900
+#define REFUSING_PORT_B 4901
+
+static pc_client_t *g_client = NULL;
+
+static void
+connected_event_cb(pc_client_t* client, int ev_type, void* ex_data, const char* arg1, const char* arg2)
+{
+    Unused(client); Unused(arg1); Unused(arg2);
+    flag_t *flag = (flag_t*)ex_data;
+
+    if (ev_type == PC_EV_CONNECTED) {
+        flag_set(flag);
+    }
+}
+
+// Connects to the endpoints with a reconnect delay far longer than the test
+// waits for, so only failing over reaches a healthy endpoint in time.
+static void
+connect_endpoints(const pc_endpoint_t *endpoints, int count, int conn_timeout, flag_t *flag)
+{
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+    config.conn_timeout = conn_timeout;
+    config.reconn_delay = 20;
+    config.reconn_delay_max = 60;
+
+    pc_client_init_result_t res = pc_client_init(NULL, &config);
+    g_client = res.client;
+    assert_int(res.rc, ==, PC_RC_OK);
+
+    pc_client_add_ev_handler(g_client, connected_event_cb, flag, NULL);
+    assert_int(pc_client_connect_endpoints(g_client, endpoints, count, NULL), ==, PC_RC_OK);
+    assert_int(flag_wait(flag, 8), ==, FLAG_SET);
+}
+
+// Endpoints that failed are backed off, the one connected to is healthy.
+static void
+assert_health(int count, int first_healthy)
+{
+    pc_endpoint_health_t health;
+    pc_client_stats_t stats;
+    int failed = 0;
+
+    for (int i = 0; i < count; ++i) {
+        assert_int(pc_client_endpoint_health(g_client, i, &health), ==, PC_RC_OK);
+        if (i < first_healthy) {
+            assert_int(health.connects, ==, 0);
+            assert_int(health.failures, <=, 1);
+            assert_int(health.score, ==, health.failures ? -1 : 0);
+            failed += health.failures;
+        } else if (health.current) {
+            assert_int(health.connects, ==, 1);
+            assert_int(health.failures, ==, 0);
+            assert_int(health.connect_ms, >=, 0);
+            assert_int(health.score, >=, 0);
+        }
+    }
+
+    assert_int(pc_client_stats(g_client, &stats), ==, PC_RC_OK);
+    assert_uint64(stats.endpoint_failovers, ==, failed);
+    assert_int(pc_client_endpoint_health(g_client, count, &health), ==, PC_RC_INVALID_ARG);
+}
+
+static MunitResult
+test_failover(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    // The refusing endpoints are much more likely to be picked first.
+    const pc_endpoint_t endpoints[] = {
+        {LOCALHOST, REFUSING_PORT_A, 1000},
+        {LOCALHOST, REFUSING_PORT_B, 1000},
+        {LOCALHOST, g_disconnect_mock_server.tcp_port, 1},
+        {LOCALHOST, g_compression_mock_server.tcp_port, 1},
+    };
+    flag_t flag = flag_make();
+
+    connect_endpoints(endpoints, ArrayCount(endpoints), 30, &flag);
+    assert_health(ArrayCount(endpoints), 2);
+
+    assert_int(pc_client_disconnect(g_client), ==, PC_RC_OK);
+    assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+    flag_cleanup(&flag);
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_handshake_failure(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    // The first endpoint accepts connections but answers the handshake after
+    // the connect timeout.
+    const pc_endpoint_t endpoints[] = {
+        {LOCALHOST, g_destroy_socket_mock_server.tcp_port, 1000},
+        {LOCALHOST, g_disconnect_mock_server.tcp_port, 1},
+    };
+    flag_t flag = flag_make();
+
+    connect_endpoints(endpoints, ArrayCount(endpoints), 2, &flag);
+    assert_health(ArrayCount(endpoints), 1);
+
+    assert_int(pc_client_disconnect(g_client), ==, PC_RC_OK);
+    assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+    flag_cleanup(&flag);
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_invalid_args(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    const pc_endpoint_t endpoints[] = {
+        {LOCALHOST, g_disconnect_mock_server.tcp_port, 1},
+        {NULL, g_disconnect_mock_server.tcp_port, 1},
+    };
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+    pc_client_init_result_t res = pc_client_init(NULL, &config);
+    assert_int(res.rc, ==, PC_RC_OK);
+
+    assert_int(pc_client_connect_endpoints(NULL, endpoints, 1, NULL), ==, PC_RC_INVALID_ARG);
+    assert_int(pc_client_connect_endpoints(res.client, endpoints, 0, NULL), ==, PC_RC_INVALID_ARG);
+    assert_int(pc_client_connect_endpoints(res.client, endpoints, PC_MAX_ENDPOINTS + 1, NULL), ==, PC_RC_INVALID_ARG);
+    assert_int(pc_client_connect_endpoints(res.client, endpoints, 2, NULL), ==, PC_RC_INVALID_ARG);
+    assert_int(pc_client_connect_endpoints(res.client, endpoints, 1, "not json"), ==, PC_RC_INVALID_JSON);
+
+    assert_int(pc_client_cleanup(res.client), ==, PC_RC_OK);
+    return MUNIT_OK;
+}
+
+static MunitTest tests[] = {
+    {"/failover", test_failover, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/handshake_failure", test_handshake_failure, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/invalid_args", test_invalid_args, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+};
+
+const MunitSuite endpoints_suite = {
+    "/endpoints", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
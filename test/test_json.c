@@ -0,0 +1,163 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pitaya.h>
+
+#include "test_common.h"
+#include "pc_JSON.h"
+
+#define JSON_TEST_ROUTES 300
+
+static char *
+make_routes_json(int formatted)
+{
+    pc_JSON *routes = pc_JSON_CreateObject();
+    char route[64];
+    char *text;
+
+    for (int i = 0; i < JSON_TEST_ROUTES; ++i) {
+        snprintf(route, sizeof(route), "connector.handler%d.method%d", i / 10, i);
+        pc_JSON_AddNumberToObject(routes, route, i);
+    }
+    // A later duplicate must not shadow the first one.
+    pc_JSON_AddNumberToObject(routes, "connector.handler0.method0", -1);
+
+    text = formatted ? pc_JSON_Print(routes) : pc_JSON_PrintUnformatted(routes);
+    pc_JSON_Delete(routes);
+    return text;
+}
+
+static void
+assert_routes(const pc_JSON *routes)
+{
+    char route[64];
+
+    for (int i = 0; i < JSON_TEST_ROUTES; ++i) {
+        snprintf(route, sizeof(route), "connector.handler%d.method%d", i / 10, i);
+        const pc_JSON *item = pc_JSON_GetObjectItem(routes, route);
+        assert_not_null(item);
+        assert_int(item->type, ==, pc_JSON_Number);
+        assert_int(item->valueint, ==, i);
+    }
+    assert_null(pc_JSON_GetObjectItem(routes, "connector.handler0.method"));
+    assert_null(pc_JSON_GetObjectItem(routes, ""));
+}
+
+static MunitResult
+test_arena(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    for (int formatted = 0; formatted < 2; ++formatted) {
+        char *text = make_routes_json(formatted);
+        const char *end = NULL;
+
+        pc_JSON *heap = pc_JSON_Parse(text);
+        pc_JSON *arena = pc_JSON_ParseArena(text, &end, 1);
+        assert_not_null(heap);
+        assert_not_null(arena);
+        assert_ptr_equal(end, text + strlen(text));
+
+        assert_routes(heap);
+        assert_routes(arena);
+
+        char *heap_text = pc_JSON_PrintUnformatted(heap);
+        char *arena_text = pc_JSON_PrintUnformatted(arena);
+        assert_string_equal(heap_text, arena_text);
+
+        free(heap_text);
+        free(arena_text);
+        pc_JSON_Delete(heap);
+        pc_JSON_DeleteArena(arena);
+        free(text);
+    }
+
+    assert_null(pc_JSON_ParseArena("{\"a\": [1, 2,", NULL, 0));
+    assert_null(pc_JSON_ParseArena("{} trailing", NULL, 1));
+    assert_null(pc_JSON_ParseArena(NULL, NULL, 0));
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_strings(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    // Escapes and quotes around the 16 byte boundaries the scanner works in.
+    static const char *text =
+        "{\"k\":\"0123456789abcd\\\"ef\\\\\", \"long\" : \"0123456789abcdef0123456789abcdef\\n\\u00e9\\ud83d\\ude00x\","
+        "\n\t\r \"empty\":\"\",   \"arr\":[ \"a\" ,\t\"b\\/c\" ]}";
+    pc_JSON *root = pc_JSON_ParseArena(text, NULL, 1);
+    assert_not_null(root);
+
+    assert_string_equal(pc_JSON_GetObjectItem(root, "k")->valuestring, "0123456789abcd\"ef\\");
+    assert_string_equal(pc_JSON_GetObjectItem(root, "long")->valuestring,
+                        "0123456789abcdef0123456789abcdef\n\xc3\xa9\xf0\x9f\x98\x80x");
+    assert_string_equal(pc_JSON_GetObjectItem(root, "empty")->valuestring, "");
+    pc_JSON *arr = pc_JSON_GetObjectItem(root, "arr");
+    assert_int(pc_JSON_GetArraySize(arr), ==, 2);
+    assert_string_equal(pc_JSON_GetArrayItem(arr, 1)->valuestring, "b/c");
+
+    pc_JSON_DeleteArena(root);
+
+    // Unterminated strings and escapes stop at the terminator.
+    static const char *unterminated[] = {"\"abc", "\"abc\\"};
+    for (size_t i = 0; i < ArrayCount(unterminated); ++i) {
+        char *copy = strdup(unterminated[i]);
+        pc_JSON *str = pc_JSON_Parse(copy);
+        assert_not_null(str);
+        assert_string_equal(str->valuestring, "abc");
+        pc_JSON_Delete(str);
+        free(copy);
+    }
+
+    return MUNIT_OK;
+}
+
+static MunitResult
+test_index(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    char *text = make_routes_json(0);
+    pc_JSON *routes = pc_JSON_Parse(text);
+    free(text);
+    assert_not_null(routes);
+
+    assert_routes(routes);
+    assert_not_null(routes->index);
+
+    // Changing the members drops the index, the next lookup sees the change.
+    pc_JSON *item = pc_JSON_DetachItemFromObject(routes, "connector.handler3.method30");
+    assert_not_null(item);
+    assert_null(routes->index);
+    assert_null(pc_JSON_GetObjectItem(routes, "connector.handler3.method30"));
+    pc_JSON_AddItemToObject(routes, "moved", item);
+    assert_int(pc_JSON_GetObjectItem(routes, "moved")->valueint, ==, 30);
+    pc_JSON_ReplaceItemInObject(routes, "moved", pc_JSON_CreateNumber(31));
+    assert_int(pc_JSON_GetObjectItem(routes, "moved")->valueint, ==, 31);
+
+    // References get an index of their own.
+    pc_JSON *holder = pc_JSON_CreateObject();
+    pc_JSON_AddItemReferenceToObject(holder, "routes", routes);
+    pc_JSON *ref = pc_JSON_GetObjectItem(holder, "routes");
+    assert_int(pc_JSON_GetObjectItem(ref, "connector.handler1.method12")->valueint, ==, 12);
+    assert_ptr_not_equal(ref->index, routes->index);
+    pc_JSON_Delete(holder);
+
+    pc_JSON_Delete(routes);
+
+    return MUNIT_OK;
+}
+
+static MunitTest tests[] = {
+    {"/arena", test_arena, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/strings", test_strings, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/index", test_index, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+};
+
+const MunitSuite json_suite = {
+    "/json", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE
+};
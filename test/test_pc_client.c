@@ -1,4 +1,7 @@
 #include <stdio.h>
+#ifdef __linux__
+#include <unistd.h>
+#endif
 #include <pitaya.h>
 #include "test_common.h"
 #include "flag.h"
@@ -191,6 +194,103 @@ test_creating_and_deleting(const MunitParameter params[], void *data)
     return MUNIT_OK;
 }
 
+#ifdef __linux__
+static size_t
+resident_bytes(void)
+{
+    long size = 0;
+    long pages = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    assert_not_null(f);
+    assert_int(fscanf(f, "%ld %ld", &size, &pages), ==, 2);
+    fclose(f);
+    return (size_t)pages * (size_t)sysconf(_SC_PAGESIZE);
+}
+#endif
+
+// Sanitizers add their own bookkeeping to every allocation.
+#if defined(__SANITIZE_ADDRESS__)
+#define IDLE_SANITIZED 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define IDLE_SANITIZED 1
+#endif
+#endif
+
+// Resident bytes an idle client may take, about twice what a tls one does.
+#define IDLE_CLIENT_MAX_BYTES (96 * 1024)
+
+// Reports and bounds the resident memory of clients that never connect,
+// their transports and network threads included.
+static MunitResult
+test_idle_footprint(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+#ifndef __linux__
+    return MUNIT_SKIP;
+#else
+    enum { NUM_CLIENTS = 100 };
+    const int transports[] = {PC_TR_NAME_UV_TCP, PC_TR_NAME_UV_TLS};
+    static pc_client_t *clients[ArrayCount(transports)][NUM_CLIENTS];
+
+    // Every client is kept until the end, so that none reuses the memory
+    // of another.
+    for (size_t t = 0; t < ArrayCount(transports); ++t) {
+        pc_client_config_t config = PC_CLIENT_CONFIG_TEST;
+        config.transport_name = transports[t];
+
+        size_t before = resident_bytes();
+        for (int i = 0; i < NUM_CLIENTS; ++i) {
+            pc_client_init_result_t res = pc_client_init(NULL, &config);
+            assert_int(res.rc, ==, PC_RC_OK);
+            clients[t][i] = res.client;
+        }
+        size_t per_client = (resident_bytes() - before) / NUM_CLIENTS;
+
+        munit_logf(MUNIT_LOG_WARNING, "%s: %zu bytes per idle client",
+                   transports[t] == PC_TR_NAME_UV_TLS ? "tls" : "tcp", per_client);
+#ifndef IDLE_SANITIZED
+        assert_size(per_client, <, IDLE_CLIENT_MAX_BYTES);
+#endif
+    }
+
+    for (size_t t = 0; t < ArrayCount(transports); ++t) {
+        for (int i = 0; i < NUM_CLIENTS; ++i) {
+            assert_int(pc_client_cleanup(clients[t][i]), ==, PC_RC_OK);
+        }
+    }
+    return MUNIT_OK;
+#endif
+}
+
+static MunitResult
+test_init_inplace(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    pc_client_config_t config = PC_CLIENT_CONFIG_TEST;
+    void *mem = malloc(pc_client_size());
+    assert_not_null(mem);
+
+    pc_client_init_result_t res = pc_client_init_inplace(NULL, pc_client_size(), NULL, &config);
+    assert_int(res.rc, ==, PC_RC_INVALID_ARG);
+    assert_null(res.client);
+    res = pc_client_init_inplace(mem, pc_client_size() - 1, NULL, &config);
+    assert_int(res.rc, ==, PC_RC_INVALID_ARG);
+    assert_null(res.client);
+
+    res = pc_client_init_inplace(mem, pc_client_size(), (void*)0xdeadbeef, &config);
+    assert_int(res.rc, ==, PC_RC_OK);
+    assert_ptr_equal(res.client, mem);
+    assert_ptr_equal(pc_client_ex_data(res.client), (void*)0xdeadbeef);
+    assert_int(pc_client_state(res.client), ==, PC_ST_INITED);
+
+    // The memory belongs to the caller, cleanup leaves it alone.
+    assert_int(pc_client_cleanup(res.client), ==, PC_RC_OK);
+    free(mem);
+    return MUNIT_OK;
+}
+
 //static MunitResult
 //test_disconnect_right_after_connect(const MunitParameter params[], void *data)
 //{
@@ -217,6 +317,8 @@ static MunitTest tests[] = {
     {"/polling", test_polling, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
     {"/serializer", test_serializer, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
     {"/creating_and_deleting", test_creating_and_deleting, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/idle_footprint", test_idle_footprint, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/init_inplace", test_init_inplace, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
 //    {"/disconnect_right_after_connect", test_disconnect_right_after_connect, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
     {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
 };
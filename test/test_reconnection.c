@@ -68,6 +68,47 @@ test_success(const MunitParameter params[], void *data)
     return MUNIT_OK;
 }
 
+// Reconnects reuse the resolution of the first connect, only one lookup
+// reaches the resolver, which answers "localhost" from the hosts file.
+MunitResult
+test_dns_cache(const MunitParameter params[], void *data)
+{
+    Unused(params); Unused(data);
+
+    flag_t flag_evs = flag_make();
+    pc_client_config_t config = PC_CLIENT_CONFIG_DEFAULT;
+
+    tr_uv_tcp_clear_dns_cache();
+
+    pc_client_init_result_t res = pc_client_init(NULL, &config);
+    g_client = res.client;
+    assert_int(res.rc, ==, PC_RC_OK);
+
+    int handler_id = pc_client_add_ev_handler(g_client, reconnect_success_event_cb, &flag_evs, NULL);
+    assert_int(handler_id, !=, PC_EV_INVALID_HANDLER_ID);
+
+    assert_int(pc_client_connect(g_client, "localhost", g_disconnect_mock_server.tcp_port, NULL), ==, PC_RC_OK);
+
+    while (flag_get_num_called(&flag_evs) < ArrayCount(SUCCESS_RECONNECT_EV_ORDER)-1) {
+        assert_int(flag_wait(&flag_evs, 60), ==, FLAG_SET);
+    }
+
+    pc_client_stats_t stats;
+    assert_int(pc_client_stats(g_client, &stats), ==, PC_RC_OK);
+    assert_uint64(stats.dns_lookups, ==, 1);
+    assert_uint64(stats.dns_cache_hits, >=, 1);
+
+    assert_int(pc_client_disconnect(g_client), ==, PC_RC_OK);
+    assert_int(flag_wait(&flag_evs, 60), ==, FLAG_SET);
+
+    assert_int(pc_client_rm_ev_handler(g_client, handler_id), ==, PC_RC_OK);
+    assert_int(pc_client_cleanup(g_client), ==, PC_RC_OK);
+
+    flag_cleanup(&flag_evs);
+    tr_uv_tcp_clear_dns_cache();
+    return MUNIT_OK;
+}
+
 static int RECONNECT_MAX_RETRY_EV_ORDER[] = {
     PC_EV_CONNECT_ERROR,
     PC_EV_RECONNECT_STARTED,
@@ -123,6 +164,7 @@ test_max_retry(const MunitParameter params[], void *data)
 static MunitTest tests[] = {
     {"/max_retry", test_max_retry, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
     {"/success", test_success, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+    {"/dns_cache", test_dns_cache, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
     {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
 };
 
@@ -0,0 +1,160 @@
+/*
+ * Offline tool that trains a zlib preset dictionary from a capture of
+ * message bodies, one body per line.
+ *
+ * Usage: dict-trainer [-s size] [-r route] [-o dict.bin] capture.txt
+ *
+ * The dictionary is written raw to the -o file, and the entry to add to the
+ * client local storage (see PR_DICT_LCK in src/tr/uv/pr_dict.h) is printed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "trainer.h"
+
+#define DEFAULT_DICT_SIZE (8 * 1024)
+#define MAX_DICT_SIZE (32 * 1024)
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-s size] [-r route] [-o dict.bin] capture.txt\n", prog);
+    fprintf(stderr, "  -s size   dictionary size in bytes (default %d, max %d)\n", DEFAULT_DICT_SIZE, MAX_DICT_SIZE);
+    fprintf(stderr, "  -r route  print the dictionary as a dictionary for this route instead of the global one\n");
+    fprintf(stderr, "  -o file   write the raw dictionary to file\n");
+}
+
+static char *
+read_file(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+
+    size_t cap = 1 << 16, len = 0, n;
+    char *buf = (char*)malloc(cap);
+    while ((n = fread(buf + len, 1, cap - len, f)) > 0) {
+        len += n;
+        if (len == cap) {
+            cap *= 2;
+            buf = (char*)realloc(buf, cap);
+        }
+    }
+    fclose(f);
+
+    *size = len;
+    return buf;
+}
+
+static void
+print_base64(const unsigned char *data, size_t len)
+{
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t i;
+    for (i = 0; i + 2 < len; i += 3) {
+        unsigned v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+        printf("%c%c%c%c", table[v >> 18], table[(v >> 12) & 63], table[(v >> 6) & 63], table[v & 63]);
+    }
+    if (len - i == 1) {
+        unsigned v = data[i] << 16;
+        printf("%c%c==", table[v >> 18], table[(v >> 12) & 63]);
+    } else if (len - i == 2) {
+        unsigned v = (data[i] << 16) | (data[i + 1] << 8);
+        printf("%c%c%c=", table[v >> 18], table[(v >> 12) & 63], table[(v >> 6) & 63]);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    size_t dict_size = DEFAULT_DICT_SIZE;
+    const char *route = NULL;
+    const char *out_path = NULL;
+    const char *capture_path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            dict_size = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            route = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (argv[i][0] != '-' && !capture_path) {
+            capture_path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!capture_path || dict_size == 0 || dict_size > MAX_DICT_SIZE) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    size_t size;
+    char *capture = read_file(capture_path, &size);
+    if (!capture) {
+        fprintf(stderr, "failed to read %s\n", capture_path);
+        return 1;
+    }
+
+    // Split the capture in samples, dropping the line breaks.
+    size_t cap = 1024, count = 0, len = 0, start = 0;
+    size_t *sizes = (size_t*)malloc(cap * sizeof(size_t));
+    unsigned char *data = (unsigned char*)malloc(size ? size : 1);
+    for (size_t i = 0; i <= size; ++i) {
+        if (i == size || capture[i] == '\n') {
+            size_t n = i - start;
+            if (n > 0 && capture[start + n - 1] == '\r') {
+                n--;
+            }
+            if (n > 0) {
+                if (count == cap) {
+                    cap *= 2;
+                    sizes = (size_t*)realloc(sizes, cap * sizeof(size_t));
+                }
+                memcpy(data + len, capture + start, n);
+                len += n;
+                sizes[count++] = n;
+            }
+            start = i + 1;
+        }
+    }
+    free(capture);
+
+    trainer_samples_t samples = {data, sizes, count};
+    unsigned char *dict = (unsigned char*)malloc(dict_size);
+    size_t n = trainer_build(&samples, dict, dict_size);
+
+    uLong id = adler32(adler32(0L, Z_NULL, 0), dict, (uInt)n);
+    fprintf(stderr, "trained dictionary %lu: %zu bytes from %zu samples (%zu bytes)\n", id, n, count, len);
+
+    if (out_path) {
+        FILE *f = fopen(out_path, "wb");
+        if (!f || fwrite(dict, 1, n, f) != n) {
+            fprintf(stderr, "failed to write %s\n", out_path);
+            return 1;
+        }
+        fclose(f);
+    }
+
+    if (route) {
+        printf("\"compressionDicts\":{\"routes\":{\"%s\":\"", route);
+        print_base64(dict, n);
+        printf("\"}}\n");
+    } else {
+        printf("\"compressionDicts\":{\"global\":\"");
+        print_base64(dict, n);
+        printf("\"}\n");
+    }
+
+    free(dict);
+    free(sizes);
+    free(data);
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include "trainer.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Substrings of this size are counted across samples.
+#define DMER_SIZE 8
+// Size of the segments copied to the dictionary.
+#define SEGMENT_SIZE 64
+#define HASH_LOG 20
+#define HASH_SIZE (1u << HASH_LOG)
+
+static uint32_t
+dmer_hash(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return (uint32_t)((v * 0x9E3779B185EBCA87ULL) >> (64 - HASH_LOG));
+}
+
+/*
+ * Marks with 1 the positions where a dmer fits inside its sample.
+ */
+static unsigned char *
+valid_positions(const trainer_samples_t *samples, size_t total)
+{
+    unsigned char *valid = (unsigned char*)calloc(total ? total : 1, 1);
+    size_t off = 0;
+    for (size_t s = 0; s < samples->count; ++s) {
+        size_t size = samples->sizes[s];
+        for (size_t i = 0; i + DMER_SIZE <= size; ++i) {
+            valid[off + i] = 1;
+        }
+        off += size;
+    }
+    return valid;
+}
+
+size_t
+trainer_build(const trainer_samples_t *samples, unsigned char *dict, size_t dict_cap)
+{
+    size_t total = 0;
+    for (size_t s = 0; s < samples->count; ++s) {
+        total += samples->sizes[s];
+    }
+
+    // Everything fits, nothing to choose.
+    if (total <= dict_cap) {
+        memcpy(dict, samples->data, total);
+        return total;
+    }
+
+    if (dict_cap < SEGMENT_SIZE) {
+        memcpy(dict, samples->data + total - dict_cap, dict_cap);
+        return dict_cap;
+    }
+
+    // Number of samples containing each dmer, so big samples do not dominate.
+    uint32_t *freq = (uint32_t*)calloc(HASH_SIZE, sizeof(uint32_t));
+    uint32_t *last_sample = (uint32_t*)calloc(HASH_SIZE, sizeof(uint32_t));
+    unsigned char *valid = valid_positions(samples, total);
+
+    size_t off = 0;
+    for (size_t s = 0; s < samples->count; ++s) {
+        for (size_t i = 0; i + DMER_SIZE <= samples->sizes[s]; ++i) {
+            uint32_t h = dmer_hash(samples->data + off + i);
+            if (last_sample[h] != s + 1) {
+                last_sample[h] = (uint32_t)(s + 1);
+                freq[h]++;
+            }
+        }
+        off += samples->sizes[s];
+    }
+
+    // total > dict_cap, so every epoch holds at least one segment.
+    size_t epochs = dict_cap / SEGMENT_SIZE;
+    size_t epoch_size = total / epochs;
+
+    size_t tail = dict_cap;
+    int picked = 1;
+
+    while (tail >= SEGMENT_SIZE && picked) {
+        picked = 0;
+        for (size_t e = 0; e < epochs && tail >= SEGMENT_SIZE; ++e) {
+            size_t begin = e * epoch_size;
+            size_t end = e == epochs - 1 ? total : begin + epoch_size;
+
+            uint64_t best_score = 0;
+            size_t best = 0;
+
+            // Sliding window with the score of the segment starting at i.
+            uint64_t score = 0;
+            for (size_t i = begin; i < end; ++i) {
+                if (valid[i]) {
+                    score += freq[dmer_hash(samples->data + i)];
+                }
+                if (i >= begin + SEGMENT_SIZE - DMER_SIZE + 1) {
+                    size_t out = i - (SEGMENT_SIZE - DMER_SIZE + 1);
+                    if (valid[out]) {
+                        score -= freq[dmer_hash(samples->data + out)];
+                    }
+                }
+                size_t start = i + DMER_SIZE > SEGMENT_SIZE ? i + DMER_SIZE - SEGMENT_SIZE : 0;
+                if (start >= begin && start + SEGMENT_SIZE <= total && score > best_score) {
+                    best_score = score;
+                    best = start;
+                }
+            }
+
+            // Only substrings seen in more than one sample are worth it.
+            if (best_score <= (SEGMENT_SIZE - DMER_SIZE + 1)) {
+                continue;
+            }
+
+            tail -= SEGMENT_SIZE;
+            memcpy(dict + tail, samples->data + best, SEGMENT_SIZE);
+            picked = 1;
+
+            // Forget the dmers of the segment, so the same content is not picked twice.
+            for (size_t i = best; i + DMER_SIZE <= best + SEGMENT_SIZE; ++i) {
+                if (valid[i]) {
+                    freq[dmer_hash(samples->data + i)] = 0;
+                }
+            }
+        }
+    }
+
+    free(freq);
+    free(last_sample);
+    free(valid);
+
+    size_t size = dict_cap - tail;
+    memmove(dict, dict + tail, size);
+    return size;
+}
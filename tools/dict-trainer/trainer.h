@@ -0,0 +1,29 @@
+/*
+ * Builds zlib preset dictionaries from samples of message bodies.
+ */
+
+#ifndef PITAYA_DICT_TRAINER_H
+#define PITAYA_DICT_TRAINER_H
+
+#include <stddef.h>
+
+typedef struct {
+    /* concatenation of all samples */
+    const unsigned char *data;
+    /* size of each sample */
+    const size_t *sizes;
+    size_t count;
+} trainer_samples_t;
+
+/*
+ * Fills `dict` with at most `dict_cap` bytes picked from the samples and
+ * returns the size of the dictionary.
+ *
+ * The samples are split in epochs and the segment of each epoch whose
+ * substrings appear in the most samples is copied to the dictionary, until
+ * it is full. Segments picked first are the most valuable ones and are
+ * placed at the end of the dictionary, where zlib references are cheaper.
+ */
+size_t trainer_build(const trainer_samples_t *samples, unsigned char *dict, size_t dict_cap);
+
+#endif // PITAYA_DICT_TRAINER_H